@@ -58,6 +58,10 @@ int32_t eventRecords_init( fifo_handle_t fifo, NVS_Items_t eventRecordKey );
 
 void eventRecords_onChangedTopic( int32_t lastRecordedEvent );
 
+void eventRecords_republish( int32_t first, int32_t last );
+
+void eventRecords_onRepublishFeedback( const char * pData, const int len );
+
 const char * eventRecords_statusText( uint8_t status);
 
 void eventRecords_saveRecord( char * pInput );
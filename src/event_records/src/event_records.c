@@ -12,14 +12,17 @@
  * Author: Ian Whitehead
  */
 #include	<stdlib.h>
+#include	<stddef.h>
 #include	<stdio.h>
 #include	<stdint.h>
 #include	<stdbool.h>
 #include	<string.h>
+#include	<time.h>
 #include	"shci.h"
 #include	"mjson.h"
 #include	"bleInterface.h"
 #include	"freertos/task.h"
+#include	"freertos/queue.h"
 #include	"event_records.h"
 #include	"bleGap.h"
 #include	"mqtt.h"
@@ -138,6 +141,31 @@ typedef struct
 #define	FREEZE_ENTRY_MIN_SIZE		( DISPENSE_RECORD_MAX_SIZE - 2 )			// Minimum size for a FreezeEvents entry
 #define	FIRMWARE_ENTRY_MIN_SIZE		( DISPENSE_RECORD_MAX_SIZE - 6 )			// Minimum size for a Firmware entry
 
+/**
+ * @brief	Event Record storage type tag
+ *
+ * Event Records are stored in the FIFO in a compact binary form, the first byte
+ * of each record identifying its type.  Records are rendered as JSON only when
+ * they are published.  Records written by earlier firmware are stored as JSON
+ * text, and are recognized by their leading '{'.
+ */
+typedef enum
+{
+	eRecordTypeDispense =	0x01,													/**< Tag followed by the raw Dispense Record, as received from Host */
+	eRecordTypeSaved =		0x02,													/**< _savedRecordHeader_t followed by JSON body, from eventRecords_saveRecord() */
+	eRecordTypeJSON =		'{'														/**< Legacy, pre-formatted JSON record */
+} _recordType_t;
+
+/**
+ * @brief	Stored header for records created by eventRecords_saveRecord()
+ */
+typedef struct
+{
+	uint8_t		type;																/**< eRecordTypeSaved */
+	int32_t		index;																/**< Event Record Index */
+	uint32_t	timeValue;															/**< Record time, seconds since Epoch */
+} __attribute__ ((packed)) _savedRecordHeader_t;
+
 #define	EVENT_RECORD_STACK_SIZE    ( 3072 )
 
 #define	EVENT_RECORD_TASK_PRIORITY	( 5 )
@@ -147,6 +175,17 @@ static const char recordFooter[] = "]}}";
 #define	footerSize	( sizeof( recordFooter ) )
 #define	MAX_EVENT_RECORD_SIZE	512			//256
 #define	MAX_RECORDS_PER_MESSAGE	10
+#define	FIFO_MIGRATE_RECORDS	8			/**< Records moved per task pass while the FIFO is resized */
+#define	REPUBLISH_QUEUE_SIZE	4			/**< Republish requests waiting for the Event Record Task */
+
+/**
+ * @brief	Republish request, queued by eventRecords_republish()
+ */
+typedef struct
+{
+	int32_t		first;																/**< First Record Index to republish */
+	int32_t		last;																/**< Last Record Index to republish */
+} _republishRequest_t;
 
 /**
  * @brief	Event Record control structure
@@ -175,6 +214,12 @@ typedef struct
 	bool				shadowUpdateSuccess;									/**< Flag set to true when Shadow Update is successful */
 	int32_t				highestReadIndex;										/**< Highest Record Index value read from FIFO */
 	int32_t				lastPublishedIndex;										/**< Last/Highest Record Index successfully published to AWS, stored in NVS */
+	QueueHandle_t		republishQueue;											/**< Republish requests, from any task, served by Event Record Task */
+	bool				republishPending;										/**< true: a range of records has been requested for republishing */
+	bool				republishing;											/**< true: message being published is a republished range */
+	int32_t				republishFirst;											/**< First Record Index still to be republished */
+	int32_t				republishLast;											/**< Last Record Index to be republished */
+	int32_t				republishNext;											/**< Record Index following the records being republished */
 } event_records_t;
 
 
@@ -408,7 +453,7 @@ static char *formatEventRecord( _dispenseRecord_t	*pDispenseRecord, uint16_t siz
 static void vUpdateEventRecordData( const uint8_t *pData, const uint16_t size )
 {
 	_dispenseRecord_t	*pDispenseRecord;
-	char * jsonBuffer = NULL;
+	uint8_t	record[ 1 + DISPENSE_RECORD_MAX_SIZE ];
 
 	shci_postCommandComplete( eEventRecordData, eCommandSucceeded );
 
@@ -426,16 +471,10 @@ static void vUpdateEventRecordData( const uint8_t *pData, const uint16_t size )
 
 			IotLogDebug( "Received index = %d", pDispenseRecord->index );
 
-			/* format record as JSON */
-			jsonBuffer = formatEventRecord( pDispenseRecord, size );
-
-			/* Save record in FIFO */
-			fifo_put( _evtrec.fifoHandle, jsonBuffer, strlen( jsonBuffer ) );
-
-//			IotLogInfo( jsonBuffer );
-			printf( jsonBuffer );
-
-			free( jsonBuffer );						/* free mjson format buffer */
+			/* Save tagged binary record in FIFO, it is formatted as JSON when published */
+			record[ 0 ] = eRecordTypeDispense;
+			memcpy( &record[ 1 ], pData, size );
+			fifo_put( _evtrec.fifoHandle, record, ( 1 + size ) );
 		}
 		else
 		{
@@ -528,6 +567,188 @@ static void fetchRecords( void )
 }
 #endif
 
+/**
+ * @brief	Format a Saved Event Record as JSON
+ *
+ * Index and DateStamp are pre-pended to the stored JSON body.
+ * Caller must free allocated buffer after use.
+ *
+ * @param[in]	pHeader		Pointer to stored record header
+ * @param[in]	pBody		Pointer to stored JSON body
+ * @param[in]	bodySize	Size of JSON body, in bytes
+ * @return		Pointer to formatted JSON record, NULL on error
+ */
+static char *formatSavedRecord( const _savedRecordHeader_t *pHeader, const char *pBody, size_t bodySize )
+{
+	char * pCommon = NULL;
+	char * pJSON = NULL;
+	char utc[ 28 ] = { 0 };
+	int32_t	lenCommon = 0;
+	time_t timeValue = pHeader->timeValue;
+
+	/* Format record time per ISO 8601 */
+	strftime( utc, sizeof( utc ), "%Y-%m-%dT%H:%M:%SZ", gmtime( &timeValue ) );
+
+	/* format the common elements */
+	lenCommon = mjson_printf( &mjson_print_dynamic_buf, &pCommon,
+			"{%Q:%d, %Q:%Q}",
+			"Index",           pHeader->index,
+			"DateTime",        utc
+			);
+
+	/* Merge the common and stored body */
+	mjson_merge( pCommon, lenCommon, pBody, bodySize, mjson_print_dynamic_buf, &pJSON );
+
+	free( pCommon );
+
+	return( pJSON );
+}
+
+/**
+ * @brief	Get the Record Index of a stored Event Record
+ *
+ * Registered with the Event FIFO as its index extractor, see fifo_setIndex().
+ * Binary records carry the Index at a fixed offset; only legacy JSON records
+ * are parsed.
+ *
+ * @param[in]	pRecord		Pointer to record, as stored in FIFO
+ * @param[in]	length		Record length, in bytes
+ * @param[out]	pIndex		Record Index
+ * @return		true if record Index found
+ */
+static bool recordIndex( const void *pRecord, size_t length, uint32_t *pIndex )
+{
+	const uint8_t *p = pRecord;
+	int32_t index;
+	double value;
+
+	if( 0 == length )
+	{
+		return false;
+	}
+
+	switch( p[ 0 ] )
+	{
+#ifdef	MODEL_A
+		case eRecordTypeDispense:
+			if( ( 1 + sizeof( index ) ) <= length )
+			{
+				memcpy( &index, &p[ 1 + offsetof( _dispenseRecord_t, index ) ], sizeof( index ) );
+				*pIndex = index;
+				return true;
+			}
+			break;
+#endif
+
+		case eRecordTypeSaved:
+			if( sizeof( _savedRecordHeader_t ) <= length )
+			{
+				memcpy( &index, &p[ offsetof( _savedRecordHeader_t, index ) ], sizeof( index ) );
+				*pIndex = index;
+				return true;
+			}
+			break;
+
+		case eRecordTypeJSON:
+			if( mjson_get_number( ( const char * ) p, length, "$.Index", &value ) )
+			{
+				*pIndex = ( uint32_t ) value;
+				return true;
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	return false;
+}
+
+/**
+ * @brief	Render a stored Event Record as JSON
+ *
+ * The stored record is decoded according to its type tag and formatted into
+ * the output buffer, without a null-terminator.
+ *
+ * @param[in]	pRecord		Pointer to record, as read from FIFO
+ * @param[in]	length		Record length, in bytes
+ * @param[out]	pOut		Pointer to output buffer
+ * @param[in]	outSize		Size of output buffer
+ * @param[out]	pIndex		Record Index, -1 if unknown
+ * @return		Number of bytes written to output buffer, 0 if record could not be rendered
+ */
+static size_t renderRecord( uint8_t *pRecord, size_t length, char *pOut, size_t outSize, int32_t *pIndex )
+{
+	char *pJSON = NULL;
+	size_t	jsonLength = 0;
+	uint32_t index;
+
+	*pIndex = recordIndex( pRecord, length, &index ) ? ( int32_t ) index : -1;
+
+	if( 0 == length )
+	{
+		return 0;
+	}
+
+	switch( pRecord[ 0 ] )
+	{
+#ifdef	MODEL_A
+		case eRecordTypeDispense:
+			if( ( ( 1 + DISPENSE_RECORD_MIN_SIZE ) <= length ) && ( length <= ( 1 + DISPENSE_RECORD_MAX_SIZE ) ) )
+			{
+				_dispenseRecord_t	dispenseRecord;
+
+				memcpy( &dispenseRecord, &pRecord[ 1 ], ( length - 1 ) );
+				pJSON = formatEventRecord( &dispenseRecord, ( length - 1 ) );
+			}
+			break;
+#endif
+
+		case eRecordTypeSaved:
+			if( sizeof( _savedRecordHeader_t ) < length )
+			{
+				_savedRecordHeader_t	header;
+
+				memcpy( &header, pRecord, sizeof( header ) );
+				pJSON = formatSavedRecord( &header, ( char * ) &pRecord[ sizeof( header ) ], ( length - sizeof( header ) ) );
+			}
+			break;
+
+		case eRecordTypeJSON:
+			/* Legacy record, already formatted */
+			if( length <= outSize )
+			{
+				memcpy( pOut, pRecord, length );
+				return length;
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	if( NULL != pJSON )
+	{
+		jsonLength = strlen( pJSON );
+		if( jsonLength <= outSize )
+		{
+			memcpy( pOut, pJSON, jsonLength );
+		}
+		else
+		{
+			jsonLength = 0;
+		}
+		free( pJSON );						/* free mjson format buffer */
+	}
+
+	if( 0 == jsonLength )
+	{
+		IotLogError( "renderRecord: unable to render record, type = 0x%02X, length = %d", pRecord[ 0 ], length );
+	}
+
+	return jsonLength;
+}
+
 /**
  * @brief	Read one or more FIFO records, format as a single JSON Object.
  *
@@ -568,13 +789,32 @@ static void fetchRecords( void )
  *		]}
  *	}
  *
- *	@param[in]	n	Number of records to read from FIFO
+ *	Records are stored in the FIFO in binary form.  Records for the message are read
+ *	in batches, as many as fit a scratch buffer of one maximum size record, and each
+ *	is rendered as JSON directly into the message buffer before the next batch is read.
+ *
+ *	Records are normally read from the FIFO read position, with fifo_getBatch(), and
+ *	the read must be committed.  If a range is given, records are instead looked up
+ *	by Record Index, with fifo_readRange(), and no commit is needed.
+ *
+ *	@param[in]		n		Number of records to read from FIFO
+ *	@param[in|out]	pFirst	NULL to read from the FIFO read position, otherwise first Record Index of range as input,
+ *							Record Index following the last record read as output
+ *	@param[in]		last	Last Record Index of range, ignored if pFirst is NULL
  *	@return		Pointer to allocated buffer, null-terminated
  */
-static char * readRecords( int n )
+static char * readRecords( int n, int32_t *pFirst, int32_t last )
 {
 	size_t	bufferSize;
-	size_t	recordSize;
+	size_t	recordLengths[ MAX_RECORDS_PER_MESSAGE ];
+	size_t	renderLength;
+	int32_t	index;
+	uint32_t rangeIndex;
+	uint16_t count;
+	int		nRead = 0;
+	int		nWritten = 0;
+	bool	bRangeEnd = false;
+	esp_err_t	err;
 
 	char utc[ 28 ] = { 0 };
 	char sernum[13] = { 0 };
@@ -583,11 +823,18 @@ static char * readRecords( int n )
 	bleGap_fetchSerialNumber(sernum, &length);
 
 	char *buffer;
-	char *record;
+	uint8_t *records;
+	uint8_t *record;
+	char *pOut;
+	char *pRecordOut;
+	char *pEnd;
 
 	char *header = NULL;
 	size_t	headerSize;
-	double value;
+	size_t	separatorSize = strlen( recordSeparator );
+
+	/* Limit number of records per message */
+	n = ( MAX_RECORDS_PER_MESSAGE < n ) ? MAX_RECORDS_PER_MESSAGE : n;
 
 	/* Get Current Time, UTC */
 	getUTC( utc, sizeof( utc ) );
@@ -602,50 +849,92 @@ static char * readRecords( int n )
 			"logs"
 			);
 
-	/* Allocate a buffer sufficient to hold n records */
-	bufferSize = ( n * MAX_EVENT_RECORD_SIZE ) + headerSize + footerSize;
+	/* Allocate a buffer sufficient to hold n records, and separators, and a scratch buffer for stored records */
+	bufferSize = ( n * ( MAX_EVENT_RECORD_SIZE + separatorSize ) ) + headerSize + footerSize;
 	buffer = pvPortMalloc( bufferSize );
+	records = pvPortMalloc( MAX_EVENT_RECORD_SIZE );
+
+	if( ( NULL == buffer ) || ( NULL == records ) )
+	{
+		vPortFree( buffer );
+		vPortFree( records );
+		free( header );
+		return NULL;
+	}
 
 	/* Copy header into buffer, then free header */
-	strcpy( buffer, header );
+	memcpy( buffer, header, headerSize );
 	free( header );
 
-	// Allocate a buffer for a single record */
-	record = pvPortMalloc( MAX_EVENT_RECORD_SIZE );
-
 	IotLogInfo( "readRecords: %d, bufferSize = %d", n, bufferSize );
 
-	/* Read n records into buffer, separate records with ", " */
-	while( n-- )
+	pOut = buffer + headerSize;
+	pEnd = buffer + bufferSize - footerSize;
+
+	/* Read records, packed back-to-back, until n are read, or no more are available */
+	while( ( nRead < n ) && !bRangeEnd )
 	{
-		recordSize = MAX_EVENT_RECORD_SIZE;
-		fifo_get( _evtrec.fifoHandle, record, &recordSize );
-		IotLogInfo( "get record: %d bytes", recordSize );
+		count = n - nRead;
+		err = ESP_FAIL;
+		if( NULL == pFirst )
+		{
+			err = fifo_getBatch( _evtrec.fifoHandle, records, MAX_EVENT_RECORD_SIZE, recordLengths, &count );
+		}
+		else if( *pFirst <= last )
+		{
+			err = fifo_readRange( _evtrec.fifoHandle, *pFirst, last, records, MAX_EVENT_RECORD_SIZE, recordLengths, &count );
+		}
 
-		/* parse json record for index value */
-		value = 0;
-		if( mjson_get_number( record, recordSize, "$.Index", &value ) )
+		if( ESP_OK != err )
 		{
-			int32_t index = ( int32_t ) value;
-			if( index > _evtrec.highestReadIndex )
-			{
-				_evtrec.highestReadIndex = index;
-				IotLogInfo( "Highest FIFO Read Index = %d", _evtrec.highestReadIndex );
-			}
+			break;
 		}
-		record[ recordSize ] = '\0';							/* terminated record */
-		strcat( buffer, record );								/* Append record */
+		nRead += count;
 
-		if( n )													/* for all but last record */
+		/* Render each record, separate records with ", " */
+		record = records;
+		for( int i = 0; i < count; ++i )
 		{
-			strcat( buffer, recordSeparator );					/* Append separator */
+			if( NULL != pFirst )
+			{
+				if( !recordIndex( record, recordLengths[ i ], &rangeIndex ) )
+				{
+					bRangeEnd = true;
+					break;
+				}
+				*pFirst = rangeIndex + 1;
+			}
+
+			/* Leave room for a separator, ahead of all but the first record */
+			pRecordOut = pOut + ( ( 0 < nWritten ) ? separatorSize : 0 );
+
+			renderLength = renderRecord( record, recordLengths[ i ], pRecordOut, ( pEnd - pRecordOut ), &index );
+			if( 0 < renderLength )
+			{
+				if( 0 < nWritten )
+				{
+					memcpy( pOut, recordSeparator, separatorSize );		/* Insert separator */
+				}
+				pOut = pRecordOut + renderLength;
+				++nWritten;
+
+				if( ( NULL == pFirst ) && ( index > _evtrec.highestReadIndex ) )
+				{
+					_evtrec.highestReadIndex = index;
+					IotLogInfo( "Highest FIFO Read Index = %d", _evtrec.highestReadIndex );
+				}
+			}
+
+			record += recordLengths[ i ];
 		}
 	}
 
-	vPortFree( record );
+	IotLogInfo( "readRecords: %d records read", nRead );
 
-	/* Add footer */
-	strcat( buffer, recordFooter );							/* Append Footer */
+	vPortFree( records );
+
+	/* Add footer, including null-terminator */
+	memcpy( pOut, recordFooter, footerSize );
 
 	return( buffer );
 }
@@ -717,42 +1006,74 @@ static void publishRecords( const char *topic )
 
 	char * jsonBuffer = NULL;
 	uint16_t	nRecords;
+	_republishRequest_t request;
 
 	switch( _evtrec.publishState )
 	{
 		case ePublishRead:
 			if( mqtt_IsConnected() )
 			{
-				nRecords = fifo_size( _evtrec.fifoHandle );
-				if( 0 < nRecords )
+				_evtrec.republishing = false;
+
+				/* Take the next requested range once the current range is complete */
+				if( !_evtrec.republishPending && ( pdTRUE == xQueueReceive( _evtrec.republishQueue, &request, 0 ) ) )
 				{
-					IotLogInfo( "Event Record FIFO has %d records", nRecords );
-					/* Limit number of records per message */
-					nRecords = ( MAX_RECORDS_PER_MESSAGE < nRecords ) ? MAX_RECORDS_PER_MESSAGE : nRecords;
+					_evtrec.republishFirst = request.first;
+					_evtrec.republishLast = request.last;
+					_evtrec.republishPending = true;
+				}
 
-					jsonBuffer = readRecords( nRecords );
-					if( NULL != jsonBuffer )
+				if( _evtrec.republishPending )
+				{
+					/* Re-serve requested range, looked up by Record Index, FIFO read position is not affected */
+					_evtrec.republishNext = _evtrec.republishFirst;
+					jsonBuffer = readRecords( MAX_RECORDS_PER_MESSAGE, &_evtrec.republishNext, _evtrec.republishLast );
+					if( _evtrec.republishNext == _evtrec.republishFirst )
+					{
+						IotLogInfo( "Republish %d - %d: no records in FIFO", _evtrec.republishFirst, _evtrec.republishLast );
+						_evtrec.republishPending = false;
+						vPortFree( jsonBuffer );
+						jsonBuffer = NULL;
+					}
+					else
+					{
+						_evtrec.republishing = true;
+					}
+				}
+				else
+				{
+					nRecords = fifo_size( _evtrec.fifoHandle );
+					if( 0 < nRecords )
 					{
-//						IotLogDebug( jsonBuffer );				/* Log message will likely be truncated */
+						IotLogInfo( "Event Record FIFO has %d records", nRecords );
+						/* Limit number of records per message */
+						nRecords = ( MAX_RECORDS_PER_MESSAGE < nRecords ) ? MAX_RECORDS_PER_MESSAGE : nRecords;
+
+						jsonBuffer = readRecords( nRecords, NULL, 0 );
+					}
+				}
+
+				if( NULL != jsonBuffer )
+				{
+//					IotLogDebug( jsonBuffer );				/* Log message will likely be truncated */
 //printf( "publishRecords: %s -> %s\n", jsonBuffer, topic);
-						/* Set callback function */
-						publishCallback.function = vEventRecordPublishComplete;
+					/* Set callback function */
+					publishCallback.function = vEventRecordPublishComplete;
 
-						/* Clear flags */
-						_evtrec.publishComplete = false;
-						_evtrec.publishSuccess = false;
+					/* Clear flags */
+					_evtrec.publishComplete = false;
+					_evtrec.publishSuccess = false;
 
-						/* Use Time Value as context */
-						_evtrec.contextTime =  getTimeValue();
-						publishCallback.pCallbackContext = &_evtrec.contextTime;
+					/* Use Time Value as context */
+					_evtrec.contextTime =  getTimeValue();
+					publishCallback.pCallbackContext = &_evtrec.contextTime;
 
-						mqtt_SendMsgToTopic( topic, strlen( topic ), jsonBuffer, strlen( jsonBuffer ), &publishCallback );
+					mqtt_SendMsgToTopic( topic, strlen( topic ), jsonBuffer, strlen( jsonBuffer ), &publishCallback );
 
-						vPortFree( jsonBuffer );					/* free buffer after if is processed */
+					vPortFree( jsonBuffer );					/* free buffer after if is processed */
 
-						IotLogInfo( "publishState -> WaitComplete" );
-						_evtrec.publishState = ePublishWaitComplete;
-					}
+					IotLogInfo( "publishState -> WaitComplete" );
+					_evtrec.publishState = ePublishWaitComplete;
 				}
 			}
 			break;
@@ -761,8 +1082,19 @@ static void publishRecords( const char *topic )
 			/* Wait for MQTT publish to complete */
 			if( _evtrec.publishComplete )
 			{
+				/* Republished records are not committed; if successful, continue with rest of range */
+				if( _evtrec.republishing )
+				{
+					if( _evtrec.publishSuccess )
+					{
+						_evtrec.republishFirst = _evtrec.republishNext;
+						_evtrec.republishPending = ( _evtrec.republishFirst <= _evtrec.republishLast );
+					}
+					IotLogInfo( "publishState -> Read" );
+					_evtrec.publishState = ePublishRead;
+				}
 				/* If successful, commit FIFO Read(s), and record Last Published Index */
-				if( _evtrec.publishSuccess )
+				else if( _evtrec.publishSuccess )
 				{
 					IotLogInfo( "publishRecords success - commit FIFO Read(s)" );
 					fifo_commitRead( _evtrec.fifoHandle, true );
@@ -849,6 +1181,12 @@ static void _eventRecordsTask(void *arg)
 			/* fetch Dispense Records from Host, put to FIFO*/
 			fetchRecords();
 #endif
+			/* write any aged, cached, Event Records to NVS */
+			fifo_flushIfDue( _evtrec.fifoHandle );
+
+			/* move Event Records for a FIFO resize, a few per pass */
+			fifo_migrate( _evtrec.fifoHandle, FIFO_MIGRATE_RECORDS );
+
 			/* get Event Records from FIFO, push to AWS */
 			if( shadowUpdates_getProductionRecordTopic() )
 			{
@@ -937,6 +1275,19 @@ int32_t eventRecords_init( fifo_handle_t fifo, NVS_Items_t nvsKey )
 	}
 
 
+	/* Queue requests from other tasks, for eventRecords_republish() */
+	_evtrec.republishQueue = xQueueCreate( REPUBLISH_QUEUE_SIZE, sizeof( _republishRequest_t ) );
+	if( NULL == _evtrec.republishQueue )
+	{
+		return ESP_FAIL;
+	}
+
+	/* Index FIFO by Record Index, for eventRecords_republish() */
+	if( ESP_OK != fifo_setIndex( _evtrec.fifoHandle, &recordIndex, MAX_EVENT_RECORD_SIZE ) )
+	{
+		IotLogError( "Error indexing Event Record FIFO" );
+	}
+
 	IotLogInfo( "Initializing Event Records:" );
 	IotLogInfo( "  Handle = %p", ( (uint32_t *) _evtrec.fifoHandle ) );
 	IotLogInfo( "  lastReportedIndex = %d", _evtrec.lastReportedIndex );
@@ -946,7 +1297,7 @@ int32_t eventRecords_init( fifo_handle_t fifo, NVS_Items_t nvsKey )
 
 #ifdef	MODEL_A
 	/* Register commands */
-	shci_RegisterCommand( eEventRecordData, &vUpdateEventRecordData );
+	shci_Subscribe( eEventRecordData, &vUpdateEventRecordData, eShciDeferred );			// writes FIFO to NVS, keep off SHCI task
 
 	/* Register callback for Dispense Record Count update */
 	bleInterface_registerUpdateCB( eDispRecCountIndex, &vRecordCountUpdate );
@@ -992,6 +1343,59 @@ void eventRecords_onChangedTopic( int32_t lastRecordedEvent )
 
 }
 
+/**
+ * @brief	Republish a range of Event Records
+ *
+ * Records still held in the Event FIFO, with a Record Index from first to last,
+ * are published again, ahead of any new records.  Intended to re-serve records
+ * missed by the cloud after a gap; records no longer in the FIFO are skipped.
+ *
+ * May be called from any task: the request is queued for the Event Record Task,
+ * and ranges are republished in the order requested.
+ *
+ * @param[in]	first	First Record Index to republish
+ * @param[in]	last	Last Record Index to republish
+ */
+void eventRecords_republish( int32_t first, int32_t last )
+{
+	_republishRequest_t request = { .first = first, .last = last };
+
+	IotLogInfo( "eventRecords_republish(%d, %d)", first, last );
+
+	if( ( 0 <= first ) && ( first <= last ) && ( NULL != _evtrec.republishQueue ) )
+	{
+		if( pdTRUE != xQueueSend( _evtrec.republishQueue, &request, 0 ) )
+		{
+			IotLogError( "eventRecords_republish: queue full, request dropped" );
+		}
+	}
+}
+
+/**
+ * @brief	Republish Feedback handler
+ *
+ * To be registered, with eventNotification_RegisterFeedbackSubjects(), for the
+ * subject used by the cloud to request missed records.  The data object holds the
+ * range, for example: { "first": 120, "last": 135 }.
+ *
+ * @param[in]	pData	Feedback data, JSON object
+ * @param[in]	len		Length of data
+ */
+void eventRecords_onRepublishFeedback( const char * pData, const int len )
+{
+	double first;
+	double last;
+
+	if( mjson_get_number( pData, len, "$.first", &first ) && mjson_get_number( pData, len, "$.last", &last ) )
+	{
+		eventRecords_republish( ( int32_t ) first, ( int32_t ) last );
+	}
+	else
+	{
+		IotLogError( "eventRecords_onRepublishFeedback: range not present" );
+	}
+}
+
 /**
  * @brief	Look-up text for status value
  *
@@ -1014,39 +1418,45 @@ const char * eventRecords_statusText( uint8_t status)
 }
 
 /**
- * @brief	Save Formatted Event Record in FIFO
+ * @brief	Save Event Record in FIFO
+ *
+ * Record is saved with a binary header holding the Index and time value.
+ * Index and DateStamp are pre-pended to the JSON body when the record is published.
  *
- * Index and DateStamp are pre-pended before the record is saved.
+ * @param[in]	pInput	JSON body, allocated by mjson, freed by this function
  */
 void eventRecords_saveRecord( char * pInput )
 {
-	char * pCommon = NULL;
-	char * pJSON = NULL;
-	char utc[ 28 ] = { 0 };
-	int32_t	lenCommon = 0;
+	_savedRecordHeader_t	header;
+	uint8_t	*pRecord;
+	size_t	bodySize = strlen( pInput );
+	size_t	recordSize = sizeof( header ) + bodySize;
 
-	/* Get Current Time, UTC, formatted per ISO 8601 */
-	getUTC( utc, sizeof( utc ) );
-
-	/* format the common elements */
-	lenCommon = mjson_printf( &mjson_print_dynamic_buf, &pCommon,
-			"{%Q:%d, %Q:%Q}",
-			"Index",           _getNextIndex(),
-			"DateTime",        utc
-			);
+	header.type = eRecordTypeSaved;
+	header.index = _getNextIndex();
+	header.timeValue = ( uint32_t ) getTimeValue();
 
-	/* Merge the common and special buffers */
-	mjson_merge( pCommon, lenCommon, pInput, strlen( pInput ), mjson_print_dynamic_buf, &pJSON );
+	IotLogInfo( "eventRecords_saveRecord: %d, %s", header.index, pInput );
 
-	/* Free format buffers */
-	free( pCommon );
-	free( pInput );
+	if( recordSize <= MAX_EVENT_RECORD_SIZE )
+	{
+		pRecord = pvPortMalloc( recordSize );
+		if( NULL != pRecord )
+		{
+			memcpy( pRecord, &header, sizeof( header ) );
+			memcpy( &pRecord[ sizeof( header ) ], pInput, bodySize );
 
-	IotLogInfo( "eventRecords_saveRecord: %s", pJSON );
+			/* Save record in FIFO */
+			fifo_put( _evtrec.fifoHandle, pRecord, recordSize );
 
-	/* Save record in FIFO */
-	fifo_put( _evtrec.fifoHandle, pJSON, strlen( pJSON ) );
+			vPortFree( pRecord );
+		}
+	}
+	else
+	{
+		IotLogError( "eventRecords_saveRecord: record too large, %d bytes", recordSize );
+	}
 
-	free( pJSON );						/* free mjson format buffer */
+	free( pInput );						/* free mjson format buffer */
 }
 
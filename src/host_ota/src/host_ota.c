@@ -2782,7 +2782,7 @@ int32_t hostOta_init( _hostOtaNotifyCallback_t notifyCb )
 	bleInterface_registerUpdateCB( eOtaStatusIndex, &vOtaStatusUpdate );
 #else
 	/* Register for SHCI Host Update Response */
-	shci_RegisterCommand( eHostUpdateResponse, &vOtaStatusUpdate );
+	shci_Subscribe( eHostUpdateResponse, &vOtaStatusUpdate, eShciDeferred );
 #endif
 
 	/* Create Task on new thread */
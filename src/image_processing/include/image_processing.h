@@ -86,6 +86,14 @@ typedef struct {
 
 typedef void (* imgCaptureCommandCallback_t)(Image_Proces_Frame_t* img);
 
+/**
+ * @brief Camera resolution the decode pipeline is designed for (VGA), used to size the workspace at init
+ */
+#define IMG_PROCES_FRAME_WIDTH		640
+#define IMG_PROCES_FRAME_HEIGHT		480
+
+img_proces_err_t	imageProces_Init(uint32_t width, uint32_t height);
+void				imageProces_Deinit(void);
 img_proces_err_t	imageProces_CaptureAndDecodeImg(imgCaptureCommandCallback_t	callback);
 img_proces_err_t 	imageProces_DecodeDWBarcode(Image_Proces_Frame_t* img);
 void 				imageProces_CleanupFrame(Image_Proces_Frame_t* img);
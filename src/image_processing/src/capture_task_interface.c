@@ -284,6 +284,11 @@ int32_t imgCapture_init(const camera_setup_t * camSetup)
 		return err;
 	}
 
+	// Allocate the decode workspace at start up, before the heap is fragmented. Decoding allocates it if this fails
+	if(imageProces_Init(IMG_PROCES_FRAME_WIDTH, IMG_PROCES_FRAME_HEIGHT) != IMG_PROCES_OK){
+		IotLogWarn("Image processing workspace not allocated");
+	}
+
 	if(err == ESP_OK)
 	{
 		// Create the image capture task
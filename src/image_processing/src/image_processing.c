@@ -76,6 +76,36 @@ typedef enum
 #define WHITESPACE_THRES			150
 #define	REQUIRED_TRANSITION_DIFF	10
 
+/**
+ * @brief Tallest trustmark area. Barcode2 start row is searched no further than 125 rows below the barcode1 end row
+ */
+#define	TMARK_MAX_AREA_HEIGHT		125
+
+/**
+ * @brief Workspace for the decode pipeline, allocated once as a single block and reused for every frame
+ *
+ * Buffer lengths follow the largest frame the workspace was sized for. Buffers that were calloc'd
+ * on first use are zeroed when a frame is initialized, so results match the per-frame allocations
+ * this replaces.
+ */
+typedef struct {
+	void*		block;					// Single allocation holding all buffers below, NULL if not sized
+	uint32_t	width;					// Largest frame width
+	uint32_t	rows;					// Largest frame height, and at least the row average length
+	uint32_t*	rowAvg;					// rows
+	uint32_t*	colAvg;					// width
+	uint32_t*	bcodeAvg[2];			// width, barcode1 and barcode2 region averages
+	uint32_t*	bcodeThres[2];			// width, barcode1 and barcode2 thresholds
+	uint32_t*	topThres;				// width
+	uint32_t*	bottomThres;			// width
+	uint32_t*	scratch;				// max(width, rows): median filter copy, trustmark region averages, barcode gradient
+	uint32_t	scratchLen;
+	uint8_t*	trustmark;				// TMARK_MAX_AREA_HEIGHT * TMARK_AREA_WIDTH
+	uint8_t		resizedTrademark[DRINKWORKS_TEMPLATE_TMARK_HEIGHT * DRINKWORKS_TEMPLATE_TMARK_WIDTH];
+}Image_Proces_Workspace_t;
+
+static Image_Proces_Workspace_t			_workspace = {0};
+
 
 static const bool						masterDrinkworksTrademark[DRINKWORKS_TEMPLATE_TMARK_HEIGHT][DRINKWORKS_TEMPLATE_TMARK_WIDTH] =
 {
@@ -146,14 +176,11 @@ static img_proces_err_t _calcImgRegionAvg( Image_Region_Avg_t* imgRegionAvg, cam
 {
 	img_proces_err_t err = IMG_PROCES_OK;
 
-	// Allocate memory for the buffer if it has not yet been allocated
+	// Buffer is assigned from the workspace by the caller
 	if(imgRegionAvg->avgBuf == NULL){
-		imgRegionAvg->avgBuf = (uint32_t*)calloc(imgRegionAvg->len, sizeof(uint32_t));
-		if(imgRegionAvg->avgBuf == NULL){
-			err = IMG_PROCES_FAIL;
-			IotLogError("Error: Failed to allocate memory for image region average");
-			return err;
-		}
+		err = IMG_PROCES_FAIL;
+		IotLogError("Error: No buffer for image region average");
+		return err;
 	}
 
 	int32_t y, x;
@@ -227,19 +254,18 @@ static img_proces_err_t _medianFilterUINT32( uint32_t* buf, uint32_t bufSize, ui
 	img_proces_err_t err = IMG_PROCES_OK;
 	int32_t i;
 
-	// Create a copy of the input array to run median searches on
-	uint32_t* bufCopy = NULL;
-	bufCopy = (uint32_t*)malloc(bufSize*sizeof(uint32_t));
-	if(bufCopy == NULL){
+	// Copy of the input array to run median searches on, held in the workspace scratch buffer
+	uint32_t* bufCopy = _workspace.scratch;
+	uint32_t medianFilterArray[MEDIAN_FILTER_SIZE];
+	if(bufCopy == NULL || bufSize > _workspace.scratchLen || medianSize > MEDIAN_FILTER_SIZE){
 		err = IMG_PROCES_FAIL;
-		IotLogError("Error (Median Filter): Failed to allocate memory for median filter copy");
+		IotLogError("Error (Median Filter): Buffer exceeds workspace");
 	}
 	if(err == IMG_PROCES_OK){
 		memcpy(bufCopy, buf, bufSize*sizeof(uint32_t));
 	}
 
 	// Find median and set array
-	uint32_t* medianFilterArray = (uint32_t*)malloc(medianSize * sizeof(uint32_t));
 	if(err == IMG_PROCES_OK){
 		for(i = medianSize/2; i<bufSize - medianSize/2; i++){
 			memcpy(medianFilterArray, &bufCopy[i - medianSize/2], medianSize*sizeof(uint32_t));
@@ -247,14 +273,6 @@ static img_proces_err_t _medianFilterUINT32( uint32_t* buf, uint32_t bufSize, ui
 		}
 	}
 
-	if (medianFilterArray != NULL) {
-		free(medianFilterArray);
-	}
-
-	if(bufCopy != NULL){
-		free(bufCopy);
-	}
-
 	return err;
 }
 
@@ -564,7 +582,7 @@ static void _defineBWThreshold( Image_Proces_Frame_t* img )
 		}
 	}
 
-	finalThreshold *= 0.6;
+	finalThreshold = (finalThreshold * 3) / 5;
 
 	img->trustmark.bwThres = finalThreshold;
 }
@@ -589,10 +607,14 @@ static img_proces_err_t _findTrustmark( Image_Proces_Frame_t* img )
 	Image_Region_Avg_t tmarkRegionAvg;
 	memset(&tmarkRegionAvg, 0, sizeof(Image_Region_Avg_t));
 
+	// Region averages are held in the workspace scratch buffer
+	tmarkRegionAvg.avgBuf = _workspace.scratch;
+
 	tmarkRegionAvg.imgRegion.endPoint.x = img->trustmark.fb.width;
 	tmarkRegionAvg.imgRegion.endPoint.y = img->trustmark.fb.height;
 	tmarkRegionAvg.scanDirection = ROW_SCAN;
 	tmarkRegionAvg.len = img->trustmark.fb.height;
+	memset(tmarkRegionAvg.avgBuf, 0, tmarkRegionAvg.len * sizeof(uint32_t));
 
 	err = _calcImgRegionAvg(&tmarkRegionAvg, &(img->trustmark.fb));
 
@@ -623,17 +645,12 @@ static img_proces_err_t _findTrustmark( Image_Proces_Frame_t* img )
 		img->trustmark.isolatedTrustmark.endPoint.y = img->trustmark.fb.height;																								// Save the end row as the last row of the trademark
 	}
 
-	// Reset the region average
-	if(NULL != tmarkRegionAvg.avgBuf){
-		free(tmarkRegionAvg.avgBuf);
-		tmarkRegionAvg.avgBuf = NULL;
-	}
-
 	// Calculate the column average for the region
 	tmarkRegionAvg.imgRegion.startPoint.y = img->trustmark.isolatedTrustmark.startPoint.y;
 	tmarkRegionAvg.imgRegion.endPoint.y = img->trustmark.isolatedTrustmark.endPoint.y;
 	tmarkRegionAvg.scanDirection = COL_SCAN;
 	tmarkRegionAvg.len = img->trustmark.fb.width;
+	memset(tmarkRegionAvg.avgBuf, 0, tmarkRegionAvg.len * sizeof(uint32_t));
 
 	err = _calcImgRegionAvg(&tmarkRegionAvg, &(img->trustmark.fb));
 
@@ -658,11 +675,6 @@ static img_proces_err_t _findTrustmark( Image_Proces_Frame_t* img )
 		}
 	}
 
-	// Free memory from stack variable
-	if(NULL != tmarkRegionAvg.avgBuf){
-		free(tmarkRegionAvg.avgBuf);
-	}
-
 	return err;
 
 }
@@ -670,27 +682,23 @@ static img_proces_err_t _findTrustmark( Image_Proces_Frame_t* img )
 
 static void _differenceCalc( Image_Proces_Frame_t* img )
 {
-	uint8_t* resizedTrademark = NULL;
-	// Create a new array for the resized trustmark
-	resizedTrademark = (uint8_t*)malloc(DRINKWORKS_TEMPLATE_TMARK_HEIGHT * DRINKWORKS_TEMPLATE_TMARK_WIDTH * sizeof(uint8_t));
-	if(resizedTrademark == NULL){
-		IotLogError("Error (differenceCalc): Failed to allocate memory for resized trustmark");
-		return;
-	}
+	// Resized trustmark is held in the workspace
+	uint8_t* resizedTrademark = _workspace.resizedTrademark;
 
 	// Due to the curvature of the pod and variations in the PM, the acquired trustmark size may be different then the template trustmark size.
 	// To normalize the captured trustmark for analysis, nearest neighbor resizing is done to resize trademark for comparison to template.
 	// Comparison trademark size is y:DRINKWORKS_TEMPLATE_TMARK_HEIGHT, x:DRINKWORKS_TEMPLATE_TMARK_WIDTH
-	float xResizeRatio = ((float) img->trustmark.isolatedTrustmark.endPoint.x - (float) img->trustmark.isolatedTrustmark.startPoint.x) / DRINKWORKS_TEMPLATE_TMARK_WIDTH;													// Create Ratio in x direction that will be used to determine what the nearest neighbor should be
-	float yResizeRatio = ((float)img->trustmark.isolatedTrustmark.endPoint.y - (float) img->trustmark.isolatedTrustmark.startPoint.y) / DRINKWORKS_TEMPLATE_TMARK_HEIGHT;													// Create Ratio in y direction that will be used to determine what the nearest neighbor should be
+	// Ratios are applied in integer arithmetic: neighbor = (pos * isolated size) / template size, truncated as the float ratio was
+	int32_t xResizeSpan = (int32_t) img->trustmark.isolatedTrustmark.endPoint.x - (int32_t) img->trustmark.isolatedTrustmark.startPoint.x;			// Isolated trustmark width, numerator of the x ratio
+	int32_t yResizeSpan = (int32_t) img->trustmark.isolatedTrustmark.endPoint.y - (int32_t) img->trustmark.isolatedTrustmark.startPoint.y;			// Isolated trustmark height, numerator of the y ratio
 	int32_t xNearestNeighbor = 0;
 	int32_t yNearestNeighbor = 0;
 	int16_t x, y;
 
 	for (y = 0; y<DRINKWORKS_TEMPLATE_TMARK_HEIGHT; y++) {																												// Loop through pixels of resized trademark in order to set them to nearest neighbor values
 		for (x = 0; x<DRINKWORKS_TEMPLATE_TMARK_WIDTH; x++) {
-			xNearestNeighbor = x*xResizeRatio;																																	// Determine what pixel from the original trademark array will be used for the resized array. Based on the x ratio
-			yNearestNeighbor = y*yResizeRatio;																																	// Determine what pixel from the original trademark array will be used for the resized array. Based on the y ratio
+			xNearestNeighbor = (x * xResizeSpan) / DRINKWORKS_TEMPLATE_TMARK_WIDTH;																								// Determine what pixel from the original trademark array will be used for the resized array. Based on the x ratio
+			yNearestNeighbor = (y * yResizeSpan) / DRINKWORKS_TEMPLATE_TMARK_HEIGHT;																							// Determine what pixel from the original trademark array will be used for the resized array. Based on the y ratio
 			if(y >= 0 && y < DRINKWORKS_TEMPLATE_TMARK_HEIGHT && x >= 0 && x < DRINKWORKS_TEMPLATE_TMARK_WIDTH && (yNearestNeighbor + img->trustmark.isolatedTrustmark.startPoint.y) < TMARK_AREA_HEIGHT && (xNearestNeighbor + img->trustmark.isolatedTrustmark.startPoint.x) < TMARK_AREA_WIDTH){
 				resizedTrademark[(y*DRINKWORKS_TEMPLATE_TMARK_WIDTH)+(x)] = img->trustmark.fb.buf[(yNearestNeighbor + img->trustmark.isolatedTrustmark.startPoint.y)*TMARK_AREA_WIDTH + (xNearestNeighbor + img->trustmark.isolatedTrustmark.startPoint.x)];
 			}
@@ -710,10 +718,6 @@ static void _differenceCalc( Image_Proces_Frame_t* img )
 		}
 	}
 
-	if(NULL != resizedTrademark){
-		free(resizedTrademark);
-	}
-
 }
 
 
@@ -736,12 +740,12 @@ static img_proces_err_t _authenticateTrustmark( Image_Proces_Frame_t* img )
 		img->trustmark.endCol = img->fb.width;
 	}
 
-	// Create a new array for the trademark
-	img->trustmark.fb.buf = (uint8_t*)malloc(img->trustmark.fb.len * sizeof(uint8_t));
-	if(img->trustmark.fb.buf == NULL){
-		IotLogError("Error (Authenticate Trademark): Failed to allocate memory for trademark");
+	// Trademark array is held in the workspace
+	if(img->trustmark.fb.height > TMARK_MAX_AREA_HEIGHT){
+		IotLogError("Error (Authenticate Trademark): Trademark area of %d rows exceeds workspace", img->trustmark.fb.height);
 		return IMG_PROCES_FAIL;
 	}
+	img->trustmark.fb.buf = _workspace.trustmark;
 
 	// Fill the trademark array
 	uint32_t x, y;
@@ -839,20 +843,12 @@ static img_proces_err_t _thresholdCalc( BarcodeRegion_t* bcode, Image_Proces_Fra
 {
 	img_proces_err_t err = IMG_PROCES_OK;
 
-	// Allocate memory for top and bottom threshold
-	uint32_t* topThres = (uint32_t*)calloc(bcode->regionAvg.len, sizeof(uint32_t));
-	if(topThres == NULL){
-		err = IMG_PROCES_FAIL;
-		IotLogError("Error: Failed to allocate memory for top threshold");
-		return err;
-	}
+	// Top and bottom thresholds are held in the workspace
+	uint32_t* topThres = _workspace.topThres;
+	memset(topThres, 0, bcode->regionAvg.len * sizeof(uint32_t));
 
-	uint32_t* bottomThres = (uint32_t*)calloc(img->barcode2.regionAvg.len, sizeof(uint32_t));
-	if(bottomThres == NULL){
-		err = IMG_PROCES_FAIL;
-		IotLogError("Error: Failed to allocate memory for top threshold");
-		return err;
-	}
+	uint32_t* bottomThres = _workspace.bottomThres;
+	memset(bottomThres, 0, img->barcode2.regionAvg.len * sizeof(uint32_t));
 
 	uint32_t barcodeScanStart = 0;
 	if (bcode->regionAvg.imgRegion.startPoint.x >= BCODE_SCAN_OFFSET) {
@@ -900,14 +896,11 @@ static img_proces_err_t _thresholdCalc( BarcodeRegion_t* bcode, Image_Proces_Fra
 				bcode->thresholdAvg[x] = bottomThres[x] / 5;
 			}
 		}
-		bcode->thresholdAvg[x] *= 0.75;
+		bcode->thresholdAvg[x] = (bcode->thresholdAvg[x] * 3) / 4;
 	}
 
 	_medianFilterUINT32(bcode->thresholdAvg, bcode->regionAvg.len, MEDIAN_FILTER_SIZE);
 
-	free(topThres);
-	free(bottomThres);
-
 	return err;
 }
 
@@ -915,26 +908,7 @@ static img_proces_err_t _defineBcodeThresholds( Image_Proces_Frame_t* img )
 {
 	img_proces_err_t err = IMG_PROCES_OK;
 
-	// Allocate memory for the buffers if they have not yet been allocated
-	if(img->barcode1.thresholdAvg == NULL){
-		img->barcode1.thresholdAvg = (uint32_t*)calloc(img->barcode1.regionAvg.len, sizeof(uint32_t));
-		if(img->barcode1.thresholdAvg == NULL){
-			err = IMG_PROCES_FAIL;
-			IotLogError("Error: Failed to allocate memory for barcode threshold");
-			return err;
-		}
-	}
-
-	if(img->barcode2.thresholdAvg == NULL){
-		img->barcode2.thresholdAvg = (uint32_t*)calloc(img->barcode2.regionAvg.len, sizeof(uint32_t));
-		if(img->barcode2.thresholdAvg == NULL){
-			err = IMG_PROCES_FAIL;
-			IotLogError("Error: Failed to allocate memory for barcode threshold");
-			return err;
-		}
-	}
-
-
+	// Threshold buffers are assigned from the workspace by _initBarcodeResults()
 	err = _thresholdCalc(&(img->barcode1), img);
 
 	if(err == IMG_PROCES_OK){
@@ -1007,7 +981,7 @@ static img_proces_err_t _eleventhBitCalculation( Image_Proces_Frame_t* img, Barc
 
 	bcode->singleBit.threshold /= 400;
 
-	if(bcode->singleBit.sum / (20 * scanWidth) < (bcode ->singleBit.threshold * 0.5)){
+	if((int32_t)(2 * (bcode->singleBit.sum / (20 * scanWidth))) < bcode->singleBit.threshold){
 		bcode->singleBit.bitResult = 1;
 		IotLogDebug("BitResult=1");
 	}
@@ -1228,7 +1202,9 @@ static img_proces_err_t _decodeBarcode( BarcodeRegion_t* bcode )
 	}
 
 	// Calculate the barcode gradient to determine transition locations from white to black
-	int32_t* barcodeGradient =(int32_t*)calloc(bcode->regionAvg.len, sizeof(uint32_t));
+	// Gradient is held in the workspace scratch buffer, free once the median filter has returned
+	int32_t* barcodeGradient = (int32_t*)_workspace.scratch;
+	memset(barcodeGradient, 0, bcode->regionAvg.len * sizeof(int32_t));
 	for(i = 0; i<bcode->regionAvg.len - 2; i++){
 		barcodeGradient[i] = (int32_t) bcode->regionAvg.avgBuf[i + 1] - (int32_t) bcode->regionAvg.avgBuf[i];
 	}
@@ -1324,8 +1300,6 @@ static img_proces_err_t _decodeBarcode( BarcodeRegion_t* bcode )
 
 	IotLogInfo( "Barcode: %d", bcode->barcodeResult );
 
-	free( barcodeGradient );
-
 	return err;
 }
 
@@ -1382,10 +1356,59 @@ static void _checkForPod( Image_Proces_Frame_t* img )
  */
 #define	VGA_HEIGHT							480
 
+/**
+ * @brief Size the workspace for frames of up to width x height pixels
+ *
+ * All buffers are carved from one allocation. An existing workspace that is large enough is kept.
+ *
+ * @param[in] width		Largest frame width
+ * @param[in] height	Largest frame height
+ *
+ * @return 	img_proces_err_t IMG_PROCES_OK if the workspace is sized, IMG_PROCES_FAIL if it cannot be allocated
+ */
+static img_proces_err_t _sizeWorkspace( uint32_t width, uint32_t height )
+{
+	uint32_t rows = (height > VGA_HEIGHT) ? height : VGA_HEIGHT;
+	uint32_t scratchLen = (width > rows) ? width : rows;
+	uint32_t* words;
+
+	if( NULL != _workspace.block && width <= _workspace.width && rows <= _workspace.rows )
+	{
+		return IMG_PROCES_OK;
+	}
+
+	imageProces_Deinit();
+
+	// Row average, column average, two barcode averages, two barcode thresholds, top and bottom thresholds, scratch, then the trademark area
+	_workspace.block = malloc( ( rows + ( 7 * width ) + scratchLen ) * sizeof(uint32_t) + ( TMARK_MAX_AREA_HEIGHT * TMARK_AREA_WIDTH ) );
+	if( NULL == _workspace.block )
+	{
+		IotLogError( "Error: Failed to allocate image processing workspace for %dx%d frames", width, height );
+		return IMG_PROCES_FAIL;
+	}
+
+	words = (uint32_t*)_workspace.block;
+	_workspace.width = width;
+	_workspace.rows = rows;
+	_workspace.rowAvg = words;				words += rows;
+	_workspace.colAvg = words;				words += width;
+	_workspace.bcodeAvg[0] = words;			words += width;
+	_workspace.bcodeAvg[1] = words;			words += width;
+	_workspace.bcodeThres[0] = words;		words += width;
+	_workspace.bcodeThres[1] = words;		words += width;
+	_workspace.topThres = words;			words += width;
+	_workspace.bottomThres = words;			words += width;
+	_workspace.scratch = words;				words += scratchLen;
+	_workspace.scratchLen = scratchLen;
+	_workspace.trustmark = (uint8_t*)words;
+
+	return IMG_PROCES_OK;
+}
+
 /**
  * @brief Initialize the barcode results for the start of a new capture
  *
- * @note The buffers (i.e. rowAvg.AvgBuf) will be set to NULL in this function. Ensure that they were not previously malloc'd
+ * @note The buffers (i.e. rowAvg.AvgBuf) are assigned from the workspace, and zeroed, in this function
  *
  * @param[in] img	Image processing frame to initialize.
  *
@@ -1395,12 +1418,48 @@ void _initBarcodeResults( Image_Proces_Frame_t* img )
 {
 	imageProces_CleanupFrame(img);
 
-	img->rowAvg = (Image_Region_Avg_t){{{ROW_AVG_START_COL, 0}, {ROW_AVG_END_COL, VGA_HEIGHT}}, ROW_SCAN, NULL, VGA_HEIGHT};
-	img->colAvg = (Image_Region_Avg_t){{{0, 0}, {0, 0}}, COL_SCAN, NULL, 0};
-	img->barcode1 = (BarcodeRegion_t){{{{0, 0}, {0, 0}}, COL_SCAN, NULL, 0}, NULL, {0, 0, 0, 0, 0}, NOT_INITIALIZED};
-	img->barcode2 = (BarcodeRegion_t){{{{0, 0}, {0, 0}}, COL_SCAN, NULL, 0}, NULL, {0, 0, 0, 0, 0}, NOT_INITIALIZED};
+	img->rowAvg = (Image_Region_Avg_t){{{ROW_AVG_START_COL, 0}, {ROW_AVG_END_COL, VGA_HEIGHT}}, ROW_SCAN, _workspace.rowAvg, VGA_HEIGHT};
+	img->colAvg = (Image_Region_Avg_t){{{0, 0}, {0, 0}}, COL_SCAN, _workspace.colAvg, 0};
+	img->barcode1 = (BarcodeRegion_t){{{{0, 0}, {0, 0}}, COL_SCAN, _workspace.bcodeAvg[0], 0}, _workspace.bcodeThres[0], {0, 0, 0, 0, 0}, NOT_INITIALIZED};
+	img->barcode2 = (BarcodeRegion_t){{{{0, 0}, {0, 0}}, COL_SCAN, _workspace.bcodeAvg[1], 0}, _workspace.bcodeThres[1], {0, 0, 0, 0, 0}, NOT_INITIALIZED};
 	img->trustmark = (Trustmark_t){ {NULL, 0, 0, 0, PIXFORMAT_GRAYSCALE, {0,0}}, 0, 0, 0, {{0,0},{0,0}}, 0};
 	img->result = (Image_Decode_Result_t){NOT_INITIALIZED, IMG_PROCES_FAIL_NOT_INITIALIZED};
+
+	// Averages accumulate into their buffers, which start from zero for each frame
+	memset(_workspace.rowAvg, 0, _workspace.rows * sizeof(uint32_t));
+	memset(_workspace.colAvg, 0, _workspace.width * sizeof(uint32_t));
+	memset(_workspace.bcodeAvg[0], 0, _workspace.width * sizeof(uint32_t));
+	memset(_workspace.bcodeAvg[1], 0, _workspace.width * sizeof(uint32_t));
+	memset(_workspace.bcodeThres[0], 0, _workspace.width * sizeof(uint32_t));
+	memset(_workspace.bcodeThres[1], 0, _workspace.width * sizeof(uint32_t));
+}
+
+/**
+ * @brief Allocate the decode workspace, sized from the camera resolution
+ *
+ * @note Call once at start up, before the heap is fragmented. A frame larger than the workspace
+ * 			resizes it when decoded, otherwise no memory is allocated or freed per frame.
+ *
+ * @param[in] width		Camera frame width, pixels
+ * @param[in] height	Camera frame height, pixels
+ *
+ * @return 	img_proces_err_t IMG_PROCES_OK if passed, IMG_PROCES_FAIL if the workspace cannot be allocated
+ */
+img_proces_err_t imageProces_Init( uint32_t width, uint32_t height )
+{
+	return _sizeWorkspace( width, height );
+}
+
+/**
+ * @brief Free the decode workspace
+ */
+void imageProces_Deinit( void )
+{
+	if( NULL != _workspace.block )
+	{
+		free( _workspace.block );
+	}
+	memset( &_workspace, 0, sizeof( _workspace ) );
 }
 
 /**
@@ -1418,6 +1477,13 @@ img_proces_err_t imageProces_DecodeDWBarcode( Image_Proces_Frame_t* img )
 	img_proces_err_t err = IMG_PROCES_OK;
 	uint32_t currentScanRow = 0;
 
+	// Size the workspace, only allocates if not initialized or the frame is larger than the camera resolution
+	err = _sizeWorkspace( img->fb.width, img->fb.height );
+	if( err != IMG_PROCES_OK )
+	{
+		return err;
+	}
+
 	// Initialize the frame results
 	_initBarcodeResults(img);
 
@@ -1512,59 +1578,28 @@ img_proces_err_t imageProces_DecodeDWBarcode( Image_Proces_Frame_t* img )
 
 
 /**
- * @brief Cleanup malloc'd memory
+ * @brief Detach a frame from the decode workspace
+ *
+ * @note Buffers belong to the workspace and are reused by the next frame, nothing is freed. Pointers
+ * 			are cleared so the frame cannot be mistaken for holding valid buffers.
  *
- * @param[in] img	Image processing frame to be free'd
+ * @param[in] img	Image processing frame to be cleaned up
  */
 void imageProces_CleanupFrame( Image_Proces_Frame_t* img )
 {
-
-	if( NULL != img->rowAvg.avgBuf )
-	{
-		free( img->rowAvg.avgBuf );
-		img->rowAvg.avgBuf = NULL;
-	}
-
-	if( NULL != img->colAvg.avgBuf )
-	{
-		free( img->colAvg.avgBuf );
-		img->colAvg.avgBuf = NULL;
-	}
-
-	if( NULL != img->barcode1.thresholdAvg )
-	{
-		free( img->barcode1.thresholdAvg );
-		img->barcode1.thresholdAvg = NULL;
-	}
-
-	if( NULL != img->barcode1.regionAvg.avgBuf )
-	{
-		free( img->barcode1.regionAvg.avgBuf );
-		img->barcode1.regionAvg.avgBuf = NULL;
-	}
-
-	if( NULL != img->barcode2.thresholdAvg )
-	{
-		free( img->barcode2.thresholdAvg );
-		img->barcode2.thresholdAvg = NULL;
-	}
-
-	if( NULL != img->barcode2.regionAvg.avgBuf )
-	{
-		free( img->barcode2.regionAvg.avgBuf );
-		img->barcode2.regionAvg.avgBuf = NULL;
-	}
-
-	if( NULL != img->trustmark.fb.buf)
-	{
-		free( img->trustmark.fb.buf );
-	}
+	img->rowAvg.avgBuf = NULL;
+	img->colAvg.avgBuf = NULL;
+	img->barcode1.thresholdAvg = NULL;
+	img->barcode1.regionAvg.avgBuf = NULL;
+	img->barcode2.thresholdAvg = NULL;
+	img->barcode2.regionAvg.avgBuf = NULL;
+	img->trustmark.fb.buf = NULL;
 }
 
 
 /**
  * @brief Capture and Decode image. This function is the high level call to decode an image. It
- * allocated a frame buffer, captures an image, calls a callback, then frees all dynamicall allocated buffers
+ * gets a frame buffer, captures an image, decodes it in the preallocated workspace, then calls a callback
  *
  * @note The Image_Proces_Frame_t parameter for the callback is on the stack of the image process
  * function. It will need to be copied if used outside of the callback
@@ -1608,7 +1643,7 @@ img_proces_err_t	imageProces_CaptureAndDecodeImg( imgCaptureCommandCallback_t ca
 		// Print out the results of the decoding
 		IotLogInfo( "Barcode1:%d\t Barcode2:%d\t TrademarkDiff:%d", img.barcode1.barcodeResult, img.barcode2.barcodeResult, img.trustmark.trustmarkDiff );
 
-		// Cleanup the allocated buffers in the image processing frame
+		// Detach the image processing frame from the workspace buffers
 		imageProces_CleanupFrame( &img );
 
 		// Call the callback
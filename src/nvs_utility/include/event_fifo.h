@@ -22,7 +22,60 @@ typedef struct fifo_s fifo_t;
  */
 typedef fifo_t* fifo_handle_t;
 
-fifo_handle_t fifo_init(const NVS_Partitions_t partition, const char * namespace, const char *keyPrefix, const uint16_t nItems, NVS_Items_t controlsKey, NVS_Items_t maxKey );
+/**
+ * @brief Opaque FIFO read cursor
+ */
+typedef struct fifo_cursor_s fifo_cursor_t;
+
+/**
+ * @brief Cursor handle, for fifo_cursor* functions
+ */
+typedef fifo_cursor_t* fifo_cursor_handle_t;
+
+/**
+ * @brief Upper limit for fifo_cacheConfig_t.maxPending
+ */
+#define	FIFO_CACHE_MAX_PENDING		32
+
+/**
+ * @brief RAM write-back cache configuration
+ *
+ * Records put to a cached FIFO are staged in RAM and written to NVS as a batch.
+ * On power loss, up to <i>maxPending</i> records may be lost.
+ */
+typedef struct
+{
+	uint16_t	maxPending;						/**< Staged records before flush, records at risk on power loss; 0 disables cache */
+	size_t		maxRecordSize;					/**< Size of each staging slot, larger records are written through */
+	uint32_t	maxAgeMs;						/**< Flush when oldest staged record reaches this age, 0 = no age limit */
+} fifo_cacheConfig_t;
+
+/**
+ * @brief Number of named read cursors per FIFO, in addition to the default reader
+ */
+#define	FIFO_MAX_CURSORS			3
+
+/**
+ * @brief Size of cursor name, including null-terminator
+ */
+#define	FIFO_CURSOR_NAME_LENGTH		8
+
+/**
+ * @brief Record Index extractor, for fifo_setIndex()
+ *
+ * Returns the monotonic Index carried by a stored record, used to locate records
+ * for fifo_readRange().
+ *
+ * @param[in]	blob	Pointer to record, as stored in the FIFO
+ * @param[in]	length	Length of record, in bytes
+ * @param[out]	pIndex	Record Index
+ * @return		<i>true</i> if record carries an Index, <i>false</i> otherwise
+ */
+typedef bool ( *fifo_indexFn_t )( const void *blob, size_t length, uint32_t *pIndex );
+
+fifo_handle_t fifo_init(const NVS_Partitions_t partition, const char * namespace, const char *keyPrefix, const uint16_t nItems, NVS_Items_t controlsKey, NVS_Items_t maxKey, const fifo_cacheConfig_t *pCache );
+
+fifo_handle_t fifo_initPacked( const NVS_Partitions_t partition, const char * namespace, const char *keyPrefix, const uint16_t nSegments, const uint16_t segmentSize, NVS_Items_t maxKey, const fifo_cacheConfig_t *pCache );
 
 void fifo_reset( fifo_handle_t fifo );
 
@@ -38,8 +91,36 @@ int32_t fifo_put( fifo_handle_t fifo, const void* blob, size_t length);
 
 int32_t fifo_get( fifo_handle_t fifo, void* blob, size_t *pLength );
 
+int32_t fifo_putBatch( fifo_handle_t fifo, const void * const blobs[], const size_t lengths[], uint16_t count );
+
+int32_t fifo_getBatch( fifo_handle_t fifo, void *buffer, size_t bufferSize, size_t lengths[], uint16_t *pCount );
+
+int32_t fifo_flush( fifo_handle_t fifo );
+
+int32_t fifo_flushIfDue( fifo_handle_t fifo );
+
 int32_t fifo_commitRead( fifo_handle_t fifo, bool commit );
 
+int32_t fifo_setIndex( fifo_handle_t fifo, fifo_indexFn_t indexFn, size_t maxRecordSize );
+
+int32_t fifo_readRange( fifo_handle_t fifo, uint32_t first, uint32_t last, void *buffer, size_t bufferSize, size_t lengths[], uint16_t *pCount );
+
+int32_t fifo_resize( fifo_handle_t fifo, uint16_t nItems );
+
+int32_t fifo_migrate( fifo_handle_t fifo, uint16_t maxRecords );
+
+bool fifo_migrating( fifo_handle_t fifo );
+
+fifo_cursor_handle_t fifo_cursorOpen( fifo_handle_t fifo, const char *name );
+
+int32_t fifo_cursorDelete( fifo_cursor_handle_t cursor );
+
+uint16_t fifo_cursorSize( fifo_cursor_handle_t cursor );
+
+int32_t fifo_cursorGet( fifo_cursor_handle_t cursor, void* blob, size_t *pLength );
+
+int32_t fifo_cursorCommit( fifo_cursor_handle_t cursor, bool commit );
+
 uint16_t fifo_getHead( fifo_handle_t fifo);
 
 uint16_t fifo_getTail( fifo_handle_t fifo);
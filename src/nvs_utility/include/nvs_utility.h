@@ -40,22 +40,87 @@ typedef	struct
 
 
 
+/**
+ * @brief	Maximum number of keys for which individual statistics are kept
+ *
+ * Keys beyond this number are accumulated in a final "other" entry.
+ */
+#define	NVS_STATS_MAX_KEYS			32
+
+/**
+ * @brief	Maximum number of partitions for which statistics are kept
+ */
+#define	NVS_STATS_MAX_PARTITIONS	8
+
+/**
+ * @brief	NVS access statistics
+ */
+typedef struct
+{
+	uint32_t	writes;										/**< Writes issued to NVS */
+	uint32_t	writesSkipped;								/**< Writes skipped, value already set */
+	uint32_t	bytesWritten;								/**< Bytes written to NVS */
+	uint32_t	reads;										/**< Reads from NVS */
+	uint32_t	erases;										/**< Keys erased */
+	uint32_t	errors;										/**< Operations that returned an error */
+	uint64_t	writeTime;									/**< Cumulative NVS_pSet latency, microseconds */
+	uint64_t	readTime;									/**< Cumulative NVS_pGet latency, microseconds */
+} NVS_Stats_t;
+
+/**
+ * @brief	NVS access statistics for a single key
+ *
+ * Keys ending in a decimal index, such as the Event FIFO record keys, are
+ * grouped by prefix, and reported with a '#' in place of the index.
+ */
+typedef struct
+{
+	NVS_Partitions_t	partition;							/**< Partition of key */
+	char				namespace[ 16 ];					/**< Namespace of key */
+	char				nvsKey[ 16 ];						/**< Key, or key prefix followed by '#' */
+	NVS_Stats_t			stats;								/**< Statistics */
+} NVS_KeyStats_t;
+
 const nvsItem_pal_t * nvsItem_getPAL( void );
 
 
 int32_t NVS_Initialize( const nvsItem_pal_t * pal );
 
+int32_t NVS_Deinitialize( void );
+
+int32_t NVS_pGet_Size_Of( const NVS_Entry_Details_t *pItem, uint32_t* size );
+
 int32_t NVS_Get_Size_Of(NVS_Items_t nvsItem, uint32_t* size);
 
 int32_t NVS_pGet( const NVS_Entry_Details_t *pItem, void* pOutput, void* pSize );
 
+int32_t NVS_pGetIfPresent( const NVS_Entry_Details_t *pItem, void* pOutput, void* pSize );
+
+int32_t NVS_pGetIfFits( const NVS_Entry_Details_t *pItem, void* pOutput, void* pSize );
+
 int32_t NVS_Get(NVS_Items_t nvsItem, void* pOutput, void* pSize);
 
 int32_t NVS_pSet( const NVS_Entry_Details_t *pItem, const void * pInput, size_t * pSize );
 
 int32_t NVS_Set(NVS_Items_t nvsItem, void* pInput, size_t * pSize);
 
+int32_t NVS_pErase( const NVS_Entry_Details_t *pItem );
+
 int32_t NVS_EraseKey(NVS_Items_t nvsItem);
 
+int32_t NVS_BeginTxn( void );
+
+int32_t NVS_Commit( void );
+
+int32_t NVS_GetPartitionStats( NVS_Partitions_t partition, NVS_Stats_t *pStats );
+
+uint16_t NVS_GetKeyStatsCount( void );
+
+int32_t NVS_GetKeyStats( uint16_t n, NVS_KeyStats_t *pStats );
+
+void NVS_ResetStats( void );
+
+void NVS_LogStats( void );
+
 
 #endif // !NVSUTILITY_H
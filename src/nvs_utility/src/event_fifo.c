@@ -9,6 +9,9 @@
 #include	"event_fifo.h"
 #include	"nvs_utility.h"
 #include	"esp_err.h"
+#include	"freertos/FreeRTOS.h"
+#include	"freertos/semphr.h"
+#include	"freertos/task.h"
 
 /* Debug Logging */
 #include "nvs_logging.h"
@@ -21,10 +24,32 @@
 #define		FIFO_NOT_FULL	0
 #define		FIFO_FULL		1
 
+#define		PACKED_LENGTH_SIZE		2								/**< Size of length prefix for each packed record */
+#define		PACKED_CONTROLS_SUFFIX	"CTL"							/**< Suffix of NVS key for packed FIFO controls */
+#define		PACKED_SEGMENT_NONE		0xFFFF							/**< Read buffer does not hold a segment */
+#define		PACKED_MIN_SEGMENTS		2								/**< Minimum number of segments for a packed FIFO */
+
+#define		CURSOR_CONTROLS_SUFFIX	"CUR"							/**< Suffix of NVS key for FIFO cursor controls */
+#define		CURSOR_SLOTS			( FIFO_MAX_CURSORS + 1 )		/**< Cursor slots, including the default reader */
+#define		CURSOR_DEFAULT			0								/**< Slot of the default reader, fifo_get()/fifo_commitRead() */
+
+#define		INDEX_INTERVAL			8								/**< Record slots per index sample */
+#define		INDEX_NONE				0xFFFFFFFF						/**< Index sample not available */
+
+#define		MIGRATE_CONTROLS_SUFFIX	"MIG"							/**< Suffix of NVS key for FIFO resize journal */
+#define		FIFO_MAX_ITEMS			0x8000							/**< Largest record FIFO, head and tail are 15-bit slot numbers */
+
 /*
  * NVS Key is formatted using snprintf( key, MAX_KEY_LENGTH, "%s%d", prefix, suffix )
  */
 
+struct fifo_cursor_s
+{
+	fifo_t *			fifo;								/**< FIFO read by cursor */
+	uint16_t			slot;								/**< Slot in FIFO cursor table */
+	uint16_t			activeOffset;						/**< Next record to read, as a count of records past the FIFO tail */
+};
+
 struct fifo_s
 {
 	union
@@ -47,6 +72,90 @@ struct fifo_s
 	char 				namespace[ MAX_NAMESPACE_LENGTH ];
 	char 				keyPrefix[ MAX_KEYPREFIX_LENGTH ];
 	char 				key[ MAX_KEY_LENGTH ];
+
+	struct fifo_cache_s
+	{
+		fifo_cacheConfig_t	config;							/**< Cache configuration, maxPending = 0 if cache is disabled */
+		uint8_t *			pData;							/**< Staging slots, each config.maxRecordSize bytes */
+		size_t *			pLength;						/**< Length of record held in each staging slot */
+		uint16_t			first;							/**< Staging slot holding oldest pending record */
+		uint16_t			pending;						/**< Number of records staged in RAM, not yet written to NVS */
+		TickType_t			firstTime;						/**< Tick count when oldest pending record was staged */
+		SemaphoreHandle_t	mutex;							/**< Guards staging ring between putting and flushing tasks */
+	} cache;												/**< Optional RAM write-back cache */
+
+	struct fifo_packed_s
+	{
+		uint16_t			segmentSize;					/**< Segment blob size, in bytes; 0 if FIFO is not packed */
+		struct fifo_packed_controls_s
+		{
+			uint16_t		headSeg;						/**< Segment records are appended to */
+			uint16_t		headOff;						/**< Offset of next record in head segment */
+			uint16_t		tailSeg;						/**< Segment holding oldest record */
+			uint16_t		tailOff;						/**< Offset of oldest record in tail segment */
+			uint16_t		count;							/**< Number of records in FIFO */
+			uint16_t		segmentSize;					/**< Segment size records were packed with */
+		} ctl;												/**< Packed FIFO controls, saved in NVS as a blob */
+		uint16_t			activeTailSeg;					/**< Segment of next record to read */
+		uint16_t			activeTailOff;					/**< Offset of next record to read */
+		uint16_t			activeCount;					/**< Number of records from active tail to head */
+		uint8_t *			pHead;							/**< Head segment, mirrored in RAM */
+		uint8_t *			pRead;							/**< Read buffer, holds one segment */
+		uint16_t			readSeg;						/**< Segment held in read buffer */
+		size_t				readLen;						/**< Length of segment held in read buffer */
+		NVS_Entry_Details_t	controlsEntry;					/**< NVS entry for packed FIFO controls */
+		char				controlsKey[ MAX_KEY_LENGTH ];
+	} packed;												/**< Packed (segment) storage mode */
+
+	struct fifo_cursors_s
+	{
+		bool				bActive;						/**< Named cursors in use, tail follows the slowest cursor */
+		struct fifo_cursor_controls_s
+		{
+			uint16_t		baseTail;						/**< FIFO tail that offsets were saved relative to */
+			uint16_t		offset[ CURSOR_SLOTS ];			/**< Committed read position of each cursor, as a count of records past the tail */
+			char			name[ CURSOR_SLOTS ][ FIFO_CURSOR_NAME_LENGTH ];	/**< Cursor names, empty if slot is unused */
+		} ctl;												/**< Cursor controls, saved in NVS as a blob */
+		struct fifo_cursor_s	cursor[ CURSOR_SLOTS ];		/**< Cursors, slot 0 is the default reader */
+		uint16_t			dropped;						/**< Records overwritten since cursor controls were saved */
+		SemaphoreHandle_t	mutex;							/**< Guards FIFO pointers, and packed segments, between reading and putting tasks */
+		NVS_Entry_Details_t	entry;							/**< NVS entry for cursor controls */
+		char				key[ MAX_KEY_LENGTH ];
+	} cursors;												/**< Multiple reader cursors */
+
+	struct fifo_index_s
+	{
+		fifo_indexFn_t		fn;								/**< Record Index extractor, NULL if FIFO is not indexed */
+		uint32_t *			pSample;						/**< Index of record in every INDEX_INTERVAL slot, or of first record in each packed segment */
+		uint16_t			samples;						/**< Number of samples */
+		size_t				maxRecordSize;					/**< Size of largest record, used to rebuild the index */
+	} index;												/**< Sparse record Index, for fifo_readRange() */
+
+	struct fifo_migrate_s
+	{
+		bool				bActive;						/**< Records are being moved to the new capacity */
+		struct fifo_migrate_controls_s
+		{
+			uint16_t		state;							/**< eMigrateStart until new controls and max are saved, then eMigrateMove */
+			uint16_t		oldMax;							/**< Capacity records are moved from */
+			uint16_t		newMax;							/**< Capacity records are moved to */
+			uint16_t		moveCount;						/**< Records to move, from slots 0 to moveCount - 1, each to slot + oldMax */
+			uint16_t		copied;							/**< Records moved so far */
+			uint16_t		spare;
+			uint32_t		controls;						/**< FIFO controls, in the new capacity, when the resize started */
+		} ctl;												/**< Resize journal, saved in NVS as a blob */
+		NVS_Entry_Details_t	entry;							/**< NVS entry for resize journal */
+		char				key[ MAX_KEY_LENGTH ];
+	} migrate;												/**< Online resize, see fifo_resize() */
+};
+
+/**
+ * @brief	Resize journal states
+ */
+enum
+{
+	eMigrateStart = 1,										/**< Journal saved, controls and max may still be for the old capacity */
+	eMigrateMove,											/**< Controls and max saved for the new capacity, records being moved */
 };
 
 //#define	MAX_KEY_SIZE	8					/**< Maximum Blob Key size, including null-terminator */
@@ -84,6 +193,115 @@ static int32_t save_controls( fifo_handle_t fifo)
 	return err;
 }
 
+/************************************************************************/
+/**
+ * @brief	Keep cursors in sync with a tail advanced by overwriting
+ *
+ * Cursors pointing at an overwritten record are moved to the new tail.
+ *
+ * @param[in] fifo	Handle of FIFO, must not be NULL
+ * @param[in] drop	Number of records the tail has advanced by
+ */
+/************************************************************************/
+static void cursors_drop( fifo_handle_t fifo, uint16_t drop )
+{
+	struct fifo_cursors_s *pCursors = &fifo->cursors;
+	int i;
+
+	if( !pCursors->bActive )
+	{
+		return;
+	}
+
+	for( i = 0; i < CURSOR_SLOTS; ++i )
+	{
+		pCursors->ctl.offset[ i ] = ( pCursors->ctl.offset[ i ] > drop ) ? ( pCursors->ctl.offset[ i ] - drop ) : 0;
+		pCursors->cursor[ i ].activeOffset = ( pCursors->cursor[ i ].activeOffset > drop ) ? ( pCursors->cursor[ i ].activeOffset - drop ) : 0;
+	}
+	pCursors->dropped += drop;
+}
+
+/************************************************************************/
+/**
+ * @brief	Advance Head Pointer, without saving controls
+ *
+ * If the buffer is full, the tail is advanced as well, dropping the oldest element.
+ * The active tail is kept in sync if it was equal to the tail.
+ * Controls are only updated in RAM, caller is responsible for saving them.
+ *
+ * @param[in] fifo	Handle of FIFO, must not be NULL
+ */
+/************************************************************************/
+static void advance_head( fifo_handle_t fifo )
+{
+	int32_t	tempTail;
+
+	if( fifo->full )
+	{
+		tempTail = fifo->tail;											// stash tail value
+		fifo->tail = (fifo->tail + 1) % fifo->max;						// increment tail
+		if( fifo->activeTail == tempTail )								// if tail value were previously equal
+		{
+			fifo->activeTail = fifo->tail;								// keep active tail in sync
+		}
+		cursors_drop( fifo, 1 );
+	}
+
+	fifo->head = (fifo->head + 1) % fifo->max;
+	fifo->full = (fifo->head == fifo->tail) ? FIFO_FULL : FIFO_NOT_FULL;
+}
+
+/************************************************************************/
+/**
+ * @brief	Drop oldest elements, ahead of a batch overwrite
+ *
+ * When a batch put will overwrite elements that are still in the FIFO, the tail
+ * is advanced past those elements, and the controls saved, <i>before</i> any
+ * element is overwritten.  A power loss during the batch will then never leave
+ * the stored tail pointing at an element that has been replaced by newer data.
+ *
+ * @param[in] fifo		Handle of FIFO, must not be NULL
+ * @param[in] count		Number of elements to be added by the batch
+ * @return
+ * 	- ESP_OK if no elements need to be dropped, or controls are saved without issue
+ * 	- ESP_FAIL if error saving controls
+ */
+/************************************************************************/
+static int32_t drop_oldest( fifo_handle_t fifo, uint16_t count )
+{
+	uint16_t	used;
+	uint16_t	drop;
+	uint32_t	newTail;
+
+	used = ( fifo->full ) ? fifo->max : ( ( fifo->head + fifo->max - fifo->tail ) % fifo->max );
+
+	if( ( used + count ) <= fifo->max )
+	{
+		return ESP_OK;														// batch fits, nothing to drop
+	}
+
+	drop = ( used + count ) - fifo->max;
+	if( drop > used )
+	{
+		drop = used;														// batch larger than FIFO, drop everything
+	}
+
+	newTail = ( fifo->tail + drop ) % fifo->max;
+
+	/* keep active tail in sync if it would otherwise point at a dropped element */
+	if( ( ( fifo->activeTail + fifo->max - fifo->tail ) % fifo->max ) < drop )
+	{
+		fifo->activeTail = newTail;
+	}
+
+	fifo->tail = newTail;
+	fifo->full = FIFO_NOT_FULL;
+	cursors_drop( fifo, drop );
+	IotLogDebug( "drop_oldest, dropped = %d, tail = %d", drop, fifo->tail );
+
+	return save_controls( fifo );
+}
+
 /************************************************************************/
 /**
  * @brief	Advance Head Pointer
@@ -100,7 +318,6 @@ static int32_t save_controls( fifo_handle_t fifo)
 static int32_t advance_pointer( fifo_handle_t fifo )
 {
 	esp_err_t err;
-	int32_t	tempTail;
 
 	if( fifo == NULL )
 	{
@@ -109,18 +326,7 @@ static int32_t advance_pointer( fifo_handle_t fifo )
 	}
 	else
 	{
-		if( fifo->full )
-		{
-			tempTail = fifo->tail;											// stash tail value
-			fifo->tail = (fifo->tail + 1) % fifo->max;						// increment tail
-			if( fifo->activeTail == tempTail )								// if tail value were previously equal
-			{
-				fifo->activeTail = fifo->tail;								// keep active tail in sync
-			}
-		}
-
-		fifo->head = (fifo->head + 1) % fifo->max;
-		fifo->full = (fifo->head == fifo->tail) ? FIFO_FULL : FIFO_NOT_FULL;
+		advance_head( fifo );
 		IotLogDebug( "advance_pointer, head = %d, tail = %d, full = %d", fifo->head, fifo->tail, fifo->full );
 		err = save_controls( fifo );
 	}
@@ -200,374 +406,2913 @@ static bool formatKey( fifo_handle_t fifo, const size_t index )
 	}
 }
 
-/* ************************************************************************** */
-/* ************************************************************************** */
-/* Section: Interface Functions                                               */
-/* ************************************************************************** */
-/* ************************************************************************** */
+/**
+ * @brief	Format Key to read the record held in a slot
+ *
+ * While a resize is in progress, a record not yet moved is still held in its
+ * slot in the old capacity, see fifo_resize().
+ *
+ * @param[in] 	fifo	Fifo handle
+ * @param[in]	slot	Record slot, in the current capacity
+ * @return
+ * 		- <i>true</i> if key string is completely written
+ * 		- <i>false</i> if formatting error
+ */
+static bool formatRecordKey( fifo_handle_t fifo, uint16_t slot )
+{
+	struct fifo_migrate_controls_s *pCtl = &fifo->migrate.ctl;
+	uint16_t source;
+
+	if( fifo->migrate.bActive )
+	{
+		source = ( slot + pCtl->newMax - pCtl->oldMax ) % pCtl->newMax;
+		if( ( source >= pCtl->copied ) && ( source < pCtl->moveCount ) )
+		{
+			slot = source;
+		}
+	}
+
+	return formatKey( fifo, slot );
+}
 
 /************************************************************************/
 /**
- * @brief		Initialize a FIFO
- *
- *  - A FIFO is created in designated NVS <i>Partition</i> and <i>Name-space</i>.
- *  - Elements will be stored using the designated <i>keyPrefix</i>.
- *  - The maximum number of elements to be stored is <i>nItems</i>
- *  - NVS keys <i>headKey, tailKey, fullKey, maxKey</i> will be used to store the FIFO pointers
- *  - If the FIFO has been previously created, the pointers will be restored from NVS
+ * @brief	Update index sample for a record just written
  *
- * @param[in] partition		enumerated NVS Partition
- * @param[in] namespace		Namespace string
- * @param[in] keyPrefix		NVS access Key Prefix, string
- * @param[in] nItems		Number of items FIFO can hold
- * @param[in] controlKey	NVS key for storing fifo control data
- * @param[in] maxKey		NVS key for storing max pointer
+ * Only records written to a sampled slot, or at the start of a packed segment,
+ * are sampled.
  *
- * @return		FIFO handle, NULL if error encountered during initialization
+ * @param[in] fifo		Handle of FIFO, must not be NULL
+ * @param[in] position	Slot record was written to, or segment of a packed FIFO
+ * @param[in] blob		Pointer to record, NULL if slot has been erased
+ * @param[in] length	Length of record, in bytes
  */
 /************************************************************************/
-fifo_handle_t fifo_init(const NVS_Partitions_t partition, const char * namespace, const char *keyPrefix, const uint16_t nItems, NVS_Items_t controlsKey, NVS_Items_t maxKey )
+static void index_update( fifo_handle_t fifo, uint16_t position, const void *blob, size_t length )
 {
-	esp_err_t	err = ESP_OK;
+	struct fifo_index_s *pIndex = &fifo->index;
+	uint32_t value;
 
-	void *buffer = NULL;
+	if( NULL == pIndex->pSample )
+	{
+		return;
+	}
 
-	/* Allocate storage for FIFO control structure */
-	buffer = pvPortMalloc( sizeof( fifo_t ) );
+	if( 0 == fifo->packed.segmentSize )
+	{
+		if( 0 != ( position % INDEX_INTERVAL ) )
+		{
+			return;
+		}
+		position /= INDEX_INTERVAL;
+	}
 
-	if( buffer == NULL )
+	if( position < pIndex->samples )
 	{
-		IotLogError( "fifo_init: Error\n" );
-		return NULL;
+		pIndex->pSample[ position ] = ( ( NULL != blob ) && pIndex->fn( blob, length, &value ) ) ? value : INDEX_NONE;
 	}
+}
 
-	fifo_handle_t fifo = ( fifo_handle_t ) buffer;
+/************************************************************************/
+/**
+ * @brief	Save packed FIFO controls in NVS
+ *
+ * @param[in] fifo	Handle of packed FIFO
+ * @return
+ * 	- ESP_OK if controls are saved without issue
+ * 	- ESP_FAIL if error saving controls
+ */
+/************************************************************************/
+static int32_t packed_save_controls( fifo_handle_t fifo )
+{
+	size_t size = sizeof( struct fifo_packed_controls_s );
+	struct fifo_packed_controls_s *pCtl = &fifo->packed.ctl;
 
-	fifo->controlsKey = controlsKey;
-	fifo->maxKey = maxKey;
+	IotLogDebug( "packed_save_controls, head = %d:%d, tail = %d:%d, count = %d", pCtl->headSeg, pCtl->headOff, pCtl->tailSeg, pCtl->tailOff, pCtl->count );
+	return NVS_pSet( &fifo->packed.controlsEntry, pCtl, &size );
+}
 
-	fifo->entry.partition = partition;
+/**
+ * @brief	Write the head segment, from its RAM mirror, to NVS
+ */
+static int32_t packed_write_head( fifo_handle_t fifo )
+{
+	size_t length = fifo->packed.ctl.headOff;
 
-	/* Save namespace */
-	if( MAX_NAMESPACE_LENGTH > strlen( namespace ) )
-	{
-		strcpy( fifo->namespace, namespace );
-		fifo->entry.namespace = (const char *) fifo->namespace;
-	}
-	else
+	if( 0 == length )
 	{
-		IotLogError( "Namespace string is too long" );
-		err= ESP_FAIL;
+		return ESP_OK;												// nothing packed in segment yet
 	}
 
-	/* save NVS Key Prefix */
-	if( ESP_OK == err)
+	if( !formatKey( fifo, fifo->packed.ctl.headSeg ) )
 	{
-		if( MAX_KEYPREFIX_LENGTH > strlen( keyPrefix ) )
-		{
-			strcpy( fifo->keyPrefix, keyPrefix );
-		}
-		else
-		{
-			IotLogError( "keyPrefix string is too long" );
-			err= ESP_FAIL;
-		}
+		return ESP_FAIL;
 	}
 
-	fifo->entry.type = NVS_TYPE_BLOB;																	/* FIFO items are Blobs */
+	return NVS_pSet( &fifo->entry, fifo->packed.pHead, &length );
+}
 
-	/*
-	 * Restore FIFO controls from NVS Storage, set to defaults if not value not currently stored in NVS
-	 */
-	if( ESP_OK == err)
+/**
+ * @brief	Load a segment into the read buffer, if not already loaded
+ *
+ * A segment never written is not logged, as index searches read every segment;
+ * callers report segments they require.
+ */
+static int32_t packed_load( fifo_handle_t fifo, uint16_t segment )
+{
+	esp_err_t err = ESP_OK;
+	size_t length = fifo->packed.segmentSize;
+
+	if( segment != fifo->packed.readSeg )
 	{
-		err = NVS_Get( fifo->controlsKey, &fifo->controls, NULL );
-		if( err != ESP_OK )
+		fifo->packed.readSeg = PACKED_SEGMENT_NONE;
+
+		if( !formatKey( fifo, segment ) )
 		{
-			fifo->head = 0;
-			fifo->tail = 0;
-			fifo->activeTail = 0;
-			fifo->full = FIFO_NOT_FULL;
-			err = NVS_Set( fifo->controlsKey, &fifo->controls, NULL );			// Update NVS
+			err = ESP_FAIL;
 		}
-		else
+
+		if( ESP_OK == err )
 		{
-			fifo->activeTail = fifo->tail;
+			err = NVS_pGetIfPresent( &fifo->entry, fifo->packed.pRead, &length );
 		}
-	}
 
-	/*
-	 * Restore FIFO Max index from NVS Storage, use function argument nItems if not value not currently stored in NVS
-	 */
-	if( ESP_OK == err)
-	{
-		err = NVS_Get( fifo->maxKey, &fifo->max, NULL );
-		if( err != ESP_OK )
+		if( ESP_OK == err )
 		{
-			fifo->max = nItems;
-			err = NVS_Set( fifo->maxKey, &fifo->max, NULL );				// Update NVS
+			fifo->packed.readSeg = segment;
+			fifo->packed.readLen = length;
 		}
 	}
 
-	IotLogInfo( "Initializing FIFO:" );
-	IotLogInfo( "  Handle = %p", ( (uint32_t *) fifo ) );
-	IotLogInfo( "  Head = %d", fifo->head );
-	IotLogInfo( "  Tail = %d", fifo->tail );
-	IotLogInfo( "  Full = %d", fifo->full);
-	IotLogInfo( "  Max  = %d", fifo->max );
-
-	return ( ( ESP_OK == err ) ? fifo : NULL );
+	return err;
 }
 
-/************************************************************************/
 /**
- * @brief	Reset FIFO
- *
- * @param[in] fifo	FIFO handle
+ * @brief	Count packed records in a segment, from offset to end of segment
  */
-/************************************************************************/
-void fifo_reset( fifo_handle_t fifo )
+static uint16_t packed_count( const uint8_t *pSegment, size_t length, uint16_t offset )
 {
-	if( fifo == NULL )
-	{
-		IotLogError( "fifo_reset: Error\n" );
-	}
-	else
+	uint16_t count = 0;
+
+	while( ( offset + PACKED_LENGTH_SIZE ) <= length )
 	{
-		fifo->head = 0;
-		fifo->tail = 0;
-		fifo->activeTail = 0;
-		fifo->full = FIFO_NOT_FULL;
-		NVS_Set( fifo->controlsKey, &fifo->controls, NULL );			// Update NVS - FIXME: check return status
+		offset += PACKED_LENGTH_SIZE + ( pSegment[ offset ] | ( pSegment[ offset + 1 ] << 8 ) );
+		++count;
 	}
+
+	return count;
 }
 
 /************************************************************************/
 /**
- * @brief	FIFO full?
+ * @brief	Drop the tail segment, so it can be reused as the head segment
  *
- * @param[in] fifo	FIFO handle
+ * Records remaining in the tail segment are lost.  Controls are saved before
+ * the segment is overwritten, so the stored tail never references a segment
+ * holding newer records.
+ *
+ * @param[in] fifo	Handle of packed FIFO
  * @return
- *		- <i>true</i> if buffer is full
- *		- <i>false</i> if buffer is not full
+ * 	- ESP_OK if controls are saved without issue
+ * 	- ESP_FAIL if error saving controls
  */
 /************************************************************************/
-bool fifo_full( fifo_handle_t fifo )
+static int32_t packed_drop_tail( fifo_handle_t fifo )
 {
-	if( fifo == NULL )
+	struct fifo_packed_s *pPacked = &fifo->packed;
+	struct fifo_packed_controls_s *pCtl = &pPacked->ctl;
+	uint16_t nextSeg = ( pCtl->tailSeg + 1 ) % fifo->max;
+	uint16_t dropped = pCtl->count;
+	uint16_t activeDropped = pPacked->activeCount;
+
+	if( ESP_OK == packed_load( fifo, pCtl->tailSeg ) )
 	{
-		IotLogError( "fifo_full: Error\n" );
-		return true;
+		dropped = packed_count( pPacked->pRead, pPacked->readLen, pCtl->tailOff );
+		activeDropped = packed_count( pPacked->pRead, pPacked->readLen, pPacked->activeTailOff );
 	}
 	else
 	{
-		return ( FIFO_FULL == fifo->full );
+		IotLogError( "packed_drop_tail: segment %d unreadable", pCtl->tailSeg );
+	}
+
+	/* keep active tail in sync if it is in the dropped segment */
+	if( pPacked->activeTailSeg == pCtl->tailSeg )
+	{
+		pPacked->activeCount = ( activeDropped < pPacked->activeCount ) ? ( pPacked->activeCount - activeDropped ) : 0;
+		pPacked->activeTailSeg = nextSeg;
+		pPacked->activeTailOff = 0;
 	}
+
+	pCtl->count = ( dropped < pCtl->count ) ? ( pCtl->count - dropped ) : 0;
+	pCtl->tailSeg = nextSeg;
+	pCtl->tailOff = 0;
+	IotLogDebug( "packed_drop_tail, dropped = %d, tail = %d", dropped, pCtl->tailSeg );
+
+	return packed_save_controls( fifo );
 }
 
 /************************************************************************/
 /**
- * @brief	FIFO empty?
+ * @brief	Append multiple records to a packed FIFO
  *
- * @param[in] fifo	FIFO handle
+ * Records are appended to the head segment mirror in RAM, as a 16-bit length
+ * (little-endian) followed by the record data.  A record that will not fit in
+ * the remaining space closes the head segment and starts the next segment,
+ * dropping the tail segment if all segments are in use.  The head segment,
+ * and the controls, are written once for all records.
+ *
+ * If the final write fails, the appended records remain in the head segment
+ * mirror and are written with the next put.
+ *
+ * @param[in] fifo		Handle of packed FIFO
+ * @param[in] blobs		Array of pointers to records
+ * @param[in] lengths	Array of record lengths, in bytes
+ * @param[in] count		Number of records
+ * @param[out] pWritten	Number of records appended
  * @return
- *		- <i>true</i> if buffer is empty
- *		- <i>false</i> if buffer is not empty
+ * 	- ESP_OK if all records stored without error
+ * 	- ESP_FAIL if error storing records
  */
 /************************************************************************/
-bool fifo_empty( fifo_handle_t fifo )
+static int32_t packed_put_elements( fifo_handle_t fifo, const void * const blobs[], const size_t lengths[], uint16_t count, uint16_t *pWritten )
 {
-	if( fifo == NULL )
+	esp_err_t err = ESP_OK;
+	struct fifo_packed_s *pPacked = &fifo->packed;
+	struct fifo_packed_controls_s *pCtl = &pPacked->ctl;
+	uint16_t i;
+	uint16_t written = 0;
+	uint16_t nextSeg;
+	size_t length;
+
+	for( i = 0; ( ESP_OK == err ) && ( i < count ); ++i )
 	{
-		IotLogError( "fifo_empty: Error\n" );
-		return false;
-	}
-	else
+		length = lengths[ i ];
+
+		if( ( NULL == blobs[ i ] ) || ( ( length + PACKED_LENGTH_SIZE ) > pPacked->segmentSize ) )
+		{
+			IotLogError( "packed_put_elements: element %d error, length = %d", i, length );
+			err = ESP_FAIL;
+			break;
+		}
+
+		/* Close head segment if record will not fit */
+		if( ( pCtl->headOff + PACKED_LENGTH_SIZE + length ) > pPacked->segmentSize )
+		{
+			err = packed_write_head( fifo );
+			nextSeg = ( pCtl->headSeg + 1 ) % fifo->max;
+
+			if( ( ESP_OK == err ) && ( nextSeg == pCtl->tailSeg ) )
+			{
+				err = packed_drop_tail( fifo );
+			}
+
+			if( ESP_OK == err )
+			{
+				pCtl->headSeg = nextSeg;
+				pCtl->headOff = 0;
+				if( pPacked->readSeg == nextSeg )
+				{
+					pPacked->readSeg = PACKED_SEGMENT_NONE;				// segment is about to be overwritten
+				}
+			}
+		}
+
+		if( ESP_OK == err )
+		{
+			if( 0 == pCtl->headOff )
+			{
+				index_update( fifo, pCtl->headSeg, blobs[ i ], length );
+			}
+			pPacked->pHead[ pCtl->headOff++ ] = ( uint8_t )( length & 0xFF );
+			pPacked->pHead[ pCtl->headOff++ ] = ( uint8_t )( length >> 8 );
+			memcpy( &pPacked->pHead[ pCtl->headOff ], blobs[ i ], length );
+			pCtl->headOff += length;
+			++pCtl->count;
+			++pPacked->activeCount;
+			++written;
+		}
+	}
+
+	/* Write head segment and controls once for all records appended */
+	if( 0 < written )
+	{
+		if( ( ESP_OK != packed_write_head( fifo ) ) || ( ESP_OK != packed_save_controls( fifo ) ) )
+		{
+			IotLogError( "packed_put_elements: error saving head segment" );
+			err = ESP_FAIL;
+		}
+	}
+
+	*pWritten = written;
+
+	return err;
+}
+
+/************************************************************************/
+/**
+ * @brief	Get next record from a packed FIFO
+ *
+ * Records are read from the head segment mirror, or from the read buffer,
+ * which is only reloaded from NVS when the active tail moves to a new segment.
+ *
+ * @param[in]		fifo	Handle of packed FIFO
+ * @param[out]		blob	Destination pointer
+ * @param[in|out]	pLength	Length of destination buffer as input, number of bytes copied as output
+ * @return
+ * 	- ESP_OK if next record retrieved without error
+ * 	- ESP_ERR_NVS_INVALID_LENGTH if record does not fit destination buffer, not logged
+ * 	- ESP_FAIL if error retrieving record
+ */
+/************************************************************************/
+static int32_t packed_get( fifo_handle_t fifo, void* blob, size_t *pLength )
+{
+	esp_err_t err = ESP_OK;
+	struct fifo_packed_s *pPacked = &fifo->packed;
+	uint16_t segment = pPacked->activeTailSeg;
+	uint16_t offset = pPacked->activeTailOff;
+	const uint8_t *pSegment = NULL;
+	size_t segmentLength = 0;
+	size_t length;
+
+	/* Locate next record, moving to next segment if active tail is at end of segment */
+	while( ESP_OK == err )
+	{
+		if( segment == pPacked->ctl.headSeg )
+		{
+			pSegment = pPacked->pHead;
+			segmentLength = pPacked->ctl.headOff;
+		}
+		else
+		{
+			err = packed_load( fifo, segment );
+			if( ESP_OK != err )
+			{
+				IotLogError( "packed_get: segment %d unreadable", segment );
+			}
+			pSegment = pPacked->pRead;
+			segmentLength = pPacked->readLen;
+		}
+
+		if( ( ESP_OK != err ) || ( ( offset + PACKED_LENGTH_SIZE ) <= segmentLength ) )
+		{
+			break;													// error, or record found
+		}
+
+		if( segment == pPacked->ctl.headSeg )
+		{
+			IotLogError( "packed_get: count mismatch, %d", pPacked->activeCount );
+			pPacked->activeCount = 0;								// reached head, no more records
+			err = ESP_FAIL;
+		}
+		else
+		{
+			segment = ( segment + 1 ) % fifo->max;
+			offset = 0;
+		}
+	}
+
+	if( ESP_OK == err )
+	{
+		length = pSegment[ offset ] | ( pSegment[ offset + 1 ] << 8 );
+
+		if( ( offset + PACKED_LENGTH_SIZE + length ) > segmentLength )
+		{
+			IotLogError( "packed_get: corrupt segment %d", segment );
+			err = ESP_FAIL;
+		}
+		else if( length > *pLength )
+		{
+			err = ESP_ERR_NVS_INVALID_LENGTH;						// caller reports, unless expected
+		}
+		else
+		{
+			memcpy( blob, &pSegment[ offset + PACKED_LENGTH_SIZE ], length );
+			*pLength = length;
+			pPacked->activeTailSeg = segment;
+			pPacked->activeTailOff = offset + PACKED_LENGTH_SIZE + length;
+			--pPacked->activeCount;
+		}
+	}
+
+	return err;
+}
+
+/**
+ * @brief	Reset packed FIFO controls, in RAM
+ */
+static void packed_reset( fifo_handle_t fifo )
+{
+	uint16_t segmentSize = fifo->packed.segmentSize;
+
+	memset( &fifo->packed.ctl, 0, sizeof( fifo->packed.ctl ) );
+	fifo->packed.ctl.segmentSize = segmentSize;
+	fifo->packed.activeTailSeg = 0;
+	fifo->packed.activeTailOff = 0;
+	fifo->packed.activeCount = 0;
+	fifo->packed.readSeg = PACKED_SEGMENT_NONE;
+}
+
+/**
+ * @brief	Get a packed segment, from the head segment mirror or the read buffer
+ *
+ * @return	Pointer to segment, NULL if segment cannot be read
+ */
+static const uint8_t *packed_segment( fifo_handle_t fifo, uint16_t segment, size_t *pLength )
+{
+	if( segment == fifo->packed.ctl.headSeg )
+	{
+		*pLength = fifo->packed.ctl.headOff;
+		return fifo->packed.pHead;
+	}
+
+	if( ESP_OK != packed_load( fifo, segment ) )
+	{
+		return NULL;
+	}
+
+	*pLength = fifo->packed.readLen;
+	return fifo->packed.pRead;
+}
+
+/************************************************************************/
+/**
+ * @brief	Rebuild index samples from records stored in NVS
+ *
+ * One record is read per INDEX_INTERVAL slots, or one segment per segment of a
+ * packed FIFO.  Slots never written, or holding records larger than the scratch
+ * buffer, are not sampled.
+ *
+ * @param[in] fifo			Handle of FIFO, index table allocated
+ * @param[in] pScratch		Buffer to read records into, not used for a packed FIFO
+ * @param[in] scratchSize	Size of scratch buffer, in bytes
+ */
+/************************************************************************/
+static void index_rebuild( fifo_handle_t fifo, uint8_t *pScratch, size_t scratchSize )
+{
+	struct fifo_index_s *pIndex = &fifo->index;
+	const uint8_t *pSegment;
+	size_t length;
+	size_t recordLength;
+	uint16_t i;
+
+	for( i = 0; i < pIndex->samples; ++i )
+	{
+		pIndex->pSample[ i ] = INDEX_NONE;
+
+		if( 0 < fifo->packed.segmentSize )
+		{
+			pSegment = packed_segment( fifo, i, &length );
+			if( ( NULL != pSegment ) && ( PACKED_LENGTH_SIZE <= length ) )
+			{
+				recordLength = pSegment[ 0 ] | ( pSegment[ 1 ] << 8 );
+				if( ( PACKED_LENGTH_SIZE + recordLength ) <= length )
+				{
+					index_update( fifo, i, &pSegment[ PACKED_LENGTH_SIZE ], recordLength );
+				}
+			}
+		}
+		else
+		{
+			/* Slots never written are not stored, until the FIFO first wraps */
+			length = scratchSize;
+			if( formatRecordKey( fifo, i * INDEX_INTERVAL ) && ( ESP_OK == NVS_pGetIfPresent( &fifo->entry, pScratch, &length ) ) )
+			{
+				index_update( fifo, i * INDEX_INTERVAL, pScratch, length );
+			}
+		}
+	}
+}
+
+/************************************************************************/
+/**
+ * @brief	Allocate index samples for the FIFO capacity, and rebuild them
+ *
+ * Caller must hold cache and cursor mutexes.
+ *
+ * @param[in] fifo	Handle of FIFO, index extractor set
+ * @return
+ * 	- ESP_OK if index is allocated and rebuilt
+ * 	- ESP_FAIL if error allocating index
+ */
+/************************************************************************/
+static int32_t index_alloc( fifo_handle_t fifo )
+{
+	esp_err_t err = ESP_OK;
+	struct fifo_index_s *pIndex = &fifo->index;
+	uint8_t *pScratch = NULL;
+
+	vPortFree( pIndex->pSample );
+	pIndex->samples = ( 0 < fifo->packed.segmentSize ) ? fifo->max : ( ( fifo->max + INDEX_INTERVAL - 1 ) / INDEX_INTERVAL );
+	pIndex->pSample = pvPortMalloc( pIndex->samples * sizeof( uint32_t ) );
+
+	if( 0 == fifo->packed.segmentSize )
+	{
+		pScratch = pvPortMalloc( pIndex->maxRecordSize );
+	}
+
+	if( ( NULL == pIndex->pSample ) || ( ( 0 == fifo->packed.segmentSize ) && ( NULL == pScratch ) ) )
+	{
+		IotLogError( "index_alloc: Error allocating index" );
+		vPortFree( pIndex->pSample );
+		pIndex->pSample = NULL;
+		err = ESP_FAIL;
+	}
+	else
+	{
+		index_rebuild( fifo, pScratch, pIndex->maxRecordSize );
+	}
+
+	vPortFree( pScratch );
+
+	return err;
+}
+
+/************************************************************************/
+/**
+ * @brief	Find the history position to start a range search from
+ *
+ * Positions count from the oldest retained slot, or segment.  The search starts at
+ * the last sample not beyond <i>first</i>.  If no such sample exists, the search
+ * starts after the last unavailable sample, skipping slots never written.
+ *
+ * @param[in] fifo		Handle of indexed FIFO
+ * @param[in] oldest	Oldest retained slot, or segment of a packed FIFO
+ * @param[in] interval	Slots per sample, 1 for a packed FIFO
+ * @param[in] first		First record Index requested
+ * @return		History position to start search from
+ */
+/************************************************************************/
+static uint16_t index_start( fifo_handle_t fifo, uint16_t oldest, uint16_t interval, uint32_t first )
+{
+	uint16_t position;
+	uint16_t slot;
+	uint16_t start = 0;
+	uint32_t value;
+	bool bFound = false;
+
+	for( position = 0; position < fifo->max; ++position )
+	{
+		slot = ( oldest + position ) % fifo->max;
+		if( 0 != ( slot % interval ) )
+		{
+			continue;
+		}
+
+		value = fifo->index.pSample[ slot / interval ];
+		if( INDEX_NONE == value )
+		{
+			if( !bFound )
+			{
+				start = position + 1;
+			}
+		}
+		else if( value <= first )
+		{
+			start = position;
+			bFound = true;
+		}
+		else
+		{
+			break;													// samples beyond first
+		}
+	}
+
+	return start;
+}
+
+/************************************************************************/
+/**
+ * @brief	Read records in an Index range from a record FIFO
+ *
+ * Slots are read in history order, oldest first, starting from the index sample
+ * nearest the range.  Reading stops at a full buffer, or a read error.  Caller
+ * must hold cursor mutex.
+ */
+/************************************************************************/
+static void index_read_records( fifo_handle_t fifo, uint32_t first, uint32_t last, uint8_t *pBuffer, size_t bufferSize, size_t lengths[], uint16_t *pCount )
+{
+	esp_err_t err = ESP_OK;
+	uint16_t max = *pCount;
+	uint16_t position;
+	size_t offset = 0;
+	size_t length;
+	uint32_t value;
+
+	*pCount = 0;
+
+	for( position = index_start( fifo, fifo->head, INDEX_INTERVAL, first ); ( position < fifo->max ) && ( *pCount < max ); ++position )
+	{
+		if( !formatRecordKey( fifo, ( fifo->head + position ) % fifo->max ) )
+		{
+			err = ESP_FAIL;
+			break;
+		}
+
+		length = bufferSize - offset;
+		err = NVS_pGetIfFits( &fifo->entry, &pBuffer[ offset ], &length );
+		if( ESP_ERR_NVS_NOT_FOUND == err )
+		{
+			err = ESP_OK;											// slot never written
+			continue;
+		}
+		else if( ESP_ERR_NVS_INVALID_LENGTH == err )
+		{
+			err = ESP_OK;											// buffer full
+			break;
+		}
+		else if( ESP_OK != err )
+		{
+			IotLogError( "fifo_readRange: error reading slot %d", ( fifo->head + position ) % fifo->max );
+			break;
+		}
+
+		if( !fifo->index.fn( &pBuffer[ offset ], length, &value ) || ( value < first ) )
+		{
+			continue;
+		}
+
+		if( value > last )
+		{
+			break;
+		}
+
+		lengths[ ( *pCount )++ ] = length;
+		offset += length;
+	}
+}
+
+/************************************************************************/
+/**
+ * @brief	Read records in an Index range from a packed FIFO
+ *
+ * Segments are read in history order, oldest first, starting from the segment
+ * whose first record is nearest the range.  Segments that cannot be read are
+ * skipped.
+ */
+/************************************************************************/
+static void index_read_packed( fifo_handle_t fifo, uint32_t first, uint32_t last, uint8_t *pBuffer, size_t bufferSize, size_t lengths[], uint16_t *pCount )
+{
+	uint16_t max = *pCount;
+	uint16_t oldest = ( fifo->packed.ctl.headSeg + 1 ) % fifo->max;
+	uint16_t position;
+	const uint8_t *pSegment;
+	size_t segmentLength;
+	size_t offset;
+	size_t used = 0;
+	size_t length;
+	uint32_t value;
+	bool bDone = false;
+
+	*pCount = 0;
+
+	for( position = index_start( fifo, oldest, 1, first ); ( position < fifo->max ) && !bDone; ++position )
+	{
+		pSegment = packed_segment( fifo, ( oldest + position ) % fifo->max, &segmentLength );
+		if( NULL == pSegment )
+		{
+			continue;												// segment never written
+		}
+
+		for( offset = 0; ( offset + PACKED_LENGTH_SIZE ) <= segmentLength; offset += PACKED_LENGTH_SIZE + length )
+		{
+			length = pSegment[ offset ] | ( pSegment[ offset + 1 ] << 8 );
+			if( ( offset + PACKED_LENGTH_SIZE + length ) > segmentLength )
+			{
+				break;												// corrupt segment
+			}
+
+			if( !fifo->index.fn( &pSegment[ offset + PACKED_LENGTH_SIZE ], length, &value ) || ( value < first ) )
+			{
+				continue;
+			}
+
+			if( ( value > last ) || ( *pCount >= max ) || ( length > ( bufferSize - used ) ) )
+			{
+				bDone = true;
+				break;
+			}
+
+			memcpy( &pBuffer[ used ], &pSegment[ offset + PACKED_LENGTH_SIZE ], length );
+			lengths[ ( *pCount )++ ] = length;
+			used += length;
+		}
+	}
+}
+
+/**
+ * @brief	Take cursor mutex, guarding FIFO pointers shared by readers and writers
+ */
+static void cursor_lock( fifo_handle_t fifo )
+{
+	if( NULL != fifo->cursors.mutex )
+	{
+		xSemaphoreTake( fifo->cursors.mutex, portMAX_DELAY );
+	}
+}
+
+/**
+ * @brief	Give cursor mutex
+ */
+static void cursor_unlock( fifo_handle_t fifo )
+{
+	if( NULL != fifo->cursors.mutex )
+	{
+		xSemaphoreGive( fifo->cursors.mutex );
+	}
+}
+
+/**
+ * @brief	Number of records stored, from tail to head
+ */
+static uint16_t stored_count( fifo_handle_t fifo )
+{
+	return ( fifo->full ) ? fifo->max : ( ( fifo->head + fifo->max - fifo->tail ) % fifo->max );
+}
+
+/************************************************************************/
+/**
+ * @brief	Save cursor controls in NVS
+ *
+ * Cursor offsets are saved with the tail they are relative to, so offsets can be
+ * corrected on restore if the tail has since been advanced, by overwriting or by
+ * a commit interrupted before the cursor controls were saved.
+ *
+ * @param[in] fifo	Handle of FIFO
+ * @return
+ * 	- ESP_OK if cursor controls are saved without issue
+ * 	- ESP_FAIL if error saving cursor controls
+ */
+/************************************************************************/
+static int32_t cursors_save( fifo_handle_t fifo )
+{
+	size_t size = sizeof( struct fifo_cursor_controls_s );
+
+	fifo->cursors.ctl.baseTail = fifo->tail;
+	fifo->cursors.dropped = 0;
+
+	return NVS_pSet( &fifo->cursors.entry, &fifo->cursors.ctl, &size );
+}
+
+/**
+ * @brief	Save cursor controls once overwriting has moved the tail half way round the FIFO
+ *
+ * A tail that has moved a complete lap since the cursor controls were saved
+ * could not be distinguished from one that has not moved.
+ */
+static int32_t cursors_save_if_due( fifo_handle_t fifo )
+{
+	if( fifo->cursors.bActive && ( fifo->cursors.dropped >= ( fifo->max / 2 ) ) )
+	{
+		return cursors_save( fifo );
+	}
+
+	return ESP_OK;
+}
+
+/**
+ * @brief	Set up cursor table and NVS entry
+ */
+static int32_t cursors_setup( fifo_handle_t fifo )
+{
+	struct fifo_cursors_s *pCursors = &fifo->cursors;
+	int n;
+	int i;
+
+	n = snprintf( pCursors->key, sizeof( pCursors->key ), "%s%s", fifo->keyPrefix, CURSOR_CONTROLS_SUFFIX );
+	if( ( 0 > n ) || ( sizeof( pCursors->key ) <= n ) )
+	{
+		IotLogError( "cursors_setup: key error" );
+		return ESP_FAIL;
+	}
+	pCursors->entry = fifo->entry;
+	pCursors->entry.nvsKey = pCursors->key;
+
+	for( i = 0; i < CURSOR_SLOTS; ++i )
+	{
+		pCursors->cursor[ i ].fifo = fifo;
+		pCursors->cursor[ i ].slot = i;
+	}
+
+	return ESP_OK;
+}
+
+/************************************************************************/
+/**
+ * @brief	Restore cursors from NVS
+ *
+ * Cursors are only activated if at least one named cursor is stored.  Offsets are
+ * corrected for any tail movement since they were saved.
+ *
+ * @param[in] fifo	Handle of FIFO, controls and max already restored
+ */
+/************************************************************************/
+static void cursors_load( fifo_handle_t fifo )
+{
+	struct fifo_cursors_s *pCursors = &fifo->cursors;
+	size_t size = sizeof( pCursors->ctl );
+	esp_err_t err;
+	uint16_t delta;
+	uint16_t used;
+	int i;
+
+	pCursors->bActive = false;
+
+	/* Cursor controls are only stored once a named cursor has been opened */
+	err = NVS_pGetIfPresent( &pCursors->entry, &pCursors->ctl, &size );
+	if( ( ESP_OK == err ) && ( sizeof( pCursors->ctl ) == size ) && ( fifo->max > pCursors->ctl.baseTail ) )
+	{
+		for( i = 1; i < CURSOR_SLOTS; ++i )
+		{
+			pCursors->ctl.name[ i ][ FIFO_CURSOR_NAME_LENGTH - 1 ] = '\0';
+			if( '\0' != pCursors->ctl.name[ i ][ 0 ] )
+			{
+				pCursors->bActive = true;
+			}
+		}
+	}
+	else if( ESP_ERR_NVS_NOT_FOUND != err )
+	{
+		IotLogError( "cursors_load: invalid cursor controls, discarded" );
+	}
+
+	if( !pCursors->bActive )
+	{
+		memset( &pCursors->ctl, 0, sizeof( pCursors->ctl ) );
+		return;
+	}
+
+	delta = ( fifo->tail + fifo->max - pCursors->ctl.baseTail ) % fifo->max;
+	used = stored_count( fifo );
+
+	for( i = 0; i < CURSOR_SLOTS; ++i )
+	{
+		pCursors->ctl.offset[ i ] = ( pCursors->ctl.offset[ i ] > delta ) ? ( pCursors->ctl.offset[ i ] - delta ) : 0;
+		if( pCursors->ctl.offset[ i ] > used )
+		{
+			pCursors->ctl.offset[ i ] = used;
+		}
+		pCursors->cursor[ i ].activeOffset = pCursors->ctl.offset[ i ];
+	}
+	pCursors->ctl.baseTail = fifo->tail;
+
+	IotLogInfo( "  Cursors restored, default offset = %d", pCursors->ctl.offset[ CURSOR_DEFAULT ] );
+}
+
+/**
+ * @brief	Is cursor slot in use?
+ */
+static bool cursor_in_use( fifo_handle_t fifo, uint16_t slot )
+{
+	return ( CURSOR_DEFAULT == slot ) || ( '\0' != fifo->cursors.ctl.name[ slot ][ 0 ] );
+}
+
+/************************************************************************/
+/**
+ * @brief	Advance tail to the slowest cursor
+ *
+ * Records committed by every cursor are released, and all offsets rebased
+ * to the new tail.  Controls are only updated in RAM.
+ *
+ * @param[in] fifo	Handle of FIFO, with active cursors
+ * @return		Number of records released
+ */
+/************************************************************************/
+static uint16_t cursors_release( fifo_handle_t fifo )
+{
+	struct fifo_cursors_s *pCursors = &fifo->cursors;
+	uint16_t release = pCursors->ctl.offset[ CURSOR_DEFAULT ];
+	int i;
+
+	for( i = 1; i < CURSOR_SLOTS; ++i )
+	{
+		if( cursor_in_use( fifo, i ) && ( pCursors->ctl.offset[ i ] < release ) )
+		{
+			release = pCursors->ctl.offset[ i ];
+		}
+	}
+
+	if( 0 < release )
+	{
+		fifo->tail = ( fifo->tail + release ) % fifo->max;
+		fifo->full = FIFO_NOT_FULL;
+		cursors_drop( fifo, release );
+		pCursors->dropped -= release;								// released, not overwritten
+	}
+
+	fifo->activeTail = ( fifo->tail + pCursors->cursor[ CURSOR_DEFAULT ].activeOffset ) % fifo->max;
+
+	return release;
+}
+
+/************************************************************************/
+/**
+ * @brief	Commit or abort a cursor read, caller must hold cursor mutex
+ *
+ * If the tail advances, FIFO controls are saved before cursor controls.  A power
+ * loss between the two leaves the cursor controls relative to the old tail, which
+ * cursors_load() corrects for; only the committing cursor's read is repeated.
+ */
+/************************************************************************/
+static int32_t cursor_commit( fifo_cursor_handle_t cursor, bool commit )
+{
+	esp_err_t err = ESP_OK;
+	fifo_handle_t fifo = cursor->fifo;
+
+	if( commit )
+	{
+		fifo->cursors.ctl.offset[ cursor->slot ] = cursor->activeOffset;
+		if( 0 < cursors_release( fifo ) )
+		{
+			err = save_controls( fifo );
+		}
+
+		if( ESP_OK == err )
+		{
+			err = cursors_save( fifo );
+		}
+	}
+	else
+	{
+		cursor->activeOffset = fifo->cursors.ctl.offset[ cursor->slot ];		// abort read, restore active offset
+	}
+
+	return err;
+}
+
+/**
+ * @brief	Get next record for a cursor, caller must hold cursor mutex
+ *
+ * A record too large for the destination buffer returns ESP_ERR_NVS_INVALID_LENGTH,
+ * not logged, and is left to be read again.
+ */
+static int32_t cursor_get( fifo_cursor_handle_t cursor, void* blob, size_t *pLength )
+{
+	esp_err_t err = ESP_OK;
+	fifo_handle_t fifo = cursor->fifo;
+
+	if( cursor->activeOffset >= stored_count( fifo ) )
+	{
+		IotLogInfo( "fifo_cursorGet: empty" );
+		err = ESP_FAIL;
+	}
+
+	if( ( ESP_OK == err ) && !formatRecordKey( fifo, ( fifo->tail + cursor->activeOffset ) % fifo->max ) )
+	{
+		err = ESP_FAIL;
+	}
+
+	if( ESP_OK == err )
+	{
+		err = NVS_pGetIfFits( &fifo->entry, blob, pLength );
+	}
+
+	if( ESP_OK == err )
+	{
+		++cursor->activeOffset;
+	}
+
+	return err;
+}
+
+/**
+ * @brief	Is cursor handle valid?
+ */
+static bool cursor_valid( fifo_cursor_handle_t cursor )
+{
+	return ( NULL != cursor ) && ( NULL != cursor->fifo ) && cursor->fifo->cursors.bActive && cursor_in_use( cursor->fifo, cursor->slot );
+}
+
+/**
+ * @brief	Get next element from the FIFO read position, for fifo_get() and fifo_getBatch()
+ *
+ * An element too large for the destination buffer returns ESP_ERR_NVS_INVALID_LENGTH,
+ * not logged, and is left to be read again.
+ */
+static int32_t get_next( fifo_handle_t fifo, void* blob, size_t *pLength )
+{
+	esp_err_t	err = ESP_OK;
+
+	/* Key and entry, or head segment and count, are shared with putting task, and a put may move records during a resize */
+	cursor_lock( fifo );
+
+	if( 0 < fifo->packed.segmentSize )
+	{
+		if( 0 == fifo->packed.activeCount )
+		{
+			IotLogInfo( "fifo_get: empty" );
+			err = ESP_FAIL;
+		}
+		else
+		{
+			err = packed_get( fifo, blob, pLength );
+		}
+	}
+	else if( fifo->cursors.bActive )
+	{
+		err = cursor_get( &fifo->cursors.cursor[ CURSOR_DEFAULT ], blob, pLength );
+	}
+	else
+	{
+		if( fifo_empty( fifo ) )
+		{
+			IotLogInfo( "fifo_get: empty" );
+			err = ESP_FAIL;
+		}
+
+		if( ( ESP_OK == err ) && !formatRecordKey( fifo, fifo->activeTail ) )
+		{
+			IotLogError( "fifo_get: key format error" );
+			err = ESP_FAIL;
+		}
+
+		if( ESP_OK == err )
+		{
+			err = NVS_pGetIfFits( &fifo->entry, blob, pLength );
+		}
+
+		if( ESP_OK == err )
+		{
+			err = retreat_pointer( fifo );
+		}
+	}
+
+	cursor_unlock( fifo );
+
+	return err;
+}
+
+/**
+ * @brief	Save resize journal in NVS
+ */
+static int32_t migrate_save( fifo_handle_t fifo )
+{
+	size_t size = sizeof( struct fifo_migrate_controls_s );
+
+	return NVS_pSet( &fifo->migrate.entry, &fifo->migrate.ctl, &size );
+}
+
+/**
+ * @brief	End resize, once all records are moved, or the FIFO is reset
+ */
+static void migrate_end( fifo_handle_t fifo )
+{
+	esp_err_t err = NVS_pErase( &fifo->migrate.entry );
+
+	if( ( ESP_OK != err ) && ( ESP_ERR_NVS_NOT_FOUND != err ) )
+	{
+		IotLogError( "migrate_end: error erasing journal" );		// completed again on next fifo_init()
+	}
+
+	fifo->migrate.bActive = false;
+	IotLogInfo( "FIFO resize complete, max = %d", fifo->max );
+}
+
+/************************************************************************/
+/**
+ * @brief	Apply controls and max of a resize journal
+ *
+ * Controls, then max, are saved for the new capacity, then the journal is moved
+ * to eMigrateMove.  A power loss before the journal is saved repeats this step
+ * in fifo_init(); controls saved later are never replaced by the journal.
+ *
+ * @param[in] fifo	Handle of FIFO, journal in eMigrateStart
+ * @return
+ * 	- ESP_OK if controls, max and journal are saved without issue
+ * 	- ESP_FAIL if error saving
+ */
+/************************************************************************/
+static int32_t migrate_apply( fifo_handle_t fifo )
+{
+	esp_err_t err;
+	struct fifo_migrate_controls_s *pCtl = &fifo->migrate.ctl;
+
+	fifo->controls = pCtl->controls;
+	fifo->max = pCtl->newMax;
+
+	err = save_controls( fifo );
+
+	if( ESP_OK == err )
+	{
+		err = NVS_Set( fifo->maxKey, &fifo->max, NULL );
+	}
+
+	if( ESP_OK == err )
+	{
+		pCtl->state = eMigrateMove;
+		err = migrate_save( fifo );
+		if( ESP_OK != err )
+		{
+			pCtl->state = eMigrateStart;
+		}
+	}
+
+	return err;
+}
+
+/************************************************************************/
+/**
+ * @brief	Move records to their slots in the new capacity
+ *
+ * Records are moved in slot order.  Each record is written to its new slot,
+ * then erased from its old slot, then progress saved.  A power loss repeats, at
+ * most, the record being moved; an old slot found erased has already been moved.
+ * A record is only ever moved into an old slot that has already been moved.
+ * Caller must hold cursor mutex.
+ *
+ * @param[in] fifo	Handle of FIFO, with a resize in progress
+ * @param[in] upTo	Move records until this many have been moved
+ * @return
+ * 	- ESP_OK if records are moved without issue
+ * 	- ESP_FAIL if error moving a record
+ */
+/************************************************************************/
+static int32_t migrate_copy( fifo_handle_t fifo, uint32_t upTo )
+{
+	esp_err_t err = ESP_OK;
+	struct fifo_migrate_controls_s *pCtl = &fifo->migrate.ctl;
+	uint8_t *pRecord;
+	uint32_t size = 0;
+	size_t length = 0;
+	uint16_t target;
+
+	if( eMigrateStart == pCtl->state )
+	{
+		err = migrate_apply( fifo );
+	}
+
+	if( upTo > pCtl->moveCount )
+	{
+		upTo = pCtl->moveCount;
+	}
+
+	while( ( ESP_OK == err ) && ( pCtl->copied < upTo ) )
+	{
+		pRecord = NULL;
+		target = ( pCtl->copied + pCtl->oldMax ) % pCtl->newMax;
+
+		/* Read record from its old slot */
+		err = formatKey( fifo, pCtl->copied ) ? NVS_pGet_Size_Of( &fifo->entry, &size ) : ESP_FAIL;
+		if( ESP_OK == err )
+		{
+			pRecord = pvPortMalloc( size );
+			length = size;
+			err = ( NULL != pRecord ) ? NVS_pGet( &fifo->entry, pRecord, &length ) : ESP_FAIL;
+		}
+
+		/* Write it to its new slot, then erase the old slot */
+		if( ESP_OK == err )
+		{
+			err = formatKey( fifo, target ) ? NVS_pSet( &fifo->entry, pRecord, &length ) : ESP_FAIL;
+		}
+
+		if( ( ESP_OK == err ) && formatKey( fifo, pCtl->copied ) && ( ESP_OK != NVS_pErase( &fifo->entry ) ) )
+		{
+			IotLogWarn( "migrate_copy: slot %d not erased", pCtl->copied );
+		}
+
+		if( ESP_OK == err )
+		{
+			index_update( fifo, target, pRecord, length );
+			index_update( fifo, pCtl->copied, NULL, 0 );
+		}
+		else if( ESP_ERR_NVS_NOT_FOUND == err )
+		{
+			err = ESP_OK;											// erased by a move interrupted by power loss
+		}
+
+		vPortFree( pRecord );
+
+		if( ESP_OK == err )
+		{
+			++pCtl->copied;
+			err = migrate_save( fifo );
+			if( ESP_OK != err )
+			{
+				--pCtl->copied;										// old slot may become a new slot, keep saved progress
+			}
+		}
+	}
+
+	if( ESP_OK != err )
+	{
+		IotLogError( "migrate_copy: error moving slot %d", pCtl->copied );
+	}
+	else if( pCtl->copied == pCtl->moveCount )
+	{
+		migrate_end( fifo );
+	}
+
+	return err;
+}
+
+/************************************************************************/
+/**
+ * @brief	Move any records a put to a slot depends on, during a resize
+ *
+ * The slot may still hold a record not yet moved, or may be the new slot of a
+ * record not yet moved.  Caller must hold cursor mutex.
+ *
+ * @param[in] fifo	Handle of FIFO
+ * @param[in] slot	Slot about to be written
+ * @return
+ * 	- ESP_OK if no resize in progress, or records moved without issue
+ * 	- ESP_FAIL if error moving records
+ */
+/************************************************************************/
+static int32_t migrate_prepare_write( fifo_handle_t fifo, uint16_t slot )
+{
+	struct fifo_migrate_controls_s *pCtl = &fifo->migrate.ctl;
+	uint32_t upTo = 0;
+	uint16_t source;
+
+	if( !fifo->migrate.bActive )
+	{
+		return ESP_OK;
+	}
+
+	if( slot < pCtl->moveCount )
+	{
+		upTo = slot + 1;											// slot holds a record to be moved
+	}
+
+	source = ( slot + pCtl->newMax - pCtl->oldMax ) % pCtl->newMax;
+	if( ( source < pCtl->moveCount ) && ( ( source + 1 ) > upTo ) )
+	{
+		upTo = source + 1;											// slot is the new slot of a record to be moved
+	}
+
+	return migrate_copy( fifo, upTo );
+}
+
+/**
+ * @brief	Set up resize journal NVS entry
+ */
+static int32_t migrate_setup( fifo_handle_t fifo )
+{
+	struct fifo_migrate_s *pMigrate = &fifo->migrate;
+	int n;
+
+	n = snprintf( pMigrate->key, sizeof( pMigrate->key ), "%s%s", fifo->keyPrefix, MIGRATE_CONTROLS_SUFFIX );
+	if( ( 0 > n ) || ( sizeof( pMigrate->key ) <= n ) )
+	{
+		IotLogError( "migrate_setup: key error" );
+		return ESP_FAIL;
+	}
+	pMigrate->entry = fifo->entry;
+	pMigrate->entry.nvsKey = pMigrate->key;
+
+	return ESP_OK;
+}
+
+/************************************************************************/
+/**
+ * @brief	Resume a resize interrupted by a power loss
+ *
+ * Controls and max are completed for the new capacity if needed, and any record
+ * move interrupted by the power loss is completed, so every record can be read.
+ *
+ * @param[in] fifo	Handle of FIFO, controls and max already restored
+ * @return
+ * 	- ESP_OK if no resize is stored, or resize resumed without issue
+ * 	- ESP_FAIL if error saving controls
+ */
+/************************************************************************/
+static int32_t migrate_load( fifo_handle_t fifo )
+{
+	esp_err_t err = ESP_OK;
+	struct fifo_migrate_s *pMigrate = &fifo->migrate;
+	size_t size = sizeof( pMigrate->ctl );
+
+	/* Journal is only stored while a resize is in progress */
+	err = NVS_pGetIfPresent( &pMigrate->entry, &pMigrate->ctl, &size );
+	if( ESP_ERR_NVS_NOT_FOUND == err )
+	{
+		return ESP_OK;												// no resize in progress
+	}
+
+	if( ( ESP_OK != err ) || ( sizeof( pMigrate->ctl ) != size ) )
+	{
+		IotLogError( "migrate_load: unreadable journal, ignored" );
+		return ESP_OK;
+	}
+
+	if( ( ( eMigrateStart != pMigrate->ctl.state ) && ( eMigrateMove != pMigrate->ctl.state ) ) ||
+		( pMigrate->ctl.newMax <= pMigrate->ctl.oldMax ) || ( FIFO_MAX_ITEMS < pMigrate->ctl.newMax ) ||
+		( pMigrate->ctl.oldMax < pMigrate->ctl.moveCount ) || ( pMigrate->ctl.moveCount < pMigrate->ctl.copied ) )
+	{
+		IotLogError( "migrate_load: invalid journal, discarded" );
+		migrate_end( fifo );
+		return ESP_OK;
+	}
+
+	IotLogInfo( "  Resuming resize, %d to %d, moved %d of %d", pMigrate->ctl.oldMax, pMigrate->ctl.newMax, pMigrate->ctl.copied, pMigrate->ctl.moveCount );
+
+	pMigrate->bActive = true;
+	err = migrate_copy( fifo, pMigrate->ctl.copied + 1 );
+
+	return err;
+}
+
+/************************************************************************/
+/**
+ * @brief	Write multiple Blobs to NVS, save controls once
+ *
+ * Packed FIFOs are dispatched to packed_put_elements().
+ * Elements and controls are written within a single NVS transaction, elements first,
+ * so controls never refer to an element that has not been written.
+ *
+ * @param[in] fifo		Handle of FIFO, must not be NULL
+ * @param[in] blobs		Array of pointers to Blobs
+ * @param[in] lengths	Array of Blob lengths, in bytes
+ * @param[in] count		Number of Blobs
+ * @param[out] pWritten	Number of Blobs written, and committed, to NVS
+ * @return
+ * 	- ESP_OK if all elements stored without error
+ * 	- ESP_FAIL if error storing elements
+ */
+/************************************************************************/
+static int32_t put_elements( fifo_handle_t fifo, const void * const blobs[], const size_t lengths[], uint16_t count, uint16_t *pWritten )
+{
+	esp_err_t err = ESP_OK;
+	uint16_t i;
+	uint16_t written = 0;
+	size_t length;
+
+	bool bTxn = ( ESP_OK == NVS_BeginTxn() );
+
+	if( 0 < fifo->packed.segmentSize )
+	{
+		cursor_lock( fifo );
+		err = packed_put_elements( fifo, blobs, lengths, count, pWritten );
+		cursor_unlock( fifo );
+		if( bTxn && ( ESP_OK != NVS_Commit() ) )
+		{
+			err = ESP_FAIL;
+		}
+		return err;
+	}
+
+	cursor_lock( fifo );
+
+	if( 0 < count )
+	{
+		err = drop_oldest( fifo, count );
+	}
+
+	for( i = 0; ( ESP_OK == err ) && ( i < count ); ++i )
+	{
+		if( ( NULL == blobs[ i ] ) || ( ESP_OK != migrate_prepare_write( fifo, fifo->head ) ) || !formatKey( fifo, fifo->head ) )
+		{
+			IotLogError( "put_elements: element %d error", i );
+			err = ESP_FAIL;
+		}
+
+		if( ESP_OK == err )
+		{
+			length = lengths[ i ];
+			err = NVS_pSet( &fifo->entry, blobs[ i ], &length );
+			IotLogDebug( "NVS_pSet: %d", err );
+		}
+
+		if( ESP_OK == err )
+		{
+			index_update( fifo, fifo->head, blobs[ i ], length );
+			advance_head( fifo );
+			++written;
+		}
+	}
+
+	/* Save controls once for all elements written */
+	if( 0 < written )
+	{
+		IotLogDebug( "put_elements, %d of %d, head = %d, tail = %d, full = %d", written, count, fifo->head, fifo->tail, fifo->full );
+		if( ESP_OK != save_controls( fifo ) )
+		{
+			err = ESP_FAIL;
+			written = 0;
+		}
+		else
+		{
+			cursors_save_if_due( fifo );
+		}
+	}
+
+	cursor_unlock( fifo );
+
+	if( bTxn && ( ESP_OK != NVS_Commit() ) )
+	{
+		err = ESP_FAIL;
+	}
+
+	*pWritten = written;
+
+	return err;
+}
+
+/**
+ * @brief	Take cache mutex, if FIFO has a RAM cache
+ */
+static void cache_lock( fifo_handle_t fifo )
+{
+	if( NULL != fifo->cache.mutex )
+	{
+		xSemaphoreTake( fifo->cache.mutex, portMAX_DELAY );
+	}
+}
+
+/**
+ * @brief	Give cache mutex, if FIFO has a RAM cache
+ */
+static void cache_unlock( fifo_handle_t fifo )
+{
+	if( NULL != fifo->cache.mutex )
+	{
+		xSemaphoreGive( fifo->cache.mutex );
+	}
+}
+
+/************************************************************************/
+/**
+ * @brief	Write all staged records to NVS
+ *
+ * Staged records are written as a single batch, so the FIFO controls are saved
+ * once per flush.  If a write fails, records that were not written remain staged.
+ * Caller must hold the cache mutex.
+ *
+ * @param[in] fifo	Handle of FIFO, must not be NULL
+ * @return
+ * 	- ESP_OK if cache is empty, disabled, or all records were written
+ * 	- ESP_FAIL if error writing records
+ */
+/************************************************************************/
+static int32_t cache_flush( fifo_handle_t fifo )
+{
+	esp_err_t err = ESP_OK;
+	struct fifo_cache_s *pCache = &fifo->cache;
+	const void *blobs[ FIFO_CACHE_MAX_PENDING ];
+	size_t lengths[ FIFO_CACHE_MAX_PENDING ];
+	uint16_t slot;
+	uint16_t written = 0;
+	uint16_t i;
+
+	if( 0 == pCache->pending )
+	{
+		return ESP_OK;
+	}
+
+	for( i = 0; i < pCache->pending; ++i )
+	{
+		slot = ( pCache->first + i ) % pCache->config.maxPending;
+		blobs[ i ] = &pCache->pData[ slot * pCache->config.maxRecordSize ];
+		lengths[ i ] = pCache->pLength[ slot ];
+	}
+
+	err = put_elements( fifo, blobs, lengths, pCache->pending, &written );
+	IotLogDebug( "cache_flush: %d of %d written", written, pCache->pending );
+
+	pCache->first = ( pCache->first + written ) % pCache->config.maxPending;
+	pCache->pending -= written;
+	pCache->firstTime = xTaskGetTickCount();
+
+	return err;
+}
+
+/************************************************************************/
+/**
+ * @brief	Stage a Blob in the RAM cache
+ *
+ * The cache is flushed when it reaches the configured number of pending records.
+ *
+ * @param[in] fifo		Handle of FIFO, must not be NULL
+ * @param[in] blob		Pointer to Blob
+ * @param[in] length	Length of Blob, in bytes
+ * @return
+ * 	- ESP_OK if Blob was staged, or written, without error
+ * 	- ESP_FAIL if error writing to NVS
+ */
+/************************************************************************/
+static int32_t cache_put( fifo_handle_t fifo, const void* blob, size_t length )
+{
+	esp_err_t err = ESP_OK;
+	struct fifo_cache_s *pCache = &fifo->cache;
+	uint16_t slot;
+	uint16_t written;
+
+	cache_lock( fifo );
+
+	/* Write-through records that do not fit a staging slot, or if staging is full after a failed flush */
+	if( ( length > pCache->config.maxRecordSize ) || ( pCache->pending >= pCache->config.maxPending ) )
+	{
+		err = cache_flush( fifo );
+		if( ESP_OK == err )
+		{
+			err = put_elements( fifo, &blob, &length, 1, &written );
+		}
+	}
+	else
+	{
+		slot = ( pCache->first + pCache->pending ) % pCache->config.maxPending;
+		memcpy( &pCache->pData[ slot * pCache->config.maxRecordSize ], blob, length );
+		pCache->pLength[ slot ] = length;
+
+		if( 0 == pCache->pending++ )
+		{
+			pCache->firstTime = xTaskGetTickCount();
+		}
+
+		if( pCache->pending >= pCache->config.maxPending )
+		{
+			err = cache_flush( fifo );
+		}
+	}
+
+	cache_unlock( fifo );
+
+	return err;
+}
+
+/* ************************************************************************** */
+/* ************************************************************************** */
+/* Section: Interface Functions                                               */
+/* ************************************************************************** */
+/* ************************************************************************** */
+
+/************************************************************************/
+/**
+ * @brief		Allocate a FIFO, and initialize items common to all storage modes
+ *
+ * @param[in] partition		enumerated NVS Partition
+ * @param[in] namespace		Namespace string
+ * @param[in] keyPrefix		NVS access Key Prefix, string
+ * @param[in] controlKey	NVS key for storing fifo control data
+ * @param[in] maxKey		NVS key for storing max pointer
+ * @param[in] pCache		RAM write-back cache configuration, NULL for write-through FIFO
+ *
+ * @return		FIFO handle, NULL if error encountered
+ */
+/************************************************************************/
+static fifo_handle_t fifo_create( const NVS_Partitions_t partition, const char * namespace, const char *keyPrefix, NVS_Items_t controlsKey, NVS_Items_t maxKey, const fifo_cacheConfig_t *pCache )
+{
+	esp_err_t	err = ESP_OK;
+
+	void *buffer = NULL;
+
+	/* Allocate storage for FIFO control structure */
+	buffer = pvPortMalloc( sizeof( fifo_t ) );
+
+	if( buffer == NULL )
+	{
+		IotLogError( "fifo_init: Error\n" );
+		return NULL;
+	}
+
+	fifo_handle_t fifo = ( fifo_handle_t ) buffer;
+
+	fifo->controlsKey = controlsKey;
+	fifo->maxKey = maxKey;
+
+	memset( &fifo->cache, 0, sizeof( fifo->cache ) );
+	memset( &fifo->packed, 0, sizeof( fifo->packed ) );
+	memset( &fifo->cursors, 0, sizeof( fifo->cursors ) );
+	memset( &fifo->index, 0, sizeof( fifo->index ) );
+	memset( &fifo->migrate, 0, sizeof( fifo->migrate ) );
+
+	fifo->entry.partition = partition;
+
+	/* Save namespace */
+	if( MAX_NAMESPACE_LENGTH > strlen( namespace ) )
+	{
+		strcpy( fifo->namespace, namespace );
+		fifo->entry.namespace = (const char *) fifo->namespace;
+	}
+	else
+	{
+		IotLogError( "Namespace string is too long" );
+		err= ESP_FAIL;
+	}
+
+	/* save NVS Key Prefix */
+	if( ESP_OK == err)
+	{
+		if( MAX_KEYPREFIX_LENGTH > strlen( keyPrefix ) )
+		{
+			strcpy( fifo->keyPrefix, keyPrefix );
+		}
+		else
+		{
+			IotLogError( "keyPrefix string is too long" );
+			err= ESP_FAIL;
+		}
+	}
+
+	fifo->entry.type = NVS_TYPE_BLOB;																	/* FIFO items are Blobs */
+
+	/* Pointers are shared by reading and putting tasks, in all storage modes */
+	if( ESP_OK == err )
+	{
+		fifo->cursors.mutex = xSemaphoreCreateMutex();
+		if( NULL == fifo->cursors.mutex )
+		{
+			IotLogError( "fifo_init: Error creating mutex" );
+			err = ESP_FAIL;
+		}
+	}
+
+	/*
+	 * Allocate optional RAM write-back cache
+	 */
+	if( ( ESP_OK == err ) && ( NULL != pCache ) && ( 0 < pCache->maxPending ) )
+	{
+		fifo->cache.config = *pCache;
+		if( FIFO_CACHE_MAX_PENDING < fifo->cache.config.maxPending )
+		{
+			fifo->cache.config.maxPending = FIFO_CACHE_MAX_PENDING;
+		}
+
+		fifo->cache.pData = pvPortMalloc( fifo->cache.config.maxPending * fifo->cache.config.maxRecordSize );
+		fifo->cache.pLength = pvPortMalloc( fifo->cache.config.maxPending * sizeof( size_t ) );
+		fifo->cache.mutex = xSemaphoreCreateMutex();
+
+		if( ( NULL == fifo->cache.pData ) || ( NULL == fifo->cache.pLength ) || ( NULL == fifo->cache.mutex ) )
+		{
+			IotLogError( "fifo_init: Error allocating cache" );
+			err = ESP_FAIL;
+		}
+	}
+
+	return ( ( ESP_OK == err ) ? fifo : NULL );
+}
+
+/************************************************************************/
+/**
+ * @brief		Initialize a FIFO
+ *
+ *  - A FIFO is created in designated NVS <i>Partition</i> and <i>Name-space</i>.
+ *  - Elements will be stored using the designated <i>keyPrefix</i>.
+ *  - The maximum number of elements to be stored is <i>nItems</i>
+ *  - NVS keys <i>headKey, tailKey, fullKey, maxKey</i> will be used to store the FIFO pointers
+ *  - If the FIFO has been previously created, the pointers will be restored from NVS
+ *  - If <i>nItems</i> is larger than the restored capacity, the FIFO is grown, keeping
+ *    its records, see fifo_resize().  A smaller <i>nItems</i> is ignored.
+ *
+ * @param[in] partition		enumerated NVS Partition
+ * @param[in] namespace		Namespace string
+ * @param[in] keyPrefix		NVS access Key Prefix, string
+ * @param[in] nItems		Number of items FIFO can hold
+ * @param[in] controlKey	NVS key for storing fifo control data
+ * @param[in] maxKey		NVS key for storing max pointer
+ * @param[in] pCache		RAM write-back cache configuration, NULL for write-through FIFO
+ *
+ * @return		FIFO handle, NULL if error encountered during initialization
+ */
+/************************************************************************/
+fifo_handle_t fifo_init(const NVS_Partitions_t partition, const char * namespace, const char *keyPrefix, const uint16_t nItems, NVS_Items_t controlsKey, NVS_Items_t maxKey, const fifo_cacheConfig_t *pCache )
+{
+	esp_err_t	err = ESP_OK;
+
+	fifo_handle_t fifo = fifo_create( partition, namespace, keyPrefix, controlsKey, maxKey, pCache );
+
+	if( fifo == NULL )
+	{
+		return NULL;
+	}
+
+	/*
+	 * Restore FIFO controls from NVS Storage, set to defaults if not value not currently stored in NVS
+	 */
+	if( ESP_OK == err)
+	{
+		err = NVS_Get( fifo->controlsKey, &fifo->controls, NULL );
+		if( err != ESP_OK )
+		{
+			fifo->head = 0;
+			fifo->tail = 0;
+			fifo->activeTail = 0;
+			fifo->full = FIFO_NOT_FULL;
+			err = NVS_Set( fifo->controlsKey, &fifo->controls, NULL );			// Update NVS
+		}
+		else
+		{
+			fifo->activeTail = fifo->tail;
+		}
+	}
+
+	/*
+	 * Restore FIFO Max index from NVS Storage, use function argument nItems if not value not currently stored in NVS
+	 */
+	if( ESP_OK == err)
+	{
+		err = NVS_Get( fifo->maxKey, &fifo->max, NULL );
+		if( err != ESP_OK )
+		{
+			fifo->max = nItems;
+			err = NVS_Set( fifo->maxKey, &fifo->max, NULL );				// Update NVS
+		}
+	}
+
+	/*
+	 * Resume a resize interrupted by a power loss
+	 */
+	if( ESP_OK == err )
+	{
+		err = migrate_setup( fifo );
+	}
+
+	if( ESP_OK == err )
+	{
+		err = migrate_load( fifo );
+	}
+
+	/*
+	 * Restore read cursors, if any named cursors are stored in NVS
+	 */
+	if( ESP_OK == err )
+	{
+		err = cursors_setup( fifo );
+	}
+
+	if( ESP_OK == err )
+	{
+		cursors_load( fifo );
+		fifo->activeTail = ( fifo->tail + fifo->cursors.cursor[ CURSOR_DEFAULT ].activeOffset ) % fifo->max;
+	}
+
+	/*
+	 * Grow FIFO if more items are requested than restored from NVS
+	 */
+	if( ( ESP_OK == err ) && ( nItems > fifo->max ) && !fifo->migrate.bActive )
+	{
+		if( ESP_OK != fifo_resize( fifo, nItems ) )
+		{
+			IotLogError( "fifo_init: Error resizing FIFO to %d", nItems );
+		}
+	}
+
+	IotLogInfo( "Initializing FIFO:" );
+	IotLogInfo( "  Handle = %p", ( (uint32_t *) fifo ) );
+	IotLogInfo( "  Head = %d", fifo->head );
+	IotLogInfo( "  Tail = %d", fifo->tail );
+	IotLogInfo( "  Full = %d", fifo->full);
+	IotLogInfo( "  Max  = %d", fifo->max );
+	IotLogInfo( "  Cache = %d", fifo->cache.config.maxPending );
+
+	return ( ( ESP_OK == err ) ? fifo : NULL );
+}
+
+/************************************************************************/
+/**
+ * @brief		Initialize a packed FIFO
+ *
+ *  - Records are appended, length-prefixed, into <i>nSegments</i> segment blobs,
+ *    each <i>segmentSize</i> bytes, stored using the designated <i>keyPrefix</i>.
+ *  - Head and tail are tracked as segment + offset, in a controls blob stored
+ *    with key <i>keyPrefix</i>"CTL".
+ *  - When all segments are in use, the oldest segment is dropped as a whole.
+ *  - If the FIFO has been previously created with the same segment size, the
+ *    controls, and the head segment, will be restored from NVS.
+ *
+ * Each write to NVS rewrites the head segment blob, from its start, so a packed FIFO
+ * requires a RAM cache (<i>pCache</i>), packing many records per segment write.  Written
+ * through, every put would rewrite the segment: in the host stress test that was 19
+ * bytes of flash written per record byte, against 3 for a record FIFO, and 12 times
+ * the page erases.  Even cached, each flush rewrites the segment so far, costing about
+ * 1.5 times the flash writes of a cached record FIFO; packing saves NVS entries, not wear.
+ * fifo_capacity() and fifo_getHead()/fifo_getTail() report segments, not records.
+ *
+ * @param[in] partition		enumerated NVS Partition
+ * @param[in] namespace		Namespace string
+ * @param[in] keyPrefix		NVS access Key Prefix, string
+ * @param[in] nSegments		Number of segments, minimum of 2
+ * @param[in] segmentSize	Size of each segment, in bytes.  Should not exceed 4000 (one NVS page)
+ * @param[in] maxKey		NVS key for storing number of segments
+ * @param[in] pCache		RAM write-back cache configuration, required
+ *
+ * @return		FIFO handle, NULL if error encountered during initialization, or no cache
+ */
+/************************************************************************/
+fifo_handle_t fifo_initPacked( const NVS_Partitions_t partition, const char * namespace, const char *keyPrefix, const uint16_t nSegments, const uint16_t segmentSize, NVS_Items_t maxKey, const fifo_cacheConfig_t *pCache )
+{
+	esp_err_t	err = ESP_OK;
+	struct fifo_packed_s *pPacked;
+	size_t size;
+	int n;
+
+	if( ( NULL == pCache ) || ( 0 == pCache->maxPending ) )
+	{
+		IotLogError( "fifo_initPacked: cache required" );
+		return NULL;
+	}
+
+	fifo_handle_t fifo = fifo_create( partition, namespace, keyPrefix, maxKey, maxKey, pCache );
+
+	if( fifo == NULL )
+	{
+		return NULL;
+	}
+
+	pPacked = &fifo->packed;
+	pPacked->segmentSize = segmentSize;
+	pPacked->readSeg = PACKED_SEGMENT_NONE;
+
+	/* Controls are a blob in the FIFO namespace */
+	n = snprintf( pPacked->controlsKey, sizeof( pPacked->controlsKey ), "%s%s", fifo->keyPrefix, PACKED_CONTROLS_SUFFIX );
+	if( ( 0 > n ) || ( sizeof( pPacked->controlsKey ) <= n ) || ( PACKED_LENGTH_SIZE >= segmentSize ) )
+	{
+		IotLogError( "fifo_initPacked: invalid parameters" );
+		err = ESP_FAIL;
+	}
+	pPacked->controlsEntry = fifo->entry;
+	pPacked->controlsEntry.nvsKey = pPacked->controlsKey;
+
+	/* Allocate head segment mirror and read buffer */
+	if( ESP_OK == err )
+	{
+		pPacked->pHead = pvPortMalloc( segmentSize );
+		pPacked->pRead = pvPortMalloc( segmentSize );
+		if( ( NULL == pPacked->pHead ) || ( NULL == pPacked->pRead ) )
+		{
+			IotLogError( "fifo_initPacked: Error allocating segment buffers" );
+			err = ESP_FAIL;
+		}
+	}
+
+	/*
+	 * Restore number of segments from NVS Storage, use function argument nSegments if not value not currently stored in NVS
+	 */
+	if( ESP_OK == err)
+	{
+		err = NVS_Get( fifo->maxKey, &fifo->max, NULL );
+		if( err != ESP_OK )
+		{
+			fifo->max = nSegments;
+			err = NVS_Set( fifo->maxKey, &fifo->max, NULL );				// Update NVS
+		}
+
+		if( ( ESP_OK == err ) && ( PACKED_MIN_SEGMENTS > fifo->max ) )
+		{
+			IotLogError( "fifo_initPacked: too few segments, %d", fifo->max );
+			err = ESP_FAIL;
+		}
+	}
+
+	/*
+	 * Restore controls, and head segment, from NVS Storage.
+	 * Start with an empty FIFO if controls are not stored, do not match the segment size, or head segment cannot be read.
+	 */
+	if( ESP_OK == err )
+	{
+		size = sizeof( pPacked->ctl );
+		err = NVS_pGet( &pPacked->controlsEntry, &pPacked->ctl, &size );
+
+		if( ( ESP_OK != err ) || ( sizeof( pPacked->ctl ) != size ) || ( segmentSize != pPacked->ctl.segmentSize ) ||
+			( fifo->max <= pPacked->ctl.headSeg ) || ( fifo->max <= pPacked->ctl.tailSeg ) || ( segmentSize < pPacked->ctl.headOff ) )
+		{
+			err = ESP_FAIL;
+		}
+
+		if( ( ESP_OK == err ) && ( 0 < pPacked->ctl.headOff ) )
+		{
+			size = segmentSize;
+			if( !formatKey( fifo, pPacked->ctl.headSeg ) ||
+				( ESP_OK != NVS_pGet( &fifo->entry, pPacked->pHead, &size ) ) ||
+				( size < pPacked->ctl.headOff ) )
+			{
+				IotLogError( "fifo_initPacked: head segment %d unreadable", pPacked->ctl.headSeg );
+				err = ESP_FAIL;
+			}
+		}
+
+		if( ESP_OK == err )
+		{
+			pPacked->activeTailSeg = pPacked->ctl.tailSeg;
+			pPacked->activeTailOff = pPacked->ctl.tailOff;
+			pPacked->activeCount = pPacked->ctl.count;
+		}
+		else
+		{
+			packed_reset( fifo );
+			err = packed_save_controls( fifo );							// Update NVS
+		}
+	}
+
+	IotLogInfo( "Initializing packed FIFO:" );
+	IotLogInfo( "  Handle = %p", ( (uint32_t *) fifo ) );
+	IotLogInfo( "  Head = %d:%d", pPacked->ctl.headSeg, pPacked->ctl.headOff );
+	IotLogInfo( "  Tail = %d:%d", pPacked->ctl.tailSeg, pPacked->ctl.tailOff );
+	IotLogInfo( "  Count = %d", pPacked->ctl.count );
+	IotLogInfo( "  Segments = %d x %d", fifo->max, pPacked->segmentSize );
+	IotLogInfo( "  Cache = %d", fifo->cache.config.maxPending );
+
+	return ( ( ESP_OK == err ) ? fifo : NULL );
+}
+
+/************************************************************************/
+/**
+ * @brief	Reset FIFO
+ *
+ * @param[in] fifo	FIFO handle
+ */
+/************************************************************************/
+void fifo_reset( fifo_handle_t fifo )
+{
+	if( fifo == NULL )
+	{
+		IotLogError( "fifo_reset: Error\n" );
+	}
+	else
+	{
+		cache_lock( fifo );
+		fifo->cache.pending = 0;										// discard staged records
+		fifo->cache.first = 0;
+		if( 0 < fifo->packed.segmentSize )
+		{
+			cursor_lock( fifo );
+			packed_reset( fifo );
+			packed_save_controls( fifo );								// Update NVS - FIXME: check return status
+			cursor_unlock( fifo );
+		}
+		else
+		{
+			cursor_lock( fifo );
+			if( fifo->migrate.bActive )
+			{
+				if( eMigrateStart == fifo->migrate.ctl.state )
+				{
+					migrate_apply( fifo );								// Update NVS - FIXME: check return status
+				}
+				migrate_end( fifo );									// records discarded, nothing left to move
+			}
+			fifo->head = 0;
+			fifo->tail = 0;
+			fifo->activeTail = 0;
+			fifo->full = FIFO_NOT_FULL;
+			NVS_Set( fifo->controlsKey, &fifo->controls, NULL );		// Update NVS - FIXME: check return status
+			if( fifo->cursors.bActive )
+			{
+				for( int i = 0; i < CURSOR_SLOTS; ++i )
+				{
+					fifo->cursors.ctl.offset[ i ] = 0;
+					fifo->cursors.cursor[ i ].activeOffset = 0;
+				}
+				cursors_save( fifo );									// Update NVS - FIXME: check return status
+			}
+			cursor_unlock( fifo );
+		}
+		cache_unlock( fifo );
+	}
+}
+
+/************************************************************************/
+/**
+ * @brief	FIFO full?
+ *
+ * A packed FIFO is full when all segments are in use; the next segment
+ * change will drop the oldest segment.
+ *
+ * @param[in] fifo	FIFO handle
+ * @return
+ *		- <i>true</i> if buffer is full
+ *		- <i>false</i> if buffer is not full
+ */
+/************************************************************************/
+bool fifo_full( fifo_handle_t fifo )
+{
+	if( fifo == NULL )
+	{
+		IotLogError( "fifo_full: Error\n" );
+		return true;
+	}
+	else if( 0 < fifo->packed.segmentSize )
+	{
+		return( ( ( fifo->packed.ctl.headSeg + 1 ) % fifo->max ) == fifo->packed.ctl.tailSeg );
+	}
+	else
+	{
+		return ( FIFO_FULL == fifo->full );
+	}
+}
+
+/************************************************************************/
+/**
+ * @brief	FIFO empty?
+ *
+ * @param[in] fifo	FIFO handle
+ * @return
+ *		- <i>true</i> if buffer is empty
+ *		- <i>false</i> if buffer is not empty
+ */
+/************************************************************************/
+bool fifo_empty( fifo_handle_t fifo )
+{
+	if( fifo == NULL )
+	{
+		IotLogError( "fifo_empty: Error\n" );
+		return false;
+	}
+	else if( 0 < fifo->packed.segmentSize )
+	{
+		return( 0 == fifo->packed.ctl.count );
+	}
+	else
+	{
+		return( (FIFO_NOT_FULL == fifo->full) && ( fifo->head == fifo->tail ) );
+	}
+}
+
+/************************************************************************/
+/**
+ * @brief	FIFO Capacity
+ *
+ * @param[in] fifo	FIFO handle
+ * @return	Size of FIFO (number of elements, or number of segments for a packed FIFO)
+ */
+/************************************************************************/
+uint16_t fifo_capacity( fifo_handle_t fifo )
+{
+	if( fifo == NULL )
+	{
+		IotLogError( "fifo_capacity: Error\n" );
+		return 0;
+	}
+	else
+	{
+		return fifo->max;
+	}
+}
+
+/************************************************************************/
+/**
+ * @brief	FIFO Size
+ *
+ *	Return the number of elements in the FIFO.
+ *	This function is intended to be used to determine how many elements there
+ *	are to be Read (fifo_get()) and thus the activeTail index is used.
+ *
+ * @param[in] fifo	FIFO handle
+ * @return	Number of elements used in FIFO
+ */
+/************************************************************************/
+uint16_t fifo_size( fifo_handle_t fifo )
+{
+	uint16_t size = 0;
+
+	if( fifo == NULL )
+	{
+		IotLogError( "fifo_size: Error\n" );
+	}
+	else if( 0 < fifo->packed.segmentSize )
+	{
+		size = fifo->packed.activeCount;
+	}
+	else if( fifo->cursors.bActive )
+	{
+		size = fifo_cursorSize( &fifo->cursors.cursor[ CURSOR_DEFAULT ] );
+	}
+	else
+	{
+		size = fifo->max;
+
+		if( FIFO_NOT_FULL == fifo->full )
+		{
+			if( fifo->head >= fifo->activeTail )
+			{
+				size = ( fifo->head - fifo->activeTail );
+			}
+			else
+			{
+				size = ( fifo->max + fifo->head - fifo->activeTail );
+			}
+		}
+	}
+	return size;
+}
+
+/************************************************************************/
+/**
+ * @brief	Add Blob to FIFO
+ *
+ * If the FIFO is full, the oldest Blob in the FIFO (accessed by
+ * the tail index) is overwritten and thus lost.
+ *
+ * If the FIFO has a RAM cache, the Blob is staged in RAM, and only written
+ * to NVS when the cache is flushed.  Staged Blobs are not visible to fifo_get()
+ * until flushed.  Blobs larger than the cache record size are written through,
+ * after flushing any staged Blobs.
+ *
+ * @param[in] fifo		FIFO handle
+ * @param[in] blob		Pointer to Blob to be added to the FIFO
+ * @param[in] length	Length of binary value to set, in bytes
+ * @return
+ * 	- ESP_OK if next element stored without error
+ * 	- ESP_FAIL if error storing element
+ */
+/************************************************************************/
+int32_t fifo_put( fifo_handle_t fifo, const void* blob, size_t length)
+{
+	esp_err_t err = ESP_OK;
+
+
+	if( ( fifo == NULL ) || ( blob == NULL ) )
+	{
+		IotLogError( "fifo_put: Error\n" );
+		return ESP_FAIL;
+	}
+
+	uint16_t written;
+
+	if( 0 < fifo->cache.config.maxPending )
+	{
+		return cache_put( fifo, blob, length );
+	}
+
+	if( 0 < fifo->packed.segmentSize )
+	{
+		return put_elements( fifo, &blob, &length, 1, &written );
+	}
+
+	cursor_lock( fifo );
+
+	if( ESP_OK == err )
+	{
+		err = migrate_prepare_write( fifo, fifo->head );
+	}
+
+	if( ( ESP_OK == err ) && !formatKey( fifo, fifo->head ) )
+	{
+		IotLogError( "fifo_get: key format error" );
+		err = ESP_FAIL;
+	}
+
+	if( ESP_OK == err )
+	{
+		err = NVS_pSet( &fifo->entry, blob, &length );
+		IotLogDebug( "NVS_pSet: %d", err );
+	}
+
+	if( ESP_OK == err )
+	{
+		index_update( fifo, fifo->head, blob, length );
+		err = advance_pointer( fifo );
+		IotLogDebug( "advance_pointer: %d", err );
+	}
+
+	if( ESP_OK == err )
+	{
+		err = cursors_save_if_due( fifo );
+	}
+
+	cursor_unlock( fifo );
+
+	return err;
+}
+
+/************************************************************************/
+/**
+ * @brief	Get next available element from the FIFO
+ *
+ * The next available element is accessed via the <i>tail</i> pointer.
+ *
+ * @param[in]		fifo	FIFO handle
+ * @param[out]		blob	Destination pointer
+ * @param[in|out]	pLength	Length of destination buffer as input, number of bytes copies as output
+ * @return
+ * 	- ESP_OK if next element retrieved without error
+ * 	- ESP_ERR_NVS_INVALID_LENGTH if element does not fit destination buffer, and is not read
+ * 	- ESP_FAIL if error retrieving element
+ */
+/************************************************************************/
+int32_t fifo_get( fifo_handle_t fifo, void* blob, size_t *pLength )
+{
+	esp_err_t	err;
+
+	if( ( fifo == NULL ) || ( blob == NULL ) || ( pLength == NULL ) )
+	{
+		IotLogError( "fifo_get: Error\n" );
+		return ESP_FAIL;
+	}
+
+	err = get_next( fifo, blob, pLength );
+	if( ESP_ERR_NVS_INVALID_LENGTH == err )
+	{
+		IotLogError( "fifo_get: buffer too small, %d", *pLength );
+	}
+
+	return err;
+}
+
+/************************************************************************/
+/**
+ * @brief	Add multiple Blobs to FIFO
+ *
+ * All blobs are written to NVS, then the FIFO controls are saved once for the
+ * complete batch, rather than once per blob.
+ *
+ * If the batch will overwrite the oldest Blobs in the FIFO, those Blobs are
+ * dropped (and the controls saved) before any Blob is written, so the stored
+ * controls never reference a partially overwritten element.  If a write fails
+ * part way through the batch, the Blobs written so far are committed.
+ *
+ * If the FIFO has a RAM cache, any staged records are flushed first, to maintain
+ * record order; the batch itself is written directly to NVS.
+ *
+ * @param[in] fifo		FIFO handle
+ * @param[in] blobs		Array of pointers to Blobs to be added to the FIFO
+ * @param[in] lengths	Array of Blob lengths, in bytes
+ * @param[in] count		Number of Blobs in batch
+ * @return
+ * 	- ESP_OK if all elements stored without error
+ * 	- ESP_FAIL if error storing elements
+ */
+/************************************************************************/
+int32_t fifo_putBatch( fifo_handle_t fifo, const void * const blobs[], const size_t lengths[], uint16_t count )
+{
+	esp_err_t err = ESP_OK;
+	uint16_t written;
+
+	if( ( fifo == NULL ) || ( blobs == NULL ) || ( lengths == NULL ) )
+	{
+		IotLogError( "fifo_putBatch: Error\n" );
+		return ESP_FAIL;
+	}
+
+	cache_lock( fifo );
+
+	err = cache_flush( fifo );
+
+	if( ESP_OK == err )
+	{
+		err = put_elements( fifo, blobs, lengths, count, &written );
+	}
+
+	cache_unlock( fifo );
+
+	return err;
+}
+
+/************************************************************************/
+/**
+ * @brief	Get multiple elements from the FIFO
+ *
+ * Elements are read from the <i>activeTail</i>, and packed back-to-back into the
+ * destination buffer.  Reading stops when the requested count has been read, the
+ * FIFO is empty, or the next element will not fit in the remaining buffer space.
+ * As with fifo_get(), the read must be completed with fifo_commitRead().
+ *
+ * @param[in]		fifo		FIFO handle
+ * @param[out]		buffer		Destination buffer
+ * @param[in]		bufferSize	Size of destination buffer, in bytes
+ * @param[out]		lengths		Array to receive length of each element read
+ * @param[in|out]	pCount		Maximum number of elements to read as input, number of elements read as output
+ * @return
+ * 	- ESP_OK if at least one element retrieved without error
+ * 	- ESP_FAIL if error retrieving first element, or FIFO is empty
+ */
+/************************************************************************/
+int32_t fifo_getBatch( fifo_handle_t fifo, void *buffer, size_t bufferSize, size_t lengths[], uint16_t *pCount )
+{
+	esp_err_t	err = ESP_OK;
+	uint16_t	i;
+	uint16_t	max;
+	size_t		offset = 0;
+	size_t		length;
+
+	if( ( fifo == NULL ) || ( buffer == NULL ) || ( lengths == NULL ) || ( pCount == NULL ) )
+	{
+		IotLogError( "fifo_getBatch: Error\n" );
+		return ESP_FAIL;
+	}
+
+	max = *pCount;
+	*pCount = 0;
+
+	for( i = 0; i < max; ++i )
+	{
+		if( 0 == fifo_size( fifo ) )
+		{
+			break;														// no more elements to read
+		}
+
+		length = bufferSize - offset;
+		err = get_next( fifo, ( uint8_t * ) buffer + offset, &length );
+		if( ( ESP_ERR_NVS_INVALID_LENGTH == err ) && ( 0 == *pCount ) )
+		{
+			IotLogError( "fifo_getBatch: buffer too small, %d", bufferSize );
+		}
+		if( ESP_OK != err )
+		{
+			break;														// includes element too large for remaining space
+		}
+
+		lengths[ i ] = length;
+		offset += length;
+		++( *pCount );
+	}
+
+	return ( ( 0 < *pCount ) ? ESP_OK : ESP_FAIL );
+}
+
+/************************************************************************/
+/**
+ * @brief	Flush FIFO RAM cache
+ *
+ * Write all records staged in the RAM cache to NVS.
+ *
+ * @param[in]		fifo	FIFO handle
+ * @return
+ * 	- ESP_OK if cache is empty, disabled, or flushed without error
+ * 	- ESP_FAIL if error writing records
+ */
+/************************************************************************/
+int32_t fifo_flush( fifo_handle_t fifo )
+{
+	esp_err_t	err;
+
+	if( fifo == NULL )
+	{
+		IotLogError( "fifo_flush: Error\n" );
+		return ESP_FAIL;
+	}
+
+	cache_lock( fifo );
+	err = cache_flush( fifo );
+	cache_unlock( fifo );
+
+	return err;
+}
+
+/************************************************************************/
+/**
+ * @brief	Flush FIFO RAM cache, if oldest staged record has reached maximum age
+ *
+ * Intended to be called periodically, by the task that consumes the FIFO.
+ *
+ * @param[in]		fifo	FIFO handle
+ * @return
+ * 	- ESP_OK if no flush is due, or flushed without error
+ * 	- ESP_FAIL if error writing records
+ */
+/************************************************************************/
+int32_t fifo_flushIfDue( fifo_handle_t fifo )
+{
+	esp_err_t	err = ESP_OK;
+
+	if( fifo == NULL )
+	{
+		IotLogError( "fifo_flushIfDue: Error\n" );
+		return ESP_FAIL;
+	}
+
+	cache_lock( fifo );
+	if( ( 0 < fifo->cache.pending ) && ( 0 < fifo->cache.config.maxAgeMs ) &&
+		( ( xTaskGetTickCount() - fifo->cache.firstTime ) >= pdMS_TO_TICKS( fifo->cache.config.maxAgeMs ) ) )
+	{
+		err = cache_flush( fifo );
+	}
+	cache_unlock( fifo );
+
+	return err;
+}
+
+/************************************************************************/
+/**
+ * @brief	Commit FIFO Read
+ *
+ * @param[in]		fifo	FIFO handle
+ * @param[in]		commit	If true, commit read, if false abort read
+ * @return
+ * 	- ESP_OK if FIFO controls saved without error
+ * 	- ESP_FAIL if error saving FIFO controls
+ */
+/************************************************************************/
+int32_t fifo_commitRead( fifo_handle_t fifo, bool commit )
+{
+	esp_err_t	err = ESP_OK;
+
+	if( 0 < fifo->packed.segmentSize )
 	{
-		return( (FIFO_NOT_FULL == fifo->full) && ( fifo->head == fifo->tail ) );
+		cursor_lock( fifo );
+		if( commit )
+		{
+			fifo->packed.ctl.tailSeg = fifo->packed.activeTailSeg;
+			fifo->packed.ctl.tailOff = fifo->packed.activeTailOff;
+			fifo->packed.ctl.count = fifo->packed.activeCount;
+		}
+		else
+		{
+			fifo->packed.activeTailSeg = fifo->packed.ctl.tailSeg;	// abort read, restore active tail
+			fifo->packed.activeTailOff = fifo->packed.ctl.tailOff;
+			fifo->packed.activeCount = fifo->packed.ctl.count;
+		}
+		err = packed_save_controls( fifo );
+		cursor_unlock( fifo );
+		return err;
+	}
+
+	if( fifo->cursors.bActive )
+	{
+		return fifo_cursorCommit( &fifo->cursors.cursor[ CURSOR_DEFAULT ], commit );
 	}
+
+	cursor_lock( fifo );
+	if( commit )
+	{
+		fifo->full = FIFO_NOT_FULL;
+		fifo->tail = fifo->activeTail;
+	}
+	else
+	{
+		fifo->activeTail = fifo->tail;						// abort read, restore tail to activeTail
+	}
+	err = save_controls( fifo );
+	cursor_unlock( fifo );
+
+	return err;
 }
 
 /************************************************************************/
 /**
- * @brief	FIFO Capacity
+ * @brief	Index FIFO records, for fifo_readRange()
  *
- * @param[in] fifo	FIFO handle
- * @return	Size of FIFO (number of elements)
+ * A sparse index is kept in RAM, sampling the record Index of one record every
+ * 8 slots, or of the first record in each segment of a packed FIFO.  The index is
+ * rebuilt from NVS when set, one record read per sample, and is then maintained as
+ * records are put.  Intended to be called once, after fifo_init()/fifo_initPacked().
+ *
+ * @param[in] fifo			FIFO handle
+ * @param[in] indexFn		Record Index extractor
+ * @param[in] maxRecordSize	Size of largest record, in bytes, used to rebuild the index
+ * @return
+ * 	- ESP_OK if index is allocated and rebuilt
+ * 	- ESP_FAIL if invalid parameters, or error allocating index
  */
 /************************************************************************/
-uint16_t fifo_capacity( fifo_handle_t fifo )
+int32_t fifo_setIndex( fifo_handle_t fifo, fifo_indexFn_t indexFn, size_t maxRecordSize )
 {
-	if( fifo == NULL )
-	{
-		IotLogError( "fifo_capacity: Error\n" );
-		return 0;
-	}
-	else
+	esp_err_t err = ESP_OK;
+
+	if( ( fifo == NULL ) || ( indexFn == NULL ) )
 	{
-		return fifo->max;
+		IotLogError( "fifo_setIndex: Error\n" );
+		return ESP_FAIL;
 	}
+
+	cache_lock( fifo );
+	cursor_lock( fifo );
+
+	fifo->index.fn = indexFn;
+	fifo->index.maxRecordSize = maxRecordSize;
+	err = index_alloc( fifo );
+
+	cursor_unlock( fifo );
+	cache_unlock( fifo );
+
+	IotLogInfo( "fifo_setIndex: %d samples", fifo->index.samples );
+
+	return err;
 }
 
 /************************************************************************/
 /**
- * @brief	FIFO Size
+ * @brief	Read records by record Index
  *
- *	Return the number of elements in the FIFO.
- *	This function is intended to be used to determine how many elements there
- *	are to be Read (fifo_get()) and thus the activeTail index is used.
+ * Records with an Index from <i>first</i> to <i>last</i>, inclusive, are packed
+ * back-to-back into the destination buffer, oldest first, as for fifo_getBatch().
+ * Every record still held in NVS is searched, including records already read and
+ * committed, until overwritten.  Read positions are not changed, and no commit is
+ * needed.
  *
- * @param[in] fifo	FIFO handle
- * @return	Number of elements used in FIFO
+ * Reading stops at the first record beyond <i>last</i>, so records must be put in
+ * increasing Index order.  Records staged in a RAM cache are not searched until
+ * flushed.  The FIFO must be indexed, see fifo_setIndex().
+ *
+ * @param[in]		fifo		FIFO handle
+ * @param[in]		first		First record Index
+ * @param[in]		last		Last record Index
+ * @param[out]		buffer		Destination buffer
+ * @param[in]		bufferSize	Size of destination buffer, in bytes
+ * @param[out]		lengths		Array to receive length of each record read
+ * @param[in|out]	pCount		Maximum number of records to read as input, number of records read as output
+ * @return
+ * 	- ESP_OK if at least one record retrieved without error
+ * 	- ESP_FAIL if FIFO is not indexed, or no record in range was retrieved
  */
 /************************************************************************/
-uint16_t fifo_size( fifo_handle_t fifo )
+int32_t fifo_readRange( fifo_handle_t fifo, uint32_t first, uint32_t last, void *buffer, size_t bufferSize, size_t lengths[], uint16_t *pCount )
 {
-	uint16_t size = fifo->max;
+	if( ( fifo == NULL ) || ( buffer == NULL ) || ( lengths == NULL ) || ( pCount == NULL ) || ( NULL == fifo->index.pSample ) )
+	{
+		IotLogError( "fifo_readRange: Error\n" );
+		return ESP_FAIL;
+	}
 
-	if( fifo == NULL )
+	cache_lock( fifo );
+	cursor_lock( fifo );
+
+	if( 0 < fifo->packed.segmentSize )
 	{
-		IotLogError( "fifo_size: Error\n" );
-		size = 0;
+		index_read_packed( fifo, first, last, buffer, bufferSize, lengths, pCount );
 	}
 	else
 	{
-		if( FIFO_NOT_FULL == fifo->full )
-		{
-			if( fifo->head >= fifo->activeTail )
-			{
-				size = ( fifo->head - fifo->activeTail );
-			}
-			else
-			{
-				size = ( fifo->max + fifo->head - fifo->activeTail );
-			}
-		}
+		index_read_records( fifo, first, last, buffer, bufferSize, lengths, pCount );
 	}
-	return size;
+
+	cursor_unlock( fifo );
+	cache_unlock( fifo );
+
+	IotLogDebug( "fifo_readRange: %d - %d, %d records", first, last, *pCount );
+
+	return ( ( 0 < *pCount ) ? ESP_OK : ESP_FAIL );
 }
 
 /************************************************************************/
 /**
- * @brief	Add Blob to FIFO
+ * @brief	Grow a record FIFO, keeping its records
  *
- * If the FIFO is full, the oldest Blob in the FIFO (accessed by
- * the tail index) is overwritten and thus lost.
+ * The FIFO capacity, and stored max, change immediately; records are moved to
+ * their slots in the new capacity in the background, by fifo_migrate().  Records
+ * are kept in place where possible: only records that wrapped round the end of
+ * the old capacity are moved.  Records not yet moved are read from their old
+ * slots, and a put that depends on a record not yet moved moves it first.
+ *
+ * Progress is journalled in NVS, with key <i>keyPrefix</i>"MIG", and a resize
+ * interrupted by a power loss is resumed by fifo_init().  Read positions, cursors
+ * and the record index are kept.
+ *
+ * Only growing a record FIFO is supported; packed FIFOs are not resized.
  *
  * @param[in] fifo		FIFO handle
- * @param[in] blob		Pointer to Blob to be added to the FIFO
- * @param[in] length	Length of binary value to set, in bytes
+ * @param[in] nItems	New number of items FIFO can hold, larger than fifo_capacity()
  * @return
- * 	- ESP_OK if next element stored without error
- * 	- ESP_FAIL if error storing element
+ * 	- ESP_OK if resize has started
+ * 	- ESP_FAIL if FIFO is packed, already resizing, invalid size, or error saving controls
  */
 /************************************************************************/
-int32_t fifo_put( fifo_handle_t fifo, const void* blob, size_t length)
+int32_t fifo_resize( fifo_handle_t fifo, uint16_t nItems )
 {
 	esp_err_t err = ESP_OK;
+	struct fifo_migrate_s *pMigrate;
+	uint32_t oldControls;
+	uint16_t used;
+	uint16_t activeOffset;
 
+	if( ( fifo == NULL ) || ( 0 < fifo->packed.segmentSize ) || fifo->migrate.bActive ||
+		( nItems <= fifo->max ) || ( FIFO_MAX_ITEMS < nItems ) )
+	{
+		IotLogError( "fifo_resize: Error\n" );
+		return ESP_FAIL;
+	}
 
-	if( ( fifo == NULL ) || ( blob == NULL ) )
+	pMigrate = &fifo->migrate;
+
+	cache_lock( fifo );
+	cursor_lock( fifo );
+
+	if( !formatKey( fifo, nItems - 1 ) )
 	{
-		IotLogError( "fifo_put: Error\n" );
+		IotLogError( "fifo_resize: key format error" );
 		err = ESP_FAIL;
 	}
 
-	if( ( ESP_OK == err ) && !formatKey( fifo, fifo->head ) )
+	used = stored_count( fifo );
+	activeOffset = fifo->cursors.bActive ? fifo->cursors.cursor[ CURSOR_DEFAULT ].activeOffset : ( ( fifo->activeTail + fifo->max - fifo->tail ) % fifo->max );
+
+	/* The tail slot is kept, so cursor offsets stay valid once rebased to it */
+	if( ( ESP_OK == err ) && fifo->cursors.bActive )
 	{
-		IotLogError( "fifo_get: key format error" );
-		err = ESP_FAIL;
+		err = cursors_save( fifo );
 	}
 
+	/* Journal holds the new controls, saving it starts the resize */
 	if( ESP_OK == err )
 	{
-		err = NVS_pSet( &fifo->entry, blob, &length );
-		IotLogDebug( "NVS_pSet: %d", err );
+		pMigrate->ctl.state = eMigrateStart;
+		pMigrate->ctl.oldMax = fifo->max;
+		pMigrate->ctl.newMax = nItems;
+		pMigrate->ctl.moveCount = ( ( fifo->tail + used ) > fifo->max ) ? ( fifo->tail + used - fifo->max ) : 0;
+		pMigrate->ctl.copied = 0;
+		pMigrate->ctl.spare = 0;
+
+		oldControls = fifo->controls;
+		fifo->head = ( fifo->tail + used ) % nItems;
+		fifo->full = FIFO_NOT_FULL;
+		pMigrate->ctl.controls = fifo->controls;
+		fifo->controls = oldControls;
+
+		err = migrate_save( fifo );
 	}
 
+	/* If saving new controls fails, the next fifo_migrate(), or put, retries */
 	if( ESP_OK == err )
 	{
-		err = advance_pointer( fifo );
-		IotLogDebug( "advance_pointer: %d", err );
+		pMigrate->bActive = true;
+		err = migrate_copy( fifo, 0 );
+		fifo->activeTail = ( fifo->tail + activeOffset ) % fifo->max;
 	}
 
+	if( ( nItems == fifo->max ) && ( NULL != fifo->index.pSample ) )
+	{
+		index_alloc( fifo );
+	}
+
+	cursor_unlock( fifo );
+	cache_unlock( fifo );
+
+	IotLogInfo( "fifo_resize: %d to %d, %d records to move", pMigrate->ctl.oldMax, nItems, pMigrate->ctl.moveCount );
+
 	return err;
 }
 
 /************************************************************************/
 /**
- * @brief	Get next available element from the FIFO
+ * @brief	Move records for a resize in progress
  *
- * The next available element is accessed via the <i>tail</i> pointer.
+ * Moves at most <i>maxRecords</i> records per call, each a read, a write and an
+ * erase of one record, plus a journal save.  Intended to be called periodically,
+ * by the task that consumes the FIFO, until fifo_migrating() returns false.
  *
- * @param[in]		fifo	FIFO handle
- * @param[out]		blob	Destination pointer
- * @param[in|out]	pLength	Length of destination buffer as input, number of bytes copies as output
+ * @param[in] fifo			FIFO handle
+ * @param[in] maxRecords	Maximum number of records to move
  * @return
- * 	- ESP_OK if next element retrieved without error
- * 	- ESP_FAIL if error retrieving element
+ * 	- ESP_OK if no resize is in progress, or records moved without error
+ * 	- ESP_FAIL if error moving records
  */
 /************************************************************************/
-int32_t fifo_get( fifo_handle_t fifo, void* blob, size_t *pLength )
+int32_t fifo_migrate( fifo_handle_t fifo, uint16_t maxRecords )
 {
-	esp_err_t	err = ESP_OK;
+	esp_err_t err = ESP_OK;
 
-	if( ( fifo == NULL ) || ( blob == NULL ) )
+	if( fifo == NULL )
 	{
-		IotLogError( "fifo_get: Error\n" );
-		err = ESP_FAIL;
+		IotLogError( "fifo_migrate: Error\n" );
+		return ESP_FAIL;
 	}
 
-	if( ( ESP_OK == err ) && fifo_empty( fifo ) )
+	cursor_lock( fifo );
+	if( fifo->migrate.bActive )
 	{
-		IotLogInfo( "fifo_get: empty" );
-		err = ESP_FAIL;
+		err = migrate_copy( fifo, fifo->migrate.ctl.copied + maxRecords );
+	}
+	cursor_unlock( fifo );
+
+	return err;
+}
+
+/************************************************************************/
+/**
+ * @brief	FIFO resize in progress?
+ *
+ * @param[in] fifo	FIFO handle
+ * @return
+ *		- <i>true</i> if records are still to be moved, see fifo_migrate()
+ *		- <i>false</i> if no resize is in progress
+ */
+/************************************************************************/
+bool fifo_migrating( fifo_handle_t fifo )
+{
+	return ( ( NULL != fifo ) && fifo->migrate.bActive );
+}
+
+/************************************************************************/
+/**
+ * @brief	Open a named read cursor
+ *
+ * Each cursor reads the FIFO independently, with its own read position and commit.
+ * Records are only released from the FIFO once every cursor, and the default reader
+ * (fifo_get()/fifo_commitRead()), has committed them.  Cursor positions are saved in
+ * NVS, with key <i>keyPrefix</i>"CUR", and restored by fifo_init().
+ *
+ * A new cursor starts at the oldest record in the FIFO.  Opening an existing cursor
+ * returns it at its last committed position.  When the FIFO is full, new records
+ * overwrite the oldest, and cursors reading those records are moved past them.
+ *
+ * Cursors are not supported for packed FIFOs.
+ *
+ * @param[in] fifo	FIFO handle
+ * @param[in] name	Cursor name, up to FIFO_CURSOR_NAME_LENGTH - 1 characters
+ * @return		Cursor handle, NULL if FIFO is packed, name is invalid, all cursors are in use, or error saving cursor
+ */
+/************************************************************************/
+fifo_cursor_handle_t fifo_cursorOpen( fifo_handle_t fifo, const char *name )
+{
+	esp_err_t err = ESP_OK;
+	struct fifo_cursors_s *pCursors;
+	bool bActivated = false;
+	int slot = 0;
+	int i;
+
+	if( ( NULL == fifo ) || ( NULL == name ) || ( '\0' == name[ 0 ] ) || ( FIFO_CURSOR_NAME_LENGTH <= strlen( name ) ) ||
+		( 0 < fifo->packed.segmentSize ) )
+	{
+		IotLogError( "fifo_cursorOpen: Error\n" );
+		return NULL;
 	}
 
-	if( ( ESP_OK == err ) && !formatKey( fifo, fifo->activeTail ) )
+	pCursors = &fifo->cursors;
+	cursor_lock( fifo );
+
+	/* First cursor: the default reader becomes cursor 0, at its current read position */
+	if( !pCursors->bActive )
 	{
-		IotLogError( "fifo_get: key format error" );
-		err = ESP_FAIL;
+		memset( &pCursors->ctl, 0, sizeof( pCursors->ctl ) );
+		pCursors->cursor[ CURSOR_DEFAULT ].activeOffset = ( fifo->activeTail + fifo->max - fifo->tail ) % fifo->max;
+		pCursors->dropped = 0;
+		pCursors->bActive = true;
+		bActivated = true;
 	}
 
-	if( ESP_OK == err )
+	for( i = 1; ( i < CURSOR_SLOTS ) && ( 0 == slot ); ++i )
+	{
+		if( 0 == strcmp( pCursors->ctl.name[ i ], name ) )
+		{
+			slot = i;
+		}
+	}
+
+	if( 0 == slot )
+	{
+		for( i = 1; ( i < CURSOR_SLOTS ) && ( 0 == slot ); ++i )
+		{
+			if( !cursor_in_use( fifo, i ) )
+			{
+				slot = i;
+				strcpy( pCursors->ctl.name[ slot ], name );
+				pCursors->ctl.offset[ slot ] = 0;
+				pCursors->cursor[ slot ].activeOffset = 0;
+				err = cursors_save( fifo );
+				if( ESP_OK != err )
+				{
+					pCursors->ctl.name[ slot ][ 0 ] = '\0';
+				}
+			}
+		}
+
+		if( 0 == slot )
+		{
+			IotLogError( "fifo_cursorOpen: no free cursor" );
+			err = ESP_FAIL;
+		}
+	}
+
+	if( ( ESP_OK != err ) && bActivated )
+	{
+		pCursors->bActive = false;
+	}
+
+	cursor_unlock( fifo );
+
+	IotLogInfo( "fifo_cursorOpen: %s, slot = %d, size = %d", name, slot, ( ESP_OK == err ) ? fifo_cursorSize( &pCursors->cursor[ slot ] ) : 0 );
+
+	return ( ESP_OK == err ) ? &pCursors->cursor[ slot ] : NULL;
+}
+
+/************************************************************************/
+/**
+ * @brief	Delete a named read cursor
+ *
+ * Records held only for the deleted cursor are released.  When the last named cursor
+ * is deleted, the FIFO reverts to the single default reader.
+ *
+ * @param[in] cursor	Cursor handle, not valid after deletion
+ * @return
+ * 	- ESP_OK if cursor deleted, and controls saved, without error
+ * 	- ESP_FAIL if invalid cursor, or error saving controls
+ */
+/************************************************************************/
+int32_t fifo_cursorDelete( fifo_cursor_handle_t cursor )
+{
+	esp_err_t err = ESP_OK;
+	fifo_handle_t fifo;
+	bool bNamed = false;
+	int i;
+
+	if( !cursor_valid( cursor ) || ( CURSOR_DEFAULT == cursor->slot ) )
+	{
+		IotLogError( "fifo_cursorDelete: Error\n" );
+		return ESP_FAIL;
+	}
+
+	fifo = cursor->fifo;
+	cursor_lock( fifo );
+
+	fifo->cursors.ctl.name[ cursor->slot ][ 0 ] = '\0';
+	fifo->cursors.ctl.offset[ cursor->slot ] = 0;
+	cursor->activeOffset = 0;
+
+	if( 0 < cursors_release( fifo ) )
+	{
+		err = save_controls( fifo );
+	}
+
+	for( i = 1; i < CURSOR_SLOTS; ++i )
 	{
-		err = NVS_pGet( &fifo->entry, blob, pLength );
+		bNamed = bNamed || cursor_in_use( fifo, i );
 	}
+	fifo->cursors.bActive = bNamed;								// without named cursors, activeTail is the default read position
 
 	if( ESP_OK == err )
 	{
-		err = retreat_pointer( fifo );
+		err = cursors_save( fifo );
 	}
 
+	cursor_unlock( fifo );
+
 	return err;
 }
 
 /************************************************************************/
 /**
- * @brief	Commit FIFO Read
+ * @brief	Number of records available to a cursor
  *
- * @param[in]		fifo	FIFO handle
- * @param[in]		commit	If true, commit read, if false abort read
+ * @param[in] cursor	Cursor handle
+ * @return	Number of records from the cursor read position to the head
+ */
+/************************************************************************/
+uint16_t fifo_cursorSize( fifo_cursor_handle_t cursor )
+{
+	uint16_t used;
+	uint16_t size = 0;
+
+	if( !cursor_valid( cursor ) )
+	{
+		IotLogError( "fifo_cursorSize: Error\n" );
+		return 0;
+	}
+
+	cursor_lock( cursor->fifo );
+	used = stored_count( cursor->fifo );
+	if( used > cursor->activeOffset )
+	{
+		size = used - cursor->activeOffset;
+	}
+	cursor_unlock( cursor->fifo );
+
+	return size;
+}
+
+/************************************************************************/
+/**
+ * @brief	Get next record for a cursor
+ *
+ * As with fifo_get(), the read must be completed with fifo_cursorCommit().
+ *
+ * @param[in]		cursor	Cursor handle
+ * @param[out]		blob	Destination pointer
+ * @param[in|out]	pLength	Length of destination buffer as input, number of bytes copied as output
  * @return
- * 	- ESP_OK if FIFO controls saved without error
- * 	- ESP_FAIL if error saving FIFO controls
+ * 	- ESP_OK if next record retrieved without error
+ * 	- ESP_FAIL if invalid cursor, no record available, or error retrieving record
  */
 /************************************************************************/
-int32_t fifo_commitRead( fifo_handle_t fifo, bool commit )
+int32_t fifo_cursorGet( fifo_cursor_handle_t cursor, void* blob, size_t *pLength )
 {
-	esp_err_t	err = ESP_OK;
+	esp_err_t err;
 
-	if( commit )
+	if( !cursor_valid( cursor ) || ( NULL == blob ) || ( NULL == pLength ) )
 	{
-		fifo->full = FIFO_NOT_FULL;
-		fifo->tail = fifo->activeTail;
+		IotLogError( "fifo_cursorGet: Error\n" );
+		return ESP_FAIL;
 	}
-	else
+
+	cursor_lock( cursor->fifo );
+	err = cursor_get( cursor, blob, pLength );
+	cursor_unlock( cursor->fifo );
+
+	if( ESP_ERR_NVS_INVALID_LENGTH == err )
 	{
-		fifo->activeTail = fifo->tail;						// abort read, restore tail to activeTail
+		IotLogError( "fifo_cursorGet: buffer too small, %d", *pLength );
 	}
-	err = save_controls( fifo );
+
+	return err;
+}
+
+/************************************************************************/
+/**
+ * @brief	Commit, or abort, cursor reads
+ *
+ * Committing saves the cursor position in NVS; if this was the slowest cursor, the
+ * FIFO tail is advanced, releasing records read by all cursors.
+ *
+ * @param[in]		cursor	Cursor handle
+ * @param[in]		commit	If true, commit read, if false abort read
+ * @return
+ * 	- ESP_OK if controls saved without error
+ * 	- ESP_FAIL if invalid cursor, or error saving controls
+ */
+/************************************************************************/
+int32_t fifo_cursorCommit( fifo_cursor_handle_t cursor, bool commit )
+{
+	esp_err_t err;
+
+	if( !cursor_valid( cursor ) )
+	{
+		IotLogError( "fifo_cursorCommit: Error\n" );
+		return ESP_FAIL;
+	}
+
+	cursor_lock( cursor->fifo );
+	err = cursor_commit( cursor, commit );
+	cursor_unlock( cursor->fifo );
 
 	return err;
 }
@@ -579,6 +3324,10 @@ int32_t fifo_commitRead( fifo_handle_t fifo, bool commit )
  */
 uint16_t fifo_getHead( fifo_handle_t fifo)
 {
+	if( 0 < fifo->packed.segmentSize )
+	{
+		return fifo->packed.ctl.headSeg;
+	}
 	return fifo->head;
 }
 
@@ -589,6 +3338,10 @@ uint16_t fifo_getHead( fifo_handle_t fifo)
  */
 uint16_t fifo_getTail( fifo_handle_t fifo)
 {
+	if( 0 < fifo->packed.segmentSize )
+	{
+		return fifo->packed.ctl.tailSeg;
+	}
 	return fifo->tail;
 }
 
@@ -9,6 +9,10 @@
 
 /* FreeRTOS includes. */
 #include "FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "esp_timer.h"
 
 /* PKCS#11 includes */
 #include "iot_pkcs11_config.h"
@@ -38,6 +42,223 @@
  */
 static const	 nvsItem_pal_t * _pal;
 
+/**
+ * @brief	Number of open namespace handles held in the handle cache
+ */
+#define	NVS_HANDLE_CACHE_SIZE		4
+
+/**
+ * @brief	Namespace handle cache entry
+ */
+typedef struct
+{
+	bool				valid;										/**< Entry holds an open handle */
+	bool				stale;										/**< Invalidated while in use, not reused, closed by final release */
+	int					partition;									/**< Partition index */
+	int32_t				readWrite;									/**< NVS_READONLY or NVS_READWRITE */
+	char				namespace[ 16 ];							/**< Namespace */
+	nvs_handle			handle;										/**< Open handle */
+	uint16_t			users;										/**< Number of callers currently using handle */
+	uint32_t			lastUsed;									/**< Use count when handle was last obtained, for LRU replacement */
+} _handleCacheEntry_t;
+
+/**
+ * @brief	Namespace handle cache
+ */
+static struct
+{
+	SemaphoreHandle_t	mutex;										/**< Protects cache, created by NVS_Initialize */
+	uint32_t			useCount;									/**< Incremented each time a handle is obtained */
+	_handleCacheEntry_t	entry[ NVS_HANDLE_CACHE_SIZE ];				/**< Cached handles */
+} _handleCache;
+
+/**
+ * @brief	Maximum number of namespace handles held by a transaction
+ */
+#define	NVS_TXN_MAX_HANDLES			4
+
+/**
+ * @brief	Transaction control
+ *
+ * Only one task may hold a transaction at a time; other tasks block in NVS_BeginTxn().
+ */
+static struct
+{
+	SemaphoreHandle_t	mutex;										/**< Held by owner for duration of transaction, created by NVS_Initialize */
+	TaskHandle_t		owner;										/**< Task holding transaction, NULL if none */
+	uint16_t			depth;										/**< Nesting depth of NVS_BeginTxn() calls */
+	uint16_t			nHandles;									/**< Number of handles held */
+	nvs_handle			handles[ NVS_TXN_MAX_HANDLES ];				/**< Handles written in transaction, committed by NVS_Commit() */
+	esp_err_t			err;										/**< First error encountered in transaction */
+} _txn;
+
+/**
+ * @brief	Size of buffer used to compare string and blob values with the stored value
+ */
+#define	NVS_COMPARE_BUFFER_SIZE		512
+
+/**
+ * @brief	Compare buffer, used by NVS_pSet to avoid heap allocation
+ */
+static struct
+{
+	SemaphoreHandle_t	mutex;										/**< Protects compare buffer, created by NVS_Initialize */
+	uint8_t				buffer[ NVS_COMPARE_BUFFER_SIZE ];			/**< Stored value, for comparison */
+} _compare;
+
+/**
+ * @brief	NVS access statistics operation
+ */
+typedef enum
+{
+	eStatsRead,
+	eStatsWrite,
+	eStatsErase
+} _statsOp_t;
+
+/**
+ * @brief	NVS access statistics, per partition and per key
+ */
+static struct
+{
+	SemaphoreHandle_t	mutex;										/**< Protects statistics, created by NVS_Initialize */
+	NVS_Stats_t			partition[ NVS_STATS_MAX_PARTITIONS ];		/**< Per partition statistics */
+	NVS_KeyStats_t		key[ NVS_STATS_MAX_KEYS ];					/**< Per key statistics, last entry accumulates all other keys */
+	uint16_t			nKeys;										/**< Number of key entries in use */
+} _stats;
+
+/**
+ * @brief	Find, or create, statistics entry for an NVS Item
+ *
+ * Keys ending in a decimal index are grouped by prefix, e.g. "EVR12" is recorded as "EVR#".
+ * When the table is full, the last entry is used for all remaining keys.
+ *
+ * @param[in]	pItem	Pointer to NVS Table Item
+ * @return		Pointer to key statistics entry
+ */
+static NVS_KeyStats_t * _getKeyStats( const NVS_Entry_Details_t *pItem )
+{
+	NVS_KeyStats_t *pKey;
+	char key[ sizeof( pKey->nvsKey ) ];
+	size_t	length;
+	size_t	prefix;
+	int i;
+
+	/* Copy key, replacing any trailing index with '#' */
+	strncpy( key, pItem->nvsKey, ( sizeof( key ) - 1 ) );
+	key[ sizeof( key ) - 1 ] = '\0';
+	length = strlen( key );
+	for( prefix = length; ( 0 < prefix ) && ( '0' <= key[ prefix - 1 ] ) && ( '9' >= key[ prefix - 1 ] ); --prefix )
+	{
+	}
+	if( ( 0 < prefix ) && ( prefix < length ) )
+	{
+		key[ prefix ] = '#';
+		key[ prefix + 1 ] = '\0';
+	}
+
+	for( i = 0; i < _stats.nKeys; ++i )
+	{
+		pKey = &_stats.key[ i ];
+		if( ( pKey->partition == pItem->partition ) &&
+			( 0 == strncmp( pKey->namespace, pItem->namespace, ( sizeof( pKey->namespace ) - 1 ) ) ) &&
+			( 0 == strcmp( pKey->nvsKey, key ) ) )
+		{
+			return pKey;
+		}
+	}
+
+	/* Table full, use last entry for all other keys */
+	if( ( NVS_STATS_MAX_KEYS - 1 ) <= _stats.nKeys )
+	{
+		pKey = &_stats.key[ NVS_STATS_MAX_KEYS - 1 ];
+		if( NVS_STATS_MAX_KEYS == _stats.nKeys )
+		{
+			return pKey;
+		}
+		strcpy( pKey->namespace, "*" );
+		strcpy( pKey->nvsKey, "*" );
+	}
+	else
+	{
+		pKey = &_stats.key[ _stats.nKeys ];
+		strncpy( pKey->namespace, pItem->namespace, ( sizeof( pKey->namespace ) - 1 ) );
+		strcpy( pKey->nvsKey, key );
+	}
+	pKey->partition = pItem->partition;
+	++_stats.nKeys;
+
+	return pKey;
+}
+
+/**
+ * @brief	Accumulate a single operation into a statistics structure
+ */
+static void _accumulateStats( NVS_Stats_t *pStats, _statsOp_t op, size_t bytes, uint32_t elapsed, esp_err_t err )
+{
+	if( ( ESP_OK != err ) && ( ESP_ERR_NVS_NOT_FOUND != err ) )
+	{
+		pStats->errors++;
+	}
+
+	switch( op )
+	{
+		case eStatsRead:
+			pStats->reads++;
+			pStats->readTime += elapsed;
+			break;
+
+		case eStatsWrite:
+			if( ESP_OK == err )
+			{
+				if( 0 < bytes )
+				{
+					pStats->writes++;
+					pStats->bytesWritten += bytes;
+				}
+				else
+				{
+					pStats->writesSkipped++;
+				}
+			}
+			pStats->writeTime += elapsed;
+			break;
+
+		case eStatsErase:
+			pStats->erases++;
+			break;
+
+		default:
+			break;
+	}
+}
+
+/**
+ * @brief	Record statistics for an NVS operation
+ *
+ * @param[in]	pItem		Pointer to NVS Table Item
+ * @param[in]	op			Operation performed
+ * @param[in]	bytes		Bytes written, zero if a write was skipped
+ * @param[in]	startTime	Time operation started, from esp_timer_get_time()
+ * @param[in]	err			Operation result
+ */
+static void _updateStats( const NVS_Entry_Details_t *pItem, _statsOp_t op, size_t bytes, int64_t startTime, esp_err_t err )
+{
+	uint32_t elapsed = ( uint32_t )( esp_timer_get_time() - startTime );
+
+	if( ( NULL != _stats.mutex ) && ( pdTRUE == xSemaphoreTake( _stats.mutex, portMAX_DELAY ) ) )
+	{
+		if( pItem->partition < NVS_STATS_MAX_PARTITIONS )
+		{
+			_accumulateStats( &_stats.partition[ pItem->partition ], op, bytes, elapsed, err );
+		}
+
+		_accumulateStats( &_getKeyStats( pItem )->stats, op, bytes, elapsed, err );
+
+		xSemaphoreGive( _stats.mutex );
+	}
+}
+
 /**
  * @brief Initialize NVS Partition using entry from Partition Table
  *
@@ -110,7 +331,7 @@ static int32_t _getTablePointerFromNVSItem( NVS_Items_t nvsItem, const NVS_Entry
 
 
 /**
- * @brief Get the handle of a specified nvs item
+ * @brief Open the handle of a specified nvs item
  *
  * @param[in] pItem			Pointer to NVS Table Item
  * @param[in] readWrite		Define handle to be NVS_READONLY or NVS_READWRITE
@@ -120,7 +341,7 @@ static int32_t _getTablePointerFromNVSItem( NVS_Items_t nvsItem, const NVS_Entry
  * 	- ESP_OK 	if successful
  * 	- ESP_FAIL	if failed
  */
-static int32_t _getNVSnamespaceHandle( const NVS_Entry_Details_t *pItem, int32_t readWrite, nvs_handle* handle )
+static int32_t _openNVSnamespaceHandle( const NVS_Entry_Details_t *pItem, int32_t readWrite, nvs_handle* handle )
 {
 	esp_err_t err = ESP_OK;
 	NVS_Partition_Details_t *pPartition;
@@ -151,16 +372,233 @@ static int32_t _getNVSnamespaceHandle( const NVS_Entry_Details_t *pItem, int32_t
 		IotLogError( "ERROR initializing flash partition", err );
 	}
 
-	if (err != ESP_OK)
+	if( ( ESP_ERR_NVS_NOT_FOUND == err ) && ( NVS_READONLY == readWrite ) )
+	{
+		/* Namespace doesn't exist yet, so no keys stored, reported by caller */
+		IotLogInfo( "Namespace \"%s\" not stored yet", pItem->namespace );
+		*handle = 0;
+	}
+	else if (err != ESP_OK)
 	{
-		/* This can happen if namespace doesn't exist yet, so no keys stored */
-		IotLogError( "FAILED NVS OPEN. Namespace \"%s\" may not exist yet, err: 0x%04X", pItem->namespace, err );
+		IotLogError( "FAILED NVS OPEN. Namespace \"%s\", err: 0x%04X", pItem->namespace, err );
+		*handle = 0;
+	}
+	else
+	{
+		IotLogInfo( "Namespace %s opened, handle = %p", pPartition->label, *handle );
 	}
 
-	IotLogInfo( "Namespace %s opened, handle = %p", pPartition->label, *handle );
 	return err;
 }
 
+/**
+ * @brief Get the handle of a specified nvs item
+ *
+ * Handles are taken from the handle cache when available, otherwise a new handle is
+ * opened and added to the cache, replacing the least recently used idle entry.
+ * If every cache entry is in use, an uncached handle is returned.
+ * Every handle obtained must be returned using _releaseNVSnamespaceHandle().
+ *
+ * @param[in] pItem			Pointer to NVS Table Item
+ * @param[in] readWrite		Define handle to be NVS_READONLY or NVS_READWRITE
+ * @param[out] handle		Handle of namespace within partition
+ *
+ * @return
+ * 	- ESP_OK 	if successful
+ * 	- ESP_FAIL	if failed
+ */
+static int32_t _getNVSnamespaceHandle( const NVS_Entry_Details_t *pItem, int32_t readWrite, nvs_handle* handle )
+{
+	esp_err_t err = ESP_OK;
+	_handleCacheEntry_t *pEntry;
+	_handleCacheEntry_t *pVictim = NULL;
+	int i;
+
+	if( ( NULL == _handleCache.mutex ) || ( pdTRUE != xSemaphoreTake( _handleCache.mutex, portMAX_DELAY ) ) )
+	{
+		return _openNVSnamespaceHandle( pItem, readWrite, handle );
+	}
+
+	/* Look for a cached handle, tracking the least recently used idle entry */
+	for( i = 0; i < NVS_HANDLE_CACHE_SIZE; ++i )
+	{
+		pEntry = &_handleCache.entry[ i ];
+		if( pEntry->valid && !pEntry->stale &&
+			( pEntry->partition == pItem->partition ) &&
+			( pEntry->readWrite == readWrite ) &&
+			( 0 == strcmp( pEntry->namespace, pItem->namespace ) ) )
+		{
+			pEntry->users++;
+			pEntry->lastUsed = ++_handleCache.useCount;
+			*handle = pEntry->handle;
+			xSemaphoreGive( _handleCache.mutex );
+			return ESP_OK;
+		}
+
+		if( 0 == pEntry->users )
+		{
+			if( ( NULL == pVictim ) || ( !pEntry->valid ) || ( pVictim->valid && ( pEntry->lastUsed < pVictim->lastUsed ) ) )
+			{
+				pVictim = pEntry;
+			}
+		}
+	}
+
+	err = _openNVSnamespaceHandle( pItem, readWrite, handle );
+
+	/* Cache the new handle, if an idle entry is available and namespace fits */
+	if( ( ESP_OK == err ) && ( NULL != pVictim ) && ( sizeof( pVictim->namespace ) > strlen( pItem->namespace ) ) )
+	{
+		if( pVictim->valid )
+		{
+			nvs_close( pVictim->handle );
+		}
+		pVictim->valid = true;
+		pVictim->stale = false;
+		pVictim->partition = pItem->partition;
+		pVictim->readWrite = readWrite;
+		strcpy( pVictim->namespace, pItem->namespace );
+		pVictim->handle = *handle;
+		pVictim->users = 1;
+		pVictim->lastUsed = ++_handleCache.useCount;
+	}
+
+	xSemaphoreGive( _handleCache.mutex );
+
+	return err;
+}
+
+/**
+ * @brief Release a handle obtained from _getNVSnamespaceHandle()
+ *
+ * Cached handles remain open, uncached handles are closed, as are invalidated handles
+ * once their last user has released them.
+ *
+ * @param[in] handle		Handle to be released
+ */
+static void _releaseNVSnamespaceHandle( nvs_handle handle )
+{
+	_handleCacheEntry_t *pEntry;
+	bool bClose = true;
+
+	if( 0 == handle )
+	{
+		return;
+	}
+
+	if( ( NULL != _handleCache.mutex ) && ( pdTRUE == xSemaphoreTake( _handleCache.mutex, portMAX_DELAY ) ) )
+	{
+		for( int i = 0; i < NVS_HANDLE_CACHE_SIZE; ++i )
+		{
+			pEntry = &_handleCache.entry[ i ];
+			if( pEntry->valid && ( pEntry->handle == handle ) )
+			{
+				if( 0 < pEntry->users )
+				{
+					pEntry->users--;
+				}
+				bClose = pEntry->stale && ( 0 == pEntry->users );
+				if( bClose )
+				{
+					pEntry->valid = false;
+					pEntry->stale = false;
+				}
+				break;
+			}
+		}
+		xSemaphoreGive( _handleCache.mutex );
+	}
+
+	if( bClose )
+	{
+		nvs_close( handle );
+	}
+}
+
+/**
+ * @brief Invalidate cached handles
+ *
+ * Idle handles are closed.  Handles in use are marked stale, so they are not handed
+ * out again, and are closed by their final release.
+ *
+ * @param[in] partition		Partition index of handles to invalidate
+ * @param[in] namespace		Namespace of handles to invalidate, NULL for all namespaces in partition
+ */
+static void _invalidateNVSnamespaceHandles( int partition, const char *namespace )
+{
+	_handleCacheEntry_t *pEntry;
+
+	if( ( NULL != _handleCache.mutex ) && ( pdTRUE == xSemaphoreTake( _handleCache.mutex, portMAX_DELAY ) ) )
+	{
+		for( int i = 0; i < NVS_HANDLE_CACHE_SIZE; ++i )
+		{
+			pEntry = &_handleCache.entry[ i ];
+			if( pEntry->valid &&
+				( ( partition < 0 ) || ( pEntry->partition == partition ) ) &&
+				( ( NULL == namespace ) || ( 0 == strcmp( pEntry->namespace, namespace ) ) ) )
+			{
+				if( 0 == pEntry->users )
+				{
+					nvs_close( pEntry->handle );
+					pEntry->valid = false;
+				}
+				else
+				{
+					pEntry->stale = true;
+				}
+			}
+		}
+		xSemaphoreGive( _handleCache.mutex );
+	}
+}
+
+/**
+ * @brief Check if calling task holds a transaction
+ *
+ * @return	true if NVS_BeginTxn() has been called, by this task, without a matching NVS_Commit()
+ */
+static bool _inTxn( void )
+{
+	return ( NULL != _txn.owner ) && ( xTaskGetCurrentTaskHandle() == _txn.owner );
+}
+
+/**
+ * @brief Hold a handle, written within a transaction, until NVS_Commit()
+ *
+ * If the handle is already held, the additional reference is released.
+ * If the transaction handle table is full, the handle is committed and released immediately.
+ *
+ * @param[in] handle		Handle written within transaction
+ */
+static void _txnHoldHandle( nvs_handle handle )
+{
+	esp_err_t err;
+
+	for( int i = 0; i < _txn.nHandles; ++i )
+	{
+		if( _txn.handles[ i ] == handle )
+		{
+			_releaseNVSnamespaceHandle( handle );
+			return;
+		}
+	}
+
+	if( NVS_TXN_MAX_HANDLES > _txn.nHandles )
+	{
+		_txn.handles[ _txn.nHandles++ ] = handle;
+	}
+	else
+	{
+		IotLogError( "Transaction handle table full, committing early" );
+		err = nvs_commit( handle );
+		if( ( ESP_OK != err ) && ( ESP_OK == _txn.err ) )
+		{
+			_txn.err = err;
+		}
+		_releaseNVSnamespaceHandle( handle );
+	}
+}
+
 /* ************************************************************************* */
 /* ************************************************************************* */
 /* **********        I N T E R F A C E   F U N C T I O N S        ********** */
@@ -187,6 +625,27 @@ int32_t NVS_Initialize( const nvsItem_pal_t * pal  )
 	/* Save abstraction layer pointer */
 	_pal = pal;
 
+	/* Create statistics and compare buffer mutexes */
+	if( NULL == _stats.mutex )
+	{
+		_stats.mutex = xSemaphoreCreateMutex();
+	}
+
+	if( NULL == _compare.mutex )
+	{
+		_compare.mutex = xSemaphoreCreateMutex();
+	}
+
+	if( NULL == _handleCache.mutex )
+	{
+		_handleCache.mutex = xSemaphoreCreateMutex();
+	}
+
+	if( NULL == _txn.mutex )
+	{
+		_txn.mutex = xSemaphoreCreateMutex();
+	}
+
 	if( NULL == _pal )
 	{
 		IotLogError( "NVS Item Abstraction Layer is NULL!" );
@@ -251,6 +710,7 @@ int32_t NVS_Initialize( const nvsItem_pal_t * pal  )
 		    if( ( err == ESP_ERR_NVS_NO_FREE_PAGES ) || ( err == ESP_ERR_NVS_NEW_VERSION_FOUND ) )
 		    {
 		    	IotLogInfo(" Erase NVS Partition: %s",  _pal->partitions[ i ].label );
+		    	_invalidateNVSnamespaceHandles( i, NULL );
 		        err = nvs_flash_erase_partition(  _pal->partitions[ i ].label );
 
 		        if( err ==  ESP_OK )
@@ -286,8 +746,8 @@ int32_t NVS_Initialize( const nvsItem_pal_t * pal  )
 int32_t NVS_pGet_Size_Of(  const NVS_Entry_Details_t *pItem, uint32_t* size )
 {
 	esp_err_t err;
-	nvs_handle handle;
-
+	nvs_handle handle = 0;
+	size_t length = 0;
 
 	err = _getNVSnamespaceHandle( pItem, NVS_READONLY, &handle );
 
@@ -328,11 +788,13 @@ int32_t NVS_pGet_Size_Of(  const NVS_Entry_Details_t *pItem, uint32_t* size )
 				break;
 
 			case NVS_TYPE_STR:
-				err = nvs_get_str( handle, pItem->nvsKey, NULL, size );
+				err = nvs_get_str( handle, pItem->nvsKey, NULL, &length );
+				*size = length;
 				break;
 
 			case NVS_TYPE_BLOB:
-				err = nvs_get_blob( handle, pItem->nvsKey, NULL, size );
+				err = nvs_get_blob( handle, pItem->nvsKey, NULL, &length );
+				*size = length;
 				break;
 
 			default:
@@ -345,7 +807,7 @@ int32_t NVS_pGet_Size_Of(  const NVS_Entry_Details_t *pItem, uint32_t* size )
 		IotLogDebug( "Unable to get NVS Item size" );
 	}
 
-	nvs_close( handle );
+	_releaseNVSnamespaceHandle( handle );
 
 	return err;
 }
@@ -374,18 +836,20 @@ int32_t NVS_Get_Size_Of( NVS_Items_t nvsItem, uint32_t* size )
 }
 
 /**
- * @brief Get the value of an nvs item using an NVS_Entry_details_t pointer
+ * @brief Get the value of an nvs item, logging errors
  *
  * @param[in]  pItem		Pointer to NVS_Entry_details_t item
  * @param[out] pOutput		Output value
  * @param[out] pSize		size of the output.  Only used for strings and blobs
+ * @param[in]  expected	Error that is an expected outcome, and is not logged, or ESP_OK
  *
  * @return 	ESP_OK if successful, -1 if failed
  */
-int32_t NVS_pGet( const NVS_Entry_Details_t *pItem, void* pOutput, void* pSize )
+static int32_t _getNVSitem( const NVS_Entry_Details_t *pItem, void* pOutput, void* pSize, esp_err_t expected )
 {
 	esp_err_t err;
-	nvs_handle handle;
+	nvs_handle handle = 0;
+	int64_t startTime = esp_timer_get_time();
 	// Initialize output size to 0
 
 
@@ -443,16 +907,64 @@ int32_t NVS_pGet( const NVS_Entry_Details_t *pItem, void* pOutput, void* pSize )
 		}
 	}
 
-	if( err != ESP_OK )
+	if( ( err != ESP_OK ) && ( err != expected ) )
 	{
 		IotLogError( "ERROR getting NVS Item: namespace = %s, key = %s, type= %d, err = %d", pItem->namespace, pItem->nvsKey, pItem->type, err );
 	}
 
-	nvs_close( handle);
+	_releaseNVSnamespaceHandle( handle );
+
+	_updateStats( pItem, eStatsRead, 0, startTime, err );
 
 	return err;
 }
 
+/**
+ * @brief Get the value of an nvs item using an NVS_Entry_details_t pointer
+ *
+ * @param[in]  pItem		Pointer to NVS_Entry_details_t item
+ * @param[out] pOutput		Output value
+ * @param[out] pSize		size of the output.  Only used for strings and blobs
+ *
+ * @return 	ESP_OK if successful, -1 if failed
+ */
+int32_t NVS_pGet( const NVS_Entry_Details_t *pItem, void* pOutput, void* pSize )
+{
+	return _getNVSitem( pItem, pOutput, pSize, ESP_OK );
+}
+
+/**
+ * @brief Get the value of an nvs item that is normally absent
+ *
+ * As NVS_pGet(), but a key that is not stored is not logged as an error.
+ *
+ * @param[in]  pItem		Pointer to NVS_Entry_details_t item
+ * @param[out] pOutput		Output value
+ * @param[out] pSize		size of the output.  Only used for strings and blobs
+ *
+ * @return 	ESP_OK if successful, ESP_ERR_NVS_NOT_FOUND if key is not stored, other error if failed
+ */
+int32_t NVS_pGetIfPresent( const NVS_Entry_Details_t *pItem, void* pOutput, void* pSize )
+{
+	return _getNVSitem( pItem, pOutput, pSize, ESP_ERR_NVS_NOT_FOUND );
+}
+
+/**
+ * @brief Get the value of a string or blob that may not fit the output buffer
+ *
+ * As NVS_pGet(), but a value larger than the output buffer is not logged as an error.
+ *
+ * @param[in]  pItem		Pointer to NVS_Entry_details_t item
+ * @param[out] pOutput		Output value
+ * @param[out] pSize		size of the output.  Only used for strings and blobs
+ *
+ * @return 	ESP_OK if successful, ESP_ERR_NVS_INVALID_LENGTH if value does not fit, other error if failed
+ */
+int32_t NVS_pGetIfFits( const NVS_Entry_Details_t *pItem, void* pOutput, void* pSize )
+{
+	return _getNVSitem( pItem, pOutput, pSize, ESP_ERR_NVS_INVALID_LENGTH );
+}
+
 /**
  * @brief Get the value of a specified nvs item
  *
@@ -479,10 +991,85 @@ int32_t NVS_Get( NVS_Items_t nvsItem, void* pOutput, void* pSize )
 	return err;
 }
 
+/**
+ * @brief Compare a string or blob value with the value stored in NVS
+ *
+ * The stored size is checked first, so a value of different size is detected without
+ * reading the stored data.  Values of matching size are read, through the open handle,
+ * into a static compare buffer.  Values larger than the compare buffer, such as
+ * certificates, are read into a temporary allocation instead, as NVS cannot read part
+ * of a value; if it cannot be allocated, the value is reported as not matching.
+ *
+ * @param[in] handle		Open namespace handle
+ * @param[in] pItem			Pointer to NVS_Entry_Details_t item, NVS_TYPE_STR or NVS_TYPE_BLOB
+ * @param[in] pInput		Value to compare
+ * @param[in] size			Size of value, including null-terminator for strings
+ *
+ * @return	true if the stored value matches
+ */
+static bool _storedValueMatches( nvs_handle handle, const NVS_Entry_Details_t * pItem, const void * pInput, size_t size )
+{
+	esp_err_t err;
+	size_t currentSize = 0;
+	uint8_t *pCurrent = NULL;
+	bool bMatch = false;
+
+	if( NVS_TYPE_STR == pItem->type )
+	{
+		err = nvs_get_str( handle, pItem->nvsKey, NULL, &currentSize );
+	}
+	else
+	{
+		err = nvs_get_blob( handle, pItem->nvsKey, NULL, &currentSize );
+	}
+
+	if( ( ESP_OK != err ) || ( currentSize != size ) )
+	{
+		return false;
+	}
+
+	if( NVS_COMPARE_BUFFER_SIZE < size )
+	{
+		pCurrent = pvPortMalloc( size );
+	}
+	else if( ( NULL != _compare.mutex ) && ( pdTRUE == xSemaphoreTake( _compare.mutex, portMAX_DELAY ) ) )
+	{
+		pCurrent = _compare.buffer;
+	}
+
+	if( NULL != pCurrent )
+	{
+		if( NVS_TYPE_STR == pItem->type )
+		{
+			err = nvs_get_str( handle, pItem->nvsKey, ( char * )pCurrent, &currentSize );
+		}
+		else
+		{
+			err = nvs_get_blob( handle, pItem->nvsKey, pCurrent, &currentSize );
+		}
+
+		bMatch = ( ESP_OK == err ) && ( currentSize == size ) && ( 0 == memcmp( pInput, pCurrent, size ) );
+
+		if( _compare.buffer == pCurrent )
+		{
+			xSemaphoreGive( _compare.mutex );
+		}
+		else
+		{
+			vPortFree( pCurrent );
+		}
+	}
+
+	return bMatch;
+}
+
 /**
  * @brief Set the value of an NVS item using an NVS_Entry_details_t pointer
  *
  * Only set the value in nvs if the value is different then what is currently stored in nvs
+ * The current value is read through the same handle used for the write, without heap allocation
+ * unless it is a string or blob larger than NVS_COMPARE_BUFFER_SIZE.
+ * Within a transaction, the value is written immediately but the commit is deferred to NVS_Commit().
  *
  * @param[in] pItem			Pointer to NVS_Entry_Details_t item
  * @param[in] pInput		Input value to set
@@ -493,9 +1080,21 @@ int32_t NVS_Get( NVS_Items_t nvsItem, void* pOutput, void* pSize )
 int32_t NVS_pSet( const NVS_Entry_Details_t * pItem, const void * pInput, size_t * pSize )
 {
 	esp_err_t err;
-	nvs_handle handle;
-	void *currentVal = NULL;
-	uint32_t currentSize = 0;
+	nvs_handle handle = 0;
+	size_t written = 0;
+	size_t length;
+	int64_t startTime = esp_timer_get_time();
+	union
+	{
+		uint8_t		u8;
+		int8_t		i8;
+		uint16_t	u16;
+		int16_t		i16;
+		uint32_t	u32;
+		int32_t		i32;
+		uint64_t	u64;
+		int64_t		i64;
+	} current;
 
 	// Open the namespace handle
 	err = _getNVSnamespaceHandle( pItem, NVS_READWRITE, &handle );
@@ -514,157 +1113,111 @@ int32_t NVS_pSet( const NVS_Entry_Details_t * pItem, const void * pInput, size_t
 		switch( pItem->type )
 		{
 			case NVS_TYPE_U8:
-				currentVal = pvPortMalloc( sizeof(uint8_t) );
-				err = NVS_pGet( pItem, currentVal, NULL );
-
-				if( err != ESP_OK || memcmp( pInput, currentVal, sizeof(uint8_t) ) != 0 )
+				if( ( ESP_OK == nvs_get_u8( handle, pItem->nvsKey, &current.u8 ) ) && ( current.u8 == *( uint8_t * )pInput ) )
 				{
-					err = nvs_set_u8( handle, pItem->nvsKey, *(uint8_t*)pInput );
+					IotLogDebug( "NVS item %s already set to %u, ignoring write", pItem->nvsKey, *( uint8_t * )pInput );
 				}
 				else
 				{
-					IotLogDebug( "NVS item %s already set to %u, ignoring write", pItem->nvsKey, *(uint8_t*)pInput );
+					err = nvs_set_u8( handle, pItem->nvsKey, *( uint8_t * )pInput );
+					written = sizeof( uint8_t );
 				}
-
-				vPortFree( currentVal );
 				break;
 
 			case NVS_TYPE_I8:
-				currentVal = pvPortMalloc( sizeof(int8_t) );
-				err = NVS_pGet( pItem, currentVal, NULL);
-
-				if( err != ESP_OK || memcmp( pInput, currentVal, sizeof(int8_t) ) != 0 )
+				if( ( ESP_OK == nvs_get_i8( handle, pItem->nvsKey, &current.i8 ) ) && ( current.i8 == *( int8_t * )pInput ) )
 				{
-					err = nvs_set_i8( handle, pItem->nvsKey, *(int8_t*)pInput );
+					IotLogDebug( "NVS item %s already set to %d, ignoring write", pItem->nvsKey, *( int8_t * )pInput );
 				}
 				else
 				{
-					IotLogInfo( "NVS item %s already set to %d, ignoring write", pItem->nvsKey, *(int8_t*)pInput );
+					err = nvs_set_i8( handle, pItem->nvsKey, *( int8_t * )pInput );
+					written = sizeof( int8_t );
 				}
-
-				vPortFree( currentVal );
 				break;
 
 			case NVS_TYPE_U16:
-				currentVal = pvPortMalloc( sizeof(uint16_t) );
-				err = NVS_pGet( pItem, currentVal, NULL );
-
-				if( err != ESP_OK || memcmp( pInput, currentVal, sizeof(uint16_t) ) != 0 )
+				if( ( ESP_OK == nvs_get_u16( handle, pItem->nvsKey, &current.u16 ) ) && ( current.u16 == *( uint16_t * )pInput ) )
 				{
-					err = nvs_set_u16( handle, pItem->nvsKey, *(uint16_t*)pInput );
+					IotLogDebug( "NVS item %s already set to %u, ignoring write", pItem->nvsKey, *( uint16_t * )pInput );
 				}
 				else
 				{
-					IotLogDebug( "NVS item %s already set to %u, ignoring write", pItem->nvsKey, *(uint16_t*)pInput );
+					err = nvs_set_u16( handle, pItem->nvsKey, *( uint16_t * )pInput );
+					written = sizeof( uint16_t );
 				}
-
-				vPortFree( currentVal );
 				break;
 
 			case NVS_TYPE_I16:
-				currentVal = pvPortMalloc( sizeof(int16_t) );
-				err = NVS_pGet( pItem, currentVal, NULL );
-
-				if( err != ESP_OK || memcmp( pInput, currentVal, sizeof(int16_t) ) != 0 )
+				if( ( ESP_OK == nvs_get_i16( handle, pItem->nvsKey, &current.i16 ) ) && ( current.i16 == *( int16_t * )pInput ) )
 				{
-					err = nvs_set_i16( handle, pItem->nvsKey, *(int16_t*)pInput );
+					IotLogDebug( "NVS item %s already set to %d, ignoring write", pItem->nvsKey, *( int16_t * )pInput );
 				}
 				else
 				{
-					IotLogInfo( "NVS item %s already set to %d, ignoring write", pItem->nvsKey, *(int16_t*)pInput );
+					err = nvs_set_i16( handle, pItem->nvsKey, *( int16_t * )pInput );
+					written = sizeof( int16_t );
 				}
-
-				vPortFree( currentVal );
 				break;
 
 			case NVS_TYPE_U32:
-				currentVal = pvPortMalloc( sizeof(uint32_t) );
-				err = NVS_pGet( pItem, currentVal, NULL );
-
-				if( err != ESP_OK || memcmp(pInput, currentVal, sizeof(uint32_t)) != 0 )
+				if( ( ESP_OK == nvs_get_u32( handle, pItem->nvsKey, &current.u32 ) ) && ( current.u32 == *( uint32_t * )pInput ) )
 				{
-					err = nvs_set_u32( handle, pItem->nvsKey, *(uint32_t*)pInput );
+					IotLogDebug( "NVS item %s already set to %u, ignoring write", pItem->nvsKey, *( uint32_t * )pInput );
 				}
 				else
 				{
-					IotLogInfo( "NVS item %s already set to %u, ignoring write", pItem->nvsKey, *(uint32_t*)pInput );
+					err = nvs_set_u32( handle, pItem->nvsKey, *( uint32_t * )pInput );
+					written = sizeof( uint32_t );
 				}
-
-				vPortFree( currentVal );
 				break;
 
 			case NVS_TYPE_I32:
-				currentVal = pvPortMalloc( sizeof(int32_t) );
-				err = NVS_pGet( pItem, currentVal, NULL );
-
-				if( err != ESP_OK || memcmp( pInput, currentVal, sizeof(int32_t) ) != 0 )
+				if( ( ESP_OK == nvs_get_i32( handle, pItem->nvsKey, &current.i32 ) ) && ( current.i32 == *( int32_t * )pInput ) )
 				{
-					err = nvs_set_i32( handle, pItem->nvsKey, *(int32_t*)pInput );
+					IotLogDebug( "NVS item %s already set to %d, ignoring write", pItem->nvsKey, *( int32_t * )pInput );
 				}
 				else
 				{
-					IotLogInfo( "NVS item %s already set to %d, ignoring write", pItem->nvsKey, *(int32_t*)pInput );
+					err = nvs_set_i32( handle, pItem->nvsKey, *( int32_t * )pInput );
+					written = sizeof( int32_t );
 				}
-
-				vPortFree( currentVal );
 				break;
 
 			case NVS_TYPE_U64:
-				currentVal = pvPortMalloc( sizeof(uint64_t) );
-				err = NVS_pGet( pItem, currentVal, NULL );
-
-				if( err != ESP_OK || memcmp(pInput, currentVal, sizeof(uint64_t)) != 0 )
+				if( ( ESP_OK == nvs_get_u64( handle, pItem->nvsKey, &current.u64 ) ) && ( current.u64 == *( uint64_t * )pInput ) )
 				{
-					err = nvs_set_u64( handle, pItem->nvsKey, *(uint64_t*)pInput );
+					IotLogDebug( "NVS item %s already set to %llu, ignoring write", pItem->nvsKey, *( uint64_t * )pInput );
 				}
 				else
 				{
-					IotLogInfo( "NVS item %s already set to %llu, ignoring write", pItem->nvsKey, *(uint64_t*)pInput );
+					err = nvs_set_u64( handle, pItem->nvsKey, *( uint64_t * )pInput );
+					written = sizeof( uint64_t );
 				}
-
-				vPortFree( currentVal );
 				break;
 
 			case NVS_TYPE_I64:
-				currentVal = pvPortMalloc( sizeof(int64_t) );
-				err = NVS_pGet( pItem, currentVal, NULL );
-
-				if( err != ESP_OK || memcmp( pInput, currentVal, sizeof(int64_t) ) != 0 )
+				if( ( ESP_OK == nvs_get_i64( handle, pItem->nvsKey, &current.i64 ) ) && ( current.i64 == *( int64_t * )pInput ) )
 				{
-					err = nvs_set_i64( handle, pItem->nvsKey, *(int64_t*)pInput );
+					IotLogDebug( "NVS item %s already set to %lld, ignoring write", pItem->nvsKey, *( int64_t * )pInput );
 				}
-				else{
-					IotLogInfo( "NVS item %s already set to %lld, ignoring write", pItem->nvsKey, *(int64_t*)pInput );
+				else
+				{
+					err = nvs_set_i64( handle, pItem->nvsKey, *( int64_t * )pInput );
+					written = sizeof( int64_t );
 				}
-
-				vPortFree( currentVal );
 				break;
 
 			case NVS_TYPE_STR:
-				err = NVS_pGet_Size_Of( pItem, &currentSize );
-
-				if( err == ESP_OK )
+				length = strlen( pInput ) + 1;
+				if( _storedValueMatches( handle, pItem, pInput, length ) )
 				{
-					currentVal = pvPortMalloc( currentSize );
-				}
-
-				if( err == ESP_OK )
-				{
-					err = NVS_pGet( pItem, currentVal, &currentSize );
-				}
-
-				if( err != ESP_OK || memcmp( pInput, currentVal, currentSize ) != 0 )
-				{
-					err = nvs_set_str( handle, pItem->nvsKey, pInput );
+					IotLogDebug( "NVS item %s already set to requested string, ignoring write", pItem->nvsKey );
 				}
 				else
 				{
-					IotLogInfo( "NVS item %s already set to requested string, ignoring write", pItem->nvsKey );
-				}
-
-				if( currentVal != NULL )
-				{
-					vPortFree( currentVal );
+					err = nvs_set_str( handle, pItem->nvsKey, pInput );
+					written = length;
 				}
 				break;
 
@@ -676,30 +1229,14 @@ int32_t NVS_pSet( const NVS_Entry_Details_t * pItem, const void * pInput, size_t
 				}
 				IotLogDebug( "NVS_Set, Blob, pSize = %d", *pSize);
 
-				err = NVS_pGet_Size_Of( pItem, &currentSize );
-
-				if( err == ESP_OK )
-				{
-					currentVal = pvPortMalloc( currentSize );
-				}
-
-				if( err == ESP_OK )
+				if( _storedValueMatches( handle, pItem, pInput, *pSize ) )
 				{
-					err = NVS_pGet( pItem, currentVal, &currentSize );
-				}
-
-				if( err != ESP_OK || memcmp( pInput, currentVal, *pSize ) != 0 )
-				{
-					err = nvs_set_blob( handle, pItem->nvsKey, pInput, *pSize );
+					IotLogDebug( "NVS item %s already set to requested blob, ignoring write", pItem->nvsKey );
 				}
 				else
 				{
-					IotLogInfo( "NVS item %s already set to requested blob, ignoring write", pItem->nvsKey );
-				}
-
-				if( currentVal != NULL )
-				{
-					vPortFree( currentVal );
+					err = nvs_set_blob( handle, pItem->nvsKey, pInput, *pSize );
+					written = *pSize;
 				}
 				break;
 
@@ -710,21 +1247,38 @@ int32_t NVS_pSet( const NVS_Entry_Details_t * pItem, const void * pInput, size_t
 		}
 	}
 
-	if( err == ESP_OK )
+	if( _inTxn() && ( 0 != handle ) )
 	{
-		err = nvs_commit( handle );
+		/* Within a transaction, commit is deferred to NVS_Commit() */
+		if( err != ESP_OK )
+		{
+			IotLogError( "ERROR setting NVS Item" );
+			if( ESP_OK == _txn.err )
+			{
+				_txn.err = err;
+			}
+		}
+		_txnHoldHandle( handle );
 	}
 	else
 	{
-		IotLogError( "ERROR setting NVS Item" );
-	}
+		if( ( err == ESP_OK ) && ( 0 < written ) )
+		{
+			err = nvs_commit( handle );
+			if( err != ESP_OK )
+			{
+				IotLogError( "ERROR Committing Handle" );
+			}
+		}
+		else if( err != ESP_OK )
+		{
+			IotLogError( "ERROR setting NVS Item" );
+		}
 
-	if( err != ESP_OK )
-	{
-		IotLogError( "ERROR Committing Handle" );
+		_releaseNVSnamespaceHandle( handle );
 	}
 
-	nvs_close( handle );
+	_updateStats( pItem, eStatsWrite, written, startTime, err );
 
 	return err;
 }
@@ -756,6 +1310,51 @@ int32_t NVS_Set( NVS_Items_t nvsItem, void* pInput, size_t * pSize )
 	return err;
 }
 
+/**
+ * @brief Erase a NVS key, specified by entry details
+ *
+ * @param[in] pItem		Pointer to NVS entry details of item to be erased
+ *
+ * @return 	ESP_OK if successful, ESP_ERR_NVS_NOT_FOUND if key is not stored, -1 if failed
+ */
+int32_t NVS_pErase( const NVS_Entry_Details_t *pItem )
+{
+	esp_err_t err;
+	nvs_handle handle = 0;
+	int64_t startTime = esp_timer_get_time();
+
+	// Open the namespace handle
+	err = _getNVSnamespaceHandle( pItem, NVS_READWRITE, &handle );
+
+	// Erasing item
+	if( err == ESP_OK )
+	{
+		err = nvs_erase_key( handle, pItem->nvsKey );
+	}
+
+	if( err == ESP_OK )
+	{
+		err = nvs_commit( handle );
+		if( err != ESP_OK )
+		{
+			IotLogError( "ERROR Committing Handle" );
+		}
+	}
+	else if( err != ESP_ERR_NVS_NOT_FOUND )
+	{
+		IotLogError( "ERROR deleting Key" );
+	}
+
+	_releaseNVSnamespaceHandle( handle );
+
+	/* Drop cached handles for namespace, so subsequent accesses re-open it */
+	_invalidateNVSnamespaceHandles( pItem->partition, pItem->namespace );
+
+	_updateStats( pItem, eStatsErase, 0, startTime, err );
+
+	return err;
+}
+
 /**
  * @brief Erase a NVS key
  *
@@ -766,39 +1365,242 @@ int32_t NVS_Set( NVS_Items_t nvsItem, void* pInput, size_t * pSize )
 int32_t NVS_EraseKey(NVS_Items_t nvsItem)
 {
 	esp_err_t err;
-	nvs_handle handle;
-	const NVS_Entry_Details_t *pItem;
+	const NVS_Entry_Details_t *pItem = NULL;
 
 	err = _getTablePointerFromNVSItem( nvsItem, &pItem );
 
-	// Open the namespace handle
 	if( err == ESP_OK )
 	{
-		err = _getNVSnamespaceHandle( pItem, NVS_READWRITE, &handle );
+		err = NVS_pErase( pItem );
 	}
 
+	return err;
+}
 
-	// Erasing item
-	if( err == ESP_OK )
+/**
+ * @brief	Begin an NVS transaction
+ *
+ * Subsequent NVS_Set/NVS_pSet calls, from the calling task, are written in call order, with a
+ * single nvs_commit per namespace performed by NVS_Commit().  Callers must order their sets so
+ * that data is written before the controls that refer to it; a power failure during the
+ * transaction then leaves, at worst, data that is not yet referenced.
+ *
+ * Transactions may be nested by the same task, only the outermost NVS_Commit() commits.
+ * Other tasks calling NVS_BeginTxn() block until the transaction completes.
+ *
+ * @return
+ * 	- ESP_OK if successful
+ * 	- ESP_FAIL if NVS module has not been initialized
+ */
+int32_t NVS_BeginTxn( void )
+{
+	if( NULL == _txn.mutex )
 	{
-		err = nvs_erase_key( handle, pItem->nvsKey );
+		return ESP_FAIL;
 	}
 
-	if( err == ESP_OK )
+	if( _inTxn() )
 	{
-		err = nvs_commit( handle );
+		_txn.depth++;
+		return ESP_OK;
 	}
-	else
+
+	if( pdTRUE != xSemaphoreTake( _txn.mutex, portMAX_DELAY ) )
 	{
-		IotLogError( "ERROR deleting Key" );
+		return ESP_FAIL;
 	}
 
-	if( err != ESP_OK )
+	_txn.owner = xTaskGetCurrentTaskHandle();
+	_txn.depth = 1;
+	_txn.nHandles = 0;
+	_txn.err = ESP_OK;
+
+	return ESP_OK;
+}
+
+/**
+ * @brief	Commit an NVS transaction
+ *
+ * Each namespace written within the transaction is committed once, and its handle released.
+ *
+ * @return
+ * 	- ESP_OK if all sets and commits were successful
+ * 	- ESP_FAIL if calling task does not hold a transaction
+ * 	- First error encountered by a set or commit within the transaction
+ */
+int32_t NVS_Commit( void )
+{
+	esp_err_t err;
+
+	if( !_inTxn() )
+	{
+		IotLogError( "NVS_Commit: no transaction" );
+		return ESP_FAIL;
+	}
+
+	if( 0 < --_txn.depth )
+	{
+		return ESP_OK;
+	}
+
+	for( int i = 0; i < _txn.nHandles; ++i )
 	{
-		IotLogError( "ERROR Committing Handle" );
+		err = nvs_commit( _txn.handles[ i ] );
+		if( ( ESP_OK != err ) && ( ESP_OK == _txn.err ) )
+		{
+			IotLogError( "NVS_Commit: ERROR Committing Handle" );
+			_txn.err = err;
+		}
+		_releaseNVSnamespaceHandle( _txn.handles[ i ] );
 	}
 
-	nvs_close( handle );
+	err = _txn.err;
+	_txn.nHandles = 0;
+	_txn.owner = NULL;
+	xSemaphoreGive( _txn.mutex );
 
 	return err;
 }
+
+/**
+ * @brief	Deinitialize the NVS module
+ *
+ * All cached namespace handles are closed, then each initialized NVS partition is deinitialized.
+ *
+ * @return
+ * 	- ESP_OK if successful
+ * 	- Error code from nvs_flash_deinit_partition
+ */
+int32_t NVS_Deinitialize( void )
+{
+	esp_err_t err = ESP_OK;
+	esp_err_t result;
+
+	_invalidateNVSnamespaceHandles( -1, NULL );
+
+	for( int i = 0; ( NULL != _pal ) && ( i < _pal->numPartitions ); ++i )
+	{
+		if( _pal->partitions[ i ].initialized )
+		{
+			result = nvs_flash_deinit_partition( _pal->partitions[ i ].label );
+			if( ESP_OK == result )
+			{
+				_pal->partitions[ i ].initialized = false;
+			}
+			else
+			{
+				IotLogError( "ERROR deinitializing NVS Partition: %s, err = %d", _pal->partitions[ i ].label, result );
+				err = result;
+			}
+		}
+	}
+
+	return err;
+}
+
+/**
+ * @brief Get access statistics for a partition
+ *
+ * @param[in]	partition	NVS partition
+ * @param[out]	pStats		Statistics
+ *
+ * @return 	ESP_OK if successful, ESP_FAIL if partition is invalid
+ */
+int32_t NVS_GetPartitionStats( NVS_Partitions_t partition, NVS_Stats_t *pStats )
+{
+	esp_err_t err = ESP_OK;
+
+	if( ( NULL == pStats ) || ( NVS_STATS_MAX_PARTITIONS <= partition ) || ( NULL == _stats.mutex ) )
+	{
+		err = ESP_FAIL;
+	}
+
+	if( ( ESP_OK == err ) && ( pdTRUE == xSemaphoreTake( _stats.mutex, portMAX_DELAY ) ) )
+	{
+		*pStats = _stats.partition[ partition ];
+		xSemaphoreGive( _stats.mutex );
+	}
+
+	return err;
+}
+
+/**
+ * @brief Get the number of keys for which access statistics are available
+ *
+ * @return 	Number of key statistics entries
+ */
+uint16_t NVS_GetKeyStatsCount( void )
+{
+	return _stats.nKeys;
+}
+
+/**
+ * @brief Get access statistics for a key
+ *
+ * @param[in]	n		Key statistics entry, 0 to NVS_GetKeyStatsCount() - 1
+ * @param[out]	pStats	Key statistics
+ *
+ * @return 	ESP_OK if successful, ESP_FAIL if entry is invalid
+ */
+int32_t NVS_GetKeyStats( uint16_t n, NVS_KeyStats_t *pStats )
+{
+	esp_err_t err = ESP_OK;
+
+	if( ( NULL == pStats ) || ( _stats.nKeys <= n ) || ( NULL == _stats.mutex ) )
+	{
+		err = ESP_FAIL;
+	}
+
+	if( ( ESP_OK == err ) && ( pdTRUE == xSemaphoreTake( _stats.mutex, portMAX_DELAY ) ) )
+	{
+		*pStats = _stats.key[ n ];
+		xSemaphoreGive( _stats.mutex );
+	}
+
+	return err;
+}
+
+/**
+ * @brief Reset all access statistics
+ */
+void NVS_ResetStats( void )
+{
+	if( ( NULL != _stats.mutex ) && ( pdTRUE == xSemaphoreTake( _stats.mutex, portMAX_DELAY ) ) )
+	{
+		memset( _stats.partition, 0, sizeof( _stats.partition ) );
+		memset( _stats.key, 0, sizeof( _stats.key ) );
+		_stats.nKeys = 0;
+		xSemaphoreGive( _stats.mutex );
+	}
+}
+
+/**
+ * @brief Log access statistics, per partition and per key
+ */
+void NVS_LogStats( void )
+{
+	NVS_Stats_t stats;
+	NVS_KeyStats_t keyStats;
+
+	IotLogInfo( "NVS Statistics: writes, skipped, bytes, reads, erases, errors, write us, read us" );
+
+	for( int i = 0; ( i < NVS_STATS_MAX_PARTITIONS ) && ( NULL != _pal ) && ( i < _pal->numPartitions ); ++i )
+	{
+		if( ESP_OK == NVS_GetPartitionStats( i, &stats ) )
+		{
+			IotLogInfo( "  %-16s %u, %u, %u, %u, %u, %u, %llu, %llu", _pal->partitions[ i ].label,
+					stats.writes, stats.writesSkipped, stats.bytesWritten, stats.reads, stats.erases, stats.errors,
+					stats.writeTime, stats.readTime );
+		}
+	}
+
+	for( int i = 0; i < NVS_GetKeyStatsCount(); ++i )
+	{
+		if( ESP_OK == NVS_GetKeyStats( i, &keyStats ) )
+		{
+			IotLogInfo( "  %d:%s:%s %u, %u, %u, %u, %u, %u, %llu, %llu", keyStats.partition, keyStats.namespace, keyStats.nvsKey,
+					keyStats.stats.writes, keyStats.stats.writesSkipped, keyStats.stats.bytesWritten, keyStats.stats.reads,
+					keyStats.stats.erases, keyStats.stats.errors, keyStats.stats.writeTime, keyStats.stats.readTime );
+		}
+	}
+}
@@ -101,6 +101,11 @@ enum ShciOpcode
 	eStatsGet =												0xC8,		/**< Command: Get Statistics */
 	eAsyncData =											0xC9,		/**< Command: Notify of change to Asynchronous Data */
 	eMcuIdSet =												0xCA,		/**< Command: Set MCU (PIC) ID */
+	eBaudRateSet =											0xCB,		/**< Command: Negotiate SHCI baud rate, see shci_internal.h */
+	eWindowAck =											0xCD,		/**< Command: Acknowledge windowed frames, see shci_window.h */
+	eWindowData =											0xCE,		/**< Event: Windowed frame, see shci_window.h */
+	eFragmentCommand =										0xD0,		/**< Command: Fragment of a large command, see shci_fragment.h */
+	eFragmentEvent =										0xD1,		/**< Event: Fragment of a large response, see shci_fragment.h */
 };
 typedef uint8_t _shciOpcode_t;
 
@@ -175,10 +180,77 @@ typedef enum
 	eMqttConnected = 1
 } _mqttStatus_t;
 
+/**
+ * @brief	Maximum number of opcodes for which handler statistics are kept
+ *
+ * Opcodes beyond this number are accumulated in a final entry, with opCode SHCI_STATS_OTHER_OPCODES.
+ */
+#define	SHCI_STATS_MAX_OPCODES		24
+
+#define	SHCI_STATS_OTHER_OPCODES	0x100				/**< opCode of entry accumulating remaining opcodes */
+
+/**
+ * @brief	Number of handler execution time histogram bins
+ *
+ * Bin n counts handlers that completed in under ( 64 << ( 2 * n ) ) microseconds, i.e. 64us, 256us,
+ * 1ms, 4ms, 16ms, 65ms, 262ms; the final bin counts all longer times.
+ */
+#define	SHCI_STATS_HISTOGRAM_BINS	8
+
+/**
+ * @brief	eStatsGet selectors, first parameter byte of the command
+ *
+ *	Link:	<eStatsGet><SHCI_STATS_LINK>
+ *			Response <eStatsGet><SHCI_STATS_LINK><fields of shci_Stats_t, 32-bit MSB first><number of opcode entries>
+ *	Opcode:	<eStatsGet><SHCI_STATS_OPCODE><n>
+ *			Response <eStatsGet><SHCI_STATS_OPCODE><n><opCode, 16-bit><count><maxTime><totalTime ms><histogram bins>, 32-bit MSB first
+ *	Reset:	<eStatsGet><SHCI_STATS_RESET>, answered with Command Complete
+ */
+#define	SHCI_STATS_LINK				0x00
+#define	SHCI_STATS_OPCODE			0x01
+#define	SHCI_STATS_RESET			0xFF
+
+/**
+ * @brief	SHCI link statistics
+ */
+typedef struct
+{
+	uint32_t	framesReceived;							/**< Valid frames received */
+	uint32_t	frameErrors;							/**< Frames discarded, checksum/CRC or length error */
+	uint32_t	unknownOpcodes;							/**< Frames with no registered handler */
+	uint32_t	bytesIn;								/**< Bytes read from UART */
+	uint32_t	framesSent;								/**< Responses written to UART */
+	uint32_t	bytesOut;								/**< Bytes written to UART */
+	uint32_t	postDrops;								/**< Responses dropped by shci_PostResponse(), message buffer full or oversize */
+	uint32_t	uartOverflows;							/**< UART driver overflows, received data discarded */
+	uint32_t	deferredDrops;							/**< Commands not passed to deferred handlers, worker queue full */
+} shci_Stats_t;
+
+/**
+ * @brief	SHCI handler statistics, for a single opcode
+ */
+typedef struct
+{
+	uint16_t	opCode;									/**< Opcode, or SHCI_STATS_OTHER_OPCODES */
+	uint32_t	count;									/**< Handler calls */
+	uint32_t	maxTime;								/**< Longest handler execution, microseconds */
+	uint64_t	totalTime;								/**< Cumulative handler execution, microseconds */
+	uint32_t	histogram[ SHCI_STATS_HISTOGRAM_BINS ];	/**< Handler execution time histogram */
+} shci_OpcodeStats_t;
+
 /**
  * @brief Callback called when an SHCI command is received
  */
 typedef void (* _shciCommandCallback_t)( const uint8_t *pData, const uint16_t size );
+
+/**
+ * @brief Where a command handler runs
+ */
+typedef enum
+{
+	eShciInline,										/**< On SHCI task, as the command is received; must be brief */
+	eShciDeferred										/**< On SHCI worker task, with a copy of the parameters */
+} shci_dispatch_t;
  
 
 /************************************************************/
@@ -216,7 +288,8 @@ void shci_deinit( void);
 /**
  * @brief	Register an SHCI command
  *
- * Callback function will be called when the command is received
+ * Callback function will be called, inline on the SHCI task, when the command is received.
+ * Replaces all existing subscriptions to the command.
  *
  * @param[in] command  	SHCI command
  * @param[in] handler	Callback function
@@ -226,12 +299,37 @@ void shci_RegisterCommand( const uint8_t command, const _shciCommandCallback_t h
 /**
  * @brief	Unregister an SHCI command
  *
- * Set Callback function to NULL, default action will be taken when the command is received
+ * Remove all subscriptions to the command, default action will be taken when the command is received
  *
  * @param[in] command  	SHCI command
  */
 void shci_UnregisterCommand( const uint8_t command );
 
+/**
+ * @brief	Subscribe to an SHCI command
+ *
+ * Several handlers may subscribe to one command, each is called when the command is received,
+ * in order of subscription.  Inline handlers run on the SHCI task, and hold off reception while
+ * they run.  Deferred handlers run on the SHCI worker task, in order of reception; if the worker
+ * queue is full, the command is not passed to them.
+ *
+ * @param[in] command  	SHCI command
+ * @param[in] handler	Callback function
+ * @param[in] dispatch	eShciInline or eShciDeferred
+ * @return ESP_OK, ESP_ERR_NO_MEM if no subscription is available, or the command has
+ *         SHCI_MAX_SUBSCRIBERS subscriptions
+ */
+int32_t shci_Subscribe( const uint8_t command, const _shciCommandCallback_t handler, shci_dispatch_t dispatch );
+
+/**
+ * @brief	Unsubscribe a handler from an SHCI command
+ *
+ * @param[in] command  	SHCI command
+ * @param[in] handler	Callback function
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if handler is not subscribed to the command
+ */
+int32_t shci_Unsubscribe( const uint8_t command, const _shciCommandCallback_t handler );
+
 /**
  * @brief Post a Command Complete Event message to the Message Buffer
  *
@@ -252,4 +350,35 @@ void shci_postCommandComplete( _shciOpcode_t opCode, _errorCodeType_t error);
  */
 bool shci_PostResponse( const uint8_t *pData, size_t numBytes );
 
+/**
+ * @brief	Get SHCI link statistics
+ *
+ * @param[out] pStats	Statistics
+ */
+void shci_GetStats( shci_Stats_t *pStats );
+
+/**
+ * @brief	Number of opcodes with handler statistics
+ */
+uint16_t shci_GetOpcodeStatsCount( void );
+
+/**
+ * @brief	Get handler statistics for one opcode
+ *
+ * @param[in]  n		Entry, 0 .. shci_GetOpcodeStatsCount() - 1
+ * @param[out] pStats	Statistics
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG if n is out of range
+ */
+int32_t shci_GetOpcodeStats( uint16_t n, shci_OpcodeStats_t *pStats );
+
+/**
+ * @brief	Clear all SHCI statistics
+ */
+void shci_ResetStats( void );
+
+/**
+ * @brief	Log all SHCI statistics
+ */
+void shci_LogStats( void );
+
 #endif /* _SHCI_H_ */
@@ -0,0 +1,60 @@
+/**
+ *  @file shci_fragment.h
+ *
+ *  @brief Fragmentation and reassembly of large SHCI messages
+ *
+ *  A message is an opcode followed by its parameters, as carried by an ordinary frame.  A
+ *  message too large for one frame is sent as fragments, each carrying a message ID, the
+ *  offset of its first byte within the message, and a final flag:
+ *
+ *	Command:	<eFragmentCommand><ID><FLAGS><OFFSET-H><OFFSET-L><MESSAGE BYTES ...>
+ *	Event:		<eFragmentEvent><ID><FLAGS><OFFSET-H><OFFSET-L><MESSAGE BYTES ...>
+ *		FLAGS: SHCI_FRAGMENT_FINAL, last fragment of the message
+ *
+ *  Fragments of one message are sent in order, starting at offset 0, and fragments of
+ *  different messages may be interleaved.  Intermediate fragments are not acknowledged.
+ *
+ *  Received commands are reassembled on the SHCI task and dispatched to the subscribers of
+ *  their opcode as if received in one frame, so handlers need no chunking code of their own.
+ *  A fragment that is out of sequence, or overflows SHCI_FRAGMENT_MAX_MESSAGE, discards its
+ *  message and is answered with Command Complete for eFragmentCommand.  Host resends the
+ *  message from offset 0.
+ *
+ *  Responses are posted once, with shciFragment_post(), and fragmented as required.  Host
+ *  reassembles eFragmentEvent fragments by ID.
+ */
+
+#ifndef _SHCI_FRAGMENT_H_
+#define _SHCI_FRAGMENT_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+
+#define	SHCI_FRAGMENT_HEADER		( 5 )					/**< Opcode, ID, flags and two offset bytes */
+#define	SHCI_FRAGMENT_FINAL			( 0x01 )				/**< Flags: last fragment of message */
+
+#define	SHCI_FRAGMENT_MAX_MESSAGE	( 8 * 1024 )			/**< Largest message, opcode and parameters, either direction */
+#define	SHCI_FRAGMENT_RX_MESSAGES	( 2 )					/**< Commands that may be reassembled at the same time */
+
+/**
+ * @brief Post a response of any size up to SHCI_FRAGMENT_MAX_MESSAGE
+ *
+ * A response that fits one frame is posted as is, larger responses are posted as
+ * eFragmentEvent fragments.  Unlike shci_PostResponse(), waits for room in the
+ * message buffer, so a large response is not dropped while earlier fragments are
+ * being transmitted.  Handlers that post large responses should subscribe with
+ * eShciDeferred: on the SHCI task a response must fit the message buffer at once.
+ *
+ * If the wait expires part way, Host will not receive the final fragment, and should
+ * discard the message once a later one with the same ID starts.
+ *
+ * @param[in] pData		response: event opcode followed by its data
+ * @param[in] numBytes	response length
+ * @param[in] wait		ticks to wait for the whole response to be posted
+ * @return	ESP_OK if posted, ESP_ERR_TIMEOUT if it could not be posted within wait,
+ * 			ESP_ERR_INVALID_ARG on bad parameters, ESP_ERR_INVALID_STATE if SHCI is not running
+ */
+int32_t shciFragment_post( const uint8_t *pData, size_t numBytes, TickType_t wait );
+
+#endif /* _SHCI_FRAGMENT_H_ */
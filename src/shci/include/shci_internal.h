@@ -12,6 +12,8 @@
 #ifndef _DWSHCI_INTERNAL_H_
 #define _DWSHCI_INTERNAL_H_
 
+#include "freertos/FreeRTOS.h"
+
 /**
  * @brief UART configuration definitions
  */
@@ -24,10 +26,50 @@
 
 #define BUF_SIZE (1024)
 
+/**
+ * @brief Baud rate negotiation, eBaudRateSet
+ *
+ * Commands must be CRC framed (SYNC-B):
+ *	Propose:	<eBaudRateSet><SHCI_BAUD_PROPOSE><BAUD-3><BAUD-2><BAUD-1><BAUD-0>
+ *		Command Complete is sent at the current rate, then the UART switches to the proposed rate.
+ *	Verify:		<eBaudRateSet><SHCI_BAUD_VERIFY><ECHO DATA ...>
+ *		Sent by Host at the new rate, answered with the same bytes.
+ *	Confirm:	<eBaudRateSet><SHCI_BAUD_CONFIRM>
+ *		Sent by Host once it has received the echo, answered with Command Complete.  Rate is kept once confirmed.
+ * If Verify, or Confirm, is not received within SHCI_BAUD_VERIFY_TIMEOUT of the previous step, or a
+ * corrupted frame is received first, the UART falls back to SHCI_BAUD_DEFAULT.  So a rate that only
+ * works from Host to ESP is abandoned by both sides.  Responses are held until Verify is answered,
+ * other commands are ignored until Confirm.
+ */
+#define	SHCI_BAUD_DEFAULT			( 115200 )
+#define	SHCI_BAUD_VERIFY_TIMEOUT	( 500 / portTICK_PERIOD_MS )
+#define	SHCI_BAUD_TX_DONE_TIMEOUT	( 100 / portTICK_PERIOD_MS )	/**< Wait for Command Complete to leave UART before switching */
+#define	SHCI_BAUD_PROPOSE			( 0x01 )
+#define	SHCI_BAUD_VERIFY			( 0x02 )
+#define	SHCI_BAUD_CONFIRM			( 0x03 )
+
+/**
+ * @brief Baud rate negotiation states
+ */
+typedef enum
+{
+	eSHCIBaudIdle,												/**< Running at agreed rate */
+	eSHCIBaudSwitch,											/**< Proposal accepted, switch once Command Complete is sent */
+	eSHCIBaudVerify,											/**< Running at proposed rate, waiting for Verify */
+	eSHCIBaudConfirm											/**< Verify answered, waiting for Host to Confirm it received the echo */
+} _shciBaudState_t;
+
 #define	SHCI_STACK_SIZE    ( 4096 )
 
 #define	SHCI_TASK_PRIORITY	( 16 )
 
+#define	SHCI_WORKER_STACK_SIZE		( 4096 )
+#define	SHCI_WORKER_TASK_PRIORITY	( 6 )							/**< Deferred handlers, below SHCI task */
+#define	SHCI_DEFERRED_BUFFER_SIZE	( (const size_t) ( 2048 ) )		/**< Commands queued for deferred handlers */
+
+#define	SHCI_MAX_SUBSCRIPTIONS		( 32 )							/**< Subscriptions, all opcodes */
+#define	SHCI_MAX_SUBSCRIBERS		( 4 )							/**< Subscriptions, one opcode */
+
 #define MAX_READ_CHAR_BUFF_SIZE 	40					///< Maximum data size for Read Local Characteristic command
 
 /**
@@ -57,7 +99,20 @@ typedef enum
 #define RESPONSE_QUEUE_SIZE  ( 4 )                             /**< Number of items in the SHCI Response Queue */
 
 //#define	SHCI_MESSAGE_BUFFER_SIZE	( (const size_t) ( 10000 ) )
-#define	SHCI_MESSAGE_BUFFER_SIZE	( (const size_t) ( 1024 ) )
+#define	SHCI_MESSAGE_BUFFER_SIZE	( (const size_t) ( 2048 ) )
+
+#define	SHCI_FRAME_OVERHEAD		( 5 )								/**< Sync, two length bytes and up to two checksum/CRC bytes */
+#define	SHCI_MAX_LENGTH			( MAX_PARAM_LEN + 1 )				/**< Largest length field: opCode and parameters */
+#define	SHCI_RX_BYTE_TIMEOUT_MS	( 20 )								/**< Partial frame is abandoned if no byte arrives for this long */
+#define	SHCI_RX_BYTE_TIMEOUT	( ( pdMS_TO_TICKS( SHCI_RX_BYTE_TIMEOUT_MS ) > 2 ) ? pdMS_TO_TICKS( SHCI_RX_BYTE_TIMEOUT_MS ) : 2 )	/**< At least 2 ticks, a single tick may expire at once */
+#define	SHCI_MAX_FRAME_SIZE		( MAX_PARAM_LEN + 1 + SHCI_FRAME_OVERHEAD )	/**< Largest command frame: header, opCode, parameters and CRC */
+
+#define	SHCI_RX_RING_SIZE		( 2 * BUF_SIZE )					/**< Receive ring size, must be a power of 2 */
+#define	SHCI_UART_QUEUE_SIZE	( 20 )								/**< Number of UART driver events that can be queued */
+#define	SHCI_UART_TX_BUFFER_SIZE	( 2 * BUF_SIZE )				/**< UART driver transmit ring, uart_write_bytes() returns once copied */
+
+#define	SHCI_MAX_RESPONSE_FRAME	( MAX_TX_RESPONSE + SHCI_FRAME_OVERHEAD )	/**< Largest response frame */
+#define	SHCI_TX_BATCH_SIZE		( 2 * SHCI_MAX_RESPONSE_FRAME )	/**< Transmit batch, holds at least one maximum size response frame */
 
 /**
  * @brief SHCI Command format
@@ -65,38 +120,91 @@ typedef enum
  * Within packet payload:
  * 		length value includes opCode and data, it does not include the length bytes, or the checksum/crc byte(s)
  * 		Checksum/CRC includes the two length bytes, but not the sync byte
- * 		Checksum/CRC is calculated on rawData[ 1 .. (length + 2) ]
+ * 		Checksum/CRC is calculated on frame[ 1 .. (length + 2) ]
+ *
+ * A received command is parsed in place, in the receive ring.  pFrame and pData
+ * point into the ring, and remain valid until the command has been dispatched.
  */
 typedef struct _shciCommand
 {
-	union
-	{
-		uint8_t	rawData[ MAX_PARAM_LEN + 6 ];
-		struct
-		{
-			struct
-			{
-				uint8_t	sync;						/**< Sync byte */
-				uint8_t length[ 2 ];				/**< head length, includes opcode and data */
-			} head;
-			uint8_t	opCode;							/**< command/event opcode */
-			uint8_t data[ MAX_PARAM_LEN ];			/**< parameter data */
-			uint8_t checkbytes[ 2];					/**< allocate space for 8-bit checksum or 16-bit CRC */
-		};
-	};
-	uint16_t length;
-	uint8_t checksum;
-	uint16_t pbCount;						// Parameter byte count
-	bool	useCRC;
-	uint16_t	crc;								/**< CRC16_CCITT value */
+	const uint8_t *	pFrame;							/**< Frame, from the sync byte */
+	const uint8_t *	pData;							/**< Parameter data, following the opCode */
+	uint16_t	frameLength;						/**< Length of complete frame, including sync, length and checksum/CRC bytes */
+	uint16_t	length;								/**< Length field: opCode and parameter data */
+	uint16_t	pbCount;							/**< Parameter byte count */
+	uint8_t		opCode;								/**< command/event opcode */
+	bool		useCRC;
 } _shciCommand_t;
 
+/**
+ * @brief SHCI Receive ring
+ *
+ * Filled directly by the UART driver, and parsed in place.  The ring is followed by
+ * room for one frame, so a frame that wraps can be made contiguous by copying only
+ * its wrapped bytes.  head and tail are free-running, indexes are taken modulo the
+ * ring size.
+ */
+typedef struct _shciRxRing
+{
+	uint8_t		data[ SHCI_RX_RING_SIZE + SHCI_MAX_FRAME_SIZE ];
+	uint32_t	head;								/**< Bytes written by UART driver */
+	uint32_t	tail;								/**< Bytes consumed by parser */
+	bool		bFull;								/**< Last fill stopped on a full ring, bytes may be left in UART driver */
+} _shciRxRing_t;
 
-typedef struct _shciResponse
+/**
+ * @brief SHCI command subscription
+ *
+ * Subscriptions to an opcode form a list, headed by the opcode's entry in the command table.
+ */
+typedef struct _shciSubscription
 {
-	uint16_t   numBytes;
-	uint8_t    buffer[ MAX_TX_RESPONSE ];
-	bool		useCRC;
-} _shciResponse_t;
+	_shciCommandCallback_t		handler;
+	struct _shciSubscription *	pNext;
+	shci_dispatch_t				dispatch;
+} _shciSubscription_t;
+
+/**
+ * @brief Header of a command queued for a deferred handler, followed by the parameter bytes
+ */
+typedef struct _shciDeferred
+{
+	_shciCommandCallback_t	handler;
+	uint8_t *				pMessage;				/**< Reassembled command too large to queue, freed once handled; NULL if parameters follow */
+	uint16_t				length;					/**< Parameter byte count */
+	uint8_t					opCode;
+} _shciDeferred_t;
+
+/**
+ * @brief Command queued for a deferred handler, as sent through the deferred message buffer
+ *
+ * A union, so the header is aligned for its pointer fields.
+ */
+typedef union _shciDeferredMessage
+{
+	_shciDeferred_t			header;
+	uint8_t					bytes[ sizeof( _shciDeferred_t ) + MAX_PARAM_LEN ];
+} _shciDeferredMessage_t;
+
+/**
+ * @brief SHCI Transmit batch
+ *
+ * Responses are framed in place, back to back, and the batch is written to the
+ * UART driver with a single uart_write_bytes() call.  Buffer is word aligned, in
+ * internal RAM, so it can be handed to a DMA capable transmit path unchanged.
+ */
+typedef struct _shciTxBatch
+{
+	uint8_t		data[ SHCI_TX_BATCH_SIZE ];
+	uint16_t	length;								/**< Bytes of framed responses in data */
+	uint16_t	frames;								/**< Number of framed responses in data */
+} _shciTxBatch_t;
+
+/**
+ * @brief Interface between SHCI and its fragmentation layer, shci_fragment.c
+ */
+bool _shciDispatchCommand( uint8_t opCode, const uint8_t *pdata, uint16_t nBytes );
+int32_t _shciPostResponseWait( const uint8_t *pData, size_t numBytes, TickType_t wait );
+void _shciFragmentCommand( const uint8_t *pData, const uint16_t size );
 
 #endif /* _DWSHCI_INTERNAL_H_ */
@@ -0,0 +1,96 @@
+/**
+ *  @file shci_window.h
+ *
+ *  @brief Sliding-window transport over SHCI, for bulk transfers to Host
+ *
+ *  Up to <i>windowSize</i> frames may be outstanding, each carrying a sequence number.
+ *  Host acknowledges frames individually, and may acknowledge several in one eWindowAck
+ *  command.  A frame that is not acknowledged within the timeout, or is negatively
+ *  acknowledged, is retransmitted on its own (selective repeat).
+ *
+ *	Data (Event):		<eWindowData><CHANNEL><SEQ><PAYLOAD ...>
+ *	Ack (Command):		<eWindowAck><CHANNEL>{ <SEQ><STATUS> } ...
+ *		STATUS: SHCI_WINDOW_ACK, frame received; SHCI_WINDOW_NAK, retransmit frame
+ *
+ *  Transfers opt in by creating a window on their own channel, and sending through it
+ *  in place of shci_PostResponse().  Host must reassemble in sequence order.
+ */
+
+#ifndef _SHCI_WINDOW_H_
+#define _SHCI_WINDOW_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+
+#define	SHCI_WINDOW_CHANNELS		( 4 )					/**< Windows that can exist at the same time */
+#define	SHCI_WINDOW_MAX_SIZE		( 16 )					/**< Maximum outstanding frames per window, a power of 2 so slots divide the 8-bit sequence */
+#define	SHCI_WINDOW_HEADER			( 3 )					/**< Opcode, channel and sequence bytes */
+
+#define	SHCI_WINDOW_ACK				( 0x00 )				/**< Ack status: frame received */
+#define	SHCI_WINDOW_NAK				( 0x01 )				/**< Ack status: frame lost or corrupted, retransmit */
+
+/**
+ * @brief Opaque window structure
+ */
+typedef struct shciWindow_s shciWindow_t;
+
+/**
+ * @brief Window handle
+ */
+typedef shciWindow_t * shciWindow_handle_t;
+
+/**
+ * @brief Create a window
+ *
+ * @param[in] channel		Channel number, identifies the transfer to Host, 0 .. SHCI_WINDOW_CHANNELS - 1
+ * @param[in] windowSize	Maximum outstanding frames, a power of 2, 1 .. SHCI_WINDOW_MAX_SIZE
+ * @param[in] maxPayload	Largest payload passed to shciWindow_send()
+ * @param[in] timeout		Ticks to wait for acknowledgment before retransmitting a frame
+ * @param[in] maxRetries	Retransmissions of one frame before the window fails
+ * @return	window handle, NULL if channel is in use or on error
+ */
+shciWindow_handle_t shciWindow_create( uint8_t channel, uint8_t windowSize, uint16_t maxPayload, TickType_t timeout, uint8_t maxRetries );
+
+/**
+ * @brief Delete a window, outstanding frames are abandoned
+ *
+ * Call once the transfer is complete or abandoned, Host should no longer acknowledge frames on the channel.
+ * An acknowledgment already being handled on the SHCI task completes before the window is freed.
+ *
+ * @param[in] window	window handle
+ */
+void shciWindow_delete( shciWindow_handle_t window );
+
+/**
+ * @brief Send a frame through a window
+ *
+ * Payload is copied, and posted to Host immediately if the window is open.  Otherwise
+ * blocks until a frame is acknowledged, retransmitting frames that time out.
+ *
+ * @param[in] window	window handle
+ * @param[in] pData		payload
+ * @param[in] numBytes	payload length, no more than maxPayload
+ * @param[in] wait		ticks to wait for the window to open
+ * @return	ESP_OK if frame was sent, ESP_ERR_TIMEOUT if the window did not open,
+ * 			ESP_FAIL if a frame exceeded its retries, ESP_ERR_INVALID_ARG on bad parameters
+ */
+int32_t shciWindow_send( shciWindow_handle_t window, const uint8_t *pData, size_t numBytes, TickType_t wait );
+
+/**
+ * @brief Wait until all frames sent through a window are acknowledged
+ *
+ * @param[in] window	window handle
+ * @param[in] wait		ticks to wait
+ * @return	ESP_OK if all frames acknowledged, ESP_ERR_TIMEOUT, or ESP_FAIL if a frame exceeded its retries
+ */
+int32_t shciWindow_flush( shciWindow_handle_t window, TickType_t wait );
+
+/**
+ * @brief Number of frames sent, not yet acknowledged
+ *
+ * @param[in] window	window handle
+ */
+uint8_t shciWindow_outstanding( shciWindow_handle_t window );
+
+#endif /* _SHCI_WINDOW_H_ */
@@ -16,12 +16,15 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <esp_wifi.h>
 #include "shci.h"
 #include "shci_internal.h"
 #include "crc16_ccitt.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "driver/uart.h"
 #include "driver/gpio.h"
 #include "shci_logging.h"
@@ -29,6 +32,8 @@
 #include "message_buffer.h"
 
 #include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
 
 /************************************************************/
 #define TEST_POINT_1    15			// Camera LED, IO15
@@ -57,25 +62,41 @@
 /**
  * @brief	SHCI Command Table
  *
- * Table contains callback functions for all possible commands.  By default, all callbacks are set to NULL
- * (a default handler will be called).  Command handlers can be installed using shci_RegisterCommand(),
- * and uninstalled using shci_UnregisterCommand().
+ * Table heads the list of subscriptions for all possible commands.  By default, all lists are empty
+ * (a default handler will be called).  Command handlers can be installed using shci_RegisterCommand()
+ * or shci_Subscribe(), and uninstalled using shci_UnregisterCommand() or shci_Unsubscribe().
+ * Subscriptions are taken from a fixed pool, lists are modified under shci_spinlock.
  */
-static _shciCommandCallback_t shciCommandTable[ 256 ] = { NULL };
+static _shciSubscription_t * shciCommandTable[ 256 ] = { NULL };
+static _shciSubscription_t _shciSubscriptions[ SHCI_MAX_SUBSCRIPTIONS ];		/**< Pool, free when handler is NULL */
+
+static MessageBufferHandle_t _shciDeferredBuffer;			/**< Commands for deferred handlers, SHCI task to worker task */
+static TaskHandle_t _shciWorkerHandle;
 
 static int _shciUartNum;									/**< UART port number used for Host communication */
 static _shciRxStateType_t _rxState = eSHCIRxSync;
 static _shciCommand_t IncommingCommand;
+static _shciRxRing_t _rxRing;								/**< Received bytes, parsed in place */
+static TickType_t _shciRxTick;								/**< Tick count when bytes were last received */
+static QueueHandle_t _shciUartQueue;						/**< UART driver event queue */
+static SemaphoreHandle_t _shciTxSemaphore;					/**< Given when a response is posted to the message buffer */
+static SemaphoreHandle_t _shciTxSpaceSemaphore;				/**< Given when responses have been taken from the message buffer */
+static QueueSetHandle_t _shciQueueSet;						/**< Wakes SHCI task on UART event or posted response */
+static _shciBaudState_t _shciBaudState = eSHCIBaudIdle;		/**< Baud rate negotiation state */
+static uint32_t _shciBaudProposed;							/**< Baud rate accepted from Host, not yet verified */
+static TickType_t _shciBaudStart;							/**< Tick count when UART switched to proposed rate */
 
 static MessageBufferHandle_t   _shciMessageBuffer;
 static TaskHandle_t _shciTaskHandle;
 static QueueHandle_t hci_handle;
-static uint8_t TxEventBuf[ 300 ];
 static bool _shciUseCRC;
 static portMUX_TYPE shci_spinlock = portMUX_INITIALIZER_UNLOCKED;
 
+static shci_Stats_t _shciStats;							/**< Link statistics, protected by shci_spinlock */
+static shci_OpcodeStats_t _shciOpcodeStats[ SHCI_STATS_MAX_OPCODES + 1 ];	/**< Handler statistics, final entry for other opcodes */
+static uint16_t _shciOpcodeStatsCount;
 
-static	_shciResponse_t _txPacket;
+static WORD_ALIGNED_ATTR _shciTxBatch_t _txBatch;			/**< Framed Responses, written to UART together */
 
 /************************************************************/
 
@@ -85,7 +106,7 @@ static	_shciResponse_t _txPacket;
 /**
  * @brief Process serial data received from Host
  * 
- * A state machine reads data from the UART, parsing it into the Command packet
+ * A state machine parses the Command packet in place, in the receive ring.
  * Receive state is static, since a single incoming packet may require several calls
  * to this function to fully receive and process.
  * 
@@ -95,11 +116,19 @@ static	_shciResponse_t _txPacket;
 static _shciRxStateType_t _shciProcessInput( _shciCommand_t *ic );
 
 /**
- * @brief Send Response Packet to Host
+ * @brief Frame next Response from message buffer into Transmit batch
+ *
+ * @param[in,out] pBatch  Pointer to Transmit batch
+ * @return true if a Response was added to the batch
+ */
+static bool _shciTxFrame( _shciTxBatch_t * pBatch );
+
+/**
+ * @brief Send Transmit batch to Host
  *
- * @param[in] pResponse  Pointer to Response Data Structure
+ * @param[in,out] pBatch  Pointer to Transmit batch
  */
-static void _shciSendResponse( _shciResponse_t * pResponse );
+static void _shciTxFlush( _shciTxBatch_t * pBatch );
 
 /************************************************************/
 
@@ -125,6 +154,143 @@ void debug_gpio_init( void )
 }
 #endif
 
+/**
+ * @brief Add to a link statistics counter
+ */
+static void _shciStatsAdd( uint32_t *pCounter, uint32_t n )
+{
+	portENTER_CRITICAL( &shci_spinlock );
+	*pCounter += n;
+	portEXIT_CRITICAL( &shci_spinlock );
+}
+
+/**
+ * @brief Record execution time of a command handler
+ *
+ * An entry is allocated for each opcode on first use; once all entries are used, remaining
+ * opcodes share the final entry.
+ *
+ * @param[in] opCode	SHCI command OpCode
+ * @param[in] elapsed	handler execution time, microseconds
+ */
+static void _shciStatsHandler( uint8_t opCode, uint32_t elapsed )
+{
+	shci_OpcodeStats_t *pStats = NULL;
+	uint16_t i;
+	uint8_t bin;
+
+	portENTER_CRITICAL( &shci_spinlock );
+
+	for( i = 0; ( i < _shciOpcodeStatsCount ) && ( NULL == pStats ); ++i )
+	{
+		if( _shciOpcodeStats[ i ].opCode == opCode )
+		{
+			pStats = &_shciOpcodeStats[ i ];
+		}
+	}
+
+	if( NULL == pStats )
+	{
+		if( _shciOpcodeStatsCount < SHCI_STATS_MAX_OPCODES )
+		{
+			pStats = &_shciOpcodeStats[ _shciOpcodeStatsCount++ ];
+			pStats->opCode = opCode;
+		}
+		else
+		{
+			pStats = &_shciOpcodeStats[ SHCI_STATS_MAX_OPCODES ];
+			pStats->opCode = SHCI_STATS_OTHER_OPCODES;
+			_shciOpcodeStatsCount = SHCI_STATS_MAX_OPCODES + 1;
+		}
+	}
+
+	for( bin = 0; ( bin < ( SHCI_STATS_HISTOGRAM_BINS - 1 ) ) && ( elapsed >= ( 64u << ( 2 * bin ) ) ); ++bin )
+	{
+	}
+
+	pStats->count++;
+	pStats->totalTime += elapsed;
+	pStats->histogram[ bin ]++;
+	if( elapsed > pStats->maxTime )
+	{
+		pStats->maxTime = elapsed;
+	}
+
+	portEXIT_CRITICAL( &shci_spinlock );
+}
+
+/**
+ * @brief Store 32-bit value, MSB first
+ */
+static uint8_t * _shciPutU32( uint8_t *p, uint32_t value )
+{
+	*p++ = ( uint8_t )( value >> 24 );
+	*p++ = ( uint8_t )( value >> 16 );
+	*p++ = ( uint8_t )( value >> 8 );
+	*p++ = ( uint8_t )( value );
+	return p;
+}
+
+/**
+ * @brief eStatsGet command handler, reports SHCI statistics to Host
+ *
+ * Registered by shci_init(), a module may register its own handler in its place.
+ *
+ * @param[in] pData   <SELECTOR>[<n>]
+ * @param[in] nBytes  Number of bytes in parameter buffer
+ */
+static void _shciStatsGet( const uint8_t *pData, const uint16_t nBytes )
+{
+	uint8_t response[ 3 + 2 + ( 4 * ( 3 + SHCI_STATS_HISTOGRAM_BINS ) ) ];
+	uint8_t *p = response;
+	shci_Stats_t stats;
+	shci_OpcodeStats_t opStats;
+	uint8_t i;
+
+	*p++ = eStatsGet;
+
+	if( ( 1 == nBytes ) && ( SHCI_STATS_LINK == pData[ 0 ] ) )
+	{
+		shci_GetStats( &stats );
+		*p++ = SHCI_STATS_LINK;
+		p = _shciPutU32( p, stats.framesReceived );
+		p = _shciPutU32( p, stats.frameErrors );
+		p = _shciPutU32( p, stats.unknownOpcodes );
+		p = _shciPutU32( p, stats.bytesIn );
+		p = _shciPutU32( p, stats.framesSent );
+		p = _shciPutU32( p, stats.bytesOut );
+		p = _shciPutU32( p, stats.postDrops );
+		p = _shciPutU32( p, stats.uartOverflows );
+		p = _shciPutU32( p, stats.deferredDrops );
+		*p++ = ( uint8_t )shci_GetOpcodeStatsCount();
+		shci_PostResponse( response, p - response );
+	}
+	else if( ( 2 == nBytes ) && ( SHCI_STATS_OPCODE == pData[ 0 ] ) && ( ESP_OK == shci_GetOpcodeStats( pData[ 1 ], &opStats ) ) )
+	{
+		*p++ = SHCI_STATS_OPCODE;
+		*p++ = pData[ 1 ];
+		*p++ = ( uint8_t )( opStats.opCode >> 8 );
+		*p++ = ( uint8_t )( opStats.opCode );
+		p = _shciPutU32( p, opStats.count );
+		p = _shciPutU32( p, opStats.maxTime );
+		p = _shciPutU32( p, ( uint32_t )( opStats.totalTime / 1000 ) );
+		for( i = 0; i < SHCI_STATS_HISTOGRAM_BINS; ++i )
+		{
+			p = _shciPutU32( p, opStats.histogram[ i ] );
+		}
+		shci_PostResponse( response, p - response );
+	}
+	else if( ( 1 == nBytes ) && ( SHCI_STATS_RESET == pData[ 0 ] ) )
+	{
+		shci_ResetStats();
+		shci_postCommandComplete( eStatsGet, eCommandSucceeded );
+	}
+	else
+	{
+		shci_postCommandComplete( eStatsGet, eInvalidCommandParameters );
+	}
+}
+
 /**
  * @brief Dispatch SHCI commands via registered callback function
  *
@@ -132,84 +298,428 @@ void debug_gpio_init( void )
  * @param[in] pData   Pointer to command parameter buffer
  * @param[in] nBytes  Number of bytes in parameter buffer
  * @return true if no registered command, false if registered command callback called
+ *
+ * Also called by the fragmentation layer, on SHCI task, for reassembled commands.  Those
+ * may exceed MAX_PARAM_LEN; a deferred handler is then given its own heap copy.
  */
-static bool _shciDispatchCommand( uint8_t opCode, uint8_t *pdata, uint16_t nBytes )
+bool _shciDispatchCommand( uint8_t opCode, const uint8_t *pdata, uint16_t nBytes )
 {
-	bool error = true;
+	_shciSubscription_t subscribers[ SHCI_MAX_SUBSCRIBERS ];
+	_shciSubscription_t *pSub;
+	_shciDeferredMessage_t deferred;
+	_shciDeferred_t *pDeferred = &deferred.header;
+	int64_t startTime;
+	size_t n;
+	int count = 0;
+	int i;
 
-	if( NULL != shciCommandTable[ opCode ] )
+	/* Copy subscriptions, so lists may be modified while handlers run */
+	portENTER_CRITICAL( &shci_spinlock );
+	for( pSub = shciCommandTable[ opCode ]; ( NULL != pSub ) && ( count < SHCI_MAX_SUBSCRIBERS ); pSub = pSub->pNext )
 	{
-		shciCommandTable[ opCode ]( pdata, nBytes );				/* dispatch registered command callback */
-		error = false;
+		subscribers[ count++ ] = *pSub;
 	}
-	else
+	portEXIT_CRITICAL( &shci_spinlock );
+
+	for( i = 0; i < count; ++i )
+	{
+		if( ( eShciDeferred == subscribers[ i ].dispatch ) && ( NULL != _shciDeferredBuffer ) )
+		{
+			pDeferred->handler = subscribers[ i ].handler;
+			pDeferred->pMessage = NULL;
+			pDeferred->length = nBytes;
+			pDeferred->opCode = opCode;
+			n = sizeof( _shciDeferred_t );
+			if( nBytes <= MAX_PARAM_LEN )
+			{
+				memcpy( &deferred.bytes[ n ], pdata, nBytes );
+				n += nBytes;
+			}
+			else if( NULL != ( pDeferred->pMessage = pvPortMalloc( nBytes ) ) )
+			{
+				memcpy( pDeferred->pMessage, pdata, nBytes );
+			}
+
+			/* SHCI task is the only writer */
+			if( ( ( nBytes > MAX_PARAM_LEN ) && ( NULL == pDeferred->pMessage ) ) ||
+				( 0 == xMessageBufferSend( _shciDeferredBuffer, deferred.bytes, n, 0 ) ) )
+			{
+				IotLogError( "Deferred command %02X dropped, worker queue full", opCode );
+				_shciStatsAdd( &_shciStats.deferredDrops, 1 );
+				vPortFree( pDeferred->pMessage );
+			}
+		}
+		else
+		{
+			startTime = esp_timer_get_time();
+			subscribers[ i ].handler( pdata, nBytes );					/* dispatch registered command callback */
+			_shciStatsHandler( opCode, ( uint32_t )( esp_timer_get_time() - startTime ) );
+		}
+	}
+
+	if( 0 == count )
 	{
 		IotLogInfo( "No callback found for command: %02X", opCode );
+		_shciStatsAdd( &_shciStats.unknownOpcodes, 1 );
 	}
-	return error;
+	return ( 0 == count );
+}
+
+/**
+ * @brief SHCI Worker Task.  Runs deferred command handlers, in order of reception
+ *
+ * @param[in] arg unused
+ */
+static void _shciWorkerTask( void *arg )
+{
+	static _shciDeferredMessage_t deferred;
+	_shciDeferred_t *pDeferred = &deferred.header;
+	int64_t startTime;
+	size_t n;
+
+	/* Message buffer needs to be created within the task, as for the SHCI Message Buffer */
+	_shciDeferredBuffer = xMessageBufferCreate( SHCI_DEFERRED_BUFFER_SIZE );
+	if( NULL == _shciDeferredBuffer )
+	{
+		IotLogError( "Error creating Deferred Message Buffer, deferred handlers will run inline" );
+		_shciWorkerHandle = NULL;
+		vTaskDelete( NULL );
+	}
+
+	while( 1 )
+	{
+		n = xMessageBufferReceive( _shciDeferredBuffer, deferred.bytes, sizeof( deferred.bytes ), portMAX_DELAY );
+		if( n >= sizeof( _shciDeferred_t ) )
+		{
+			startTime = esp_timer_get_time();
+			if( NULL != pDeferred->pMessage )
+			{
+				pDeferred->handler( pDeferred->pMessage, pDeferred->length );
+				vPortFree( pDeferred->pMessage );
+			}
+			else
+			{
+				pDeferred->handler( &deferred.bytes[ sizeof( _shciDeferred_t ) ], n - sizeof( _shciDeferred_t ) );
+			}
+			_shciStatsHandler( pDeferred->opCode, ( uint32_t )( esp_timer_get_time() - startTime ) );
+		}
+	}
+}
+
+
+/**
+ * @brief Number of received bytes in ring, not yet consumed by parser
+ */
+static uint32_t _shciRxCount( void )
+{
+	return _rxRing.head - _rxRing.tail;
+}
+
+/**
+ * @brief Byte in ring, <i>offset</i> bytes past the tail
+ */
+static uint8_t _shciRxPeek( uint32_t offset )
+{
+	return _rxRing.data[ ( _rxRing.tail + offset ) & ( SHCI_RX_RING_SIZE - 1 ) ];
+}
+
+/**
+ * @brief Consume bytes from ring
+ */
+static void _shciRxConsume( uint32_t count )
+{
+	_rxRing.tail += count;
+}
+
+/**
+ * @brief Read all bytes buffered by UART driver into the receive ring
+ *
+ * Bytes are read straight into the free space of the ring, at most two driver calls
+ * per wrap of the ring.  If the ring fills, bytes left in the driver raise no further
+ * event; the SHCI task fills again once the parser has consumed frames.
+ */
+static void _shciRxFill( void )
+{
+	uint32_t index;
+	uint32_t span;
+	int len;
+
+	do
+	{
+		index = _rxRing.head & ( SHCI_RX_RING_SIZE - 1 );
+		span = SHCI_RX_RING_SIZE - _shciRxCount();					// free space
+		if( span > ( SHCI_RX_RING_SIZE - index ) )
+		{
+			span = SHCI_RX_RING_SIZE - index;						// contiguous free space
+		}
+
+		len = ( 0 < span ) ? uart_read_bytes( _shciUartNum, &_rxRing.data[ index ], span, 0 ) : 0;
+		if( 0 < len )
+		{
+			_shciRxTick = xTaskGetTickCount();
+			_rxRing.head += len;
+			_shciStatsAdd( &_shciStats.bytesIn, len );
+		}
+	} while( ( 0 < len ) && ( len == span ) );
+
+	_rxRing.bFull = ( 0 == span );
+}
+
+/**
+ * @brief Fill receive ring again, if the last fill stopped on a full ring and the parser has since made room
+ *
+ * @return true if ring was filled, and input should be parsed again
+ */
+static bool _shciRxRefill( void )
+{
+	if( _rxRing.bFull && ( SHCI_RX_RING_SIZE > _shciRxCount() ) )
+	{
+		_shciRxFill();
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * @brief Discard all received data, in UART driver and receive ring, and restart parser
+ */
+static void _shciRxReset( void )
+{
+	uart_flush_input( _shciUartNum );
+	xQueueReset( _shciUartQueue );
+	_rxRing.tail = _rxRing.head;
+	_rxRing.bFull = false;
+	_rxState = eSHCIRxSync;
+}
+
+/**
+ * @brief Return UART to default baud rate, after a failed negotiation
+ *
+ * @param[in] reason	Description of failure, for log
+ */
+static void _shciBaudFallback( const char *reason )
+{
+	IotLogWarn( "Baud rate %u not confirmed (%s), falling back to %u", _shciBaudProposed, reason, SHCI_BAUD_DEFAULT );
+	uart_set_baudrate( _shciUartNum, SHCI_BAUD_DEFAULT );
+	_shciRxReset();
+	_shciBaudState = eSHCIBaudIdle;
+}
+
+/**
+ * @brief Running at a proposed baud rate that has not yet been confirmed by Host
+ */
+static bool _shciBaudPending( void )
+{
+	return ( eSHCIBaudVerify == _shciBaudState ) || ( eSHCIBaudConfirm == _shciBaudState );
+}
+
+/**
+ * @brief Switch UART to proposed baud rate, once Command Complete for the proposal has been sent
+ */
+static void _shciBaudSwitch( void )
+{
+	uart_wait_tx_done( _shciUartNum, SHCI_BAUD_TX_DONE_TIMEOUT );
+	uart_set_baudrate( _shciUartNum, _shciBaudProposed );
+	_shciRxReset();
+	_shciBaudStart = xTaskGetTickCount();
+	_shciBaudState = eSHCIBaudVerify;
+	IotLogInfo( "Baud rate %u, waiting for verify", _shciBaudProposed );
+}
+
+/**
+ * @brief Handle eBaudRateSet command
+ *
+ * Propose is answered with Command Complete, the switch is made by the task once it has been sent.
+ * Verify is answered by echoing the command; a repeated Verify is echoed again.  Confirm, sent by
+ * Host once the echo has been received, completes the negotiation.
+ *
+ * @param[in] ic	pointer to Incoming Command packet
+ */
+static void _shciBaudCommand( const _shciCommand_t *ic )
+{
+	_errorCodeType_t error = eCommandSucceeded;
+	uint8_t echo[ 1 + MAX_PARAM_LEN ];
+	uint32_t baud;
+
+	if( !ic->useCRC || ( 0 == ic->pbCount ) )
+	{
+		error = eCommandDisallowed;
+	}
+	else if( SHCI_BAUD_PROPOSE == ic->pData[ 0 ] )
+	{
+		baud = ( 5 == ic->pbCount ) ?
+				( ( uint32_t )ic->pData[ 1 ] << 24 ) | ( ( uint32_t )ic->pData[ 2 ] << 16 ) | ( ( uint32_t )ic->pData[ 3 ] << 8 ) | ic->pData[ 4 ] : 0;
+
+		if( 5 != ic->pbCount )
+		{
+			error = eInvalidCommandParameters;
+		}
+		else if( ( SHCI_BAUD_DEFAULT != baud ) && ( 460800 != baud ) && ( 921600 != baud ) )
+		{
+			error = eUnsupportedFeatureOrParameterValue;
+		}
+		else if( eSHCIBaudIdle != _shciBaudState )
+		{
+			error = eCommandDisallowed;
+		}
+		else
+		{
+			_shciBaudProposed = baud;
+			_shciBaudState = eSHCIBaudSwitch;
+		}
+	}
+	else if( SHCI_BAUD_VERIFY == ic->pData[ 0 ] )
+	{
+		if( _shciBaudPending() )
+		{
+			_shciBaudStart = xTaskGetTickCount();
+			_shciBaudState = eSHCIBaudConfirm;
+			IotLogInfo( "Baud rate %u verified, waiting for confirm", _shciBaudProposed );
+
+			echo[ 0 ] = eBaudRateSet;
+			memcpy( &echo[ 1 ], ic->pData, ic->pbCount );
+			shci_PostResponse( echo, 1 + ic->pbCount );
+			return;
+		}
+		error = eCommandDisallowed;
+	}
+	else if( SHCI_BAUD_CONFIRM == ic->pData[ 0 ] )
+	{
+		if( eSHCIBaudConfirm == _shciBaudState )
+		{
+			_shciBaudState = eSHCIBaudIdle;
+			IotLogInfo( "Baud rate %u confirmed", _shciBaudProposed );
+		}
+		else
+		{
+			error = eCommandDisallowed;
+		}
+	}
+	else
+	{
+		error = eInvalidCommandParameters;
+	}
+
+	shci_postCommandComplete( eBaudRateSet, error );
 }
 
+/**
+ * @brief Handle a UART driver event
+ *
+ * On overflow, data buffered by the driver is incomplete: it is discarded, with
+ * the receive ring, and the parser restarted.
+ *
+ * @param[in] pEvent	UART driver event
+ */
+static void _shciUartEvent( const uart_event_t *pEvent )
+{
+	switch( pEvent->type )
+	{
+		case UART_DATA:
+			_shciRxFill();
+			break;
+
+		case UART_FIFO_OVF:
+		case UART_BUFFER_FULL:
+			IotLogError( "UART overflow, event %d", pEvent->type );
+			_shciStatsAdd( &_shciStats.uartOverflows, 1 );
+			_shciRxReset();
+			break;
+
+		case UART_FRAME_ERR:
+			if( _shciBaudPending() )
+			{
+				_shciBaudFallback( "framing error" );
+			}
+			break;
+
+		default:
+			IotLogInfo( "UART event %d", pEvent->type );
+			break;
+	}
+}
 
 /**
  * @brief Process serial data received from Host
  *
- * A state machine reads data from the UART, parsing it into the Command packet
+ * A state machine parses the Command packet in place, in the receive ring.
  * Receive state is static, since a single incoming packet may require several calls
- * to this function to fully receive and process.
+ * to this function to fully receive and process.  Once a complete frame is available,
+ * a frame that wraps the end of the ring is made contiguous, and the checksum/CRC
+ * checked over the frame in place.  The frame is only consumed from the ring once
+ * it has been dispatched, see _shciRxRelease().  A length field that is zero, or beyond
+ * SHCI_MAX_LENGTH, is rejected as soon as the header is received.
  *
  * @param[in,out] ic	pointer to Incoming Command packet
  * @return Current Receive Status.  Incoming Command packet contains a complete command when status returned is RX_VALID
  */
 static _shciRxStateType_t _shciProcessInput( _shciCommand_t *ic )
 {
-	int len;
+	uint32_t start;
+	uint32_t wrapped;
+	uint8_t checksum;
+	uint8_t sync;
 	_shciRxStateType_t nextState = _rxState;	// default to maintaining current state
 	do
 	{
 		_rxState = nextState;
 
-		/* get number of bytes in UART RX FIFO */
-		uart_get_buffered_data_len( _shciUartNum, ( size_t * )&len );
-
 		switch( _rxState )
 		{
 
 			case eSHCIRxSync:
-				if( len >= 1 )
+				while( 0 < _shciRxCount() )
 				{
-					len = uart_read_bytes( _shciUartNum, &ic->head.sync, 1, 0 );			// read one byte
-					if( ( len == 1 ) && ( ( SYNC_A_CHAR == ic->head.sync ) || (SYNC_B_CHAR == ic->head.sync ) ) )
+					sync = _shciRxPeek( 0 );
+					if( ( SYNC_A_CHAR == sync ) || ( SYNC_B_CHAR == sync ) )
 					{
 						DEBUG_GPIO_PIN_SET( TEST_POINT_1 );
 						nextState = eSHCIRxHead;
-						ic->useCRC = ( SYNC_B_CHAR == ic->head.sync ) ? true : false;
+						ic->useCRC = ( SYNC_B_CHAR == sync ) ? true : false;
 						ic->pbCount = 0;
+						break;
 					}
+					_shciRxConsume( 1 );									// skip byte
 				}
 				break;
 
 			case eSHCIRxHead:
-				if( len >= 2 )
+				if( _shciRxCount() >= 3 )
 				{
-	//	            DEBUG_GPIO_PIN_CLR( TEST_POINT_1 );
-					len = uart_read_bytes( _shciUartNum, ic->head.length, 2, 0 );					// read 2 bytes
-					ic->length = ( ic->head.length[0] << 8 ) + ic->head.length[1];					// reassemble length
-					nextState = eSHCIRxData;
+					ic->length = ( _shciRxPeek( 1 ) << 8 ) + _shciRxPeek( 2 );			// reassemble length
+					ic->frameLength = 3 + ic->length + ( ic->useCRC ? 2 : 1 );
+					if( ( 0 == ic->length ) || ( SHCI_MAX_LENGTH < ic->length ) )				// no opCode, or more parameters than can be dispatched
+					{
+						IotLogError( "ProcessInput, length %d invalid", ic->length );
+						nextState = eSHCIRxError;
+					}
+					else
+					{
+						nextState = eSHCIRxData;
+					}
 				}
 				break;
 
 			case eSHCIRxData:																		// includes the OpCode, any parameters and checksum/crc
-				if( ic->useCRC )
+				if( _shciRxCount() >= ic->frameLength )
 				{
-					if( len >= ( ic->length + 2 ) )
+					/* Make frame contiguous, copying any wrapped bytes to follow the end of the ring */
+					start = _rxRing.tail & ( SHCI_RX_RING_SIZE - 1 );
+					if( ( start + ic->frameLength ) > SHCI_RX_RING_SIZE )
 					{
-	//				    DEBUG_GPIO_PIN_SET( TEST_POINT_1, 1);
-						len = uart_read_bytes( _shciUartNum, &ic->opCode, (ic->length + 2), 0 );	// read (length+2) bytes
-						/* compute CRC and validate that it is zero */
-						ic->crc = crc16_ccitt_compute( &ic->rawData[ 1 ], ( ic->length + 4 ) );		// include length and crc bytes
+						wrapped = start + ic->frameLength - SHCI_RX_RING_SIZE;
+						memcpy( &_rxRing.data[ SHCI_RX_RING_SIZE ], &_rxRing.data[ 0 ], wrapped );
+					}
+					ic->pFrame = &_rxRing.data[ start ];
+					ic->opCode = ic->pFrame[ 3 ];
+					ic->pData = &ic->pFrame[ 4 ];
 
+					if( ic->useCRC )
+					{
+						/* compute CRC and validate that it is zero */
 						DEBUG_GPIO_PIN_CLR( TEST_POINT_1 );
-						if ( ic->crc == 0 )															// if crc is zero
+						if ( 0 == crc16_ccitt_compute( &ic->pFrame[ 1 ], ( ic->length + 4 ) ) )		// include length and crc bytes
 						{
 							ic->pbCount = ( ic->length - 1 );
 							_shciUseCRC = true;														// if a CRC packet is successfully received, enable CRC's when transmitting
@@ -221,18 +731,14 @@ static _shciRxStateType_t _shciProcessInput( _shciCommand_t *ic )
 							nextState = eSHCIRxError;
 						}
 					}
-				}
-				else
-				{
-					if ( len >= ( ic->length + 1 ) )
+					else
 					{
-						len = uart_read_bytes( _shciUartNum, &ic->opCode, (ic->length + 1), 0 );	// read (length+1) bytes
-						ic->checksum = 0;
+						checksum = 0;
 						for ( int i = 1; i <= ( ic->length + 3 ); ++i ) 							// sum all data bytes, including length and checksum
 						{
-							ic->checksum += ic->rawData[ i ];
+							checksum += ic->pFrame[ i ];
 						}
-						if ( ic->checksum == 0 )													// if checksum is zero
+						if ( checksum == 0 )														// if checksum is zero
 						{
 							ic->pbCount = ( ic->length - 1 );
 							DEBUG_GPIO_PIN_CLR( TEST_POINT_1 );
@@ -241,7 +747,6 @@ static _shciRxStateType_t _shciProcessInput( _shciCommand_t *ic )
 						else
 						{
 							IotLogError( "ProcessInput, non-zero checksum" );
-		//	        		esp_log_buffer_hex( TAG, (void *)ic->data, ic->length );
 							nextState = eSHCIRxError;
 						}
 					}
@@ -263,59 +768,105 @@ static _shciRxStateType_t _shciProcessInput( _shciCommand_t *ic )
 	return _rxState;
 }
 
+/**
+ * @brief Release a parsed frame from the receive ring, and restart parser
+ *
+ * A valid frame is consumed.  After an error only the sync byte is consumed, so the
+ * bytes already received are rescanned for the next sync byte: a good frame following
+ * line noise, or a corrupted length, is found without waiting for more data.
+ *
+ * @param[in] ic	pointer to Incoming Command packet, in RX_VALID or RX_ERROR state
+ */
+static void _shciRxRelease( _shciCommand_t *ic )
+{
+	_shciRxConsume( ( eSHCIRxError == _rxState ) ? 1 : ic->frameLength );
+	ic->pFrame = NULL;
+	ic->pData = NULL;
+	_rxState = eSHCIRxSync;
+}
+
 
 /**
- * @brief Send Response Packet to Host
+ * @brief Frame next Response from message buffer into Transmit batch
  *
- *	Response buffer is packetized with either Checksum:
+ *	Response is received directly into the batch, after room for the header, and
+ *	packetized in place with either Checksum:
  *		<SYNC-A><LEN-H><LEN-L><BUFFER><CHECKSUM>
  *	Or CRC:
  *		<SYNC-B><LEN-H><LEN-L><BUFFER><CRC-H><CRC-L>
  *
- * @param[in] pResponse  Pointer to Response Data Structure
+ *	Caller must ensure batch has room for SHCI_MAX_RESPONSE_FRAME bytes.
+ *
+ * @param[in,out] pBatch  Pointer to Transmit batch
+ * @return true if a Response was added to the batch, false if message buffer is empty
  */
-static void _shciSendResponse( _shciResponse_t * pResponse )
+static bool _shciTxFrame( _shciTxBatch_t * pBatch )
 {
+	uint8_t *pFrame = &pBatch->data[ pBatch->length ];
+	size_t numBytes;
 	uint16_t j;
-	uint16_t i = 0;
+	uint16_t i;
 	uint8_t chksum = 0;
 
-	if( _shciUseCRC )																/* SHCI Protocol with CRC16 */
+	numBytes = xMessageBufferReceive( _shciMessageBuffer, &pFrame[ 3 ], MAX_TX_RESPONSE, ( TickType_t ) 0 );
+	if( 0 == numBytes )
 	{
-		uint16_t crc;
+		return false;
+	}
 
-		TxEventBuf[ i++ ] = SYNC_B_CHAR;
-		TxEventBuf[ i++ ] = ( uint8_t )( pResponse->numBytes >> 8 );					/* MSB of length field */
-		TxEventBuf[ i++ ] = ( uint8_t )( pResponse->numBytes & 0xFF );					/* LSB of length field */
+	IotLogDebug( "Read %d bytes from Message Buffer", numBytes );
 
-		for( j = 0; j < pResponse->numBytes; ++j )										/* Copy Response data to TxEventBuf */
-		{
-			TxEventBuf[ i++ ] = pResponse->buffer[ j ];
-		}
+	pFrame[ 1 ] = ( uint8_t )( numBytes >> 8 );										/* MSB of length field */
+	pFrame[ 2 ] = ( uint8_t )( numBytes & 0xFF );									/* LSB of length field */
+	i = 3 + numBytes;
+
+	if( _shciUseCRC )																/* SHCI Protocol with CRC16 */
+	{
+		uint16_t crc;
 
-		crc = crc16_ccitt_compute( &TxEventBuf[ 1 ], ( pResponse->numBytes + 2 ) );
+		pFrame[ 0 ] = SYNC_B_CHAR;
+		crc = crc16_ccitt_compute( &pFrame[ 1 ], ( numBytes + 2 ) );
 
-		TxEventBuf[ i++ ] = ( uint8_t )( crc >> 8 );									/* Add CRC msb */
-		TxEventBuf[ i++ ] = ( uint8_t )( crc & 0xff );									/* Add CRC lsb */
-//		iot_log_info( "_shciSendResponse: ");
-//		esp_log_buffer_hex( "_shciSendResponse: ", (void *)TxEventBuf, i );
+		pFrame[ i++ ] = ( uint8_t )( crc >> 8 );									/* Add CRC msb */
+		pFrame[ i++ ] = ( uint8_t )( crc & 0xff );									/* Add CRC lsb */
 	}
-	else																				/* SHCI Protocol with 8-bit checksum */
+	else																			/* SHCI Protocol with 8-bit checksum */
 	{
-		TxEventBuf[ i++ ] = SYNC_A_CHAR;
-		chksum += TxEventBuf[ i++ ] = ( uint8_t )( pResponse->numBytes >> 8 );			/* MSB of length field */
-		chksum += TxEventBuf[ i++ ] = ( uint8_t )( pResponse->numBytes & 0xFF );		/* LSB of length field */
-
-		for( j = 0; j < pResponse->numBytes; ++j )										/* Copy Response data to TxEventBuf */
+		pFrame[ 0 ] = SYNC_A_CHAR;
+		for( j = 1; j < i; ++j )													/* Length field and Response data */
 		{
-			chksum += TxEventBuf[ i++ ] = pResponse->buffer[ j ];
+			chksum += pFrame[ j ];
 		}
 
-		TxEventBuf[ i++ ] = ( uint8_t )( 0 - chksum );									/* Add checksum */
+		pFrame[ i++ ] = ( uint8_t )( 0 - chksum );									/* Add checksum */
 	}
 
-	IotLogInfo( "_shciSendResponse: %d bytes", i );
-	uart_write_bytes( _shciUartNum, (const char *) TxEventBuf, i );						/* transmit Response packet */
+	pBatch->length += i;
+	pBatch->frames++;
+	return true;
+}
+
+/**
+ * @brief Send Transmit batch to Host
+ *
+ *	All framed Responses in the batch are written with one uart_write_bytes() call
+ *
+ * @param[in,out] pBatch  Pointer to Transmit batch, emptied on return
+ */
+static void _shciTxFlush( _shciTxBatch_t * pBatch )
+{
+	if( 0 != pBatch->length )
+	{
+		IotLogInfo( "_shciTxFlush: %d responses, %d bytes", pBatch->frames, pBatch->length );
+		uart_write_bytes( _shciUartNum, (const char *) pBatch->data, pBatch->length );	/* transmit Response packets */
+		portENTER_CRITICAL( &shci_spinlock );
+		_shciStats.framesSent += pBatch->frames;
+		_shciStats.bytesOut += pBatch->length;
+		portEXIT_CRITICAL( &shci_spinlock );
+		pBatch->length = 0;
+		pBatch->frames = 0;
+		xSemaphoreGive( _shciTxSpaceSemaphore );					/* wake a task waiting in _shciPostResponseWait() */
+	}
 }
 
 /**
@@ -336,6 +887,13 @@ static void _shciSendResponse( _shciResponse_t * pResponse )
  * Transmit Response Queue allows client modules/tasks to add Response messages that
  * will be transmitted to Host in the order they are queued.
  *
+ * Task blocks on a queue set holding the UART event queue and a binary semaphore given by
+ * shci_PostResponse(), so it only runs when there is input to parse or a response to send.
+ * While a frame is partly received the wait is bounded: if no UART event arrives, and the
+ * driver holds no more bytes, within SHCI_RX_BYTE_TIMEOUT of the last byte received, the
+ * frame is treated as corrupted, and the bytes following its sync byte rescanned.  Time the
+ * task spends in handlers or UART writes does not abandon a frame whose bytes have arrived.
+ *
  * @param[in] arg pointer to uart number
  * 
  */
@@ -343,12 +901,17 @@ static void _shciTask(void *arg)
 {
     int uart_num = (int) arg;
     uint8_t unknownCommandResponse[3] = { 0x80, 0x00, 0x01 };
+    uart_event_t uartEvent;
+    QueueSetMemberHandle_t member;
+    TickType_t waitTicks;
+    TickType_t elapsed;
+    bool rxPartial;
 
 	
     /* Configure parameters of an UART driver,
      * communication pins and install the driver */
     uart_config_t uart_config = {
-        .baud_rate = 115200,
+        .baud_rate = SHCI_BAUD_DEFAULT,
         .data_bits = UART_DATA_8_BITS,
         .parity    = UART_PARITY_DISABLE,
         .stop_bits = UART_STOP_BITS_1,
@@ -357,7 +920,18 @@ static void _shciTask(void *arg)
 
     uart_param_config( uart_num, &uart_config );
     uart_set_pin( uart_num, SHCI_TXD, SHCI_RXD, SHCI_RTS, SHCI_CTS );							// Set GPIO pins for UART usage
-    uart_driver_install( uart_num, BUF_SIZE * 2, 0, 0, NULL, 0 );								// Install UART driver
+    uart_driver_install( uart_num, BUF_SIZE * 2, SHCI_UART_TX_BUFFER_SIZE, SHCI_UART_QUEUE_SIZE, &_shciUartQueue, 0 );	// Install UART driver, with event queue
+
+    /* Task blocks until a UART event, or a posted response, is available */
+    _shciTxSemaphore = xSemaphoreCreateBinary();
+    _shciTxSpaceSemaphore = xSemaphoreCreateBinary();
+    _shciQueueSet = xQueueCreateSet( SHCI_UART_QUEUE_SIZE + 1 );
+    if( ( NULL == _shciTxSemaphore ) || ( NULL == _shciTxSpaceSemaphore ) || ( NULL == _shciQueueSet ) ||
+    	( pdPASS != xQueueAddToSet( _shciUartQueue, _shciQueueSet ) ) ||
+    	( pdPASS != xQueueAddToSet( _shciTxSemaphore, _shciQueueSet ) ) )
+    {
+		IotLogError( "Error creating Queue Set" );
+    }
 
     /* Message buffer needs to be created within the task, if it is created in the init call we get exceptions ! */
 
@@ -369,42 +943,123 @@ static void _shciTask(void *arg)
 
     while( 1 ) 
 	{
-		
+    	/* Wait for received data, or a response to send.  Until a new baud rate is confirmed, wait no longer than the verify timeout */
+    	waitTicks = portMAX_DELAY;
+    	if( _shciBaudPending() )
+    	{
+    		elapsed = xTaskGetTickCount() - _shciBaudStart;
+    		if( elapsed >= SHCI_BAUD_VERIFY_TIMEOUT )
+    		{
+    			_shciBaudFallback( "timeout" );
+    		}
+    		else
+    		{
+    			waitTicks = SHCI_BAUD_VERIFY_TIMEOUT - elapsed;
+    		}
+    	}
+
+    	/* While a frame is partly received, wait no longer than the rest of the inter-byte timeout */
+    	rxPartial = ( eSHCIRxHead == _rxState ) || ( eSHCIRxData == _rxState );
+    	if( rxPartial )
+    	{
+    		elapsed = xTaskGetTickCount() - _shciRxTick;
+    		elapsed = ( elapsed < SHCI_RX_BYTE_TIMEOUT ) ? ( SHCI_RX_BYTE_TIMEOUT - elapsed ) : 0;
+    		if( elapsed < waitTicks )
+    		{
+    			waitTicks = elapsed;
+    		}
+    	}
+    	member = xQueueSelectFromSet( _shciQueueSet, waitTicks );
+
     	DEBUG_GPIO_PIN_TOGGLE( TEST_POINT_2 );								// Debug - Toggle TestPoint2
 
-    	/* Process incoming packets */
-    	_shciProcessInput( &IncommingCommand );
-    	if( _rxState == eSHCIRxValid ) 
-		{
-			if( _shciDispatchCommand( IncommingCommand.opCode, IncommingCommand.data, IncommingCommand.pbCount ) )
-			{
-				unknownCommandResponse[1] = IncommingCommand.opCode;     /* overwrite the opcode */
-				shci_PostResponse( ( const uint8_t * ) &unknownCommandResponse, sizeof( unknownCommandResponse ) );
-			}
-    		_rxState = eSHCIRxSync;
+    	/* Move received data from UART driver to receive ring */
+    	if( ( member == _shciUartQueue ) && ( pdTRUE == xQueueReceive( _shciUartQueue, &uartEvent, 0 ) ) )
+    	{
+    		_shciUartEvent( &uartEvent );
     	}
-    	else if( _rxState == eSHCIRxError )
-		{
-    		IotLogError( "Invalid command" );
-    		_rxState = eSHCIRxSync;
+    	else if( member == _shciTxSemaphore )
+    	{
+    		xSemaphoreTake( _shciTxSemaphore, 0 );
+    	}
+    	else if( ( NULL == member ) && rxPartial )
+    	{
+    		/* No UART event in the window.  After a long handler or UART write the rest of the
+    		 * frame may already be in the driver, so collect it before abandoning the frame */
+    		_shciRxFill();
+    		elapsed = xTaskGetTickCount() - _shciRxTick;
+    		if( elapsed >= SHCI_RX_BYTE_TIMEOUT )
+    		{
+    			IotLogError( "Partial frame, no data for %u ticks", elapsed );
+    			_rxState = eSHCIRxError;
+    		}
     	}
+
+    	/* Process all complete incoming packets, then any bytes left in the driver by a full ring */
+    	do
+    	{
+    		while( 0 < _shciRxCount() )
+    		{
+    			_shciProcessInput( &IncommingCommand );
+    			if( _rxState == eSHCIRxValid )
+    			{
+    				_shciStatsAdd( &_shciStats.framesReceived, 1 );
+    			}
+
+    			if( ( _rxState == eSHCIRxValid ) && ( eBaudRateSet == IncommingCommand.opCode ) )
+    			{
+    				_shciBaudCommand( &IncommingCommand );
+    				_shciRxRelease( &IncommingCommand );
+    			}
+    			else if( ( _rxState == eSHCIRxValid ) && _shciBaudPending() )
+    			{
+    				IotLogInfo( "Command %02X ignored, baud rate not confirmed", IncommingCommand.opCode );
+    				_shciRxRelease( &IncommingCommand );
+    			}
+    			else if( _rxState == eSHCIRxValid )
+    			{
+    				if( _shciDispatchCommand( IncommingCommand.opCode, IncommingCommand.pData, IncommingCommand.pbCount ) )
+    				{
+    					unknownCommandResponse[1] = IncommingCommand.opCode;     /* overwrite the opcode */
+    					shci_PostResponse( ( const uint8_t * ) &unknownCommandResponse, sizeof( unknownCommandResponse ) );
+    				}
+    				_shciRxRelease( &IncommingCommand );
+    			}
+    			else if( _rxState == eSHCIRxError )
+    			{
+    				IotLogError( "Invalid command" );
+    				_shciStatsAdd( &_shciStats.frameErrors, 1 );
+    				_shciRxRelease( &IncommingCommand );
+    				if( _shciBaudPending() )
+    				{
+    					_shciBaudFallback( "invalid frame" );
+    					break;
+    				}
+    			}
+    			else
+    			{
+    				break;														// waiting for more data
+    			}
+    		}
+    	} while( _shciRxRefill() );
 		
-    	/* Process any outgoing messages in the message buffer */
-		if( _shciMessageBuffer != NULL )
+    	/* Process all outgoing messages in the message buffer, one semaphore give may cover several posts.
+    	 * Responses are framed back to back, batch is written when it cannot hold another Response.
+    	 * Responses are held while a new baud rate is being verified */
+		while( ( _shciMessageBuffer != NULL ) && ( eSHCIBaudVerify != _shciBaudState ) && _shciTxFrame( &_txBatch ) )
 		{
-			_txPacket.numBytes = xMessageBufferReceive( _shciMessageBuffer, &_txPacket.buffer, MAX_TX_RESPONSE, ( TickType_t ) 0 );
-			
-			if ( _txPacket.numBytes != 0 )
+//		    DEBUG_GPIO_PIN_CLR( TEST_POINT_2 );
+			if( ( SHCI_TX_BATCH_SIZE - _txBatch.length ) < SHCI_MAX_RESPONSE_FRAME )
 			{
-				
-//			    DEBUG_GPIO_PIN_CLR( TEST_POINT_2 );
-	            IotLogDebug( "Read %d bytes from Message Buffer",  _txPacket.numBytes );
-			
-				_shciSendResponse( & _txPacket );
+				_shciTxFlush( &_txBatch );
 			}
-			// Test with hardwired response to Device Information command times-out with vTaskDelay(50);
 		}
-		vTaskDelay( 10 / portTICK_PERIOD_MS );
+		_shciTxFlush( &_txBatch );
+
+		if( eSHCIBaudSwitch == _shciBaudState )
+		{
+			_shciBaudSwitch();
+		}
     }
 }
 
@@ -428,6 +1083,9 @@ int shci_init(int uart_num)
 
 	_shciUseCRC = false;
 
+	shci_RegisterCommand( eStatsGet, &_shciStatsGet );						// Default statistics handler, may be replaced
+	shci_RegisterCommand( eFragmentCommand, &_shciFragmentCommand );		// Reassembles large commands, see shci_fragment.h
+
 
     xTaskCreate( _shciTask, "shci_task", SHCI_STACK_SIZE, (void *) _shciUartNum, SHCI_TASK_PRIORITY, &_shciTaskHandle );		// Create Task on new thread, Increase stack size
     if( _shciTaskHandle == NULL )
@@ -435,6 +1093,12 @@ int shci_init(int uart_num)
         return -1;
     }
 
+    xTaskCreate( _shciWorkerTask, "shci_worker", SHCI_WORKER_STACK_SIZE, NULL, SHCI_WORKER_TASK_PRIORITY, &_shciWorkerHandle );	// Runs deferred command handlers
+    if( _shciWorkerHandle == NULL )
+	{
+        return -1;
+    }
+
     hci_handle = xQueueCreate( 1, sizeof(int) );											// Create a queue ... used for passkey acceptance
     if( hci_handle == NULL )
 	{
@@ -479,6 +1143,10 @@ void shci_deinit( void)
 		IotLogInfo( "Deleting SHCI Task" );
 		vTaskDelete( _shciTaskHandle );
 	}
+	if( NULL != _shciWorkerHandle )
+	{
+		vTaskDelete( _shciWorkerHandle );
+	}
 }
 
 /**
@@ -491,7 +1159,11 @@ void shci_deinit( void)
  */
 void shci_RegisterCommand( const uint8_t command, const _shciCommandCallback_t handler )
 {
-	shciCommandTable[ command ] = handler;
+	shci_UnregisterCommand( command );
+	if( NULL != handler )
+	{
+		shci_Subscribe( command, handler, eShciInline );
+	}
 }
 
 /**
@@ -503,7 +1175,98 @@ void shci_RegisterCommand( const uint8_t command, const _shciCommandCallback_t h
  */
 void shci_UnregisterCommand( const uint8_t command )
 {
+	_shciSubscription_t *pSub;
+
+	portENTER_CRITICAL( &shci_spinlock );
+	for( pSub = shciCommandTable[ command ]; NULL != pSub; pSub = pSub->pNext )
+	{
+		pSub->handler = NULL;									/* return to pool */
+	}
 	shciCommandTable[ command ] = NULL;
+	portEXIT_CRITICAL( &shci_spinlock );
+}
+
+/**
+ * @brief	Subscribe to an SHCI command
+ *
+ * Subscription is appended to the command's list, so handlers are called in order of subscription.
+ *
+ * @param[in] command  	SHCI command
+ * @param[in] handler	Callback function
+ * @param[in] dispatch	eShciInline or eShciDeferred
+ * @return ESP_OK, ESP_ERR_NO_MEM if no subscription is available
+ */
+int32_t shci_Subscribe( const uint8_t command, const _shciCommandCallback_t handler, shci_dispatch_t dispatch )
+{
+	esp_err_t err = ESP_ERR_NO_MEM;
+	_shciSubscription_t **ppTail;
+	int count = 0;
+	int i;
+
+	if( NULL == handler )
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	portENTER_CRITICAL( &shci_spinlock );
+
+	for( ppTail = &shciCommandTable[ command ]; NULL != *ppTail; ppTail = &( *ppTail )->pNext )
+	{
+		++count;
+	}
+
+	for( i = 0; ( i < SHCI_MAX_SUBSCRIPTIONS ) && ( count < SHCI_MAX_SUBSCRIBERS ); ++i )
+	{
+		if( NULL == _shciSubscriptions[ i ].handler )
+		{
+			_shciSubscriptions[ i ].handler = handler;
+			_shciSubscriptions[ i ].dispatch = dispatch;
+			_shciSubscriptions[ i ].pNext = NULL;
+			*ppTail = &_shciSubscriptions[ i ];
+			err = ESP_OK;
+			break;
+		}
+	}
+
+	portEXIT_CRITICAL( &shci_spinlock );
+
+	if( ESP_OK != err )
+	{
+		IotLogError( "shci_Subscribe %02X: no subscription available", command );
+	}
+	return err;
+}
+
+/**
+ * @brief	Unsubscribe a handler from an SHCI command
+ *
+ * @param[in] command  	SHCI command
+ * @param[in] handler	Callback function
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if handler is not subscribed to the command
+ */
+int32_t shci_Unsubscribe( const uint8_t command, const _shciCommandCallback_t handler )
+{
+	esp_err_t err = ESP_ERR_NOT_FOUND;
+	_shciSubscription_t **ppSub;
+	_shciSubscription_t *pSub;
+
+	portENTER_CRITICAL( &shci_spinlock );
+
+	for( ppSub = &shciCommandTable[ command ]; NULL != *ppSub; ppSub = &( *ppSub )->pNext )
+	{
+		if( handler == ( *ppSub )->handler )
+		{
+			pSub = *ppSub;
+			*ppSub = pSub->pNext;
+			pSub->handler = NULL;									/* return to pool */
+			err = ESP_OK;
+			break;
+		}
+	}
+
+	portEXIT_CRITICAL( &shci_spinlock );
+
+	return err;
 }
 
 
@@ -538,7 +1301,12 @@ bool shci_PostResponse( const uint8_t *pData, size_t numBytes )
 	bool error = true;
 	size_t n;
 	
-	if ( _shciMessageBuffer != NULL )
+	if( numBytes > MAX_TX_RESPONSE )
+	{
+		IotLogError( "shci_PostResponse %d bytes, exceeds maximum Response", numBytes );
+		_shciStatsAdd( &_shciStats.postDrops, 1 );
+	}
+	else if ( _shciMessageBuffer != NULL )
 	{
 		/*  Since this function can be called from different tasks, must follow:
 		 *
@@ -548,12 +1316,17 @@ bool shci_PostResponse( const uint8_t *pData, size_t numBytes )
 		 */
 		portENTER_CRITICAL(&shci_spinlock);
 		n = xMessageBufferSend( _shciMessageBuffer, ( const void * ) pData, numBytes, 0 );
+		if( n != numBytes )
+		{
+			_shciStats.postDrops++;
+		}
 	    portEXIT_CRITICAL(&shci_spinlock);
 
 		if( n == numBytes )
 		{
 //		    DEBUG_GPIO_PIN_SET( TEST_POINT_2 );
 //			 vTaskDelay( 10 );
+			xSemaphoreGive( _shciTxSemaphore );						/* wake SHCI task */
 			IotLogDebug( "shci_PostResponse %d bytes", numBytes);
 			return false;		/* Succeeded to post the message, within 5 ticks */
 		}
@@ -563,6 +1336,137 @@ bool shci_PostResponse( const uint8_t *pData, size_t numBytes )
 	return error;
 }
 
+/**
+ * @brief Post a response, waiting for room in the Message Buffer
+ *
+ * Used by the fragmentation layer, which posts many responses back to back.  Waits on
+ * a semaphore given each time the SHCI task takes responses from the message buffer.
+ * Does not wait when called on the SHCI task, by an inline handler, as that task
+ * empties the message buffer.
+ *
+ * @param[in] pData		Pointer to Response Data
+ * @param[in] numBytes	Number of bytes in Response Data, no more than MAX_TX_RESPONSE
+ * @param[in] wait		Ticks to wait for room
+ * @return	ESP_OK if posted, ESP_ERR_TIMEOUT if no room within wait,
+ * 			ESP_ERR_INVALID_ARG if oversize, ESP_ERR_INVALID_STATE if SHCI is not running
+ */
+int32_t _shciPostResponseWait( const uint8_t *pData, size_t numBytes, TickType_t wait )
+{
+	TickType_t start = xTaskGetTickCount();
+	TickType_t elapsed;
+	size_t n;
 
+	if( numBytes > MAX_TX_RESPONSE )
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	if( ( NULL == _shciMessageBuffer ) || ( NULL == _shciTxSpaceSemaphore ) )
+	{
+		return ESP_ERR_INVALID_STATE;
+	}
+	if( xTaskGetCurrentTaskHandle() == _shciTaskHandle )
+	{
+		wait = 0;
+	}
 
+	while( 1 )
+	{
+		/* Multiple writers, see shci_PostResponse() */
+		portENTER_CRITICAL( &shci_spinlock );
+		n = xMessageBufferSend( _shciMessageBuffer, ( const void * ) pData, numBytes, 0 );
+		portEXIT_CRITICAL( &shci_spinlock );
+
+		if( n == numBytes )
+		{
+			xSemaphoreGive( _shciTxSemaphore );						/* wake SHCI task */
+			return ESP_OK;
+		}
+
+		elapsed = xTaskGetTickCount() - start;
+		if( elapsed >= wait )
+		{
+			_shciStatsAdd( &_shciStats.postDrops, 1 );
+			return ESP_ERR_TIMEOUT;
+		}
+		xSemaphoreTake( _shciTxSpaceSemaphore, wait - elapsed );
+	}
+}
+
+/**
+ * @brief	Get SHCI link statistics
+ *
+ * @param[out] pStats	Statistics
+ */
+void shci_GetStats( shci_Stats_t *pStats )
+{
+	portENTER_CRITICAL( &shci_spinlock );
+	*pStats = _shciStats;
+	portEXIT_CRITICAL( &shci_spinlock );
+}
+
+/**
+ * @brief	Number of opcodes with handler statistics
+ */
+uint16_t shci_GetOpcodeStatsCount( void )
+{
+	return _shciOpcodeStatsCount;
+}
 
+/**
+ * @brief	Get handler statistics for one opcode
+ *
+ * @param[in]  n		Entry, 0 .. shci_GetOpcodeStatsCount() - 1
+ * @param[out] pStats	Statistics
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG if n is out of range
+ */
+int32_t shci_GetOpcodeStats( uint16_t n, shci_OpcodeStats_t *pStats )
+{
+	esp_err_t err = ESP_ERR_INVALID_ARG;
+
+	portENTER_CRITICAL( &shci_spinlock );
+	if( n < _shciOpcodeStatsCount )
+	{
+		*pStats = _shciOpcodeStats[ n ];
+		err = ESP_OK;
+	}
+	portEXIT_CRITICAL( &shci_spinlock );
+
+	return err;
+}
+
+/**
+ * @brief	Clear all SHCI statistics
+ */
+void shci_ResetStats( void )
+{
+	portENTER_CRITICAL( &shci_spinlock );
+	memset( &_shciStats, 0, sizeof( _shciStats ) );
+	memset( _shciOpcodeStats, 0, sizeof( _shciOpcodeStats ) );
+	_shciOpcodeStatsCount = 0;
+	portEXIT_CRITICAL( &shci_spinlock );
+}
+
+/**
+ * @brief	Log all SHCI statistics
+ */
+void shci_LogStats( void )
+{
+	shci_Stats_t stats;
+	shci_OpcodeStats_t opStats;
+
+	shci_GetStats( &stats );
+	IotLogInfo( "SHCI Statistics: rx frames %u, errors %u, unknown %u, rx bytes %u, tx frames %u, tx bytes %u, dropped %u, overflows %u, deferred dropped %u",
+			stats.framesReceived, stats.frameErrors, stats.unknownOpcodes, stats.bytesIn,
+			stats.framesSent, stats.bytesOut, stats.postDrops, stats.uartOverflows, stats.deferredDrops );
+
+	IotLogInfo( "  opcode: count, max us, total us, histogram <64us <256us <1ms <4ms <16ms <65ms <262ms longer" );
+	for( uint16_t i = 0; i < shci_GetOpcodeStatsCount(); ++i )
+	{
+		if( ESP_OK == shci_GetOpcodeStats( i, &opStats ) )
+		{
+			IotLogInfo( "  %02X: %u, %u, %llu, %u %u %u %u %u %u %u %u", opStats.opCode, opStats.count, opStats.maxTime, opStats.totalTime,
+					opStats.histogram[ 0 ], opStats.histogram[ 1 ], opStats.histogram[ 2 ], opStats.histogram[ 3 ],
+					opStats.histogram[ 4 ], opStats.histogram[ 5 ], opStats.histogram[ 6 ], opStats.histogram[ 7 ] );
+		}
+	}
+}
@@ -0,0 +1,240 @@
+/**
+ *  @file shci_fragment.c
+ *
+ *	@brief Fragmentation and reassembly of large SHCI messages
+ *
+ *	Command fragments are handled on the SHCI task, via the eFragmentCommand command, and
+ *	copied into a reassembly buffer allocated when the first fragment of a message arrives.
+ *	Once the final fragment arrives the message is dispatched, and the buffer freed.
+ *
+ *	Responses are split into fragments by the posting task, each fragment posted as soon
+ *	as the message buffer has room for it.
+ *
+ *  @copyright	Drinkworks LLC.  All rights reserved.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "shci.h"
+#include "shci_internal.h"
+#include "shci_fragment.h"
+#include "shci_logging.h"
+
+#define	FRAGMENT_TX_PAYLOAD		( MAX_TX_RESPONSE - SHCI_FRAGMENT_HEADER )		/**< Largest response fragment payload */
+
+/**
+ * @brief Command being reassembled
+ */
+typedef struct
+{
+	uint8_t		*pMessage;										/**< SHCI_FRAGMENT_MAX_MESSAGE bytes, NULL if slot is free */
+	TickType_t	lastTick;										/**< Tick count of latest fragment, oldest is replaced when all slots are in use */
+	uint16_t	length;											/**< Bytes received, offset expected of next fragment */
+	uint8_t		id;
+} shciFragmentRx_t;
+
+static shciFragmentRx_t _rx[ SHCI_FRAGMENT_RX_MESSAGES ];		/**< Used only on SHCI task */
+static uint8_t _txId;											/**< ID of next fragmented response */
+static portMUX_TYPE _txLock = portMUX_INITIALIZER_UNLOCKED;
+
+static void fragment_free( shciFragmentRx_t *pRx )
+{
+	vPortFree( pRx->pMessage );
+	pRx->pMessage = NULL;
+	pRx->length = 0;
+}
+
+/**
+ * @brief Find the message a fragment belongs to
+ *
+ * A fragment at offset 0 starts a message, restarting one with the same ID.  A new message
+ * takes a free slot, or replaces the least recently active one, which Host has abandoned.
+ *
+ * @return	slot, NULL if an intermediate fragment matches no message, or no memory
+ */
+static shciFragmentRx_t * fragment_find( uint8_t id, uint16_t offset )
+{
+	shciFragmentRx_t *pRx = NULL;
+	shciFragmentRx_t *pFree = NULL;
+	shciFragmentRx_t *pOldest = NULL;
+	TickType_t now = xTaskGetTickCount();
+	int i;
+
+	for( i = 0; ( NULL == pRx ) && ( i < SHCI_FRAGMENT_RX_MESSAGES ); ++i )
+	{
+		if( NULL == _rx[ i ].pMessage )
+		{
+			pFree = ( NULL == pFree ) ? &_rx[ i ] : pFree;
+		}
+		else if( id == _rx[ i ].id )
+		{
+			pRx = &_rx[ i ];
+		}
+		else if( ( NULL == pOldest ) || ( ( now - _rx[ i ].lastTick ) > ( now - pOldest->lastTick ) ) )
+		{
+			pOldest = &_rx[ i ];
+		}
+	}
+
+	if( ( 0 != offset ) || ( NULL != pRx ) )
+	{
+		if( ( NULL != pRx ) && ( 0 == offset ) )
+		{
+			pRx->length = 0;
+		}
+		return pRx;
+	}
+
+	if( NULL == pFree )
+	{
+		IotLogWarn( "Fragmented command %d abandoned, replaced by %d", pOldest->id, id );
+		fragment_free( pOldest );
+		pFree = pOldest;
+	}
+
+	pFree->pMessage = pvPortMalloc( SHCI_FRAGMENT_MAX_MESSAGE );
+	if( NULL == pFree->pMessage )
+	{
+		IotLogError( "Fragmented command %d, no memory", id );
+		return NULL;
+	}
+	pFree->id = id;
+	pFree->length = 0;
+	pFree->lastTick = now;
+	return pFree;
+}
+
+/**
+ * @brief Dispatch a reassembled command
+ *
+ * @return	error code for Command Complete, eCommandSucceeded if dispatched
+ */
+static _errorCodeType_t fragment_dispatch( const shciFragmentRx_t *pRx )
+{
+	if( ( 0 == pRx->length ) || ( eFragmentCommand == pRx->pMessage[ 0 ] ) )
+	{
+		return eInvalidCommandParameters;
+	}
+
+	IotLogDebug( "Fragmented command %d, opcode %02X, %d bytes", pRx->id, pRx->pMessage[ 0 ], pRx->length );
+	if( _shciDispatchCommand( pRx->pMessage[ 0 ], &pRx->pMessage[ 1 ], pRx->length - 1 ) )
+	{
+		shci_postCommandComplete( pRx->pMessage[ 0 ], eUnknownCommand );
+	}
+	return eCommandSucceeded;
+}
+
+/**
+ * @brief eFragmentCommand command handler, runs on SHCI task
+ *
+ * @param[in] pData	<ID><FLAGS><OFFSET-H><OFFSET-L><MESSAGE BYTES ...>
+ * @param[in] size	number of bytes
+ */
+void _shciFragmentCommand( const uint8_t *pData, const uint16_t size )
+{
+	_errorCodeType_t error = eCommandSucceeded;
+	shciFragmentRx_t *pRx = NULL;
+	uint16_t offset;
+	uint16_t n;
+
+	if( size < ( SHCI_FRAGMENT_HEADER - 1 ) )
+	{
+		shci_postCommandComplete( eFragmentCommand, eInvalidCommandParameters );
+		return;
+	}
+
+	offset = ( ( uint16_t )pData[ 2 ] << 8 ) | pData[ 3 ];
+	n = size - ( SHCI_FRAGMENT_HEADER - 1 );
+
+	pRx = fragment_find( pData[ 0 ], offset );
+	if( NULL == pRx )
+	{
+		error = ( 0 == offset ) ? eMemoryCapacityExceeded : eInvalidCommandParameters;
+	}
+	else if( offset != pRx->length )
+	{
+		IotLogError( "Fragmented command %d, offset %d, expected %d", pRx->id, offset, pRx->length );
+		error = eInvalidCommandParameters;
+	}
+	else if( ( offset + n ) > SHCI_FRAGMENT_MAX_MESSAGE )
+	{
+		IotLogError( "Fragmented command %d exceeds %d bytes", pRx->id, SHCI_FRAGMENT_MAX_MESSAGE );
+		error = eMemoryCapacityExceeded;
+	}
+	else
+	{
+		memcpy( &pRx->pMessage[ offset ], &pData[ SHCI_FRAGMENT_HEADER - 1 ], n );
+		pRx->length += n;
+		pRx->lastTick = xTaskGetTickCount();
+
+		if( 0 != ( pData[ 1 ] & SHCI_FRAGMENT_FINAL ) )
+		{
+			error = fragment_dispatch( pRx );
+			fragment_free( pRx );
+		}
+	}
+
+	if( eCommandSucceeded != error )
+	{
+		if( NULL != pRx )
+		{
+			fragment_free( pRx );
+		}
+		shci_postCommandComplete( eFragmentCommand, error );
+	}
+}
+
+/* ************************************************************************* */
+/* **********        I N T E R F A C E   F U N C T I O N S        ********** */
+/* ************************************************************************* */
+
+int32_t shciFragment_post( const uint8_t *pData, size_t numBytes, TickType_t wait )
+{
+	esp_err_t err = ESP_OK;
+	uint8_t fragment[ MAX_TX_RESPONSE ];
+	TickType_t start = xTaskGetTickCount();
+	TickType_t elapsed;
+	size_t offset;
+	size_t n;
+	uint8_t id;
+
+	if( ( NULL == pData ) || ( 0 == numBytes ) || ( numBytes > SHCI_FRAGMENT_MAX_MESSAGE ) )
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	/* Fits one frame, no fragment header needed */
+	if( numBytes <= MAX_TX_RESPONSE )
+	{
+		return _shciPostResponseWait( pData, numBytes, wait );
+	}
+
+	portENTER_CRITICAL( &_txLock );
+	id = _txId++;
+	portEXIT_CRITICAL( &_txLock );
+
+	for( offset = 0; ( ESP_OK == err ) && ( offset < numBytes ); offset += n )
+	{
+		n = ( ( numBytes - offset ) > FRAGMENT_TX_PAYLOAD ) ? FRAGMENT_TX_PAYLOAD : ( numBytes - offset );
+
+		fragment[ 0 ] = eFragmentEvent;
+		fragment[ 1 ] = id;
+		fragment[ 2 ] = ( ( offset + n ) == numBytes ) ? SHCI_FRAGMENT_FINAL : 0;
+		fragment[ 3 ] = ( uint8_t )( offset >> 8 );
+		fragment[ 4 ] = ( uint8_t )offset;
+		memcpy( &fragment[ SHCI_FRAGMENT_HEADER ], &pData[ offset ], n );
+
+		elapsed = xTaskGetTickCount() - start;
+		err = _shciPostResponseWait( fragment, n + SHCI_FRAGMENT_HEADER, ( elapsed < wait ) ? ( wait - elapsed ) : 0 );
+	}
+
+	if( ESP_OK != err )
+	{
+		IotLogError( "Fragmented response %d, %d of %d bytes posted", id, ( int )( offset - n ), ( int )numBytes );
+	}
+	return err;
+}
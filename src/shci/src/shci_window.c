@@ -0,0 +1,434 @@
+/**
+ *  @file shci_window.c
+ *
+ *	@brief Sliding-window transport over SHCI
+ *
+ *	Frames are copied into a slot of the window, posted to the SHCI message buffer, and
+ *	kept until Host acknowledges them.  Acknowledgments are handled on the SHCI task, via
+ *	the eWindowAck command.  Timeouts are serviced by the sending task, while it waits
+ *	in shciWindow_send() or shciWindow_flush().
+ *
+ *	The window table is guarded by a spinlock.  An acknowledgment holds a reference to
+ *	its window while it runs, and shciWindow_delete() waits for references to be dropped.
+ *
+ *  @copyright	Drinkworks LLC.  All rights reserved.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_err.h"
+#include "shci.h"
+#include "shci_internal.h"
+#include "shci_window.h"
+#include "shci_logging.h"
+
+/**
+ * @brief Outstanding frame
+ */
+typedef struct
+{
+	TickType_t	sentAt;										/**< Tick count when frame was last posted */
+	uint16_t	length;										/**< Frame length, including header */
+	uint8_t		retries;									/**< Retransmissions of frame */
+	bool		acked;										/**< Host acknowledged frame, may be ahead of base */
+} shciWindowSlot_t;
+
+/**
+ * @brief Window control structure
+ */
+struct shciWindow_s
+{
+	SemaphoreHandle_t	mutex;								/**< Protects window, taken by sender and by SHCI task */
+	SemaphoreHandle_t	ackEvent;							/**< Given by SHCI task when a frame is acknowledged */
+	TickType_t			timeout;
+	uint16_t			maxFrame;							/**< Slot size: header and maximum payload */
+	uint8_t				channel;
+	uint8_t				size;								/**< Window size, frames */
+	uint8_t				maxRetries;
+	uint8_t				base;								/**< Oldest unacknowledged sequence number */
+	uint8_t				next;								/**< Next sequence number to send */
+	uint8_t				users;								/**< Acknowledgments in progress on SHCI task, under _windowsLock */
+	bool				failed;								/**< A frame exceeded its retries */
+	shciWindowSlot_t	slots[ SHCI_WINDOW_MAX_SIZE ];
+	uint8_t				*pFrames;							/**< size * maxFrame bytes, slot for sequence s at ( s % size ) */
+};
+
+static shciWindow_t * _windows[ SHCI_WINDOW_CHANNELS ] = { NULL };
+static portMUX_TYPE _windowsLock = portMUX_INITIALIZER_UNLOCKED;		/**< Protects _windows[] and window users */
+
+/**
+ * @brief Look up the window on a channel, and take a reference to it
+ *
+ * @return	window, NULL if no window on channel
+ */
+static shciWindow_t * window_acquire( uint8_t channel )
+{
+	shciWindow_t *w = NULL;
+
+	if( channel < SHCI_WINDOW_CHANNELS )
+	{
+		portENTER_CRITICAL( &_windowsLock );
+		w = _windows[ channel ];
+		if( NULL != w )
+		{
+			w->users++;
+		}
+		portEXIT_CRITICAL( &_windowsLock );
+	}
+	return w;
+}
+
+static void window_release( shciWindow_t *w )
+{
+	portENTER_CRITICAL( &_windowsLock );
+	w->users--;
+	portEXIT_CRITICAL( &_windowsLock );
+}
+
+static uint8_t window_users( shciWindow_t *w )
+{
+	uint8_t users;
+
+	portENTER_CRITICAL( &_windowsLock );
+	users = w->users;
+	portEXIT_CRITICAL( &_windowsLock );
+	return users;
+}
+
+/**
+ * @brief Frames sent, not yet acknowledged
+ */
+static uint8_t window_outstanding( const shciWindow_t *w )
+{
+	return ( uint8_t )( w->next - w->base );
+}
+
+static uint8_t * window_frame( shciWindow_t *w, uint8_t seq )
+{
+	return &w->pFrames[ ( seq % w->size ) * w->maxFrame ];
+}
+
+/**
+ * @brief Post a frame to Host
+ *
+ * A frame that cannot be posted (message buffer full) is treated as lost, and will be
+ * retransmitted on timeout.
+ */
+static void window_post( shciWindow_t *w, uint8_t seq )
+{
+	shciWindowSlot_t *pSlot = &w->slots[ seq % w->size ];
+
+	pSlot->sentAt = xTaskGetTickCount();
+	if( shci_PostResponse( window_frame( w, seq ), pSlot->length ) )
+	{
+		IotLogWarn( "Window %d, frame %d not posted", w->channel, seq );
+	}
+}
+
+/**
+ * @brief Retransmit one frame, fail window if frame has exceeded its retries
+ */
+static void window_retransmit( shciWindow_t *w, uint8_t seq )
+{
+	shciWindowSlot_t *pSlot = &w->slots[ seq % w->size ];
+
+	if( pSlot->retries >= w->maxRetries )
+	{
+		IotLogError( "Window %d, frame %d not acknowledged after %d retries", w->channel, seq, pSlot->retries );
+		w->failed = true;
+	}
+	else
+	{
+		pSlot->retries++;
+		window_post( w, seq );
+	}
+}
+
+/**
+ * @brief Retransmit outstanding frames that have timed out
+ *
+ * @return	ticks until the next frame times out
+ */
+static TickType_t window_service( shciWindow_t *w )
+{
+	TickType_t now = xTaskGetTickCount();
+	TickType_t next = w->timeout;
+	TickType_t elapsed;
+	uint8_t seq;
+
+	for( seq = w->base; !w->failed && ( seq != w->next ); ++seq )
+	{
+		shciWindowSlot_t *pSlot = &w->slots[ seq % w->size ];
+
+		if( !pSlot->acked )
+		{
+			elapsed = now - pSlot->sentAt;
+			if( elapsed >= w->timeout )
+			{
+				window_retransmit( w, seq );
+			}
+			else if( ( w->timeout - elapsed ) < next )
+			{
+				next = w->timeout - elapsed;
+			}
+		}
+	}
+
+	return next;
+}
+
+/**
+ * @brief Wait, servicing timeouts, until no more than <i>limit</i> frames are outstanding
+ *
+ * Called, and returns, with window mutex held.
+ */
+static int32_t window_wait( shciWindow_t *w, uint8_t limit, TickType_t wait )
+{
+	TickType_t start = xTaskGetTickCount();
+	TickType_t elapsed;
+	TickType_t ticks;
+
+	while( window_outstanding( w ) > limit )
+	{
+		ticks = window_service( w );
+		if( w->failed )
+		{
+			return ESP_FAIL;
+		}
+
+		elapsed = xTaskGetTickCount() - start;
+		if( elapsed >= wait )
+		{
+			return ESP_ERR_TIMEOUT;
+		}
+		if( ticks > ( wait - elapsed ) )
+		{
+			ticks = wait - elapsed;
+		}
+
+		xSemaphoreGive( w->mutex );
+		xSemaphoreTake( w->ackEvent, ( 0 == ticks ) ? 1 : ticks );
+		xSemaphoreTake( w->mutex, portMAX_DELAY );
+	}
+
+	return w->failed ? ESP_FAIL : ESP_OK;
+}
+
+/**
+ * @brief eWindowAck command handler, runs on SHCI task
+ *
+ * @param[in] pData	<CHANNEL>{ <SEQ><STATUS> } ...
+ * @param[in] size	number of bytes
+ */
+static void window_onAck( const uint8_t *pData, const uint16_t size )
+{
+	shciWindow_t *w;
+	uint16_t i;
+	uint8_t seq;
+	bool bAdvanced = false;
+
+	if( ( size < 3 ) || ( NULL == ( w = window_acquire( pData[ 0 ] ) ) ) )
+	{
+		shci_postCommandComplete( eWindowAck, eInvalidCommandParameters );
+		return;
+	}
+
+	xSemaphoreTake( w->mutex, portMAX_DELAY );
+
+	for( i = 1; ( i + 1 ) < size; i += 2 )
+	{
+		seq = pData[ i ];
+		if( ( uint8_t )( seq - w->base ) >= window_outstanding( w ) )
+		{
+			continue;												/* Not outstanding, duplicate or stale */
+		}
+
+		if( SHCI_WINDOW_ACK == pData[ i + 1 ] )
+		{
+			w->slots[ seq % w->size ].acked = true;
+		}
+		else if( !w->slots[ seq % w->size ].acked )
+		{
+			window_retransmit( w, seq );
+		}
+	}
+
+	/* Slide window past acknowledged frames */
+	while( ( w->base != w->next ) && w->slots[ w->base % w->size ].acked )
+	{
+		w->slots[ w->base % w->size ].acked = false;
+		w->base++;
+		bAdvanced = true;
+	}
+
+	xSemaphoreGive( w->mutex );
+
+	if( bAdvanced || w->failed )
+	{
+		xSemaphoreGive( w->ackEvent );
+	}
+
+	window_release( w );
+}
+
+/* ************************************************************************* */
+/* **********        I N T E R F A C E   F U N C T I O N S        ********** */
+/* ************************************************************************* */
+
+shciWindow_handle_t shciWindow_create( uint8_t channel, uint8_t windowSize, uint16_t maxPayload, TickType_t timeout, uint8_t maxRetries )
+{
+	esp_err_t err = ESP_OK;
+	shciWindow_t *w = NULL;
+
+	if( ( channel >= SHCI_WINDOW_CHANNELS ) || ( 0 == windowSize ) || ( windowSize > SHCI_WINDOW_MAX_SIZE ) ||
+		( 0 != ( windowSize & ( windowSize - 1 ) ) ) ||
+		( 0 == maxPayload ) || ( ( maxPayload + SHCI_WINDOW_HEADER ) > MAX_TX_RESPONSE ) || ( 0 == timeout ) )
+	{
+		IotLogError( "shciWindow_create: invalid parameters" );
+		err = ESP_ERR_INVALID_ARG;
+	}
+	else if( NULL != _windows[ channel ] )
+	{
+		IotLogError( "shciWindow_create: channel %d in use", channel );
+		err = ESP_FAIL;
+	}
+
+	if( ESP_OK == err )
+	{
+		w = pvPortMalloc( sizeof( shciWindow_t ) );
+		err = ( NULL == w ) ? ESP_ERR_NO_MEM : ESP_OK;
+	}
+
+	if( ESP_OK == err )
+	{
+		memset( w, 0, sizeof( shciWindow_t ) );
+		w->channel = channel;
+		w->size = windowSize;
+		w->maxFrame = maxPayload + SHCI_WINDOW_HEADER;
+		w->timeout = timeout;
+		w->maxRetries = maxRetries;
+		w->pFrames = pvPortMalloc( windowSize * w->maxFrame );
+		w->mutex = xSemaphoreCreateMutex();
+		w->ackEvent = xSemaphoreCreateBinary();
+		if( ( NULL == w->pFrames ) || ( NULL == w->mutex ) || ( NULL == w->ackEvent ) )
+		{
+			err = ESP_ERR_NO_MEM;
+		}
+	}
+
+	if( ESP_OK == err )
+	{
+		shci_RegisterCommand( eWindowAck, &window_onAck );
+
+		portENTER_CRITICAL( &_windowsLock );
+		if( NULL == _windows[ channel ] )
+		{
+			_windows[ channel ] = w;
+		}
+		else
+		{
+			err = ESP_FAIL;											/* Channel taken since checked */
+		}
+		portEXIT_CRITICAL( &_windowsLock );
+	}
+
+	if( ( ESP_OK != err ) && ( NULL != w ) )
+	{
+		shciWindow_delete( w );
+		w = NULL;
+	}
+
+	return w;
+}
+
+void shciWindow_delete( shciWindow_handle_t window )
+{
+	if( NULL != window )
+	{
+		portENTER_CRITICAL( &_windowsLock );
+		if( window == _windows[ window->channel ] )
+		{
+			_windows[ window->channel ] = NULL;
+		}
+		portEXIT_CRITICAL( &_windowsLock );
+
+		/* No new acknowledgment can find the window, wait for any in progress on SHCI task */
+		while( 0 != window_users( window ) )
+		{
+			vTaskDelay( 1 );
+		}
+
+		if( NULL != window->mutex )
+		{
+			vSemaphoreDelete( window->mutex );
+		}
+		if( NULL != window->ackEvent )
+		{
+			vSemaphoreDelete( window->ackEvent );
+		}
+		vPortFree( window->pFrames );
+		vPortFree( window );
+	}
+}
+
+int32_t shciWindow_send( shciWindow_handle_t window, const uint8_t *pData, size_t numBytes, TickType_t wait )
+{
+	esp_err_t err = ESP_OK;
+	uint8_t *pFrame;
+
+	if( ( NULL == window ) || ( NULL == pData ) || ( 0 == numBytes ) || ( ( numBytes + SHCI_WINDOW_HEADER ) > window->maxFrame ) )
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	xSemaphoreTake( window->mutex, portMAX_DELAY );
+
+	/* Wait for a free slot */
+	err = window_wait( window, window->size - 1, wait );
+
+	if( ESP_OK == err )
+	{
+		shciWindowSlot_t *pSlot = &window->slots[ window->next % window->size ];
+
+		pFrame = window_frame( window, window->next );
+		pFrame[ 0 ] = eWindowData;
+		pFrame[ 1 ] = window->channel;
+		pFrame[ 2 ] = window->next;
+		memcpy( &pFrame[ SHCI_WINDOW_HEADER ], pData, numBytes );
+
+		pSlot->length = numBytes + SHCI_WINDOW_HEADER;
+		pSlot->retries = 0;
+		pSlot->acked = false;
+		window_post( window, window->next );
+		window->next++;
+	}
+
+	xSemaphoreGive( window->mutex );
+
+	return err;
+}
+
+int32_t shciWindow_flush( shciWindow_handle_t window, TickType_t wait )
+{
+	esp_err_t err;
+
+	if( NULL == window )
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	xSemaphoreTake( window->mutex, portMAX_DELAY );
+	err = window_wait( window, 0, wait );
+	xSemaphoreGive( window->mutex );
+
+	return err;
+}
+
+uint8_t shciWindow_outstanding( shciWindow_handle_t window )
+{
+	return ( NULL == window ) ? 0 : window_outstanding( window );
+}
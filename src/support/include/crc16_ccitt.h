@@ -55,6 +55,15 @@
 extern "C" {
 #endif
 
+/**@brief Implementations, select one at build time with CRC16_CCITT_METHOD (default CRC16_CCITT_TABLE)
+ *
+ * Table sizes: CRC16_CCITT_TABLE 512 bytes, CRC16_CCITT_SLICE4 2 KB, CRC16_CCITT_SLICE8 4 KB.
+ */
+#define CRC16_CCITT_BITWISE     0       /**< Shift and xor, no table */
+#define CRC16_CCITT_TABLE       1       /**< 256 entry table, one byte per lookup */
+#define CRC16_CCITT_SLICE4      4       /**< Slice-by-4, four tables */
+#define CRC16_CCITT_SLICE8      8       /**< Slice-by-8, eight tables */
+
 /**@brief Function for calculating CRC-16
  *
  * Calculate CRC16_CCITT for a block of data, initial CRC value is 0x0000.
@@ -66,6 +75,20 @@ extern "C" {
  */
 uint16_t crc16_ccitt_compute(uint8_t const * p_data, uint32_t size);
 
+/**@brief Function for updating CRC-16
+ *
+ * Continue a CRC16_CCITT calculation with another block of data, so that data held in
+ * separate buffers (e.g. header and payload) can be covered without concatenating it.
+ * Start with 0x0000; crc16_ccitt_compute( p, n ) equals crc16_ccitt_update( 0x0000, p, n ).
+ *
+ * @param[in] crc    CRC value of the preceding data.
+ * @param[in] p_data The input data block for computation.
+ * @param[in] size   The size of the input data block in bytes.
+ *
+ * @return The updated CRC-16 value, based on the input supplied.
+ */
+uint16_t crc16_ccitt_update(uint16_t crc, uint8_t const * p_data, uint32_t size);
+
 
 #ifdef __cplusplus
 }
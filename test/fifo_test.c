@@ -5,10 +5,13 @@
  */
 
 #include	<stdint.h>
+#include	<stdlib.h>
 #include	<string.h>
 #include	"event_fifo.h"
 #include	"nvs_utility.h"
 #include	"esp_err.h"
+#include	"freertos/FreeRTOS.h"
+#include	"freertos/task.h"
 
 /* Debug Logging */
 #include "nvs_logging.h"
@@ -21,9 +24,16 @@
 #define	PHASE_1			1
 #define	PHASE_2			2
 #define	PHASE_3			3
+#define	PHASE_4			4
 #define	TEST1_STEP_PUT	0
 #define	TEST1_STEP_GET	1
 
+#define	TEST3_BATCH_SIZE	8				/**< Number of records per batch, for batch put/get test */
+
+#define	TEST4_CURSOR		"TEST4"			/**< Name of read cursor, for multiple reader test */
+
+#define	TEST5_RANGE_SIZE	10				/**< Number of records per range read, for indexed read test */
+
 
 const static char testRecordTemplate[] =
 		"{"
@@ -198,6 +208,7 @@ static int32_t get_verify_test_data( fifo_handle_t fifo, uint32_t index )
 					err = ESP_FAIL;
 				}
 			}
+			fifo_commitRead( fifo, ( ESP_OK == err ) );	// commit verified read, otherwise retry record
 			vPortFree( readrecord );					// free read buffer
 		}
 		vPortFree( testrecord );						// free compare buffer
@@ -242,6 +253,7 @@ static int32_t fifo_empty_test( fifo_handle_t fifo )
 			{
 				IotLogInfo( "  size = %d", fifo_size( fifo ) );
 
+				size = sizeof( testRecordTemplate ) + 10;
 				err = fifo_get( fifo, readrecord, &size );						// read record
 				if( ESP_OK != err )
 				{
@@ -249,6 +261,7 @@ static int32_t fifo_empty_test( fifo_handle_t fifo )
 				}
 			};
 
+			fifo_commitRead( fifo, ( ESP_OK == err ) );							// discard records read
 			vPortFree( readrecord );											// free buffer
 		}
 		else
@@ -670,6 +683,492 @@ static int32_t fifo_test2( testControl_t *pTest, fifo_handle_t fifo, uint32_t st
 }
 
 
+/**
+ * @brief	FIFO Test 3 - Batch put and get
+ *
+ * 	3.	Batch Write/Read
+ * 		a) Write records in batches of TEST3_BATCH_SIZE, using fifo_putBatch()
+ * 		b) Verify fifo_size
+ * 		c) Read records in batches, using fifo_getBatch()
+ * 		d) Compare data, commit read
+ * 		e) Verify fifo_empty
+ *
+ * param[in|out] 	pTest		Pointer to test control parameters
+ * param[in]		fifo		FIFO handle
+ * param[in]		startIndex	Starting record index, used for creating/verifying records
+ * param[in]		count		Number of records to Write/Read, must be less than FIFO_SIZE
+ * @return		ESP_OK on success
+ */
+static int32_t fifo_test3( testControl_t *pTest, fifo_handle_t fifo, uint32_t startIndex, uint32_t count )
+{
+	esp_err_t err = ESP_OK;
+	char *records[ TEST3_BATCH_SIZE ] = { NULL };
+	size_t lengths[ TEST3_BATCH_SIZE ];
+	size_t recordSize = sizeof( testRecordTemplate ) + 10;
+	uint16_t nBatch;
+	uint16_t i;
+	char *readBuffer;
+	char *pRecord;
+
+	switch( pTest->phase )
+	{
+		case PHASE_0:									// empty the FIFO before starting
+			IotLogInfo( "fifo_test3: start" );
+			err = fifo_empty_test( fifo );
+			fifo_commitRead( fifo, true );
+			IotLogInfo( "  emptied" );
+			pTest->index = startIndex;					// initialize test index
+			pTest->step = 0;							// initialize test step
+			pTest->bComplete = false;					// initialize test complete flag
+			pTest->error = 0;							// Clear error count
+			++pTest->phase;								// Next phase
+			break;
+
+		case PHASE_1:									// Write one batch of records
+			nBatch = ( ( startIndex + count - pTest->index ) < TEST3_BATCH_SIZE ) ? ( startIndex + count - pTest->index ) : TEST3_BATCH_SIZE;
+			IotLogInfo( "  Batch Write, index = %d, count = %d, head = %d", pTest->index, nBatch, fifo_getHead( fifo ) );
+
+			for( i = 0; ( i < nBatch ) && ( ESP_OK == err ); ++i )
+			{
+				records[ i ] = test_data( pTest->index + i );
+				if( NULL == records[ i ] )
+				{
+					err = ESP_FAIL;
+				}
+				else
+				{
+					lengths[ i ] = strlen( records[ i ] );
+				}
+			}
+
+			if( ESP_OK == err )
+			{
+				err = fifo_putBatch( fifo, ( const void * const * ) records, lengths, nBatch );
+			}
+
+			for( i = 0; i < nBatch; ++i )
+			{
+				vPortFree( records[ i ] );
+			}
+
+			if( ESP_OK == err )
+			{
+				pTest->index += nBatch;
+				if( ( pTest->index - startIndex ) != fifo_size( fifo ) )
+				{
+					IotLogError( "  fifo_size error" );
+					err = ESP_FAIL;
+				}
+			}
+
+			if( ESP_OK != err )
+			{
+				IotLogError( "  fifo_putBatch: %d", err );
+				++pTest->error;											// increment error count
+			}
+
+			if( pTest->index >= ( startIndex + count ) )				/* if phase is complete */
+			{
+				pTest->index = startIndex;
+				pTest->phase++;
+			}
+			break;
+
+		case PHASE_2:									// Read/Verify one batch of records
+			readBuffer = pvPortMalloc( TEST3_BATCH_SIZE * recordSize );
+			if( NULL == readBuffer )
+			{
+				err = ESP_FAIL;
+			}
+
+			if( ESP_OK == err )
+			{
+				nBatch = TEST3_BATCH_SIZE;
+				err = fifo_getBatch( fifo, readBuffer, ( TEST3_BATCH_SIZE * recordSize ), lengths, &nBatch );
+				IotLogInfo( "  Batch Read, index = %d, count = %d, tail = %d", pTest->index, nBatch, fifo_getTail( fifo ) );
+			}
+
+			pRecord = readBuffer;
+			for( i = 0; ( ESP_OK == err ) && ( i < nBatch ); ++i )
+			{
+				records[ 0 ] = test_data( pTest->index );
+				if( ( NULL == records[ 0 ] ) || ( lengths[ i ] != strlen( records[ 0 ] ) ) || ( 0 != memcmp( records[ 0 ], pRecord, lengths[ i ] ) ) )
+				{
+					IotLogError( "  fifo_test3: data mismatch record: %d", pTest->index );
+					err = ESP_FAIL;
+				}
+				vPortFree( records[ 0 ] );
+				pRecord += lengths[ i ];
+				++pTest->index;
+			}
+
+			vPortFree( readBuffer );
+
+			if( ESP_OK == err )
+			{
+				err = fifo_commitRead( fifo, true );
+			}
+
+			if( ESP_OK != err )
+			{
+				IotLogError( "  fifo_getBatch: %d", err );
+				++pTest->error;											// increment error count
+				fifo_commitRead( fifo, false );
+				pTest->phase++;											// abandon read phase
+			}
+			else if( pTest->index >= ( startIndex + count ) )			/* if phase is complete */
+			{
+				if( !fifo_empty( fifo ) )
+				{
+					IotLogError( "  fifo_empty error" );
+					++pTest->error;										// increment error count
+				}
+				pTest->phase++;
+			}
+			break;
+
+		case PHASE_3:												/* Test is complete */
+			IotLogInfo( "fifo_test3: complete" );
+			if( pTest->error )
+			{
+				IotLogInfo( "  FAILED, error count = %d", pTest->error );
+			}
+			else
+			{
+				IotLogInfo("  PASSED" );
+			}
+			pTest->bComplete = true;
+			break;
+
+		default:
+			break;
+	}
+
+	return err;
+}
+
+/**
+ * @brief	FIFO Test 4 - Multiple readers
+ *
+ * 	4.	Named cursor and default reader
+ * 		a) Open cursor, write records
+ * 		b) Read records with cursor, compare data, commit read
+ * 		c) Verify records are retained for the default reader
+ * 		d) Read records with default reader, verify fifo_empty
+ * 		e) Delete cursor
+ *
+ * param[in|out] 	pTest		Pointer to test control parameters
+ * param[in]		fifo		FIFO handle
+ * param[in]		startIndex	Starting record index, used for creating/verifying records
+ * param[in]		count		Number of records to Write/Read, must be less than FIFO_SIZE
+ * @return		ESP_OK on success
+ */
+static int32_t fifo_test4( testControl_t *pTest, fifo_handle_t fifo, uint32_t startIndex, uint32_t count )
+{
+	esp_err_t err = ESP_OK;
+	fifo_cursor_handle_t cursor = NULL;
+	size_t size = sizeof( testRecordTemplate ) + 10;
+	char *testrecord;
+	char *readrecord;
+	uint32_t i;
+
+	if( ( PHASE_0 != pTest->phase ) && ( PHASE_4 != pTest->phase ) )
+	{
+		cursor = fifo_cursorOpen( fifo, TEST4_CURSOR );		// re-open cursor, test may have been resumed after a power cycle
+		if( NULL == cursor )
+		{
+			IotLogError( "  fifo_cursorOpen error" );
+			++pTest->error;
+			pTest->phase = PHASE_4;
+		}
+	}
+
+	switch( pTest->phase )
+	{
+		case PHASE_0:									// empty the FIFO, and write records
+			IotLogInfo( "fifo_test4: start" );
+			err = fifo_empty_test( fifo );
+			fifo_commitRead( fifo, true );
+			pTest->index = startIndex;					// initialize test index
+			pTest->step = 0;							// initialize test step
+			pTest->bComplete = false;					// initialize test complete flag
+			pTest->error = 0;							// Clear error count
+
+			if( NULL == fifo_cursorOpen( fifo, TEST4_CURSOR ) )
+			{
+				IotLogError( "  fifo_cursorOpen error" );
+				err = ESP_FAIL;
+			}
+
+			for( i = 0; ( ESP_OK == err ) && ( i < count ); ++i )
+			{
+				err = put_test_data( fifo, startIndex + i );
+			}
+
+			if( ESP_OK != err )
+			{
+				IotLogError( "  put_test_data: %d", err );
+				++pTest->error;
+			}
+			++pTest->phase;
+			break;
+
+		case PHASE_1:									// Read/verify records with cursor
+			IotLogInfo( "  Cursor Read, size = %d", fifo_cursorSize( cursor ) );
+			if( count != fifo_cursorSize( cursor ) )
+			{
+				IotLogError( "  fifo_cursorSize error" );
+				++pTest->error;
+			}
+
+			readrecord = pvPortMalloc( size );
+			for( i = 0; ( ESP_OK == err ) && ( i < count ); ++i )
+			{
+				size = sizeof( testRecordTemplate ) + 10;
+				testrecord = test_data( startIndex + i );
+				if( ( NULL == readrecord ) || ( NULL == testrecord ) || ( ESP_OK != fifo_cursorGet( cursor, readrecord, &size ) ) ||
+					( size != strlen( testrecord ) ) || ( 0 != memcmp( testrecord, readrecord, size ) ) )
+				{
+					IotLogError( "  fifo_test4: data mismatch record: %d", startIndex + i );
+					err = ESP_FAIL;
+				}
+				vPortFree( testrecord );
+			}
+			vPortFree( readrecord );
+
+			if( ( ESP_OK != fifo_cursorCommit( cursor, ( ESP_OK == err ) ) ) || ( ESP_OK != err ) )
+			{
+				++pTest->error;
+			}
+			++pTest->phase;
+			break;
+
+		case PHASE_2:									// Verify records retained, until read by default reader
+			if( ( 0 != fifo_cursorSize( cursor ) ) || ( count != fifo_size( fifo ) ) || fifo_empty( fifo ) )
+			{
+				IotLogError( "  fifo_test4: records not retained, size = %d", fifo_size( fifo ) );
+				++pTest->error;
+			}
+
+			for( i = 0; ( ESP_OK == err ) && ( i < count ); ++i )
+			{
+				err = get_verify_test_data( fifo, startIndex + i );
+			}
+			pTest->index = startIndex + i;
+
+			if( ( ESP_OK != err ) || !fifo_empty( fifo ) )
+			{
+				IotLogError( "  fifo_test4: default read error, size = %d", fifo_size( fifo ) );
+				++pTest->error;
+			}
+			++pTest->phase;
+			break;
+
+		case PHASE_3:									// Delete cursor
+			if( ESP_OK != fifo_cursorDelete( cursor ) )
+			{
+				IotLogError( "  fifo_cursorDelete error" );
+				++pTest->error;
+			}
+			++pTest->phase;
+			break;
+
+		case PHASE_4:												/* Test is complete */
+			IotLogInfo( "fifo_test4: complete" );
+			if( pTest->error )
+			{
+				IotLogInfo( "  FAILED, error count = %d", pTest->error );
+			}
+			else
+			{
+				IotLogInfo("  PASSED" );
+			}
+			pTest->bComplete = true;
+			break;
+
+		default:
+			break;
+	}
+
+	return err;
+}
+
+/**
+ * @brief	Get Index of a test record, for fifo_setIndex()
+ */
+static bool test_index( const void *blob, size_t length, uint32_t *pIndex )
+{
+	static const char prefix[] = "{\"Index\": ";
+
+	if( ( length <= ( sizeof( prefix ) - 1 ) ) || ( 0 != memcmp( blob, prefix, sizeof( prefix ) - 1 ) ) )
+	{
+		return false;
+	}
+
+	*pIndex = strtoul( ( const char * ) blob + sizeof( prefix ) - 1, NULL, 10 );		// record continues after Index, conversion stops at ','
+	return true;
+}
+
+/**
+ * @brief	Read a range of records by Index, and verify data
+ *
+ * @param[in]	fifo	FIFO handle
+ * @param[in]	first	First record Index of range
+ * @param[in]	last	Last record Index of range
+ * @param[in]	expect	First record Index expected to be returned
+ * @param[in]	count	Number of records expected to be returned
+ * @return		ESP_OK on success
+ */
+static int32_t range_verify_test_data( fifo_handle_t fifo, uint32_t first, uint32_t last, uint32_t expect, uint16_t count )
+{
+	esp_err_t err = ESP_OK;
+	size_t lengths[ TEST5_RANGE_SIZE ];
+	uint16_t nRead = TEST5_RANGE_SIZE;
+	size_t offset = 0;
+	char *testrecord;
+	char *buffer;
+	uint16_t i;
+
+	buffer = pvPortMalloc( TEST5_RANGE_SIZE * ( sizeof( testRecordTemplate ) + 10 ) );
+	if( NULL == buffer )
+	{
+		return ESP_FAIL;
+	}
+
+	if( ESP_OK != fifo_readRange( fifo, first, last, buffer, TEST5_RANGE_SIZE * ( sizeof( testRecordTemplate ) + 10 ), lengths, &nRead ) )
+	{
+		nRead = 0;
+	}
+
+	if( count != nRead )
+	{
+		IotLogError( " range_verify_test_data: %d - %d, count mismatch (%d vs %d)", first, last, nRead, count );
+		err = ESP_FAIL;
+	}
+
+	for( i = 0; ( ESP_OK == err ) && ( i < nRead ); ++i )
+	{
+		testrecord = test_data( expect + i );
+		if( ( NULL == testrecord ) || ( lengths[ i ] != strlen( testrecord ) ) || ( 0 != memcmp( testrecord, &buffer[ offset ], lengths[ i ] ) ) )
+		{
+			IotLogError( " range_verify_test_data: data mismatch record: %d", expect + i );
+			err = ESP_FAIL;
+		}
+		offset += lengths[ i ];
+		vPortFree( testrecord );
+	}
+
+	vPortFree( buffer );
+
+	return err;
+}
+
+/**
+ * @brief	FIFO Test 5 - Read by record Index
+ *
+ * 	5.	Indexed range read
+ * 		a) Over-fill FIFO, dropping oldest records
+ * 		b) Read and commit all records
+ * 		c) Read ranges of committed records by Index, compare data
+ * 		d) Verify a range partly overwritten, and a range beyond the head
+ * 		e) Verify fifo_size is not changed by range reads
+ *
+ * param[in|out] 	pTest		Pointer to test control parameters
+ * param[in]		fifo		FIFO handle
+ * param[in]		startIndex	Starting record index, used for creating/verifying records
+ * param[in]		count		Number of records to Write/Read, must be greater than FIFO_SIZE
+ * @return		ESP_OK on success
+ */
+static int32_t fifo_test5( testControl_t *pTest, fifo_handle_t fifo, uint32_t startIndex, uint32_t count )
+{
+	esp_err_t err = ESP_OK;
+	uint32_t dropped = count - FIFO_SIZE;
+	uint32_t i;
+
+	if( ( PHASE_3 != pTest->phase ) && ( ESP_OK != fifo_setIndex( fifo, &test_index, sizeof( testRecordTemplate ) + 10 ) ) )
+	{
+		IotLogError( "  fifo_setIndex error" );				// index is rebuilt, test may have been resumed after a power cycle
+		++pTest->error;
+		pTest->phase = PHASE_3;
+	}
+
+	switch( pTest->phase )
+	{
+		case PHASE_0:									// empty the FIFO, and over-fill
+			IotLogInfo( "fifo_test5: start" );
+			err = fifo_empty_test( fifo );
+			fifo_commitRead( fifo, true );
+			pTest->index = startIndex;					// initialize test index
+			pTest->step = 0;							// initialize test step
+			pTest->bComplete = false;					// initialize test complete flag
+			pTest->error = 0;							// Clear error count
+
+			for( i = 0; ( ESP_OK == err ) && ( i < count ); ++i )
+			{
+				err = put_test_data( fifo, startIndex + i );
+			}
+
+			if( ESP_OK != err )
+			{
+				IotLogError( "  put_test_data: %d", err );
+				++pTest->error;
+			}
+			++pTest->phase;
+			break;
+
+		case PHASE_1:									// Read and commit all records
+			for( i = dropped; ( ESP_OK == err ) && ( i < count ); ++i )
+			{
+				err = get_verify_test_data( fifo, startIndex + i );
+			}
+			pTest->index = startIndex + i;
+
+			if( ( ESP_OK != err ) || !fifo_empty( fifo ) )
+			{
+				IotLogError( "  fifo_test5: read error, size = %d", fifo_size( fifo ) );
+				++pTest->error;
+			}
+			++pTest->phase;
+			break;
+
+		case PHASE_2:									// Read ranges of committed records
+			if( ( ESP_OK != range_verify_test_data( fifo, startIndex + dropped + 20, startIndex + dropped + 20 + TEST5_RANGE_SIZE - 1, startIndex + dropped + 20, TEST5_RANGE_SIZE ) ) ||
+				( ESP_OK != range_verify_test_data( fifo, startIndex + ( count / 2 ), startIndex + ( count / 2 ) + 2, startIndex + ( count / 2 ), 3 ) ) ||
+				( ESP_OK != range_verify_test_data( fifo, startIndex, startIndex + dropped + 2, startIndex + dropped, 3 ) ) ||
+				( ESP_OK != range_verify_test_data( fifo, startIndex + count - 2, startIndex + count + 5, startIndex + count - 2, 2 ) ) ||
+				( ESP_OK != range_verify_test_data( fifo, startIndex + count, startIndex + count + 5, 0, 0 ) ) )
+			{
+				++pTest->error;
+			}
+
+			if( 0 != fifo_size( fifo ) )
+			{
+				IotLogError( "  fifo_test5: range read changed size, %d", fifo_size( fifo ) );
+				++pTest->error;
+			}
+			++pTest->phase;
+			break;
+
+		case PHASE_3:												/* Test is complete */
+			IotLogInfo( "fifo_test5: complete" );
+			if( pTest->error )
+			{
+				IotLogInfo( "  FAILED, error count = %d", pTest->error );
+			}
+			else
+			{
+				IotLogInfo("  PASSED" );
+			}
+			pTest->bComplete = true;
+			break;
+
+		default:
+			break;
+	}
+
+	return err;
+}
+
 /**
  * @brief	Reset test parameters
  *
@@ -704,7 +1203,7 @@ void fifo_test( void )
 	bool bAllDone = false;
 	size_t size = sizeof( testControl_t );
 
-	fifo = fifo_init( NVS_PART_EDATA, "EventRecords", "EVR", FIFO_SIZE, NVS_FIFO_CONTROLS, NVS_FIFO_MAX );
+	fifo = fifo_init( NVS_PART_EDATA, "EventRecords", "EVR", FIFO_SIZE, NVS_FIFO_CONTROLS, NVS_FIFO_MAX, NULL );
 	if( NULL != fifo )
 	{
 		IotLogInfo( "Fifo Initialization complete" );
@@ -759,6 +1258,18 @@ void fifo_test( void )
 						fifo_test2( &test, fifo, test.startIndex, ( FIFO_SIZE + 15 ) );		// test #2 - over fill FIFO
 						break;
 
+					case 4:
+						fifo_test3( &test, fifo, test.startIndex, ( FIFO_SIZE / 2 ) );		// test #3 - batch put/get
+						break;
+
+					case 5:
+						fifo_test4( &test, fifo, test.startIndex, 20 );						// test #4 - multiple readers
+						break;
+
+					case 6:
+						fifo_test5( &test, fifo, test.startIndex, ( FIFO_SIZE + 15 ) );		// test #5 - read by record Index
+						break;
+
 					default:												// All tests complete
 						reset_test( &test );								// Reset test parameters so test suite can be re-run
 						test.cycle++;										// increment cycle count
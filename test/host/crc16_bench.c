@@ -0,0 +1,163 @@
+/**
+ * @file	crc16_bench.c
+ *
+ * Host test and benchmark for the CRC16-CCITT kernel.
+ *
+ * Built once per CRC16_CCITT_METHOD.  The selected implementation is checked against
+ * the original bitwise implementation, kept here as a reference, for random data and
+ * random splits through crc16_ccitt_update().  Throughput of both is then reported
+ * for block sizes typical of SHCI frames and host OTA blocks.
+ */
+
+#include	<string.h>
+#include	<time.h>
+#include	"crc16_ccitt.h"
+#include	"host_test.h"
+
+#define	BENCH_BUFFER_SIZE		4096				/**< Random data, blocks are taken from here */
+#define	BENCH_BYTES				( 64 * 1024 * 1024 )	/**< Bytes processed per measurement */
+#define	BENCH_CHECKS			2000				/**< Random blocks compared with reference */
+
+uint32_t hostTest_failures = 0;
+
+static const uint32_t _blockSizes[] = { 8, 64, 260, 512, 4096 };
+
+static uint8_t _data[ BENCH_BUFFER_SIZE ];
+
+static uint32_t _seed = 1;
+
+/**
+ * @brief	Deterministic pseudo-random number, so failures are reproducible
+ */
+static uint32_t bench_rand( void )
+{
+	_seed = ( _seed * 1103515245 ) + 12345;
+	return ( _seed >> 16 ) & 0x7FFF;
+}
+
+/**
+ * @brief	Reference: original shift and xor implementation
+ */
+static uint16_t crc16_reference( uint16_t crc, uint8_t const * p_data, uint32_t size )
+{
+	for( uint32_t i = 0; i < size; i++ )
+	{
+		crc  = ( uint8_t )( crc >> 8 ) | ( crc << 8 );
+		crc ^= p_data[ i ];
+		crc ^= ( uint8_t )( crc & 0xFF ) >> 4;
+		crc ^= ( crc << 8 ) << 4;
+		crc ^= ( ( crc & 0xFF ) << 4 ) << 1;
+	}
+
+	return crc;
+}
+
+static const char * method_name( void )
+{
+	switch( CRC16_CCITT_METHOD )
+	{
+		case CRC16_CCITT_BITWISE:	return "bitwise";
+		case CRC16_CCITT_TABLE:		return "table";
+		case CRC16_CCITT_SLICE4:	return "slice-by-4";
+		case CRC16_CCITT_SLICE8:	return "slice-by-8";
+		default:					return "unknown";
+	}
+}
+
+static double elapsed_ms( const struct timespec *pStart )
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return ( ( now.tv_sec - pStart->tv_sec ) * 1000.0 ) + ( ( now.tv_nsec - pStart->tv_nsec ) / 1000000.0 );
+}
+
+/**
+ * @brief	Compare selected implementation with reference
+ */
+static void bench_verify( void )
+{
+	static const uint8_t check[] = "123456789";
+	uint8_t frame[ 8 ];
+	uint16_t crc;
+
+	/* CRC-16/XMODEM check value */
+	HOST_CHECK( 0x31C3 == crc16_ccitt_compute( check, 9 ) );
+	HOST_CHECK( 0x0000 == crc16_ccitt_compute( check, 0 ) );
+
+	/* Appending CRC, MSB first, gives zero remainder, as checked by SHCI receive */
+	memcpy( frame, "\x00\x03\x01\x02\x03", 5 );
+	crc = crc16_ccitt_compute( frame, 5 );
+	frame[ 5 ] = ( uint8_t )( crc >> 8 );
+	frame[ 6 ] = ( uint8_t )( crc & 0xFF );
+	HOST_CHECK( 0 == crc16_ccitt_compute( frame, 7 ) );
+
+	for( uint32_t n = 0; n < BENCH_CHECKS; ++n )
+	{
+		uint32_t offset = bench_rand() % BENCH_BUFFER_SIZE;
+		uint32_t size = bench_rand() % ( BENCH_BUFFER_SIZE - offset + 1 );
+		uint32_t split = ( 0 == size ) ? 0 : bench_rand() % ( size + 1 );
+		uint16_t expected = crc16_reference( 0x0000, &_data[ offset ], size );
+
+		HOST_CHECK( expected == crc16_ccitt_compute( &_data[ offset ], size ) );
+
+		/* Header and payload in separate calls */
+		crc = crc16_ccitt_update( 0x0000, &_data[ offset ], split );
+		crc = crc16_ccitt_update( crc, &_data[ offset + split ], size - split );
+		HOST_CHECK( expected == crc );
+	}
+}
+
+/**
+ * @brief	Offset of next block within random data
+ */
+static uint32_t next_offset( uint32_t offset, uint32_t blockSize )
+{
+	offset += blockSize;
+	return ( ( offset + blockSize ) > BENCH_BUFFER_SIZE ) ? 0 : offset;
+}
+
+/**
+ * @brief	Throughput of reference and selected implementation, for one block size
+ */
+static void bench_block( uint32_t blockSize )
+{
+	struct timespec start;
+	volatile uint16_t sink = 0;
+	double refMs, ms;
+	uint32_t blocks = BENCH_BYTES / blockSize;
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	for( uint32_t n = 0, offset = 0; n < blocks; ++n, offset = next_offset( offset, blockSize ) )
+	{
+		sink ^= crc16_reference( 0x0000, &_data[ offset ], blockSize );
+	}
+	refMs = elapsed_ms( &start );
+
+	clock_gettime( CLOCK_MONOTONIC, &start );
+	for( uint32_t n = 0, offset = 0; n < blocks; ++n, offset = next_offset( offset, blockSize ) )
+	{
+		sink ^= crc16_ccitt_compute( &_data[ offset ], blockSize );
+	}
+	ms = elapsed_ms( &start );
+
+	printf( "%-10s %4u byte blocks: bitwise %7.1f MB/s, %-10s %7.1f MB/s, x%.2f\n", method_name(), blockSize,
+			BENCH_BYTES / ( refMs * 1000.0 ), method_name(), BENCH_BYTES / ( ms * 1000.0 ), refMs / ms );
+}
+
+int main( void )
+{
+	for( uint32_t i = 0; i < BENCH_BUFFER_SIZE; ++i )
+	{
+		_data[ i ] = ( uint8_t )bench_rand();
+	}
+
+	bench_verify();
+
+	for( uint32_t i = 0; i < sizeof( _blockSizes ) / sizeof( _blockSizes[ 0 ] ); ++i )
+	{
+		bench_block( _blockSizes[ i ] );
+	}
+
+	return HOST_TEST_RESULT( "crc16_bench" );
+}
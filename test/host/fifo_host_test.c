@@ -0,0 +1,36 @@
+/**
+ * @file	fifo_host_test.c
+ *
+ * Host runner for the on-target event FIFO test suite, test/fifo_test.c
+ */
+
+#include	"FreeRTOS.h"
+#include	"nvs_utility.h"
+#include	"nvs_emulator.h"
+#include	"fifo_test.h"
+#include	"host_log.h"
+#include	"host_test.h"
+
+#define	FIFO_TEST_COUNT		7						/**< Tests run by fifo_test() sequencer */
+
+uint32_t hostTest_failures = 0;
+
+int main( void )
+{
+	nvsEmu_stats_t stats = { 0 };
+
+	nvsEmu_reset();
+
+	HOST_CHECK( ESP_OK == NVS_Initialize( nvsItem_getPAL() ) );
+
+	fifo_test();
+
+	nvsEmu_getStats( "edata", &stats );
+	printf( "edata: %u sets, %u payload bytes, %u entries written, %u page erases, max page erase count %u\n",
+			stats.setCalls, stats.payloadBytes, stats.entriesWritten, stats.pageErases, stats.maxPageEraseCount );
+
+	HOST_CHECK( 0 == hostLog_failed() );
+	HOST_CHECK( FIFO_TEST_COUNT <= hostLog_passed() );
+
+	return HOST_TEST_RESULT( "fifo_host_test" );
+}
@@ -0,0 +1,424 @@
+/**
+ * @file	fifo_powerfail.c
+ *
+ * Host power-fail harness for the event FIFO.
+ *
+ * A deterministic script of put, flush, get and fifo_commitRead() operations is run
+ * against each FIFO storage mode.  The script is first run without interruption, to
+ * count its NVS writes, then re-run with power cut before each of those writes in
+ * turn.  After each cut, NVS is re-initialized and the FIFO restored by fifo_init(),
+ * and the restored FIFO is checked:
+ *
+ *	- Records are in order, with no duplicates, and with valid content
+ *	- No record whose put (or flush) completed is lost, unless its read was committed
+ *	- No record whose read commit completed is returned again
+ *	- fifo_size(), fifo_empty() and fifo_full() agree with the records read
+ *	- The FIFO remains usable: a new record can be put, read and committed, and the
+ *	  committed state survives a further power cycle
+ *
+ * The resize mode grows a record FIFO part way through the script, moving one record
+ * per step with fifo_migrate(), so power is also cut at every write of the resize.
+ */
+
+#include	<string.h>
+#include	"FreeRTOS.h"
+#include	"event_fifo.h"
+#include	"nvs_utility.h"
+#include	"nvs_emulator.h"
+#include	"host_test.h"
+
+#define	PF_SCRIPT_STEPS			60					/**< Operations per script run */
+#define	PF_SEEDS				3					/**< Scripts, per mode */
+#define	PF_MIN_LENGTH			8					/**< Minimum record length, bytes */
+#define	PF_MAX_LENGTH			40					/**< Maximum record length, bytes */
+#define	PF_MAX_BURST			6					/**< Maximum records per put/get operation */
+#define	PF_MAX_OUTSTANDING		10					/**< Records put, not committed; fits all modes without overwrite */
+#define	PF_RECORD_ITEMS			16					/**< Record-per-key FIFO size, small so indices wrap */
+#define	PF_SEGMENTS				5					/**< Packed FIFO segments */
+#define	PF_SEGMENT_SIZE			256					/**< Packed FIFO segment size, bytes */
+#define	PF_RESIZE_STEP			20					/**< Script step that grows the resize mode FIFO */
+#define	PF_RESIZED_ITEMS		21					/**< Record FIFO size after resize, so moved records wrap */
+
+uint32_t hostTest_failures = 0;
+
+typedef enum
+{
+	eModeRecord,
+	eModeCached,
+	eModePackedCached,
+	eModeResize,
+	eModeEnd
+} pfMode_t;
+
+static const char * const _modeNames[ eModeEnd ] =
+{
+	[ eModeRecord ]			= "record",
+	[ eModeCached ]			= "record+cache",
+	[ eModePackedCached ]	= "packed+cache",
+	[ eModeResize ]			= "record+resize",
+};
+
+static const fifo_cacheConfig_t _cache =
+{
+	.maxPending = 4,
+	.maxRecordSize = PF_MAX_LENGTH,
+	.maxAgeMs = 0,
+};
+
+/**
+ * @brief	What the script knows of the FIFO contents, by record sequence number
+ *
+ * Records [0, durableSeq) were certainly stored, records [0, committedSeq) certainly
+ * consumed.  An operation cut short by power failure leaves records up to putSeq
+ * possibly stored, and records up to commitSeq possibly consumed.
+ */
+typedef struct
+{
+	uint32_t	putSeq;								/**< Next record to put */
+	uint32_t	durableSeq;							/**< Records put, and known written to NVS */
+	uint32_t	readSeq;							/**< Next record expected from fifo_get() */
+	uint32_t	committedSeq;						/**< Records whose read commit completed */
+	uint32_t	commitSeq;							/**< Records whose read commit may have completed */
+} pfModel_t;
+
+static uint32_t _seed;
+
+static uint32_t pf_rand( void )
+{
+	_seed = ( _seed * 1103515245 ) + 12345;
+	return ( _seed >> 16 ) & 0x7FFF;
+}
+
+/**
+ * @brief	Fill record with sequence number <i>seq</i>
+ */
+static size_t record_fill( uint32_t seq, uint8_t *pRecord )
+{
+	size_t length = PF_MIN_LENGTH + ( ( seq * 2654435761u ) >> 8 ) % ( PF_MAX_LENGTH - PF_MIN_LENGTH + 1 );
+
+	memcpy( pRecord, &seq, sizeof( seq ) );
+	for( size_t i = sizeof( seq ); i < length; ++i )
+	{
+		pRecord[ i ] = ( uint8_t )( seq ^ i );
+	}
+
+	return length;
+}
+
+/**
+ * @brief	Check record content, return its sequence number, or UINT32_MAX if invalid
+ */
+static uint32_t record_check( const uint8_t *pRecord, size_t length )
+{
+	uint8_t expected[ PF_MAX_LENGTH ];
+	uint32_t seq;
+
+	if( sizeof( seq ) > length )
+	{
+		return UINT32_MAX;
+	}
+
+	memcpy( &seq, pRecord, sizeof( seq ) );
+	if( ( length != record_fill( seq, expected ) ) || ( 0 != memcmp( expected, pRecord, length ) ) )
+	{
+		return UINT32_MAX;
+	}
+
+	return seq;
+}
+
+static fifo_handle_t pf_fifoInit( pfMode_t mode )
+{
+	switch( mode )
+	{
+		case eModeRecord:
+			return fifo_init( NVS_PART_EDATA, "Stress", "PFR", PF_RECORD_ITEMS, NVS_STRESS_CONTROLS, NVS_STRESS_MAX, NULL );
+		case eModeCached:
+			return fifo_init( NVS_PART_EDATA, "Stress", "PFC", PF_RECORD_ITEMS, NVS_STRESS_CONTROLS, NVS_STRESS_MAX, &_cache );
+		case eModePackedCached:
+			return fifo_initPacked( NVS_PART_EDATA, "Stress", "PFQ", PF_SEGMENTS, PF_SEGMENT_SIZE, NVS_STRESS_MAX, &_cache );
+		case eModeResize:
+			return fifo_init( NVS_PART_EDATA, "Stress", "PFZ", PF_RECORD_ITEMS, NVS_STRESS_CONTROLS, NVS_STRESS_MAX, NULL );
+		default:
+			return NULL;
+	}
+}
+
+/**
+ * @brief	Power up: re-initialize NVS, restore FIFO from NVS
+ */
+static fifo_handle_t pf_powerUp( pfMode_t mode )
+{
+	NVS_Deinitialize();
+	nvsEmu_powerCycle();
+	HOST_CHECK( ESP_OK == NVS_Initialize( nvsItem_getPAL() ) );
+
+	return pf_fifoInit( mode );
+}
+
+/**
+ * @brief	Run script, stopping early if power fails
+ *
+ * @param[in]	fifo	FIFO handle
+ * @param[in]	mode	FIFO storage mode
+ * @param[in]	seed	Script seed
+ * @param[out]	pModel	Expected FIFO contents
+ * @return		true if script ran to completion
+ */
+static bool pf_script( fifo_handle_t fifo, pfMode_t mode, uint32_t seed, pfModel_t *pModel )
+{
+	bool bCached = ( ( eModeCached == mode ) || ( eModePackedCached == mode ) );
+	uint8_t record[ PF_MAX_LENGTH ];
+	size_t length;
+
+	_seed = seed;
+	memset( pModel, 0, sizeof( pfModel_t ) );
+
+	for( int step = 0; step < PF_SCRIPT_STEPS; ++step )
+	{
+		uint32_t op = pf_rand() % 4;
+		uint32_t burst = 1 + ( pf_rand() % PF_MAX_BURST );
+		bool bCommit = ( 0 != ( pf_rand() % 4 ) );
+		int32_t err = ESP_OK;
+
+		if( eModeResize == mode )
+		{
+			if( PF_RESIZE_STEP == step )
+			{
+				err = fifo_resize( fifo, PF_RESIZED_ITEMS );
+			}
+			else
+			{
+				err = fifo_migrate( fifo, 1 );
+			}
+		}
+
+		switch( ( ESP_OK == err ) ? op : UINT32_MAX )
+		{
+			case UINT32_MAX:								/* Resize failed */
+				break;
+
+			case 0:
+			case 1:											/* Put records */
+				for( uint32_t i = 0; ( i < burst ) && ( ESP_OK == err ) &&
+									 ( PF_MAX_OUTSTANDING > ( pModel->putSeq - pModel->committedSeq ) ); ++i )
+				{
+					length = record_fill( pModel->putSeq++, record );
+					err = fifo_put( fifo, record, length );
+					if( ( ESP_OK == err ) && !bCached && !nvsEmu_isPowerFailed() )
+					{
+						pModel->durableSeq = pModel->putSeq;
+					}
+				}
+				break;
+
+			case 2:											/* Flush cache */
+				err = fifo_flush( fifo );
+				if( ( ESP_OK == err ) && !nvsEmu_isPowerFailed() )
+				{
+					pModel->durableSeq = pModel->putSeq;
+				}
+				break;
+
+			default:										/* Read records, commit or abort */
+				for( uint32_t i = 0; ( i < burst ) && ( ESP_OK == err ) && ( 0 < fifo_size( fifo ) ); ++i )
+				{
+					length = sizeof( record );
+					err = fifo_get( fifo, record, &length );
+					if( ESP_OK == err )
+					{
+						HOST_CHECK( pModel->readSeq == record_check( record, length ) );
+						++pModel->readSeq;
+					}
+				}
+
+				if( ESP_OK == err )
+				{
+					pModel->commitSeq = ( bCommit ? pModel->readSeq : pModel->committedSeq );
+					err = fifo_commitRead( fifo, bCommit );
+				}
+				if( ( ESP_OK == err ) && !nvsEmu_isPowerFailed() )
+				{
+					pModel->committedSeq = pModel->commitSeq;
+					pModel->readSeq = pModel->committedSeq;
+				}
+				break;
+		}
+
+		if( nvsEmu_isPowerFailed() )
+		{
+			return false;
+		}
+
+		/* Without a power failure, every operation succeeds */
+		HOST_CHECK( ESP_OK == err );
+	}
+
+	return true;
+}
+
+/**
+ * @brief	Check FIFO restored after a power failure against the script model
+ *
+ * @return	true if FIFO is consistent
+ */
+static bool pf_verify( pfMode_t mode, const pfModel_t *pModel )
+{
+	uint32_t errors = hostTest_failures;
+	uint8_t record[ PF_MAX_LENGTH ];
+	fifo_handle_t fifo;
+	uint32_t first = UINT32_MAX;
+	uint32_t next = UINT32_MAX;
+	uint16_t size;
+	size_t length;
+
+	fifo = pf_powerUp( mode );
+	HOST_CHECK( NULL != fifo );
+	if( NULL == fifo )
+	{
+		return false;
+	}
+
+	size = fifo_size( fifo );
+	HOST_CHECK( fifo_empty( fifo ) == ( 0 == size ) );
+	HOST_CHECK( !fifo_full( fifo ) );
+	HOST_CHECK( PF_MAX_OUTSTANDING >= size );
+
+	/* Records are consecutive, and valid */
+	for( uint16_t i = 0; ( i < size ) && ( errors == hostTest_failures ); ++i )
+	{
+		uint32_t seq;
+
+		length = sizeof( record );
+		HOST_CHECK( ESP_OK == fifo_get( fifo, record, &length ) );
+		seq = record_check( record, length );
+		HOST_CHECK( UINT32_MAX != seq );
+		if( 0 == i )
+		{
+			first = seq;
+		}
+		else
+		{
+			HOST_CHECK( next == seq );
+		}
+		next = seq + 1;
+	}
+	HOST_CHECK( 0 == fifo_size( fifo ) );
+
+	if( 0 < size )
+	{
+		/* Committed reads are not repeated, durable records are not lost */
+		HOST_CHECK( ( pModel->committedSeq <= first ) && ( first <= pModel->commitSeq ) );
+		HOST_CHECK( ( pModel->durableSeq <= next ) && ( next <= pModel->putSeq ) );
+	}
+	else
+	{
+		/* Empty FIFO: all durable records may have been consumed */
+		HOST_CHECK( pModel->durableSeq <= pModel->commitSeq );
+		next = pModel->durableSeq;
+	}
+
+	HOST_CHECK( ESP_OK == fifo_commitRead( fifo, true ) );
+	HOST_CHECK( fifo_empty( fifo ) );
+
+	/* FIFO remains usable */
+	length = record_fill( next, record );
+	HOST_CHECK( ESP_OK == fifo_put( fifo, record, length ) );
+	HOST_CHECK( ESP_OK == fifo_flush( fifo ) );
+	HOST_CHECK( 1 == fifo_size( fifo ) );
+	length = sizeof( record );
+	HOST_CHECK( ( ESP_OK == fifo_get( fifo, record, &length ) ) && ( next == record_check( record, length ) ) );
+	HOST_CHECK( ESP_OK == fifo_commitRead( fifo, true ) );
+
+	/* An interrupted resize completes */
+	if( eModeResize == mode )
+	{
+		HOST_CHECK( ( PF_RECORD_ITEMS == fifo_capacity( fifo ) ) || ( PF_RESIZED_ITEMS == fifo_capacity( fifo ) ) );
+		for( int i = 0; fifo_migrating( fifo ) && ( i < PF_RECORD_ITEMS ); ++i )
+		{
+			HOST_CHECK( ESP_OK == fifo_migrate( fifo, 1 ) );
+		}
+		HOST_CHECK( !fifo_migrating( fifo ) );
+	}
+
+	/* Committed state survives a further power cycle */
+	fifo = pf_powerUp( mode );
+	HOST_CHECK( ( NULL != fifo ) && fifo_empty( fifo ) && ( 0 == fifo_size( fifo ) ) );
+	HOST_CHECK( ( NULL != fifo ) && !fifo_migrating( fifo ) );
+
+	return ( errors == hostTest_failures );
+}
+
+/**
+ * @brief	Start from an erased emulator, with an empty FIFO
+ */
+static fifo_handle_t pf_start( pfMode_t mode )
+{
+	NVS_Deinitialize();
+	nvsEmu_reset();
+	HOST_CHECK( ESP_OK == NVS_Initialize( nvsItem_getPAL() ) );
+
+	return pf_fifoInit( mode );
+}
+
+/**
+ * @brief	Cut power at every NVS write boundary of one script
+ */
+static void pf_run( pfMode_t mode, uint32_t seed )
+{
+	fifo_handle_t fifo;
+	pfModel_t model;
+	uint32_t writes;
+	uint32_t failPoint;
+
+	/* Uninterrupted run, count writes */
+	fifo = pf_start( mode );
+	HOST_CHECK( NULL != fifo );
+	if( NULL == fifo )
+	{
+		return;
+	}
+	writes = nvsEmu_writeCount();
+	HOST_CHECK( pf_script( fifo, mode, seed, &model ) );
+	writes = nvsEmu_writeCount() - writes;
+	HOST_CHECK( pf_verify( mode, &model ) );
+
+	for( failPoint = 0; failPoint < writes; ++failPoint )
+	{
+		fifo = pf_start( mode );
+		nvsEmu_setPowerFail( failPoint );
+		if( pf_script( fifo, mode, seed, &model ) )
+		{
+			nvsEmu_setPowerFail( -1 );
+			HOST_CHECK( false );					/* script no longer matches uninterrupted run */
+		}
+
+		if( !pf_verify( mode, &model ) )
+		{
+			printf( "  %s, seed %u: inconsistent after power fail at write %u of %u "
+					"(put %u, durable %u, committed %u, commit %u)\n",
+					_modeNames[ mode ], seed, failPoint, writes,
+					model.putSeq, model.durableSeq, model.committedSeq, model.commitSeq );
+			break;
+		}
+	}
+
+	printf( "%-13s seed %u: %4u power fail points checked\n", _modeNames[ mode ], seed, failPoint );
+}
+
+int main( void )
+{
+	HOST_CHECK( ESP_OK == NVS_Initialize( nvsItem_getPAL() ) );
+
+	for( pfMode_t mode = eModeRecord; mode < eModeEnd; ++mode )
+	{
+		for( uint32_t seed = 1; seed <= PF_SEEDS; ++seed )
+		{
+			pf_run( mode, seed );
+		}
+	}
+
+	NVS_Deinitialize();
+
+	return HOST_TEST_RESULT( "fifo_powerfail" );
+}
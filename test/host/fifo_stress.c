@@ -0,0 +1,478 @@
+/**
+ * @file	fifo_stress.c
+ *
+ * Host stress test and benchmark for the event FIFO.
+ *
+ * Records of random length are put and read back, in random sized bursts, through
+ * each FIFO storage mode.  Order and content of every record are verified.
+ * Throughput, and flash write amplification from the NVS emulator wear model, are
+ * reported for each mode.  Records retained after the run are then read back by
+ * sequence number, with fifo_readRange().
+ *
+ * The resize mode grows a record FIFO half way through the run, once its records
+ * wrap, moving one record per burst with fifo_migrate().
+ *
+ * A FIFO restored and indexed at power up, with no resize or named cursor stored,
+ * and slots or segments not yet written, must not log an error.
+ *
+ * Finally a record FIFO is grown repeatedly while one thread puts, as the SHCI worker
+ * does, and another gets, commits and calls fifo_migrate(), as the event record task
+ * does.  Puts move records during the resize; every get must still return the next
+ * record in order.
+ */
+
+#include	<string.h>
+#include	<time.h>
+#include	<pthread.h>
+#include	<sched.h>
+#include	"FreeRTOS.h"
+#include	"event_fifo.h"
+#include	"nvs_utility.h"
+#include	"nvs_emulator.h"
+#include	"host_log.h"
+#include	"host_test.h"
+
+#define	STRESS_RECORDS			4000				/**< Records put, per mode */
+#define	STRESS_MIN_LENGTH		8					/**< Minimum record length, bytes */
+#define	STRESS_MAX_LENGTH		64					/**< Maximum record length, bytes */
+#define	STRESS_MAX_BURST		16					/**< Maximum records per put/get burst */
+#define	STRESS_RECORD_ITEMS		64					/**< Record-per-key FIFO size */
+#define	STRESS_SEGMENTS			8					/**< Packed FIFO segments */
+#define	STRESS_SEGMENT_SIZE		1024				/**< Packed FIFO segment size, bytes */
+#define	STRESS_MAX_OUTSTANDING	32					/**< Records put, not yet read; fits all modes without overwrite */
+#define	STRESS_RANGE_RECORDS	48					/**< Most recent records, retained by all modes, for range reads */
+#define	STRESS_RANGE_READS		200					/**< Range reads, per mode */
+#define	STRESS_RESIZED_ITEMS	80					/**< Record FIFO size after resize, so moved records wrap */
+#define	STRESS_CONCURRENT_RECORDS	3000			/**< Records put while resizing, concurrent reader */
+#define	STRESS_CONCURRENT_GROWTH	16				/**< Items added by each resize */
+#define	STRESS_CONCURRENT_ITEMS		256				/**< Largest size the FIFO is grown to */
+
+uint32_t hostTest_failures = 0;
+
+typedef enum
+{
+	eModeRecord,
+	eModeCached,
+	eModePackedCached,
+	eModeResize,
+	eModeEnd
+} stressMode_t;
+
+static const char * const _modeNames[ eModeEnd ] =
+{
+	[ eModeRecord ]			= "record",
+	[ eModeCached ]			= "record+cache",
+	[ eModePackedCached ]	= "packed+cache",
+	[ eModeResize ]			= "record+resize",
+};
+
+static const fifo_cacheConfig_t _cache =
+{
+	.maxPending = 16,
+	.maxRecordSize = STRESS_MAX_LENGTH,
+	.maxAgeMs = 0,
+};
+
+static uint32_t _seed = 1;
+
+/**
+ * @brief	Deterministic pseudo-random number, so failures are reproducible
+ */
+static uint32_t stress_rand( void )
+{
+	_seed = ( _seed * 1103515245 ) + 12345;
+	return ( _seed >> 16 ) & 0x7FFF;
+}
+
+/**
+ * @brief	Length of record with sequence number <i>seq</i>
+ */
+static size_t record_length( uint32_t seq )
+{
+	return STRESS_MIN_LENGTH + ( ( seq * 2654435761u ) >> 8 ) % ( STRESS_MAX_LENGTH - STRESS_MIN_LENGTH + 1 );
+}
+
+/**
+ * @brief	Fill record with sequence number <i>seq</i>
+ */
+static size_t record_fill( uint32_t seq, uint8_t *pRecord )
+{
+	size_t length = record_length( seq );
+
+	memcpy( pRecord, &seq, sizeof( seq ) );
+	for( size_t i = sizeof( seq ); i < length; ++i )
+	{
+		pRecord[ i ] = ( uint8_t )( seq + i );
+	}
+
+	return length;
+}
+
+/**
+ * @brief	Record sequence number, as the record Index for fifo_setIndex()
+ */
+static bool record_index( const void *blob, size_t length, uint32_t *pIndex )
+{
+	if( sizeof( uint32_t ) > length )
+	{
+		return false;
+	}
+
+	memcpy( pIndex, blob, sizeof( uint32_t ) );
+	return true;
+}
+
+/**
+ * @brief	Read records <i>first</i> to <i>last</i> by sequence number, and verify
+ */
+static void stress_range( fifo_handle_t fifo, uint32_t first, uint32_t last )
+{
+	uint8_t buffer[ 8 * STRESS_MAX_LENGTH ];
+	uint8_t expected[ STRESS_MAX_LENGTH ];
+	size_t lengths[ 8 ];
+	uint16_t count = 8;
+	size_t offset = 0;
+
+	HOST_CHECK( ESP_OK == fifo_readRange( fifo, first, last, buffer, sizeof( buffer ), lengths, &count ) );
+	HOST_CHECK( ( last - first + 1 ) == count );
+
+	for( uint16_t i = 0; i < count; ++i )
+	{
+		size_t expectedLength = record_fill( first + i, expected );
+
+		HOST_CHECK( expectedLength == lengths[ i ] );
+		HOST_CHECK( 0 == memcmp( expected, &buffer[ offset ], expectedLength ) );
+		offset += lengths[ i ];
+	}
+}
+
+static double elapsed_ms( const struct timespec *pStart )
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return ( ( now.tv_sec - pStart->tv_sec ) * 1000.0 ) + ( ( now.tv_nsec - pStart->tv_nsec ) / 1000000.0 );
+}
+
+/**
+ * @brief	Run stress sequence for one FIFO mode, against a freshly erased emulator
+ */
+static void stress_mode( stressMode_t mode )
+{
+	fifo_handle_t fifo = NULL;
+	uint8_t record[ STRESS_MAX_LENGTH ];
+	uint8_t expected[ STRESS_MAX_LENGTH ];
+	uint32_t putSeq = 0;
+	uint32_t getSeq = 0;
+	uint32_t payload = 0;
+	uint32_t errors = hostTest_failures;
+	nvsEmu_stats_t stats = { 0 };
+	struct timespec start;
+	double ms;
+
+	NVS_Deinitialize();
+	nvsEmu_reset();
+	HOST_CHECK( ESP_OK == NVS_Initialize( nvsItem_getPAL() ) );
+
+	switch( mode )
+	{
+		case eModeRecord:
+			fifo = fifo_init( NVS_PART_EDATA, "Stress", "STR", STRESS_RECORD_ITEMS, NVS_STRESS_CONTROLS, NVS_STRESS_MAX, NULL );
+			break;
+		case eModeCached:
+			fifo = fifo_init( NVS_PART_EDATA, "Stress", "STC", STRESS_RECORD_ITEMS, NVS_STRESS_CONTROLS, NVS_STRESS_MAX, &_cache );
+			break;
+		case eModePackedCached:
+			fifo = fifo_initPacked( NVS_PART_EDATA, "Stress", "SPC", STRESS_SEGMENTS, STRESS_SEGMENT_SIZE, NVS_STRESS_MAX, &_cache );
+			break;
+		case eModeResize:
+			fifo = fifo_init( NVS_PART_EDATA, "Stress", "STZ", STRESS_RECORD_ITEMS, NVS_STRESS_CONTROLS, NVS_STRESS_MAX, NULL );
+			break;
+		default:
+			break;
+	}
+	HOST_CHECK( NULL != fifo );
+	if( NULL == fifo )
+	{
+		return;
+	}
+
+	HOST_CHECK( ESP_OK == fifo_setIndex( fifo, &record_index, STRESS_MAX_LENGTH ) );
+
+	nvsEmu_clearStats();
+	clock_gettime( CLOCK_MONOTONIC, &start );
+
+	while( ( getSeq < STRESS_RECORDS ) && ( errors == hostTest_failures ) )
+	{
+		uint32_t burst = 1 + ( stress_rand() % STRESS_MAX_BURST );
+
+		/* Put a burst */
+		for( uint32_t i = 0; ( i < burst ) && ( putSeq < STRESS_RECORDS ) && ( ( putSeq - getSeq ) < STRESS_MAX_OUTSTANDING ); ++i )
+		{
+			size_t length = record_fill( putSeq, record );
+
+			HOST_CHECK( ESP_OK == fifo_put( fifo, record, length ) );
+			payload += length;
+			++putSeq;
+		}
+
+		/* Staged records are not readable until flushed */
+		HOST_CHECK( ESP_OK == fifo_flush( fifo ) );
+
+		/* Read a burst, abort or commit the read */
+		burst = 1 + ( stress_rand() % STRESS_MAX_BURST );
+		bool bCommit = ( 0 != ( stress_rand() % 4 ) );
+		uint32_t seq = getSeq;
+
+		for( uint32_t i = 0; ( i < burst ) && ( seq < putSeq ); ++i, ++seq )
+		{
+			size_t length = sizeof( record );
+			size_t expectedLength = record_fill( seq, expected );
+
+			HOST_CHECK( ESP_OK == fifo_get( fifo, record, &length ) );
+			HOST_CHECK( expectedLength == length );
+			HOST_CHECK( 0 == memcmp( expected, record, expectedLength ) );
+		}
+
+		HOST_CHECK( ESP_OK == fifo_commitRead( fifo, bCommit ) );
+		if( bCommit )
+		{
+			getSeq = seq;
+		}
+
+		HOST_CHECK( ( putSeq - getSeq ) == fifo_size( fifo ) );
+
+		/* Grow, once records wrap, then move one record per burst */
+		if( eModeResize == mode )
+		{
+			if( ( STRESS_RECORD_ITEMS == fifo_capacity( fifo ) ) && ( ( STRESS_RECORDS / 2 ) <= putSeq ) &&
+				( fifo_getHead( fifo ) < fifo_getTail( fifo ) ) )
+			{
+				HOST_CHECK( ESP_OK == fifo_resize( fifo, STRESS_RESIZED_ITEMS ) );
+				HOST_CHECK( fifo_migrating( fifo ) );
+				HOST_CHECK( ( putSeq - getSeq ) == fifo_size( fifo ) );
+			}
+			HOST_CHECK( ESP_OK == fifo_migrate( fifo, 1 ) );
+		}
+	}
+
+	HOST_CHECK( fifo_empty( fifo ) );
+	if( eModeResize == mode )
+	{
+		HOST_CHECK( ( STRESS_RESIZED_ITEMS == fifo_capacity( fifo ) ) && !fifo_migrating( fifo ) );
+	}
+
+	ms = elapsed_ms( &start );
+	nvsEmu_getStats( "edata", &stats );
+
+	printf( "%-13s %6u records, %8.1f ms, %9.0f records/s, %6u sets, %6u commits, write amplification %5.2f, %4u page erases\n",
+			_modeNames[ mode ], getSeq, ms, ( 0 < ms ) ? ( getSeq * 1000.0 / ms ) : 0.0,
+			stats.setCalls, stats.commits,
+			( 0 < payload ) ? ( ( double ) stats.entriesWritten * NVS_EMU_ENTRY_SIZE / payload ) : 0.0,
+			stats.pageErases );
+
+	/* Range reads, from the index maintained by puts, then from an index rebuilt from NVS */
+	for( int pass = 0; pass < 2; ++pass )
+	{
+		for( uint32_t i = 0; i < STRESS_RANGE_READS; ++i )
+		{
+			uint32_t first = STRESS_RECORDS - 1 - ( stress_rand() % STRESS_RANGE_RECORDS );
+			uint32_t last = first + ( stress_rand() % 8 );
+
+			stress_range( fifo, first, ( STRESS_RECORDS <= last ) ? ( STRESS_RECORDS - 1 ) : last );
+		}
+
+		HOST_CHECK( ESP_OK == fifo_setIndex( fifo, &record_index, STRESS_MAX_LENGTH ) );
+	}
+
+	{
+		uint8_t buffer[ STRESS_MAX_LENGTH ];
+		size_t length;
+		uint16_t count = 1;
+
+		HOST_CHECK( ESP_FAIL == fifo_readRange( fifo, 0, 0, buffer, sizeof( buffer ), &length, &count ) );		// overwritten
+		HOST_CHECK( 0 == count );
+		count = 1;
+		HOST_CHECK( ESP_FAIL == fifo_readRange( fifo, STRESS_RECORDS, STRESS_RECORDS + 10, buffer, sizeof( buffer ), &length, &count ) );
+		HOST_CHECK( fifo_empty( fifo ) );
+	}
+}
+
+/**
+ * @brief	Open the FIFO used by stress_restore()
+ */
+static fifo_handle_t restore_init( bool bPacked )
+{
+	if( bPacked )
+	{
+		return fifo_initPacked( NVS_PART_EDATA, "Stress", "SQP", STRESS_SEGMENTS, STRESS_SEGMENT_SIZE, NVS_STRESS_MAX, &_cache );
+	}
+	return fifo_init( NVS_PART_EDATA, "Stress", "STQ", STRESS_RECORD_ITEMS, NVS_STRESS_CONTROLS, NVS_STRESS_MAX, NULL );
+}
+
+/**
+ * @brief	Restore, index and batch read a FIFO that has not wrapped, after a power cycle,
+ *			checking that no error is logged
+ */
+static void stress_restore( bool bPacked )
+{
+	uint8_t record[ STRESS_MAX_LENGTH ];
+	uint8_t batch[ STRESS_MAX_LENGTH ];
+	size_t lengths[ 2 ];
+	size_t length;
+	uint16_t count;
+	uint32_t errors;
+
+	NVS_Deinitialize();
+	nvsEmu_reset();
+	HOST_CHECK( ESP_OK == NVS_Initialize( nvsItem_getPAL() ) );
+
+	fifo_handle_t fifo = restore_init( bPacked );
+	HOST_CHECK( NULL != fifo );
+	HOST_CHECK( ESP_OK == fifo_put( fifo, record, record_fill( 0, record ) ) );
+	HOST_CHECK( ESP_OK == fifo_flush( fifo ) );
+
+	NVS_Deinitialize();
+	nvsEmu_powerCycle();
+	HOST_CHECK( ESP_OK == NVS_Initialize( nvsItem_getPAL() ) );
+
+	errors = hostLog_errors();
+	fifo = restore_init( bPacked );
+	HOST_CHECK( ( NULL != fifo ) && ( 1 == fifo_size( fifo ) ) );
+	HOST_CHECK( ESP_OK == fifo_setIndex( fifo, &record_index, STRESS_MAX_LENGTH ) );
+
+	/* Batch reads stop at a record that does not fit the remaining space */
+	length = record_fill( 0, record ) + 1;
+	HOST_CHECK( ESP_OK == fifo_put( fifo, record, record_fill( 1, record ) ) );
+	HOST_CHECK( ESP_OK == fifo_flush( fifo ) );
+	count = 2;
+	HOST_CHECK( ( ESP_OK == fifo_getBatch( fifo, batch, length, lengths, &count ) ) && ( 1 == count ) );
+	HOST_CHECK( ESP_OK == fifo_commitRead( fifo, false ) );
+	count = 2;
+	HOST_CHECK( ( ESP_OK == fifo_readRange( fifo, 0, 1, batch, length, lengths, &count ) ) && ( 1 == count ) );
+	HOST_CHECK( errors == hostLog_errors() );
+	printf( "restore       %s, %u errors logged\n", ( bPacked ? "packed" : "record" ), hostLog_errors() - errors );
+}
+
+static fifo_handle_t _concurrentFifo;
+static volatile uint32_t _concurrentPut;				/**< Records put, and readable */
+static volatile uint32_t _concurrentGet;				/**< Records read and committed */
+static volatile uint32_t _concurrentResizes;
+static volatile bool _concurrentFailed;
+
+/**
+ * @brief	Putting thread: puts records, never overwriting unread ones, and grows the FIFO
+ *			whenever its records wrap and no resize is in progress
+ */
+static void * concurrent_putter( void *arg )
+{
+	uint8_t record[ STRESS_MAX_LENGTH ];
+	fifo_handle_t fifo = _concurrentFifo;
+	uint16_t capacity;
+
+	while( ( _concurrentPut < STRESS_CONCURRENT_RECORDS ) && !_concurrentFailed )
+	{
+		if( ( _concurrentPut - _concurrentGet ) >= STRESS_MAX_OUTSTANDING )
+		{
+			sched_yield();
+			continue;
+		}
+
+		if( ESP_OK != fifo_put( fifo, record, record_fill( _concurrentPut, record ) ) )
+		{
+			printf( "concurrent put %u failed\n", _concurrentPut );
+			_concurrentFailed = true;
+			break;
+		}
+		__atomic_add_fetch( &_concurrentPut, 1, __ATOMIC_SEQ_CST );
+
+		capacity = fifo_capacity( fifo );
+		if( ( ( capacity + STRESS_CONCURRENT_GROWTH ) <= STRESS_CONCURRENT_ITEMS ) && !fifo_migrating( fifo ) &&
+			( fifo_getHead( fifo ) < fifo_getTail( fifo ) ) )
+		{
+			if( ESP_OK == fifo_resize( fifo, capacity + STRESS_CONCURRENT_GROWTH ) )
+			{
+				_concurrentResizes++;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief	Get each record as soon as it is put, while the FIFO is resized under it
+ */
+static void stress_concurrentResize( void )
+{
+	uint8_t record[ STRESS_MAX_LENGTH ];
+	uint8_t expected[ STRESS_MAX_LENGTH ];
+	pthread_t putter;
+	size_t length;
+	size_t expectedLength;
+	uint32_t errors = hostTest_failures;
+
+	NVS_Deinitialize();
+	nvsEmu_reset();
+	HOST_CHECK( ESP_OK == NVS_Initialize( nvsItem_getPAL() ) );
+
+	_concurrentFifo = fifo_init( NVS_PART_EDATA, "Stress", "STK", STRESS_RECORD_ITEMS, NVS_STRESS_CONTROLS, NVS_STRESS_MAX, NULL );
+	HOST_CHECK( NULL != _concurrentFifo );
+	if( NULL == _concurrentFifo )
+	{
+		return;
+	}
+
+	_concurrentPut = 0;
+	_concurrentGet = 0;
+	_concurrentResizes = 0;
+	_concurrentFailed = false;
+	HOST_CHECK( 0 == pthread_create( &putter, NULL, concurrent_putter, NULL ) );
+
+	while( ( _concurrentGet < STRESS_CONCURRENT_RECORDS ) && !_concurrentFailed )
+	{
+		if( _concurrentGet == _concurrentPut )
+		{
+			sched_yield();
+			continue;
+		}
+
+		length = sizeof( record );
+		expectedLength = record_fill( _concurrentGet, expected );
+		HOST_CHECK( ESP_OK == fifo_get( _concurrentFifo, record, &length ) );
+		HOST_CHECK( ( expectedLength == length ) && ( 0 == memcmp( expected, record, expectedLength ) ) );
+		HOST_CHECK( ESP_OK == fifo_commitRead( _concurrentFifo, true ) );
+		HOST_CHECK( ESP_OK == fifo_migrate( _concurrentFifo, 1 ) );
+		if( errors != hostTest_failures )
+		{
+			printf( "concurrent get %u failed\n", _concurrentGet );
+			_concurrentFailed = true;
+		}
+		__atomic_add_fetch( &_concurrentGet, 1, __ATOMIC_SEQ_CST );
+	}
+
+	pthread_join( putter, NULL );
+	HOST_CHECK( !_concurrentFailed );
+	HOST_CHECK( 0 < _concurrentResizes );
+	printf( "concurrent    %6u records, %u resizes, capacity %u\n", _concurrentGet, _concurrentResizes, fifo_capacity( _concurrentFifo ) );
+}
+
+int main( void )
+{
+	HOST_CHECK( ESP_OK == NVS_Initialize( nvsItem_getPAL() ) );
+
+	/* A packed FIFO written through would rewrite its head segment on every put */
+	HOST_CHECK( NULL == fifo_initPacked( NVS_PART_EDATA, "Stress", "STP", STRESS_SEGMENTS, STRESS_SEGMENT_SIZE, NVS_STRESS_MAX, NULL ) );
+
+	for( stressMode_t mode = eModeRecord; mode < eModeEnd; ++mode )
+	{
+		stress_mode( mode );
+	}
+	stress_restore( false );
+	stress_restore( true );
+	stress_concurrentResize();
+
+	NVS_Deinitialize();
+
+	return HOST_TEST_RESULT( "fifo_stress" );
+}
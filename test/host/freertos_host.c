@@ -0,0 +1,155 @@
+/**
+ * @file	freertos_host.c
+ *
+ * Host build: FreeRTOS and ESP-IDF system services used by the modules under test.
+ *
+ * Tasks are backed by pthreads, critical sections by a spin lock in the portMUX_TYPE;
+ * semaphores and queues are in freertos_queue.c.  The tick count is virtual, advanced only
+ * by vTaskDelay(), hostTick_advance() and timed out waits, so timed behaviour is
+ * deterministic.
+ */
+
+#include	<stdlib.h>
+#include	<pthread.h>
+#include	<time.h>
+#include	"FreeRTOS.h"
+#include	"freertos/task.h"
+#include	"esp_timer.h"
+
+static volatile TickType_t	_tickCount = 0;
+static uint32_t				_allocCount = 0;
+
+/**
+ * @brief	Task start parameters
+ */
+typedef struct
+{
+	TaskFunction_t	pxTaskCode;
+	void			*pvParameters;
+} taskStart_t;
+
+void *pvPortMalloc( size_t xSize )
+{
+	__atomic_add_fetch( &_allocCount, 1, __ATOMIC_RELAXED );
+	return malloc( xSize );
+}
+
+void vPortFree( void *pv )
+{
+	free( pv );
+}
+
+uint32_t esp_get_free_heap_size( void )
+{
+	return 0x40000;
+}
+
+/**
+ * @brief	Number of pvPortMalloc() calls since start
+ */
+uint32_t hostHeap_allocCount( void )
+{
+	return __atomic_load_n( &_allocCount, __ATOMIC_RELAXED );
+}
+
+static void *task_start( void *arg )
+{
+	taskStart_t start = *( taskStart_t * ) arg;
+
+	free( arg );
+	start.pxTaskCode( start.pvParameters );
+
+	return NULL;
+}
+
+BaseType_t xTaskCreate( TaskFunction_t pxTaskCode, const char * const pcName, const uint32_t usStackDepth,
+						void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask )
+{
+	pthread_t thread;
+	taskStart_t *pStart = malloc( sizeof( taskStart_t ) );
+
+	( void ) pcName;
+	( void ) usStackDepth;
+	( void ) uxPriority;
+
+	if( NULL == pStart )
+	{
+		return pdFAIL;
+	}
+	pStart->pxTaskCode = pxTaskCode;
+	pStart->pvParameters = pvParameters;
+
+	if( 0 != pthread_create( &thread, NULL, task_start, pStart ) )
+	{
+		free( pStart );
+		return pdFAIL;
+	}
+	pthread_detach( thread );
+
+	if( NULL != pxCreatedTask )
+	{
+		*pxCreatedTask = ( TaskHandle_t )( uintptr_t ) thread;
+	}
+
+	return pdPASS;
+}
+
+/**
+ * @brief	Delete a task, NULL for the calling task
+ *
+ * Another task is cancelled when it next blocks; it must not hold a mutex.
+ */
+void vTaskDelete( TaskHandle_t xTaskToDelete )
+{
+	if( NULL == xTaskToDelete )
+	{
+		pthread_exit( NULL );
+	}
+	pthread_cancel( ( pthread_t )( uintptr_t ) xTaskToDelete );
+}
+
+TickType_t xTaskGetTickCount( void )
+{
+	return _tickCount;
+}
+
+void vTaskDelay( const TickType_t xTicksToDelay )
+{
+	hostTick_advance( xTicksToDelay );
+	sched_yield();
+}
+
+/**
+ * @brief	Handle of the calling thread, matches the handle returned by xTaskCreate()
+ */
+TaskHandle_t xTaskGetCurrentTaskHandle( void )
+{
+	return ( TaskHandle_t )( uintptr_t ) pthread_self();
+}
+
+void hostCritical_enter( portMUX_TYPE *pMux )
+{
+	while( 0 != __atomic_exchange_n( &pMux->owner, 1, __ATOMIC_ACQUIRE ) )
+	{
+		sched_yield();
+	}
+}
+
+void hostCritical_exit( portMUX_TYPE *pMux )
+{
+	__atomic_store_n( &pMux->owner, 0, __ATOMIC_RELEASE );
+}
+
+void hostTick_advance( TickType_t ticks )
+{
+	__atomic_add_fetch( &_tickCount, ticks, __ATOMIC_RELAXED );
+}
+
+int64_t esp_timer_get_time( void )
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+
+	return ( ( int64_t ) now.tv_sec * 1000000 ) + ( now.tv_nsec / 1000 );
+}
@@ -0,0 +1,510 @@
+/**
+ * @file	freertos_queue.c
+ *
+ * Host build: FreeRTOS semaphores, queues, queue sets and message buffers.
+ *
+ * Mutexes are pthread mutexes.  Queues, binary semaphores (queues of length one with no
+ * item data), queue sets and message buffers share one lock and condition variable; a
+ * task blocked on any of them is woken by every change, and re-checks its own condition.
+ *
+ * A finite block time is waited in real time, since the wait is for another thread.  If
+ * the wait times out, the virtual tick count is advanced to cover the block time, so
+ * code measuring the wait with xTaskGetTickCount() sees it expire.
+ */
+
+#include	<stdlib.h>
+#include	<string.h>
+#include	<errno.h>
+#include	<pthread.h>
+#include	<time.h>
+#include	"FreeRTOS.h"
+#include	"freertos/semphr.h"
+#include	"freertos/queue.h"
+#include	"freertos/task.h"
+#include	"message_buffer.h"
+
+#define	HOST_MESSAGE_LENGTH		sizeof( uint32_t )			/**< Length stored with each message, as on target */
+
+/**
+ * @brief	Object type, first member of every handle
+ */
+typedef enum
+{
+	eHostMutex = 1,
+	eHostQueue,
+	eHostMessageBuffer
+} hostObject_t;
+
+typedef struct
+{
+	hostObject_t		type;
+	pthread_mutex_t		mutex;
+} hostMutex_t;
+
+typedef struct hostQueue
+{
+	hostObject_t		type;
+	UBaseType_t			length;
+	UBaseType_t			itemSize;
+	UBaseType_t			count;
+	UBaseType_t			head;								/**< Index of oldest item */
+	struct hostQueue	*pSet;								/**< Queue set this queue is a member of */
+	uint8_t				*pItems;
+} hostQueue_t;
+
+typedef struct
+{
+	hostObject_t		type;
+	size_t				size;
+	size_t				used;								/**< Bytes of stored messages, including lengths */
+	size_t				head;								/**< Index of oldest message */
+	uint8_t				*pData;
+} hostMessageBuffer_t;
+
+static pthread_once_t	_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t	_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	_changed;
+
+static void host_init( void )
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init( &attr );
+	pthread_condattr_setclock( &attr, CLOCK_MONOTONIC );
+	pthread_cond_init( &_changed, &attr );
+	pthread_condattr_destroy( &attr );
+}
+
+static void host_lock( void )
+{
+	pthread_once( &_once, host_init );
+	pthread_mutex_lock( &_lock );
+}
+
+static void host_unlock( void *arg )
+{
+	( void ) arg;
+	pthread_mutex_unlock( &_lock );
+}
+
+/**
+ * @brief	Wake all blocked tasks, called with lock held after any change
+ */
+static void host_changed( void )
+{
+	pthread_cond_broadcast( &_changed );
+}
+
+/**
+ * @brief	Wait, with lock held, until ready( pObject ) or ticks have passed
+ *
+ * A task deleted while blocked releases the lock.
+ */
+static bool host_wait( bool ( *ready )( void * ), void *pObject, TickType_t ticks )
+{
+	struct timespec deadline;
+	TickType_t start = xTaskGetTickCount();
+	TickType_t elapsed;
+	int rc = 0;
+
+	if( ready( pObject ) || ( 0 == ticks ) )
+	{
+		return ready( pObject );
+	}
+
+	if( portMAX_DELAY != ticks )
+	{
+		clock_gettime( CLOCK_MONOTONIC, &deadline );
+		deadline.tv_sec += ticks / configTICK_RATE_HZ;
+		deadline.tv_nsec += ( long )( ticks % configTICK_RATE_HZ ) * ( 1000000000 / configTICK_RATE_HZ );
+		if( deadline.tv_nsec >= 1000000000 )
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+	}
+
+	pthread_cleanup_push( host_unlock, NULL );
+	while( !ready( pObject ) && ( ETIMEDOUT != rc ) )
+	{
+		rc = ( portMAX_DELAY == ticks ) ? pthread_cond_wait( &_changed, &_lock ) :
+										  pthread_cond_timedwait( &_changed, &_lock, &deadline );
+	}
+	pthread_cleanup_pop( 0 );
+
+	if( !ready( pObject ) )
+	{
+		elapsed = xTaskGetTickCount() - start;
+		if( elapsed < ticks )
+		{
+			hostTick_advance( ticks - elapsed );
+		}
+		return false;
+	}
+	return true;
+}
+
+/* ************************************************************************* */
+/* Queues, queue sets and binary semaphores                                  */
+/* ************************************************************************* */
+
+static bool queue_hasSpace( void *pObject )
+{
+	hostQueue_t *pQueue = pObject;
+
+	return pQueue->count < pQueue->length;
+}
+
+static bool queue_hasItem( void *pObject )
+{
+	hostQueue_t *pQueue = pObject;
+
+	return 0 < pQueue->count;
+}
+
+/**
+ * @brief	Append item, lock held and queue not full
+ *
+ * If the queue is a member of a set, the queue handle is appended to the set.
+ */
+static void queue_put( hostQueue_t *pQueue, const void *pItem )
+{
+	UBaseType_t index = ( pQueue->head + pQueue->count ) % pQueue->length;
+
+	if( 0 != pQueue->itemSize )
+	{
+		memcpy( &pQueue->pItems[ index * pQueue->itemSize ], pItem, pQueue->itemSize );
+	}
+	pQueue->count++;
+
+	if( ( NULL != pQueue->pSet ) && queue_hasSpace( pQueue->pSet ) )
+	{
+		queue_put( pQueue->pSet, &pQueue );
+	}
+	host_changed();
+}
+
+/**
+ * @brief	Remove oldest item, lock held and queue not empty
+ */
+static void queue_get( hostQueue_t *pQueue, void *pItem )
+{
+	if( ( 0 != pQueue->itemSize ) && ( NULL != pItem ) )
+	{
+		memcpy( pItem, &pQueue->pItems[ pQueue->head * pQueue->itemSize ], pQueue->itemSize );
+	}
+	pQueue->head = ( pQueue->head + 1 ) % pQueue->length;
+	pQueue->count--;
+	host_changed();
+}
+
+QueueHandle_t xQueueCreate( UBaseType_t uxQueueLength, UBaseType_t uxItemSize )
+{
+	hostQueue_t *pQueue;
+
+	if( 0 == uxQueueLength )
+	{
+		return NULL;
+	}
+
+	pQueue = calloc( 1, sizeof( hostQueue_t ) + ( uxQueueLength * uxItemSize ) );
+	if( NULL != pQueue )
+	{
+		pQueue->type = eHostQueue;
+		pQueue->length = uxQueueLength;
+		pQueue->itemSize = uxItemSize;
+		pQueue->pItems = ( uint8_t * )( pQueue + 1 );
+	}
+	return pQueue;
+}
+
+void vQueueDelete( QueueHandle_t xQueue )
+{
+	free( xQueue );
+}
+
+BaseType_t xQueueSend( QueueHandle_t xQueue, const void * pvItemToQueue, TickType_t xTicksToWait )
+{
+	hostQueue_t *pQueue = xQueue;
+	BaseType_t result = pdFALSE;
+
+	host_lock();
+	if( host_wait( queue_hasSpace, pQueue, xTicksToWait ) )
+	{
+		queue_put( pQueue, pvItemToQueue );
+		result = pdTRUE;
+	}
+	host_unlock( NULL );
+
+	return result;
+}
+
+BaseType_t xQueueReceive( QueueHandle_t xQueue, void * pvBuffer, TickType_t xTicksToWait )
+{
+	hostQueue_t *pQueue = xQueue;
+	BaseType_t result = pdFALSE;
+
+	host_lock();
+	if( host_wait( queue_hasItem, pQueue, xTicksToWait ) )
+	{
+		queue_get( pQueue, pvBuffer );
+		result = pdTRUE;
+	}
+	host_unlock( NULL );
+
+	return result;
+}
+
+/**
+ * @brief	Empty queue
+ *
+ * Handles already posted to a queue set are left there, as on target.
+ */
+BaseType_t xQueueReset( QueueHandle_t xQueue )
+{
+	hostQueue_t *pQueue = xQueue;
+
+	host_lock();
+	pQueue->count = 0;
+	pQueue->head = 0;
+	host_changed();
+	host_unlock( NULL );
+
+	return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting( QueueHandle_t xQueue )
+{
+	hostQueue_t *pQueue = xQueue;
+	UBaseType_t count;
+
+	host_lock();
+	count = pQueue->count;
+	host_unlock( NULL );
+
+	return count;
+}
+
+QueueSetHandle_t xQueueCreateSet( UBaseType_t uxEventQueueLength )
+{
+	return xQueueCreate( uxEventQueueLength, sizeof( hostQueue_t * ) );
+}
+
+BaseType_t xQueueAddToSet( QueueSetMemberHandle_t xQueueOrSemaphore, QueueSetHandle_t xQueueSet )
+{
+	hostQueue_t *pQueue = xQueueOrSemaphore;
+	BaseType_t result = pdFAIL;
+
+	host_lock();
+	if( ( eHostQueue == pQueue->type ) && ( NULL == pQueue->pSet ) && ( 0 == pQueue->count ) )
+	{
+		pQueue->pSet = xQueueSet;
+		result = pdPASS;
+	}
+	host_unlock( NULL );
+
+	return result;
+}
+
+QueueSetMemberHandle_t xQueueSelectFromSet( QueueSetHandle_t xQueueSet, TickType_t xTicksToWait )
+{
+	hostQueue_t *pMember = NULL;
+
+	xQueueReceive( xQueueSet, &pMember, xTicksToWait );
+
+	return pMember;
+}
+
+/* ************************************************************************* */
+/* Semaphores                                                                */
+/* ************************************************************************* */
+
+SemaphoreHandle_t xSemaphoreCreateMutex( void )
+{
+	hostMutex_t *pMutex = malloc( sizeof( hostMutex_t ) );
+
+	if( NULL != pMutex )
+	{
+		pMutex->type = eHostMutex;
+		pthread_mutex_init( &pMutex->mutex, NULL );
+	}
+	return pMutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary( void )
+{
+	return xQueueCreate( 1, 0 );
+}
+
+BaseType_t xSemaphoreTake( SemaphoreHandle_t xSemaphore, TickType_t xTicksToWait )
+{
+	hostMutex_t *pMutex = xSemaphore;
+
+	if( eHostMutex != pMutex->type )
+	{
+		return xQueueReceive( xSemaphore, NULL, xTicksToWait );
+	}
+	if( 0 == xTicksToWait )
+	{
+		return ( 0 == pthread_mutex_trylock( &pMutex->mutex ) ) ? pdTRUE : pdFALSE;
+	}
+	return ( 0 == pthread_mutex_lock( &pMutex->mutex ) ) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive( SemaphoreHandle_t xSemaphore )
+{
+	hostMutex_t *pMutex = xSemaphore;
+
+	if( eHostMutex != pMutex->type )
+	{
+		return xQueueSend( xSemaphore, NULL, 0 );
+	}
+	return ( 0 == pthread_mutex_unlock( &pMutex->mutex ) ) ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete( SemaphoreHandle_t xSemaphore )
+{
+	hostMutex_t *pMutex = xSemaphore;
+
+	if( eHostMutex == pMutex->type )
+	{
+		pthread_mutex_destroy( &pMutex->mutex );
+	}
+	free( xSemaphore );
+}
+
+/* ************************************************************************* */
+/* Message buffers                                                           */
+/* ************************************************************************* */
+
+static bool buffer_hasMessage( void *pObject )
+{
+	hostMessageBuffer_t *pBuffer = pObject;
+
+	return 0 < pBuffer->used;
+}
+
+/**
+ * @brief	Wait condition for send: room for a message and its length
+ */
+typedef struct
+{
+	hostMessageBuffer_t	*pBuffer;
+	size_t				needed;
+} bufferSpace_t;
+
+static bool buffer_hasSpace( void *pObject )
+{
+	bufferSpace_t *pSpace = pObject;
+
+	return ( pSpace->pBuffer->size - pSpace->pBuffer->used ) >= pSpace->needed;
+}
+
+/**
+ * @brief	Copy into ring, at offset past the oldest message
+ */
+static void buffer_write( hostMessageBuffer_t *pBuffer, size_t offset, const void *pSrc, size_t n )
+{
+	size_t index = ( pBuffer->head + offset ) % pBuffer->size;
+	size_t span = ( n < ( pBuffer->size - index ) ) ? n : ( pBuffer->size - index );
+
+	memcpy( &pBuffer->pData[ index ], pSrc, span );
+	memcpy( pBuffer->pData, ( const uint8_t * ) pSrc + span, n - span );
+}
+
+/**
+ * @brief	Copy out of ring, at offset past the oldest message
+ */
+static void buffer_read( const hostMessageBuffer_t *pBuffer, size_t offset, void *pDst, size_t n )
+{
+	size_t index = ( pBuffer->head + offset ) % pBuffer->size;
+	size_t span = ( n < ( pBuffer->size - index ) ) ? n : ( pBuffer->size - index );
+
+	memcpy( pDst, &pBuffer->pData[ index ], span );
+	memcpy( ( uint8_t * ) pDst + span, pBuffer->pData, n - span );
+}
+
+MessageBufferHandle_t xMessageBufferCreate( size_t xBufferSizeBytes )
+{
+	hostMessageBuffer_t *pBuffer = calloc( 1, sizeof( hostMessageBuffer_t ) + xBufferSizeBytes );
+
+	if( NULL != pBuffer )
+	{
+		pBuffer->type = eHostMessageBuffer;
+		pBuffer->size = xBufferSizeBytes;
+		pBuffer->pData = ( uint8_t * )( pBuffer + 1 );
+	}
+	return pBuffer;
+}
+
+void vMessageBufferDelete( MessageBufferHandle_t xMessageBuffer )
+{
+	free( xMessageBuffer );
+}
+
+size_t xMessageBufferSend( MessageBufferHandle_t xMessageBuffer, const void *pvTxData, size_t xDataLengthBytes, TickType_t xTicksToWait )
+{
+	hostMessageBuffer_t *pBuffer = xMessageBuffer;
+	bufferSpace_t space = { pBuffer, HOST_MESSAGE_LENGTH + xDataLengthBytes };
+	uint32_t length = ( uint32_t ) xDataLengthBytes;
+	size_t sent = 0;
+
+	if( space.needed > pBuffer->size )
+	{
+		return 0;
+	}
+
+	host_lock();
+	if( host_wait( buffer_hasSpace, &space, xTicksToWait ) )
+	{
+		buffer_write( pBuffer, pBuffer->used, &length, HOST_MESSAGE_LENGTH );
+		buffer_write( pBuffer, pBuffer->used + HOST_MESSAGE_LENGTH, pvTxData, xDataLengthBytes );
+		pBuffer->used += space.needed;
+		sent = xDataLengthBytes;
+		host_changed();
+	}
+	host_unlock( NULL );
+
+	return sent;
+}
+
+/**
+ * @brief	Receive oldest message
+ *
+ * As on target, a message longer than xBufferLengthBytes is left in the buffer, and 0 returned.
+ */
+size_t xMessageBufferReceive( MessageBufferHandle_t xMessageBuffer, void *pvRxData, size_t xBufferLengthBytes, TickType_t xTicksToWait )
+{
+	hostMessageBuffer_t *pBuffer = xMessageBuffer;
+	uint32_t length;
+	size_t received = 0;
+
+	host_lock();
+	if( host_wait( buffer_hasMessage, pBuffer, xTicksToWait ) )
+	{
+		buffer_read( pBuffer, 0, &length, HOST_MESSAGE_LENGTH );
+		if( length <= xBufferLengthBytes )
+		{
+			buffer_read( pBuffer, HOST_MESSAGE_LENGTH, pvRxData, length );
+			pBuffer->head = ( pBuffer->head + HOST_MESSAGE_LENGTH + length ) % pBuffer->size;
+			pBuffer->used -= HOST_MESSAGE_LENGTH + length;
+			received = length;
+			host_changed();
+		}
+	}
+	host_unlock( NULL );
+
+	return received;
+}
+
+size_t xMessageBufferSpacesAvailable( MessageBufferHandle_t xMessageBuffer )
+{
+	hostMessageBuffer_t *pBuffer = xMessageBuffer;
+	size_t space;
+
+	host_lock();
+	space = pBuffer->size - pBuffer->used;
+	host_unlock( NULL );
+
+	return space;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file	host_log.c
+ *
+ * Host build: logging for IotLog* and configPRINTF.
+ *
+ * Messages at or below the HOST_LOG_LEVEL environment variable (default: 1, errors) are
+ * printed.  All messages are scanned, so test runners can count the "PASSED" and "FAILED"
+ * results reported by the on-target test suites.
+ */
+
+#include	<stdio.h>
+#include	<stdlib.h>
+#include	<stdarg.h>
+#include	<string.h>
+#include	"iot_config.h"
+#include	"host_log.h"
+
+#define	HOST_LOG_BUFFER_SIZE	1024
+
+static int		_level = -1;
+static uint32_t	_passed;
+static uint32_t	_failed;
+static uint32_t	_errors;
+
+static void log_message( int level, const char *library, const char *format, va_list args )
+{
+	char buffer[ HOST_LOG_BUFFER_SIZE ];
+	const char *pResult;
+
+	if( 0 > _level )
+	{
+		const char *pEnv = getenv( "HOST_LOG_LEVEL" );
+		_level = ( NULL != pEnv ) ? atoi( pEnv ) : IOT_LOG_ERROR;
+	}
+
+	vsnprintf( buffer, sizeof( buffer ), format, args );
+
+	/* Test suites report results as an indented "PASSED" or "FAILED..." message */
+	pResult = buffer + strspn( buffer, " \t" );
+	if( ( pResult > buffer ) && ( 0 == strncmp( pResult, "PASSED", 6 ) ) )
+	{
+		_passed++;
+	}
+	if( ( pResult > buffer ) && ( 0 == strncmp( pResult, "FAILED", 6 ) ) )
+	{
+		_failed++;
+	}
+	if( IOT_LOG_ERROR == level )
+	{
+		_errors++;
+	}
+
+	if( level <= _level )
+	{
+		if( NULL != library )
+		{
+			printf( "[%s] %s\n", library, buffer );
+		}
+		else
+		{
+			fputs( buffer, stdout );
+		}
+	}
+}
+
+void hostLog_print( int level, const char *library, const char *format, ... )
+{
+	va_list args;
+
+	va_start( args, format );
+	log_message( level, library, format, args );
+	va_end( args );
+}
+
+void hostLog_printf( const char *format, ... )
+{
+	va_list args;
+
+	va_start( args, format );
+	log_message( IOT_LOG_INFO, NULL, format, args );
+	va_end( args );
+}
+
+uint32_t hostLog_passed( void )
+{
+	return _passed;
+}
+
+uint32_t hostLog_failed( void )
+{
+	return _failed;
+}
+
+uint32_t hostLog_errors( void )
+{
+	return _errors;
+}
+
+void hostLog_resetCounts( void )
+{
+	_passed = 0;
+	_failed = 0;
+	_errors = 0;
+}
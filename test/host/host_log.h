@@ -0,0 +1,20 @@
+/**
+ * @file	host_log.h
+ *
+ * Host build: log message counters, for test runners
+ */
+
+#ifndef	HOST_LOG_H
+#define	HOST_LOG_H
+
+#include	<stdint.h>
+
+uint32_t hostLog_passed( void );
+
+uint32_t hostLog_failed( void );
+
+uint32_t hostLog_errors( void );
+
+void hostLog_resetCounts( void );
+
+#endif		/* HOST_LOG_H */
@@ -0,0 +1,56 @@
+/**
+ * @file	host_nvs_items.c
+ *
+ * Host build: project NVS Item table, normally provided by the application
+ */
+
+#include	"nvs_utility.h"
+#include	"iot_pkcs11_config.h"
+
+/**
+ * @brief	NVS Partitions
+ */
+static NVS_Partition_Details_t _partitions[] =
+{
+	[ NVS_PART_NVS ]	= { .label = "nvs",   .encrypted = false, .initialized = false },
+	[ NVS_PART_PDATA ]	= { .label = "pdata", .encrypted = true,  .initialized = false },
+	[ NVS_PART_EDATA ]	= { .label = "edata", .encrypted = false, .initialized = false },
+};
+
+/**
+ * @brief	NVS Items
+ */
+static const NVS_Entry_Details_t _items[] =
+{
+	[ NVS_FIFO_CONTROLS ]	= { .type = NVS_TYPE_U32,  .partition = NVS_PART_EDATA, .namespace = "EventRecords", .nvsKey = "Controls" },
+	[ NVS_FIFO_MAX ]		= { .type = NVS_TYPE_U16,  .partition = NVS_PART_EDATA, .namespace = "EventRecords", .nvsKey = "Max" },
+	[ NVS_FIFO_TEST ]		= { .type = NVS_TYPE_BLOB, .partition = NVS_PART_EDATA, .namespace = "FifoTest",     .nvsKey = "TestControls" },
+	[ NVS_STRESS_CONTROLS ]	= { .type = NVS_TYPE_U32,  .partition = NVS_PART_EDATA, .namespace = "Stress",       .nvsKey = "Controls" },
+	[ NVS_STRESS_MAX ]		= { .type = NVS_TYPE_U16,  .partition = NVS_PART_EDATA, .namespace = "Stress",       .nvsKey = "Max" },
+	[ NVS_U8_TEST ]			= { .type = NVS_TYPE_U8,   .partition = NVS_PART_PDATA, .namespace = pkcs11configSTORAGE_NS, .nvsKey = "TestU8" },
+	[ NVS_I8_TEST ]			= { .type = NVS_TYPE_I8,   .partition = NVS_PART_PDATA, .namespace = pkcs11configSTORAGE_NS, .nvsKey = "TestI8" },
+	[ NVS_U16_TEST ]		= { .type = NVS_TYPE_U16,  .partition = NVS_PART_PDATA, .namespace = pkcs11configSTORAGE_NS, .nvsKey = "TestU16" },
+	[ NVS_I16_TEST ]		= { .type = NVS_TYPE_I16,  .partition = NVS_PART_PDATA, .namespace = pkcs11configSTORAGE_NS, .nvsKey = "TestI16" },
+	[ NVS_U32_TEST ]		= { .type = NVS_TYPE_U32,  .partition = NVS_PART_PDATA, .namespace = pkcs11configSTORAGE_NS, .nvsKey = "TestU32" },
+	[ NVS_I32_TEST ]		= { .type = NVS_TYPE_I32,  .partition = NVS_PART_PDATA, .namespace = pkcs11configSTORAGE_NS, .nvsKey = "TestI32" },
+	[ NVS_U64_TEST ]		= { .type = NVS_TYPE_U64,  .partition = NVS_PART_PDATA, .namespace = pkcs11configSTORAGE_NS, .nvsKey = "TestU64" },
+	[ NVS_I64_TEST ]		= { .type = NVS_TYPE_I64,  .partition = NVS_PART_PDATA, .namespace = pkcs11configSTORAGE_NS, .nvsKey = "TestI64" },
+	[ NVS_STR_TEST ]		= { .type = NVS_TYPE_STR,  .partition = NVS_PART_PDATA, .namespace = pkcs11configSTORAGE_NS, .nvsKey = "TestStr" },
+	[ NVS_BLOB_TEST ]		= { .type = NVS_TYPE_BLOB, .partition = NVS_PART_PDATA, .namespace = pkcs11configSTORAGE_NS, .nvsKey = "TestBlob" },
+};
+
+static const nvsItem_pal_t _pal =
+{
+	.partitions = _partitions,
+	.numPartitions = NVS_PART_END,
+	.items = _items,
+	.numItems = NVS_ITEMS_END,
+};
+
+/**
+ * @brief	Get NVS Item Abstraction Layer
+ */
+const nvsItem_pal_t * nvsItem_getPAL( void )
+{
+	return &_pal;
+}
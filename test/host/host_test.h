@@ -0,0 +1,35 @@
+/**
+ * @file	host_test.h
+ *
+ * Host build: minimal check macros for host test programs
+ */
+
+#ifndef	HOST_TEST_H
+#define	HOST_TEST_H
+
+#include	<stdio.h>
+#include	<stdint.h>
+
+extern uint32_t hostTest_failures;
+
+/**
+ * @brief	Record a failure, with location, if condition is false
+ */
+#define	HOST_CHECK( cond )																	\
+	do																						\
+	{																						\
+		if( !( cond ) )																		\
+		{																					\
+			printf( "FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond );						\
+			hostTest_failures++;															\
+		}																					\
+	} while( 0 )
+
+/**
+ * @brief	Report result, return process exit code
+ */
+#define	HOST_TEST_RESULT( name )															\
+	( printf( "%s: %s, %u failure(s)\n", ( name ), ( 0 == hostTest_failures ) ? "PASS" : "FAIL", hostTest_failures ), \
+	  ( 0 == hostTest_failures ) ? 0 : 1 )
+
+#endif		/* HOST_TEST_H */
@@ -0,0 +1,60 @@
+/**
+ * @file	FreeRTOS.h
+ *
+ * Host build: minimal FreeRTOS kernel definitions, implemented by freertos_host.c
+ */
+
+#ifndef	HOST_FREERTOS_H
+#define	HOST_FREERTOS_H
+
+#include	<stdint.h>
+#include	<stddef.h>
+#include	<stdbool.h>
+#include	<stdlib.h>
+#include	<stdio.h>
+
+typedef	uint32_t		TickType_t;
+typedef	int				BaseType_t;
+typedef	unsigned int	UBaseType_t;
+typedef	void *			TaskHandle_t;
+typedef	void *			SemaphoreHandle_t;
+typedef	void *			QueueHandle_t;
+
+#define	pdTRUE					( 1 )
+#define	pdFALSE					( 0 )
+#define	pdPASS					( 1 )
+#define	pdFAIL					( 0 )
+
+#define	configTICK_RATE_HZ		( 1000 )
+#define	portTICK_PERIOD_MS		( 1000 / configTICK_RATE_HZ )
+#define	portMAX_DELAY			( ( TickType_t ) 0xffffffffUL )
+#define	pdMS_TO_TICKS( xTimeInMs )	( ( TickType_t ) ( ( ( TickType_t ) ( xTimeInMs ) * ( TickType_t ) configTICK_RATE_HZ ) / ( TickType_t ) 1000 ) )
+
+typedef struct
+{
+	int		owner;
+} portMUX_TYPE;
+
+#define	portMUX_INITIALIZER_UNLOCKED	{ 0 }
+#define	portENTER_CRITICAL( mux )		hostCritical_enter( mux )
+#define	portEXIT_CRITICAL( mux )		hostCritical_exit( mux )
+
+#define	configPRINTF( X )		hostLog_printf X
+
+void *pvPortMalloc( size_t xSize );
+
+void vPortFree( void *pv );
+
+uint32_t esp_get_free_heap_size( void );
+
+void hostLog_printf( const char *format, ... );
+
+/* Host only: spin lock, critical sections are not nested */
+void hostCritical_enter( portMUX_TYPE *pMux );
+
+void hostCritical_exit( portMUX_TYPE *pMux );
+
+/* Host only: heap instrumentation */
+uint32_t hostHeap_allocCount( void );
+
+#endif		/* HOST_FREERTOS_H */
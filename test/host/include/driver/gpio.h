@@ -0,0 +1,19 @@
+/**
+ * @file	driver/gpio.h
+ *
+ * Host build: ESP-IDF GPIO pin numbers, for UART pin configuration
+ */
+
+#ifndef	HOST_GPIO_H
+#define	HOST_GPIO_H
+
+typedef enum
+{
+	GPIO_NUM_NC = -1,
+	GPIO_NUM_4 = 4,
+	GPIO_NUM_5 = 5,
+	GPIO_NUM_12 = 12,
+	GPIO_NUM_15 = 15
+} gpio_num_t;
+
+#endif		/* HOST_GPIO_H */
@@ -0,0 +1,113 @@
+/**
+ * @file	driver/uart.h
+ *
+ * Host build: ESP-IDF UART driver, implemented over a socket pair by uart_host.c
+ *
+ * hostUart_open() creates the port and returns the Host end of the socket pair; the driver
+ * end behaves as the ESP-IDF driver, posting UART_DATA events to the event queue as bytes
+ * arrive, and UART_BUFFER_FULL when its receive buffer overflows.  The baud rate is only
+ * recorded, transfers are not paced; but while the Host end's rate, set by
+ * hostUart_setPeerBaud(), differs from the driver's, bytes are corrupted in both directions
+ * and UART_FRAME_ERR is posted for each received block, as on a mismatched link.
+ */
+
+#ifndef	HOST_UART_H
+#define	HOST_UART_H
+
+#include	"freertos/FreeRTOS.h"
+#include	"freertos/queue.h"
+#include	"esp_err.h"
+
+#define	UART_NUM_MAX			( 3 )
+#define	UART_PIN_NO_CHANGE		( -1 )
+
+typedef	int		uart_port_t;
+
+typedef enum
+{
+	UART_DATA,
+	UART_BREAK,
+	UART_BUFFER_FULL,
+	UART_FIFO_OVF,
+	UART_FRAME_ERR,
+	UART_PARITY_ERR,
+	UART_DATA_BREAK,
+	UART_PATTERN_DET,
+	UART_EVENT_MAX
+} uart_event_type_t;
+
+typedef struct
+{
+	uart_event_type_t	type;
+	size_t				size;
+	bool				timeout_flag;
+} uart_event_t;
+
+typedef enum
+{
+	UART_DATA_5_BITS,
+	UART_DATA_6_BITS,
+	UART_DATA_7_BITS,
+	UART_DATA_8_BITS
+} uart_word_length_t;
+
+typedef enum
+{
+	UART_PARITY_DISABLE,
+	UART_PARITY_EVEN = 2,
+	UART_PARITY_ODD
+} uart_parity_t;
+
+typedef enum
+{
+	UART_STOP_BITS_1 = 1,
+	UART_STOP_BITS_1_5,
+	UART_STOP_BITS_2
+} uart_stop_bits_t;
+
+typedef enum
+{
+	UART_HW_FLOWCTRL_DISABLE,
+	UART_HW_FLOWCTRL_RTS,
+	UART_HW_FLOWCTRL_CTS,
+	UART_HW_FLOWCTRL_CTS_RTS
+} uart_hw_flowcontrol_t;
+
+typedef struct
+{
+	int						baud_rate;
+	uart_word_length_t		data_bits;
+	uart_parity_t			parity;
+	uart_stop_bits_t		stop_bits;
+	uart_hw_flowcontrol_t	flow_ctrl;
+	uint8_t					rx_flow_ctrl_thresh;
+} uart_config_t;
+
+esp_err_t uart_param_config( uart_port_t uart_num, const uart_config_t *uart_config );
+
+esp_err_t uart_set_pin( uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num );
+
+esp_err_t uart_driver_install( uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *uart_queue, int intr_alloc_flags );
+
+/* Host: does not block, returns the bytes already received, up to length */
+int uart_read_bytes( uart_port_t uart_num, void *buf, uint32_t length, TickType_t ticks_to_wait );
+
+int uart_write_bytes( uart_port_t uart_num, const void *src, size_t size );
+
+esp_err_t uart_get_buffered_data_len( uart_port_t uart_num, size_t *size );
+
+esp_err_t uart_flush_input( uart_port_t uart_num );
+
+esp_err_t uart_set_baudrate( uart_port_t uart_num, uint32_t baudrate );
+
+esp_err_t uart_get_baudrate( uart_port_t uart_num, uint32_t *baudrate );
+
+esp_err_t uart_wait_tx_done( uart_port_t uart_num, TickType_t ticks_to_wait );
+
+/* Host only: create port, return Host end of the link, -1 on error */
+int hostUart_open( uart_port_t uart_num );
+
+/* Host only: baud rate of Host end of the link */
+void hostUart_setPeerBaud( uart_port_t uart_num, uint32_t baudrate );
+
+#endif		/* HOST_UART_H */
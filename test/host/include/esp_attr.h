@@ -0,0 +1,14 @@
+/**
+ * @file	esp_attr.h
+ *
+ * Host build: ESP-IDF memory placement attributes
+ */
+
+#ifndef	HOST_ESP_ATTR_H
+#define	HOST_ESP_ATTR_H
+
+#define	WORD_ALIGNED_ATTR		__attribute__( ( aligned( 4 ) ) )
+#define	IRAM_ATTR
+#define	DRAM_ATTR
+
+#endif		/* HOST_ESP_ATTR_H */
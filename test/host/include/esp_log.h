@@ -0,0 +1,10 @@
+/**
+ * @file	esp_log.h
+ *
+ * Host build: ESP-IDF logging, modules under test log through IotLog*
+ */
+
+#ifndef	HOST_ESP_LOG_H
+#define	HOST_ESP_LOG_H
+
+#endif		/* HOST_ESP_LOG_H */
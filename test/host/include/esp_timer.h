@@ -0,0 +1,14 @@
+/**
+ * @file	esp_timer.h
+ *
+ * Host build: ESP-IDF high resolution timer
+ */
+
+#ifndef	HOST_ESP_TIMER_H
+#define	HOST_ESP_TIMER_H
+
+#include	<stdint.h>
+
+int64_t esp_timer_get_time( void );
+
+#endif		/* HOST_ESP_TIMER_H */
@@ -0,0 +1,12 @@
+/**
+ * @file	esp_wifi.h
+ *
+ * Host build: ESP-IDF WiFi, included by modules under test but not used
+ */
+
+#ifndef	HOST_ESP_WIFI_H
+#define	HOST_ESP_WIFI_H
+
+#include	"esp_err.h"
+
+#endif		/* HOST_ESP_WIFI_H */
@@ -0,0 +1,7 @@
+/**
+ * @file	freertos/FreeRTOS.h
+ *
+ * Host build: ESP-IDF include path for FreeRTOS.h
+ */
+
+#include	"../FreeRTOS.h"
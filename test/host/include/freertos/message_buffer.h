@@ -0,0 +1,7 @@
+/**
+ * @file	freertos/message_buffer.h
+ *
+ * Host build: ESP-IDF include path for message_buffer.h
+ */
+
+#include	"../message_buffer.h"
@@ -0,0 +1,35 @@
+/**
+ * @file	freertos/queue.h
+ *
+ * Host build: FreeRTOS queues and queue sets, implemented by freertos_queue.c
+ */
+
+#ifndef	HOST_QUEUE_H
+#define	HOST_QUEUE_H
+
+#include	"../FreeRTOS.h"
+
+typedef	void *			QueueSetHandle_t;
+typedef	void *			QueueSetMemberHandle_t;
+
+QueueHandle_t xQueueCreate( UBaseType_t uxQueueLength, UBaseType_t uxItemSize );
+
+void vQueueDelete( QueueHandle_t xQueue );
+
+BaseType_t xQueueSend( QueueHandle_t xQueue, const void * pvItemToQueue, TickType_t xTicksToWait );
+
+#define	xQueueSendToBack( xQueue, pvItemToQueue, xTicksToWait )	xQueueSend( ( xQueue ), ( pvItemToQueue ), ( xTicksToWait ) )
+
+BaseType_t xQueueReceive( QueueHandle_t xQueue, void * pvBuffer, TickType_t xTicksToWait );
+
+BaseType_t xQueueReset( QueueHandle_t xQueue );
+
+UBaseType_t uxQueueMessagesWaiting( QueueHandle_t xQueue );
+
+QueueSetHandle_t xQueueCreateSet( UBaseType_t uxEventQueueLength );
+
+BaseType_t xQueueAddToSet( QueueSetMemberHandle_t xQueueOrSemaphore, QueueSetHandle_t xQueueSet );
+
+QueueSetMemberHandle_t xQueueSelectFromSet( QueueSetHandle_t xQueueSet, TickType_t xTicksToWait );
+
+#endif		/* HOST_QUEUE_H */
@@ -0,0 +1,25 @@
+/**
+ * @file	freertos/semphr.h
+ *
+ * Host build: FreeRTOS semaphores, implemented by freertos_queue.c
+ *
+ * Mutexes are pthread mutexes; binary semaphores are queues of length one, so they can
+ * be members of a queue set.
+ */
+
+#ifndef	HOST_SEMPHR_H
+#define	HOST_SEMPHR_H
+
+#include	"../FreeRTOS.h"
+
+SemaphoreHandle_t xSemaphoreCreateMutex( void );
+
+SemaphoreHandle_t xSemaphoreCreateBinary( void );
+
+BaseType_t xSemaphoreTake( SemaphoreHandle_t xSemaphore, TickType_t xTicksToWait );
+
+BaseType_t xSemaphoreGive( SemaphoreHandle_t xSemaphore );
+
+void vSemaphoreDelete( SemaphoreHandle_t xSemaphore );
+
+#endif		/* HOST_SEMPHR_H */
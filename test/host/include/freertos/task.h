@@ -0,0 +1,32 @@
+/**
+ * @file	freertos/task.h
+ *
+ * Host build: FreeRTOS task API, implemented by freertos_host.c
+ *
+ * The tick count is virtual; it advances only through vTaskDelay(), hostTick_advance(), or
+ * a blocking call that times out, so time-dependent code runs deterministically and, unless
+ * it waits on another task, without real delays.
+ */
+
+#ifndef	HOST_TASK_H
+#define	HOST_TASK_H
+
+#include	"../FreeRTOS.h"
+
+typedef void ( *TaskFunction_t )( void * );
+
+BaseType_t xTaskCreate( TaskFunction_t pxTaskCode, const char * const pcName, const uint32_t usStackDepth,
+						void * const pvParameters, UBaseType_t uxPriority, TaskHandle_t * const pxCreatedTask );
+
+void vTaskDelete( TaskHandle_t xTaskToDelete );
+
+TickType_t xTaskGetTickCount( void );
+
+void vTaskDelay( const TickType_t xTicksToDelay );
+
+TaskHandle_t xTaskGetCurrentTaskHandle( void );
+
+/* Host only: advance the virtual tick count */
+void hostTick_advance( TickType_t ticks );
+
+#endif		/* HOST_TASK_H */
@@ -0,0 +1,20 @@
+/**
+ * @file	iot_config.h
+ *
+ * Host build: library configuration, always included first by module logging headers
+ */
+
+#ifndef	HOST_IOT_CONFIG_H
+#define	HOST_IOT_CONFIG_H
+
+#include	"FreeRTOS.h"
+
+#define	IOT_LOG_NONE			0
+#define	IOT_LOG_ERROR			1
+#define	IOT_LOG_WARN			2
+#define	IOT_LOG_INFO			3
+#define	IOT_LOG_DEBUG			4
+
+#define	IOT_LOG_LEVEL_GLOBAL	IOT_LOG_DEBUG
+
+#endif		/* HOST_IOT_CONFIG_H */
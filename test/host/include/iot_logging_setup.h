@@ -0,0 +1,29 @@
+/**
+ * @file	iot_logging_setup.h
+ *
+ * Host build: logging macros, implemented by host_log.c
+ *
+ * Like the library header, this file has no include guard; each module includes it
+ * after defining LIBRARY_LOG_NAME and LIBRARY_LOG_LEVEL.
+ */
+
+#include	<stdio.h>
+#include	<stddef.h>
+#include	<stdint.h>
+
+#ifndef	HOST_LOG_DECLARED
+#define	HOST_LOG_DECLARED
+void hostLog_print( int level, const char *library, const char *format, ... );
+#endif
+
+#undef	IotLogError
+#undef	IotLogWarn
+#undef	IotLogInfo
+#undef	IotLogDebug
+#undef	IotLog_PrintBuffer
+
+#define	IotLogError( ... )			hostLog_print( IOT_LOG_ERROR, LIBRARY_LOG_NAME, __VA_ARGS__ )
+#define	IotLogWarn( ... )			hostLog_print( IOT_LOG_WARN, LIBRARY_LOG_NAME, __VA_ARGS__ )
+#define	IotLogInfo( ... )			hostLog_print( IOT_LOG_INFO, LIBRARY_LOG_NAME, __VA_ARGS__ )
+#define	IotLogDebug( ... )			hostLog_print( IOT_LOG_DEBUG, LIBRARY_LOG_NAME, __VA_ARGS__ )
+#define	IotLog_PrintBuffer( ... )
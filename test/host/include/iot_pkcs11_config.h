@@ -0,0 +1,12 @@
+/**
+ * @file	iot_pkcs11_config.h
+ *
+ * Host build: PKCS#11 configuration
+ */
+
+#ifndef	HOST_IOT_PKCS11_CONFIG_H
+#define	HOST_IOT_PKCS11_CONFIG_H
+
+#define	pkcs11configSTORAGE_NS		"storage"
+
+#endif		/* HOST_IOT_PKCS11_CONFIG_H */
@@ -0,0 +1,27 @@
+/**
+ * @file	message_buffer.h
+ *
+ * Host build: FreeRTOS message buffers, implemented by freertos_queue.c
+ *
+ * As on target, each message is stored with a 4 byte length, which counts against the
+ * buffer size.
+ */
+
+#ifndef	HOST_MESSAGE_BUFFER_H
+#define	HOST_MESSAGE_BUFFER_H
+
+#include	"FreeRTOS.h"
+
+typedef	void *			MessageBufferHandle_t;
+
+MessageBufferHandle_t xMessageBufferCreate( size_t xBufferSizeBytes );
+
+void vMessageBufferDelete( MessageBufferHandle_t xMessageBuffer );
+
+size_t xMessageBufferSend( MessageBufferHandle_t xMessageBuffer, const void *pvTxData, size_t xDataLengthBytes, TickType_t xTicksToWait );
+
+size_t xMessageBufferReceive( MessageBufferHandle_t xMessageBuffer, void *pvRxData, size_t xBufferLengthBytes, TickType_t xTicksToWait );
+
+size_t xMessageBufferSpacesAvailable( MessageBufferHandle_t xMessageBuffer );
+
+#endif		/* HOST_MESSAGE_BUFFER_H */
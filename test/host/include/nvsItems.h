@@ -0,0 +1,44 @@
+/**
+ * @file	nvsItems.h
+ *
+ * Host build: project NVS Item definitions, table in host_nvs_items.c
+ */
+
+#ifndef	HOST_NVSITEMS_H
+#define	HOST_NVSITEMS_H
+
+/**
+ * @brief	Enumerated NVS Partitions
+ */
+typedef enum
+{
+	NVS_PART_NVS,
+	NVS_PART_PDATA,
+	NVS_PART_EDATA,
+	NVS_PART_END
+} NVS_Partitions_t;
+
+/**
+ * @brief	Enumerated NVS Items
+ */
+typedef enum
+{
+	NVS_FIFO_CONTROLS,
+	NVS_FIFO_MAX,
+	NVS_FIFO_TEST,
+	NVS_STRESS_CONTROLS,
+	NVS_STRESS_MAX,
+	NVS_U8_TEST,
+	NVS_I8_TEST,
+	NVS_U16_TEST,
+	NVS_I16_TEST,
+	NVS_U32_TEST,
+	NVS_I32_TEST,
+	NVS_U64_TEST,
+	NVS_I64_TEST,
+	NVS_STR_TEST,
+	NVS_BLOB_TEST,
+	NVS_ITEMS_END
+} NVS_Items_t;
+
+#endif		/* HOST_NVSITEMS_H */
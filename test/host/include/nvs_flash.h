@@ -0,0 +1,18 @@
+/**
+ * @file	nvs_flash.h
+ *
+ * Host build: ESP-IDF NVS partition API, implemented by nvs_emulator.c
+ */
+
+#ifndef	HOST_NVS_FLASH_H
+#define	HOST_NVS_FLASH_H
+
+#include	"nvs.h"
+
+esp_err_t nvs_flash_init_partition( const char *partition_label );
+
+esp_err_t nvs_flash_deinit_partition( const char *partition_label );
+
+esp_err_t nvs_flash_erase_partition( const char *partition_label );
+
+#endif		/* HOST_NVS_FLASH_H */
@@ -0,0 +1,944 @@
+/**
+ * @file	nvs_emulator.c
+ *
+ * Host build: in-memory emulation of the ESP-IDF NVS API.
+ *
+ * Values are held in RAM, while the flash layout is modelled to measure wear:
+ *	- Each partition is divided into pages of NVS_EMU_ENTRIES_PER_PAGE, 32-byte, entries.
+ *	- Scalars use one entry; strings and blobs use one header entry plus one entry per 32 bytes of data.
+ *	- Values are appended to the active page; overwritten or erased values leave erased entries behind.
+ *	- When only one free page remains, the full page with the most erased entries is garbage
+ *	  collected: its live entries are relocated and the page is erased.
+ *
+ * Power-fail injection: nvsEmu_setPowerFail( n ) allows n further flash writes (set or erase);
+ * the next write, and every NVS operation after it, fails until nvsEmu_powerCycle() is called.
+ * Values written before the failure are retained, as they would be on flash.
+ *
+ * As in ESP-IDF, the API may be called from several tasks: each call holds the emulator lock.
+ */
+
+#include	<stdlib.h>
+#include	<string.h>
+#include	<pthread.h>
+#include	"nvs.h"
+#include	"nvs_flash.h"
+#include	"nvs_emulator.h"
+
+#define	NVS_EMU_MAX_PARTITIONS		4
+#define	NVS_EMU_MAX_NAMESPACES		32
+#define	NVS_EMU_MAX_HANDLES			64
+#define	NVS_EMU_NAME_SIZE			16				/**< Maximum key/namespace length, 15 characters plus null-terminator */
+#define	NVS_EMU_LABEL_SIZE			32
+
+/**
+ * @brief	Stored value
+ */
+typedef struct item_s
+{
+	struct item_s	*next;
+	char			namespace[ NVS_EMU_NAME_SIZE ];
+	char			key[ NVS_EMU_NAME_SIZE ];
+	nvs_type_t		type;
+	uint8_t			*data;
+	size_t			length;
+	uint16_t		page;							/**< Page holding the value's entries */
+	uint16_t		entries;						/**< Number of entries used by value */
+} item_t;
+
+/**
+ * @brief	Flash page wear model
+ */
+typedef struct
+{
+	uint16_t	used;								/**< Entries written since page was erased */
+	uint16_t	erased;								/**< Entries no longer holding live values */
+	uint32_t	eraseCount;							/**< Number of times page has been erased */
+} page_t;
+
+/**
+ * @brief	Emulated partition
+ */
+typedef struct
+{
+	char			label[ NVS_EMU_LABEL_SIZE ];
+	bool			configured;
+	bool			initialized;
+	uint16_t		nPages;
+	page_t			*pages;
+	uint16_t		activePage;
+	item_t			*items;
+	char			namespaces[ NVS_EMU_MAX_NAMESPACES ][ NVS_EMU_NAME_SIZE ];
+	uint16_t		nNamespaces;
+	nvsEmu_stats_t	stats;
+} partition_t;
+
+/**
+ * @brief	Open handle
+ */
+typedef struct
+{
+	bool			open;
+	partition_t		*pPartition;
+	char			namespace[ NVS_EMU_NAME_SIZE ];
+	bool			readOnly;
+} handle_t;
+
+static partition_t	_partitions[ NVS_EMU_MAX_PARTITIONS ];
+static handle_t		_handles[ NVS_EMU_MAX_HANDLES ];
+
+static int32_t		_powerFailCountdown = -1;		/**< Writes allowed before power fails, -1 to disable */
+static bool			_powerFailed = false;
+static uint32_t		_writeCount = 0;
+static pthread_mutex_t	_lock = PTHREAD_MUTEX_INITIALIZER;	/**< Held by each ESP-IDF API call */
+
+/**
+ * @brief	Find partition by label, optionally adding it
+ */
+static partition_t *find_partition( const char *label, bool create )
+{
+	partition_t *pFree = NULL;
+
+	if( NULL == label )
+	{
+		return NULL;
+	}
+
+	for( int i = 0; i < NVS_EMU_MAX_PARTITIONS; ++i )
+	{
+		if( _partitions[ i ].configured && ( 0 == strcmp( _partitions[ i ].label, label ) ) )
+		{
+			return &_partitions[ i ];
+		}
+		if( !_partitions[ i ].configured && ( NULL == pFree ) )
+		{
+			pFree = &_partitions[ i ];
+		}
+	}
+
+	if( create && ( NULL != pFree ) && ( NVS_EMU_LABEL_SIZE > strlen( label ) ) )
+	{
+		memset( pFree, 0, sizeof( *pFree ) );
+		strcpy( pFree->label, label );
+		pFree->configured = true;
+		pFree->nPages = NVS_EMU_DEFAULT_PAGES;
+		pFree->pages = calloc( pFree->nPages, sizeof( page_t ) );
+		return pFree;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief	Get open handle
+ */
+static handle_t *get_handle( nvs_handle_t handle )
+{
+	if( ( 0 == handle ) || ( NVS_EMU_MAX_HANDLES < handle ) || !_handles[ handle - 1 ].open )
+	{
+		return NULL;
+	}
+	return &_handles[ handle - 1 ];
+}
+
+/**
+ * @brief	Find stored value
+ */
+static item_t *find_item( partition_t *pPartition, const char *namespace, const char *key )
+{
+	for( item_t *pItem = pPartition->items; NULL != pItem; pItem = pItem->next )
+	{
+		if( ( 0 == strcmp( pItem->namespace, namespace ) ) && ( 0 == strcmp( pItem->key, key ) ) )
+		{
+			return pItem;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief	Count free pages, other than the active page
+ */
+static uint16_t count_free_pages( partition_t *pPartition, uint16_t *pFirst )
+{
+	uint16_t count = 0;
+
+	for( uint16_t i = 0; i < pPartition->nPages; ++i )
+	{
+		if( ( i != pPartition->activePage ) && ( 0 == pPartition->pages[ i ].used ) )
+		{
+			if( 0 == count )
+			{
+				*pFirst = i;
+			}
+			++count;
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief	Erase a page, updating wear statistics
+ */
+static void erase_page( partition_t *pPartition, uint16_t page )
+{
+	page_t *pPage = &pPartition->pages[ page ];
+
+	pPage->used = 0;
+	pPage->erased = 0;
+	pPage->eraseCount++;
+	pPartition->stats.pageErases++;
+	if( pPage->eraseCount > pPartition->stats.maxPageEraseCount )
+	{
+		pPartition->stats.maxPageEraseCount = pPage->eraseCount;
+	}
+}
+
+/**
+ * @brief	Garbage collect the page with the most erased entries into the reserved free page
+ *
+ * @return	true if space was recovered
+ */
+static bool collect_garbage( partition_t *pPartition, uint16_t reserve )
+{
+	uint16_t victim = 0;
+	uint16_t mostErased = 0;
+
+	for( uint16_t i = 0; i < pPartition->nPages; ++i )
+	{
+		if( ( i != reserve ) && ( pPartition->pages[ i ].erased > mostErased ) )
+		{
+			victim = i;
+			mostErased = pPartition->pages[ i ].erased;
+		}
+	}
+
+	if( 0 == mostErased )
+	{
+		return false;
+	}
+
+	/* Relocate live values from victim into the reserve page, which becomes the active page */
+	pPartition->activePage = reserve;
+	for( item_t *pItem = pPartition->items; NULL != pItem; pItem = pItem->next )
+	{
+		if( pItem->page == victim )
+		{
+			pItem->page = reserve;
+			pPartition->pages[ reserve ].used += pItem->entries;
+			pPartition->stats.entriesWritten += pItem->entries;
+			pPartition->stats.entriesRelocated += pItem->entries;
+		}
+	}
+
+	erase_page( pPartition, victim );
+
+	return true;
+}
+
+/**
+ * @brief	Allocate entries for a new value
+ */
+static esp_err_t allocate_entries( partition_t *pPartition, uint16_t entries, uint16_t *pPage )
+{
+	uint16_t next = 0;
+
+	if( NVS_EMU_ENTRIES_PER_PAGE < entries )
+	{
+		return ESP_ERR_NVS_VALUE_TOO_LONG;
+	}
+
+	for( int attempt = 0; attempt <= pPartition->nPages; ++attempt )
+	{
+		page_t *pActive = &pPartition->pages[ pPartition->activePage ];
+
+		if( ( pActive->used + entries ) <= NVS_EMU_ENTRIES_PER_PAGE )
+		{
+			pActive->used += entries;
+			pPartition->stats.entriesWritten += entries;
+			*pPage = pPartition->activePage;
+			return ESP_OK;
+		}
+
+		/* Active page is full; move to a free page, always keeping one in reserve for garbage collection */
+		if( 1 < count_free_pages( pPartition, &next ) )
+		{
+			pPartition->activePage = next;
+		}
+		else if( ( 0 == count_free_pages( pPartition, &next ) ) || !collect_garbage( pPartition, next ) )
+		{
+			break;
+		}
+	}
+
+	return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+/**
+ * @brief	Mark a value's entries erased, and remove it
+ */
+static void remove_item( partition_t *pPartition, item_t *pRemove )
+{
+	for( item_t **ppItem = &pPartition->items; NULL != *ppItem; ppItem = &( *ppItem )->next )
+	{
+		if( *ppItem == pRemove )
+		{
+			*ppItem = pRemove->next;
+			pPartition->pages[ pRemove->page ].erased += pRemove->entries;
+			pPartition->stats.liveEntries -= pRemove->entries;
+			free( pRemove->data );
+			free( pRemove );
+			return;
+		}
+	}
+}
+
+/**
+ * @brief	Account for a flash write, failing if power has been cut
+ *
+ * @return	true if write may proceed
+ */
+static bool write_boundary( void )
+{
+	if( _powerFailed )
+	{
+		return false;
+	}
+
+	if( 0 == _powerFailCountdown )
+	{
+		_powerFailed = true;
+		return false;
+	}
+
+	if( 0 < _powerFailCountdown )
+	{
+		--_powerFailCountdown;
+	}
+	++_writeCount;
+
+	return true;
+}
+
+/**
+ * @brief	Write a value
+ */
+static esp_err_t emu_set_value( nvs_handle_t handle, const char *key, nvs_type_t type, const void *value, size_t length )
+{
+	handle_t *pHandle = get_handle( handle );
+	partition_t *pPartition;
+	item_t *pItem;
+	uint16_t entries;
+	uint16_t page;
+	esp_err_t err;
+
+	if( NULL == pHandle )
+	{
+		return ESP_ERR_NVS_INVALID_HANDLE;
+	}
+	if( pHandle->readOnly )
+	{
+		return ESP_ERR_NVS_READ_ONLY;
+	}
+	if( ( NULL == key ) || ( NVS_EMU_NAME_SIZE <= strlen( key ) ) )
+	{
+		return ESP_ERR_NVS_KEY_TOO_LONG;
+	}
+	if( !write_boundary() )
+	{
+		return ESP_FAIL;
+	}
+
+	pPartition = pHandle->pPartition;
+	entries = ( ( NVS_TYPE_STR == type ) || ( NVS_TYPE_BLOB == type ) ) ? ( 1 + ( ( length + NVS_EMU_ENTRY_SIZE - 1 ) / NVS_EMU_ENTRY_SIZE ) ) : 1;
+
+	err = allocate_entries( pPartition, entries, &page );
+	if( ESP_OK != err )
+	{
+		return err;
+	}
+
+	/* Replace any previous value, of any type */
+	pItem = find_item( pPartition, pHandle->namespace, key );
+	if( NULL != pItem )
+	{
+		remove_item( pPartition, pItem );
+	}
+
+	pItem = calloc( 1, sizeof( item_t ) );
+	pItem->data = malloc( length ? length : 1 );
+	memcpy( pItem->data, value, length );
+	pItem->length = length;
+	pItem->type = type;
+	pItem->page = page;
+	pItem->entries = entries;
+	strcpy( pItem->namespace, pHandle->namespace );
+	strcpy( pItem->key, key );
+	pItem->next = pPartition->items;
+	pPartition->items = pItem;
+
+	pPartition->stats.setCalls++;
+	pPartition->stats.payloadBytes += length;
+	pPartition->stats.liveEntries += entries;
+
+	return ESP_OK;
+}
+
+/**
+ * @brief	Read a value
+ *
+ * For strings and blobs, pLength is in/out; a NULL value returns the required length.
+ */
+static esp_err_t emu_get_value( nvs_handle_t handle, const char *key, nvs_type_t type, void *value, size_t *pLength )
+{
+	handle_t *pHandle = get_handle( handle );
+	item_t *pItem;
+
+	if( _powerFailed )
+	{
+		return ESP_FAIL;
+	}
+	if( NULL == pHandle )
+	{
+		return ESP_ERR_NVS_INVALID_HANDLE;
+	}
+	if( NULL == key )
+	{
+		return ESP_ERR_NVS_NOT_FOUND;
+	}
+
+	pItem = find_item( pHandle->pPartition, pHandle->namespace, key );
+	if( ( NULL == pItem ) || ( pItem->type != type ) )
+	{
+		return ESP_ERR_NVS_NOT_FOUND;
+	}
+
+	if( ( NVS_TYPE_STR == type ) || ( NVS_TYPE_BLOB == type ) )
+	{
+		if( NULL == pLength )
+		{
+			return ESP_ERR_NVS_INVALID_LENGTH;
+		}
+		if( NULL == value )
+		{
+			*pLength = pItem->length;
+			return ESP_OK;
+		}
+		if( *pLength < pItem->length )
+		{
+			return ESP_ERR_NVS_INVALID_LENGTH;
+		}
+		*pLength = pItem->length;
+	}
+
+	if( NULL == value )
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	memcpy( value, pItem->data, pItem->length );
+
+	return ESP_OK;
+}
+
+/* ************************************************************************* */
+/* **********                  E S P - I D F   A P I              ********** */
+/* ************************************************************************* */
+
+static esp_err_t emu_flash_init_partition( const char *partition_label )
+{
+	partition_t *pPartition;
+
+	if( _powerFailed )
+	{
+		return ESP_FAIL;
+	}
+
+	pPartition = find_partition( partition_label, true );
+	if( NULL == pPartition )
+	{
+		return ESP_ERR_NVS_PART_NOT_FOUND;
+	}
+
+	pPartition->initialized = true;
+
+	return ESP_OK;
+}
+
+static esp_err_t emu_flash_deinit_partition( const char *partition_label )
+{
+	partition_t *pPartition = find_partition( partition_label, false );
+
+	if( ( NULL == pPartition ) || !pPartition->initialized )
+	{
+		return ESP_ERR_NVS_NOT_INITIALIZED;
+	}
+
+	for( int i = 0; i < NVS_EMU_MAX_HANDLES; ++i )
+	{
+		if( _handles[ i ].open && ( _handles[ i ].pPartition == pPartition ) )
+		{
+			_handles[ i ].open = false;
+		}
+	}
+	pPartition->initialized = false;
+
+	return ESP_OK;
+}
+
+static esp_err_t emu_flash_erase_partition( const char *partition_label )
+{
+	partition_t *pPartition;
+
+	if( _powerFailed )
+	{
+		return ESP_FAIL;
+	}
+
+	pPartition = find_partition( partition_label, true );
+	if( NULL == pPartition )
+	{
+		return ESP_ERR_NVS_PART_NOT_FOUND;
+	}
+
+	while( NULL != pPartition->items )
+	{
+		remove_item( pPartition, pPartition->items );
+	}
+
+	for( uint16_t i = 0; i < pPartition->nPages; ++i )
+	{
+		if( 0 < pPartition->pages[ i ].used )
+		{
+			erase_page( pPartition, i );
+		}
+	}
+	pPartition->activePage = 0;
+	pPartition->nNamespaces = 0;
+
+	return ESP_OK;
+}
+
+static esp_err_t emu_open_from_partition( const char *part_name, const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle )
+{
+	partition_t *pPartition = find_partition( part_name, false );
+	bool bFound = false;
+	uint16_t page;
+
+	if( _powerFailed )
+	{
+		return ESP_FAIL;
+	}
+	if( ( NULL == pPartition ) || !pPartition->initialized )
+	{
+		return ESP_ERR_NVS_NOT_INITIALIZED;
+	}
+	if( ( NULL == name ) || ( NVS_EMU_NAME_SIZE <= strlen( name ) ) )
+	{
+		return ESP_ERR_NVS_INVALID_NAME;
+	}
+
+	pPartition->stats.opens++;
+
+	for( int i = 0; i < pPartition->nNamespaces; ++i )
+	{
+		if( 0 == strcmp( pPartition->namespaces[ i ], name ) )
+		{
+			bFound = true;
+			break;
+		}
+	}
+
+	if( !bFound )
+	{
+		if( NVS_READONLY == open_mode )
+		{
+			return ESP_ERR_NVS_NOT_FOUND;
+		}
+		if( NVS_EMU_MAX_NAMESPACES <= pPartition->nNamespaces )
+		{
+			return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+		}
+
+		/* Namespace is recorded in a single entry */
+		if( ESP_OK != allocate_entries( pPartition, 1, &page ) )
+		{
+			return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+		}
+		strcpy( pPartition->namespaces[ pPartition->nNamespaces++ ], name );
+	}
+
+	for( int i = 0; i < NVS_EMU_MAX_HANDLES; ++i )
+	{
+		if( !_handles[ i ].open )
+		{
+			_handles[ i ].open = true;
+			_handles[ i ].pPartition = pPartition;
+			_handles[ i ].readOnly = ( NVS_READONLY == open_mode );
+			strcpy( _handles[ i ].namespace, name );
+			*out_handle = i + 1;
+			return ESP_OK;
+		}
+	}
+
+	return ESP_ERR_NO_MEM;
+}
+
+static void emu_close( nvs_handle_t handle )
+{
+	handle_t *pHandle = get_handle( handle );
+
+	if( NULL != pHandle )
+	{
+		pHandle->open = false;
+	}
+}
+
+static esp_err_t emu_commit( nvs_handle_t handle )
+{
+	handle_t *pHandle = get_handle( handle );
+
+	if( _powerFailed )
+	{
+		return ESP_FAIL;
+	}
+	if( NULL == pHandle )
+	{
+		return ESP_ERR_NVS_INVALID_HANDLE;
+	}
+
+	pHandle->pPartition->stats.commits++;
+
+	return ESP_OK;
+}
+
+static esp_err_t emu_erase_key( nvs_handle_t handle, const char *key )
+{
+	handle_t *pHandle = get_handle( handle );
+	item_t *pItem;
+
+	if( NULL == pHandle )
+	{
+		return ESP_ERR_NVS_INVALID_HANDLE;
+	}
+	if( pHandle->readOnly )
+	{
+		return ESP_ERR_NVS_READ_ONLY;
+	}
+	if( ( NULL == key ) || ( NULL == ( pItem = find_item( pHandle->pPartition, pHandle->namespace, key ) ) ) )
+	{
+		return ESP_ERR_NVS_NOT_FOUND;
+	}
+	if( !write_boundary() )
+	{
+		return ESP_FAIL;
+	}
+
+	remove_item( pHandle->pPartition, pItem );
+	pHandle->pPartition->stats.eraseCalls++;
+
+	return ESP_OK;
+}
+
+static esp_err_t emu_erase_all( nvs_handle_t handle )
+{
+	handle_t *pHandle = get_handle( handle );
+	item_t *pItem;
+	item_t *pNext;
+
+	if( NULL == pHandle )
+	{
+		return ESP_ERR_NVS_INVALID_HANDLE;
+	}
+	if( pHandle->readOnly )
+	{
+		return ESP_ERR_NVS_READ_ONLY;
+	}
+	if( !write_boundary() )
+	{
+		return ESP_FAIL;
+	}
+
+	for( pItem = pHandle->pPartition->items; NULL != pItem; pItem = pNext )
+	{
+		pNext = pItem->next;
+		if( 0 == strcmp( pItem->namespace, pHandle->namespace ) )
+		{
+			remove_item( pHandle->pPartition, pItem );
+		}
+	}
+	pHandle->pPartition->stats.eraseCalls++;
+
+	return ESP_OK;
+}
+
+/* Each API call holds the emulator lock */
+
+static esp_err_t set_value( nvs_handle_t handle, const char *key, nvs_type_t type, const void *value, size_t length )
+{
+	esp_err_t err;
+
+	pthread_mutex_lock( &_lock );
+	err = emu_set_value( handle, key, type, value, length );
+	pthread_mutex_unlock( &_lock );
+	return err;
+}
+
+static esp_err_t get_value( nvs_handle_t handle, const char *key, nvs_type_t type, void *value, size_t *pLength )
+{
+	esp_err_t err;
+
+	pthread_mutex_lock( &_lock );
+	err = emu_get_value( handle, key, type, value, pLength );
+	pthread_mutex_unlock( &_lock );
+	return err;
+}
+
+esp_err_t nvs_flash_init_partition( const char *partition_label )
+{
+	esp_err_t err;
+
+	pthread_mutex_lock( &_lock );
+	err = emu_flash_init_partition( partition_label );
+	pthread_mutex_unlock( &_lock );
+	return err;
+}
+
+esp_err_t nvs_flash_deinit_partition( const char *partition_label )
+{
+	esp_err_t err;
+
+	pthread_mutex_lock( &_lock );
+	err = emu_flash_deinit_partition( partition_label );
+	pthread_mutex_unlock( &_lock );
+	return err;
+}
+
+esp_err_t nvs_flash_erase_partition( const char *partition_label )
+{
+	esp_err_t err;
+
+	pthread_mutex_lock( &_lock );
+	err = emu_flash_erase_partition( partition_label );
+	pthread_mutex_unlock( &_lock );
+	return err;
+}
+
+esp_err_t nvs_open_from_partition( const char *part_name, const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle )
+{
+	esp_err_t err;
+
+	pthread_mutex_lock( &_lock );
+	err = emu_open_from_partition( part_name, name, open_mode, out_handle );
+	pthread_mutex_unlock( &_lock );
+	return err;
+}
+
+void nvs_close( nvs_handle_t handle )
+{
+	pthread_mutex_lock( &_lock );
+	emu_close( handle );
+	pthread_mutex_unlock( &_lock );
+}
+
+esp_err_t nvs_commit( nvs_handle_t handle )
+{
+	esp_err_t err;
+
+	pthread_mutex_lock( &_lock );
+	err = emu_commit( handle );
+	pthread_mutex_unlock( &_lock );
+	return err;
+}
+
+esp_err_t nvs_erase_key( nvs_handle_t handle, const char *key )
+{
+	esp_err_t err;
+
+	pthread_mutex_lock( &_lock );
+	err = emu_erase_key( handle, key );
+	pthread_mutex_unlock( &_lock );
+	return err;
+}
+
+esp_err_t nvs_erase_all( nvs_handle_t handle )
+{
+	esp_err_t err;
+
+	pthread_mutex_lock( &_lock );
+	err = emu_erase_all( handle );
+	pthread_mutex_unlock( &_lock );
+	return err;
+}
+
+#define	NVS_EMU_SCALAR( name, type, nvsType )																\
+	esp_err_t nvs_set_##name( nvs_handle_t handle, const char *key, type value )							\
+	{																										\
+		return set_value( handle, key, nvsType, &value, sizeof( type ) );									\
+	}																										\
+	esp_err_t nvs_get_##name( nvs_handle_t handle, const char *key, type *out_value )						\
+	{																										\
+		return get_value( handle, key, nvsType, out_value, NULL );											\
+	}
+
+NVS_EMU_SCALAR( i8, int8_t, NVS_TYPE_I8 )
+NVS_EMU_SCALAR( u8, uint8_t, NVS_TYPE_U8 )
+NVS_EMU_SCALAR( i16, int16_t, NVS_TYPE_I16 )
+NVS_EMU_SCALAR( u16, uint16_t, NVS_TYPE_U16 )
+NVS_EMU_SCALAR( i32, int32_t, NVS_TYPE_I32 )
+NVS_EMU_SCALAR( u32, uint32_t, NVS_TYPE_U32 )
+NVS_EMU_SCALAR( i64, int64_t, NVS_TYPE_I64 )
+NVS_EMU_SCALAR( u64, uint64_t, NVS_TYPE_U64 )
+
+esp_err_t nvs_set_str( nvs_handle_t handle, const char *key, const char *value )
+{
+	if( NULL == value )
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	return set_value( handle, key, NVS_TYPE_STR, value, strlen( value ) + 1 );
+}
+
+esp_err_t nvs_set_blob( nvs_handle_t handle, const char *key, const void *value, size_t length )
+{
+	if( ( NULL == value ) && ( 0 < length ) )
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+	return set_value( handle, key, NVS_TYPE_BLOB, value, length );
+}
+
+esp_err_t nvs_get_str( nvs_handle_t handle, const char *key, char *out_value, size_t *length )
+{
+	return get_value( handle, key, NVS_TYPE_STR, out_value, length );
+}
+
+esp_err_t nvs_get_blob( nvs_handle_t handle, const char *key, void *out_value, size_t *length )
+{
+	return get_value( handle, key, NVS_TYPE_BLOB, out_value, length );
+}
+
+/* ************************************************************************* */
+/* **********               E M U L A T O R   C O N T R O L       ********** */
+/* ************************************************************************* */
+
+/**
+ * @brief	Erase all partitions, close all handles, clear power-fail state and statistics
+ */
+void nvsEmu_reset( void )
+{
+	for( int i = 0; i < NVS_EMU_MAX_PARTITIONS; ++i )
+	{
+		partition_t *pPartition = &_partitions[ i ];
+
+		while( NULL != pPartition->items )
+		{
+			remove_item( pPartition, pPartition->items );
+		}
+		free( pPartition->pages );
+		memset( pPartition, 0, sizeof( *pPartition ) );
+	}
+	memset( _handles, 0, sizeof( _handles ) );
+
+	_powerFailCountdown = -1;
+	_powerFailed = false;
+	_writeCount = 0;
+}
+
+/**
+ * @brief	Set the number of flash pages of a partition
+ *
+ * Must be called before the partition holds any values.
+ *
+ * @param[in]	label	Partition label
+ * @param[in]	nPages	Number of 4 KB pages, minimum 2
+ */
+void nvsEmu_configurePartition( const char *label, uint16_t nPages )
+{
+	partition_t *pPartition = find_partition( label, true );
+
+	if( ( NULL != pPartition ) && ( NULL == pPartition->items ) && ( 2 <= nPages ) )
+	{
+		free( pPartition->pages );
+		pPartition->nPages = nPages;
+		pPartition->pages = calloc( nPages, sizeof( page_t ) );
+		pPartition->activePage = 0;
+	}
+}
+
+/**
+ * @brief	Get partition statistics
+ *
+ * @return	false if partition does not exist
+ */
+bool nvsEmu_getStats( const char *label, nvsEmu_stats_t *pStats )
+{
+	partition_t *pPartition = find_partition( label, false );
+
+	if( NULL == pPartition )
+	{
+		return false;
+	}
+	*pStats = pPartition->stats;
+
+	return true;
+}
+
+/**
+ * @brief	Clear statistics of all partitions, live entry counts are retained
+ */
+void nvsEmu_clearStats( void )
+{
+	for( int i = 0; i < NVS_EMU_MAX_PARTITIONS; ++i )
+	{
+		uint32_t liveEntries = _partitions[ i ].stats.liveEntries;
+
+		memset( &_partitions[ i ].stats, 0, sizeof( nvsEmu_stats_t ) );
+		_partitions[ i ].stats.liveEntries = liveEntries;
+	}
+	_writeCount = 0;
+}
+
+/**
+ * @brief	Inject a power failure
+ *
+ * @param[in]	writes	Number of flash writes allowed before power fails, -1 to disable
+ */
+void nvsEmu_setPowerFail( int32_t writes )
+{
+	_powerFailCountdown = writes;
+}
+
+/**
+ * @brief	Check if an injected power failure has occurred
+ */
+bool nvsEmu_isPowerFailed( void )
+{
+	return _powerFailed;
+}
+
+/**
+ * @brief	Number of flash writes (sets and erases) since reset, or statistics cleared
+ */
+uint32_t nvsEmu_writeCount( void )
+{
+	return _writeCount;
+}
+
+/**
+ * @brief	Restore power, as after a reset
+ *
+ * Stored values are retained; all handles are closed and partitions must be initialized again.
+ * Power-fail injection is disabled.
+ */
+void nvsEmu_powerCycle( void )
+{
+	memset( _handles, 0, sizeof( _handles ) );
+
+	for( int i = 0; i < NVS_EMU_MAX_PARTITIONS; ++i )
+	{
+		_partitions[ i ].initialized = false;
+	}
+
+	_powerFailCountdown = -1;
+	_powerFailed = false;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file	nvs_emulator.h
+ *
+ * Host build: in-memory emulation of ESP-IDF NVS, with a flash wear model and
+ * injected power-fail points.
+ */
+
+#ifndef	NVS_EMULATOR_H
+#define	NVS_EMULATOR_H
+
+#include	<stdint.h>
+#include	<stdbool.h>
+
+#define	NVS_EMU_ENTRY_SIZE			32			/**< Bytes per NVS entry */
+#define	NVS_EMU_ENTRIES_PER_PAGE	126			/**< Entries per 4 KB flash page */
+#define	NVS_EMU_DEFAULT_PAGES		64			/**< Pages in a partition that has not been configured */
+
+/**
+ * @brief	Emulator statistics, per partition
+ */
+typedef struct
+{
+	uint32_t	setCalls;						/**< nvs_set_* calls that wrote to flash */
+	uint32_t	eraseCalls;						/**< nvs_erase_key/nvs_erase_all calls */
+	uint32_t	commits;						/**< nvs_commit calls */
+	uint32_t	opens;							/**< nvs_open_from_partition calls */
+	uint32_t	payloadBytes;					/**< Value bytes passed to nvs_set_* */
+	uint32_t	entriesWritten;					/**< Entries written to flash, including garbage collection */
+	uint32_t	entriesRelocated;				/**< Entries moved by garbage collection */
+	uint32_t	pageErases;						/**< Flash page erase cycles */
+	uint32_t	maxPageEraseCount;				/**< Highest erase count of any single page */
+	uint32_t	liveEntries;					/**< Entries currently holding live values */
+} nvsEmu_stats_t;
+
+void nvsEmu_reset( void );
+
+void nvsEmu_configurePartition( const char *label, uint16_t nPages );
+
+bool nvsEmu_getStats( const char *label, nvsEmu_stats_t *pStats );
+
+void nvsEmu_clearStats( void );
+
+void nvsEmu_setPowerFail( int32_t writes );
+
+bool nvsEmu_isPowerFailed( void );
+
+uint32_t nvsEmu_writeCount( void );
+
+void nvsEmu_powerCycle( void );
+
+#endif		/* NVS_EMULATOR_H */
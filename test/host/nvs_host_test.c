@@ -0,0 +1,380 @@
+/**
+ * @file	nvs_host_test.c
+ *
+ * Host tests for nvs_utility, run against the NVS emulator
+ */
+
+#include	<string.h>
+#include	<pthread.h>
+#include	"FreeRTOS.h"
+#include	"nvs_utility.h"
+#include	"nvs_emulator.h"
+#include	"host_log.h"
+#include	"host_test.h"
+
+uint32_t hostTest_failures = 0;
+
+#define	HANDLE_READERS		2							/**< Readers sharing a cached handle */
+#define	HANDLE_ERASES		50000						/**< Erases, each invalidating the readers' handle */
+
+static volatile bool _readersStop;
+static volatile uint32_t _readerErrors;
+
+/**
+ * @brief	Emulator statistics for the partition holding the test items
+ */
+static nvsEmu_stats_t pdata_stats( void )
+{
+	nvsEmu_stats_t stats = { 0 };
+
+	nvsEmu_getStats( "pdata", &stats );
+	return stats;
+}
+
+/**
+ * @brief	Simulate a reset: NVS module state is lost, stored values are retained
+ */
+static void power_cycle( void )
+{
+	NVS_Deinitialize();
+	nvsEmu_powerCycle();
+	HOST_CHECK( ESP_OK == NVS_Initialize( nvsItem_getPAL() ) );
+}
+
+static void test_scalars( void )
+{
+	uint8_t u8 = 0xA5, u8Out = 0;
+	int16_t i16 = -1234, i16Out = 0;
+	uint32_t u32 = 0xDEADBEEF, u32Out = 0;
+	int64_t i64 = -1234567890123LL, i64Out = 0;
+
+	HOST_CHECK( ESP_OK != NVS_Get( NVS_U8_TEST, &u8Out, NULL ) );
+
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_U8_TEST, &u8, NULL ) );
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_I16_TEST, &i16, NULL ) );
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_U32_TEST, &u32, NULL ) );
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_I64_TEST, &i64, NULL ) );
+
+	HOST_CHECK( ( ESP_OK == NVS_Get( NVS_U8_TEST, &u8Out, NULL ) ) && ( u8 == u8Out ) );
+	HOST_CHECK( ( ESP_OK == NVS_Get( NVS_I16_TEST, &i16Out, NULL ) ) && ( i16 == i16Out ) );
+	HOST_CHECK( ( ESP_OK == NVS_Get( NVS_U32_TEST, &u32Out, NULL ) ) && ( u32 == u32Out ) );
+	HOST_CHECK( ( ESP_OK == NVS_Get( NVS_I64_TEST, &i64Out, NULL ) ) && ( i64 == i64Out ) );
+
+	HOST_CHECK( ESP_OK == NVS_EraseKey( NVS_U8_TEST ) );
+	HOST_CHECK( ESP_OK != NVS_Get( NVS_U8_TEST, &u8Out, NULL ) );
+}
+
+static void test_strings_and_blobs( void )
+{
+	const char input[] = "drinkworks";
+	char output[ 32 ] = { 0 };
+	uint8_t blob[ 100 ];
+	uint8_t blobOut[ 100 ];
+	size_t size;
+	uint32_t sizeOf = 0;
+
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_STR_TEST, ( void * ) input, NULL ) );
+	size = sizeof( output );
+	HOST_CHECK( ( ESP_OK == NVS_Get( NVS_STR_TEST, output, &size ) ) && ( sizeof( input ) == size ) );
+	HOST_CHECK( 0 == strcmp( input, output ) );
+	HOST_CHECK( ( ESP_OK == NVS_Get_Size_Of( NVS_STR_TEST, &sizeOf ) ) && ( sizeof( input ) == sizeOf ) );
+
+	for( int i = 0; i < sizeof( blob ); ++i )
+	{
+		blob[ i ] = ( uint8_t ) i;
+	}
+	size = sizeof( blob );
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_BLOB_TEST, blob, &size ) );
+	HOST_CHECK( ESP_OK != NVS_Set( NVS_BLOB_TEST, blob, NULL ) );
+
+	size = sizeof( blobOut );
+	HOST_CHECK( ( ESP_OK == NVS_Get( NVS_BLOB_TEST, blobOut, &size ) ) && ( sizeof( blob ) == size ) );
+	HOST_CHECK( 0 == memcmp( blob, blobOut, sizeof( blob ) ) );
+
+	/* Shorter blob replaces longer */
+	size = 10;
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_BLOB_TEST, &blob[ 50 ], &size ) );
+	size = sizeof( blobOut );
+	HOST_CHECK( ( ESP_OK == NVS_Get( NVS_BLOB_TEST, blobOut, &size ) ) && ( 10 == size ) && ( 50 == blobOut[ 0 ] ) );
+	HOST_CHECK( ( ESP_OK == NVS_Get_Size_Of( NVS_BLOB_TEST, &sizeOf ) ) && ( 10 == sizeOf ) );
+}
+
+/**
+ * @brief	Unchanged values are not written, and the compare only allocates for large values
+ */
+static void test_skip_unchanged( void )
+{
+	uint32_t u32 = 42;
+	uint8_t blob[ 64 ] = { 1, 2, 3 };
+	static uint8_t large[ 1200 ];
+	size_t size = sizeof( blob );
+	nvsEmu_stats_t before;
+	uint32_t allocs;
+
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_U32_TEST, &u32, NULL ) );
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_BLOB_TEST, blob, &size ) );
+
+	before = pdata_stats();
+	allocs = hostHeap_allocCount();
+
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_U32_TEST, &u32, NULL ) );
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_BLOB_TEST, blob, &size ) );
+
+	HOST_CHECK( before.setCalls == pdata_stats().setCalls );
+	HOST_CHECK( allocs == hostHeap_allocCount() );
+
+	/* Changed value is written */
+	blob[ 63 ] = 0xFF;
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_BLOB_TEST, blob, &size ) );
+	HOST_CHECK( ( before.setCalls + 1 ) == pdata_stats().setCalls );
+
+	/* Values larger than the compare buffer, such as certificates, are compared through a temporary allocation */
+	size = sizeof( large );
+	memset( large, 0x5A, size );
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_BLOB_TEST, large, &size ) );
+	before = pdata_stats();
+	allocs = hostHeap_allocCount();
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_BLOB_TEST, large, &size ) );
+	HOST_CHECK( before.setCalls == pdata_stats().setCalls );
+	HOST_CHECK( ( allocs + 1 ) == hostHeap_allocCount() );
+
+	large[ sizeof( large ) - 1 ] = 0xA5;
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_BLOB_TEST, large, &size ) );
+	HOST_CHECK( ( before.setCalls + 1 ) == pdata_stats().setCalls );
+}
+
+/**
+ * @brief	Statistics count writes issued and skipped, per key
+ */
+static void test_statistics( void )
+{
+	NVS_KeyStats_t keyStats;
+	NVS_Stats_t partStats;
+	char value[] = "stats1";
+	bool bFound = false;
+
+	NVS_ResetStats();
+
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_STR_TEST, value, NULL ) );
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_STR_TEST, value, NULL ) );
+	value[ 5 ] = '2';
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_STR_TEST, value, NULL ) );
+
+	for( uint16_t i = 0; i < NVS_GetKeyStatsCount(); ++i )
+	{
+		HOST_CHECK( ESP_OK == NVS_GetKeyStats( i, &keyStats ) );
+		if( 0 == strcmp( keyStats.nvsKey, "TestStr" ) )
+		{
+			bFound = true;
+			HOST_CHECK( 2 == keyStats.stats.writes );
+			HOST_CHECK( 1 == keyStats.stats.writesSkipped );
+			HOST_CHECK( ( 2 * sizeof( value ) ) == keyStats.stats.bytesWritten );
+		}
+	}
+	HOST_CHECK( bFound );
+
+	HOST_CHECK( ESP_OK == NVS_GetPartitionStats( NVS_PART_PDATA, &partStats ) );
+	HOST_CHECK( 2 == partStats.writes );
+	HOST_CHECK( ESP_OK != NVS_GetKeyStats( NVS_GetKeyStatsCount(), &keyStats ) );
+}
+
+/**
+ * @brief	Namespace handles are reused, not re-opened
+ */
+static void test_handle_cache( void )
+{
+	uint32_t u32 = 0;
+	uint32_t opens;
+
+	HOST_CHECK( ESP_OK == NVS_Get( NVS_U32_TEST, &u32, NULL ) );
+	opens = pdata_stats().opens;
+
+	for( int i = 0; i < 100; ++i )
+	{
+		u32 = i;
+		HOST_CHECK( ESP_OK == NVS_Set( NVS_U32_TEST, &u32, NULL ) );
+		HOST_CHECK( ESP_OK == NVS_Get( NVS_U32_TEST, &u32, NULL ) );
+	}
+
+	/* At most one additional open, for the read/write handle */
+	HOST_CHECK( ( opens + 1 ) >= pdata_stats().opens );
+
+	/* Erase invalidates namespace handles */
+	HOST_CHECK( ESP_OK == NVS_EraseKey( NVS_U32_TEST ) );
+	HOST_CHECK( ESP_OK != NVS_Get( NVS_U32_TEST, &u32, NULL ) );
+}
+
+/**
+ * @brief	Reader sharing a cached namespace handle with other readers
+ */
+static void * handle_reader( void *arg )
+{
+	uint32_t u32;
+
+	while( !_readersStop )
+	{
+		if( ( ESP_OK != NVS_Get( NVS_U32_TEST, &u32, NULL ) ) || ( 1234 != u32 ) )
+		{
+			__atomic_add_fetch( &_readerErrors, 1, __ATOMIC_SEQ_CST );
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief	A handle invalidated while shared stays open until its last user releases it
+ */
+static void test_handle_invalidate( void )
+{
+	pthread_t readers[ HANDLE_READERS ];
+	uint32_t u32 = 1234;
+	uint8_t u8 = 1;
+	int i;
+
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_U32_TEST, &u32, NULL ) );
+
+	_readersStop = false;
+	_readerErrors = 0;
+	for( i = 0; i < HANDLE_READERS; ++i )
+	{
+		HOST_CHECK( 0 == pthread_create( &readers[ i ], NULL, handle_reader, NULL ) );
+	}
+
+	for( i = 0; i < HANDLE_ERASES; ++i )
+	{
+		HOST_CHECK( ESP_OK == NVS_Set( NVS_U8_TEST, &u8, NULL ) );
+		HOST_CHECK( ESP_OK == NVS_EraseKey( NVS_U8_TEST ) );
+	}
+
+	_readersStop = true;
+	for( i = 0; i < HANDLE_READERS; ++i )
+	{
+		pthread_join( readers[ i ], NULL );
+	}
+
+	HOST_CHECK( 0 == _readerErrors );
+}
+
+/**
+ * @brief	An item that is normally absent, or may not fit, is looked up without logging an error
+ */
+static void test_optional_item( void )
+{
+	const NVS_Entry_Details_t absentNamespace = { .type = NVS_TYPE_BLOB, .partition = NVS_PART_PDATA, .namespace = "Absent", .nvsKey = "Journal" };
+	const NVS_Entry_Details_t absentKey = { .type = NVS_TYPE_BLOB, .partition = NVS_PART_PDATA, .namespace = "Optional", .nvsKey = "Journal" };
+	const NVS_Entry_Details_t present = { .type = NVS_TYPE_BLOB, .partition = NVS_PART_PDATA, .namespace = "Optional", .nvsKey = "Present" };
+	uint8_t blob[ 4 ] = { 1, 2, 3, 4 };
+	uint8_t out[ 4 ] = { 0 };
+	size_t size = sizeof( blob );
+	uint32_t errors;
+
+	HOST_CHECK( ESP_OK == NVS_pSet( &present, blob, &size ) );
+
+	errors = hostLog_errors();
+	size = sizeof( out );
+	HOST_CHECK( ESP_ERR_NVS_NOT_FOUND == NVS_pGetIfPresent( &absentNamespace, out, &size ) );
+	size = sizeof( out );
+	HOST_CHECK( ESP_ERR_NVS_NOT_FOUND == NVS_pGetIfPresent( &absentKey, out, &size ) );
+	HOST_CHECK( errors == hostLog_errors() );
+
+	size = sizeof( out );
+	HOST_CHECK( ( ESP_OK == NVS_pGetIfPresent( &present, out, &size ) ) && ( sizeof( blob ) == size ) && ( 0 == memcmp( blob, out, size ) ) );
+
+	/* A value larger than the buffer is not logged, when it may not fit */
+	size = 2;
+	HOST_CHECK( ESP_ERR_NVS_INVALID_LENGTH == NVS_pGetIfFits( &present, out, &size ) );
+	HOST_CHECK( errors == hostLog_errors() );
+
+	/* A required item is still reported */
+	size = sizeof( out );
+	HOST_CHECK( ESP_ERR_NVS_NOT_FOUND == NVS_pGet( &absentKey, out, &size ) );
+	HOST_CHECK( errors < hostLog_errors() );
+}
+
+/**
+ * @brief	A transaction commits each namespace once
+ */
+static void test_transaction( void )
+{
+	uint8_t u8 = 1;
+	int8_t i8 = -1;
+	uint16_t u16 = 1000;
+	uint32_t commits = pdata_stats().commits;
+
+	HOST_CHECK( ESP_OK == NVS_BeginTxn() );
+	HOST_CHECK( ESP_OK == NVS_BeginTxn() );					/* nested */
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_U8_TEST, &u8, NULL ) );
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_I8_TEST, &i8, NULL ) );
+	HOST_CHECK( ESP_OK == NVS_Commit() );
+	HOST_CHECK( commits == pdata_stats().commits );
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_U16_TEST, &u16, NULL ) );
+	HOST_CHECK( ESP_OK == NVS_Commit() );
+	HOST_CHECK( ( commits + 1 ) == pdata_stats().commits );
+
+	HOST_CHECK( ESP_FAIL == NVS_Commit() );
+}
+
+/**
+ * @brief	Values written before a power failure survive it
+ */
+static void test_power_fail( void )
+{
+	uint32_t u32 = 1, u32Out = 0;
+
+	HOST_CHECK( ESP_OK == NVS_Set( NVS_U32_TEST, &u32, NULL ) );
+
+	nvsEmu_setPowerFail( 0 );
+	u32 = 2;
+	HOST_CHECK( ESP_OK != NVS_Set( NVS_U32_TEST, &u32, NULL ) );
+	HOST_CHECK( nvsEmu_isPowerFailed() );
+
+	power_cycle();
+
+	HOST_CHECK( ( ESP_OK == NVS_Get( NVS_U32_TEST, &u32Out, NULL ) ) && ( 1 == u32Out ) );
+}
+
+/**
+ * @brief	Garbage collection recycles pages, wear is recorded
+ */
+static void test_wear( void )
+{
+	uint8_t blob[ 200 ];
+	size_t size = sizeof( blob );
+	nvsEmu_stats_t stats;
+
+	for( int i = 0; i < 2000; ++i )
+	{
+		memset( blob, i, sizeof( blob ) );
+		HOST_CHECK( ESP_OK == NVS_Set( NVS_BLOB_TEST, blob, &size ) );
+	}
+
+	stats = pdata_stats();
+	HOST_CHECK( 0 < stats.pageErases );
+	HOST_CHECK( stats.entriesWritten >= ( 2000 * 8 ) );
+	printf( "wear: %u sets, %u entries written, %u page erases, max page erase count %u\n",
+			stats.setCalls, stats.entriesWritten, stats.pageErases, stats.maxPageEraseCount );
+}
+
+int main( void )
+{
+	nvsEmu_reset();
+	nvsEmu_configurePartition( "pdata", 16 );
+
+	HOST_CHECK( ESP_OK == NVS_Initialize( nvsItem_getPAL() ) );
+
+	test_scalars();
+	test_strings_and_blobs();
+	test_skip_unchanged();
+	test_statistics();
+	test_handle_cache();
+	test_handle_invalidate();
+	test_optional_item();
+	test_transaction();
+	test_power_fail();
+	test_wear();
+
+	NVS_Deinitialize();
+
+	return HOST_TEST_RESULT( "nvs_host_test" );
+}
@@ -0,0 +1,1397 @@
+/**
+ * @file	shci_loopback.c
+ *
+ * Host test and benchmark for SHCI, over the socket pair UART of uart_host.c.
+ *
+ * shci.c runs unchanged, on its own task, with handlers for the BLE command set of
+ * test/dw_test_shci.c, reimplemented here without the BLE stack.  The test program is
+ * Host: it frames commands with SYNC-A (checksum) or SYNC-B (CRC16), and checks every
+ * response frame.  After the functional checks it reports:
+ *	- stop-and-wait round trip latency percentiles
+ *	- pipelined frames per second, for both framings, and bulk command throughput
+ *	- frames lost to each kind of corruption: each corrupted frame is followed by valid
+ *	  frames, and a marker command; valid frames not answered before the marker are lost
+ * It then negotiates a baud rate, and checks fallback when Host does not follow or confirm, runs
+ * a windowed transfer with a negative and a missing acknowledgment, and moves EE blocks
+ * of several kilobytes as fragmented messages, reporting their throughput.
+ *
+ * The link is not paced, so rates measure SHCI and the host scheduler, not the UART.
+ */
+
+#include	<string.h>
+#include	<time.h>
+#include	<poll.h>
+#include	<pthread.h>
+#include	<sched.h>
+#include	<unistd.h>
+#include	"FreeRTOS.h"
+#include	"freertos/task.h"
+#include	"driver/uart.h"
+#include	"esp_err.h"
+#include	"crc16_ccitt.h"
+#include	"shci.h"
+#include	"shci_internal.h"
+#include	"shci_window.h"
+#include	"shci_fragment.h"
+#include	"host_test.h"
+
+#define	LOOPBACK_UART			( 1 )
+#define	LOOPBACK_TIMEOUT_MS		( 1000 )			/**< Wait for an expected response */
+#define	LOOPBACK_LOST_MS		( 100 )				/**< Wait for a response that may be lost, several inter-byte timeouts */
+#define	LOOPBACK_GUARD_MS		( 20 )				/**< Host pause after a baud rate change */
+#define	LOOPBACK_RTT_FRAMES		( 2000 )
+#define	LOOPBACK_PIPE_FRAMES	( 20000 )
+#define	LOOPBACK_PIPE_DEPTH		( 16 )				/**< Commands outstanding, pipelined */
+#define	LOOPBACK_PIPE_BYTES		( BUF_SIZE )		/**< Bytes outstanding, pipelined; the link has no flow control */
+#define	LOOPBACK_BULK_FRAMES	( 5000 )
+#define	LOOPBACK_BULK_PAYLOAD	( 250 )
+#define	LOOPBACK_TRIALS			( 40 )				/**< Trials per kind of corruption */
+#define	LOOPBACK_FOLLOWERS		( 4 )				/**< Valid frames after each corrupted frame */
+#define	LOOPBACK_STANDBY		( 0x03 )			/**< BLE status: standby mode */
+#define	LOOPBACK_CHAR_HANDLES	( 4 )
+#define	LOOPBACK_WINDOW_FRAMES	( 8 )
+#define	LOOPBACK_WINDOW_ACKS	( 500 )				/**< Acknowledgments sent while windows are created and deleted */
+#define	LOOPBACK_FRAGMENT_PAYLOAD	( SHCI_MAX_LENGTH - SHCI_FRAGMENT_HEADER )	/**< Largest command fragment payload */
+#define	LOOPBACK_EE_BLOCK		( 6000 )			/**< EE block size, bytes */
+#define	LOOPBACK_EE_TRANSFERS	( 200 )				/**< Save and restore round trips, benchmark */
+
+uint32_t hostTest_failures = 0;
+
+/**
+ * @brief	Response frame received by Host
+ */
+typedef struct
+{
+	uint8_t		sync;
+	uint16_t	length;
+	uint8_t		data[ SHCI_MAX_RESPONSE_FRAME ];
+} peerFrame_t;
+
+/**
+ * @brief	Kinds of corruption, applied to a SYNC-B eReadLocalInformation frame
+ */
+typedef enum
+{
+	eCorruptPayload,
+	eCorruptCrc,
+	eCorruptSync,
+	eCorruptLengthHigh,
+	eCorruptLengthLow,
+	eCorruptDrop,
+	eCorruptInsert,
+	eCorruptEnd
+} corruption_t;
+
+static const char * const _corruptionNames[ eCorruptEnd ] =
+{
+	[ eCorruptPayload ]		= "payload byte",
+	[ eCorruptCrc ]			= "CRC byte",
+	[ eCorruptSync ]		= "sync byte",
+	[ eCorruptLengthHigh ]	= "length MSB",
+	[ eCorruptLengthLow ]	= "length LSB",
+	[ eCorruptDrop ]		= "byte dropped",
+	[ eCorruptInsert ]		= "byte inserted",
+};
+
+static int		_fd;
+static uint8_t	_rx[ 8192 ];								/**< Host receive accumulator */
+static size_t	_rxLength;
+static uint32_t	_peerErrors;								/**< Response frames failing checksum/CRC */
+static uint32_t	_seed = 1;
+
+/* ************************************************************************* */
+/* ESP: command set of test/dw_test_shci.c                                   */
+/* ************************************************************************* */
+
+static const uint8_t deviceInfoResponse[] = { 0x80, 0x01, 0x00, 0x01, 0x11, 0x01, 0x01, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x01 };
+static const uint8_t deviceNameResponse[] = { 0x80, 0x07, 0x00, 'E', 'S', 'P', '3', '2', '-', 'W', 'r', 'o', 'v', 'e', 'r' };
+static const uint8_t bondTableResponse[] = { 0x80, 0x0C, 0x00, 0x00 };
+static const uint8_t statusResponse[] = { eStatusReport, LOOPBACK_STANDBY };
+
+static uint8_t	_charValues[ LOOPBACK_CHAR_HANDLES ][ MAX_READ_CHAR_BUFF_SIZE ];
+static uint16_t	_charLengths[ LOOPBACK_CHAR_HANDLES ];
+static volatile uint32_t _statusSubscriberCalls;
+static uint8_t	_eeBlock[ SHCI_FRAGMENT_MAX_MESSAGE ];
+static uint16_t	_eeBlockLength;
+static volatile uint32_t _eeAuditBytes;					/**< Block size seen by deferred subscriber to eEEBlockSave */
+static volatile uint32_t _eeAuditSum;
+static volatile uint32_t _handlerStallMs;					/**< eWriteDeviceName handler delay */
+
+static void vReadDeviceName( const uint8_t *pData, const uint16_t size )
+{
+	if( 0 == size )
+	{
+		shci_PostResponse( deviceNameResponse, sizeof( deviceNameResponse ) );
+	}
+	else
+	{
+		shci_postCommandComplete( eReadDeviceName, eInvalidCommandParameters );
+	}
+}
+
+static void vWriteDeviceName( const uint8_t *pData, const uint16_t size )
+{
+	if( 0 != _handlerStallMs )
+	{
+		/* A slow inline handler holds up the SHCI task: in real time, while Host sends, and in host ticks */
+		usleep( _handlerStallMs * 1000 );
+		vTaskDelay( pdMS_TO_TICKS( _handlerStallMs ) );
+	}
+	shci_postCommandComplete( eWriteDeviceName, ( size >= 2 ) ? eCommandSucceeded : eInvalidCommandParameters );
+}
+
+static void vReadLocalInformation( const uint8_t *pData, const uint16_t size )
+{
+	if( 0 == size )
+	{
+		shci_PostResponse( deviceInfoResponse, sizeof( deviceInfoResponse ) );
+	}
+	else
+	{
+		shci_postCommandComplete( eReadLocalInformation, eInvalidCommandParameters );
+	}
+}
+
+static void vReadStatus( const uint8_t *pData, const uint16_t size )
+{
+	if( 0 == size )
+	{
+		shci_PostResponse( statusResponse, sizeof( statusResponse ) );
+	}
+	else
+	{
+		shci_postCommandComplete( eReadStatus, eInvalidCommandParameters );
+	}
+}
+
+static void vReadAllPairedDeviceInformation( const uint8_t *pData, const uint16_t size )
+{
+	if( 0 == size )
+	{
+		shci_PostResponse( bondTableResponse, sizeof( bondTableResponse ) );
+	}
+	else
+	{
+		shci_postCommandComplete( eReadAllPairedDeviceInformation, eInvalidCommandParameters );
+	}
+}
+
+static void vWriteScanResponseData( const uint8_t *pData, const uint16_t size )
+{
+	shci_postCommandComplete( eWriteScanResponseData, eCommandSucceeded );
+}
+
+static void vConnectionParameterUpdateRequest( const uint8_t *pData, const uint16_t size )
+{
+	shci_postCommandComplete( eConnectionParameterUpdateRequest, ( 8 == size ) ? eCommandSucceeded : eInvalidCommandParameters );
+}
+
+static void vSetAdvertisingEnable( const uint8_t *pData, const uint16_t size )
+{
+	shci_postCommandComplete( eSetAdvertisingEnable, ( 1 == size ) ? eCommandSucceeded : eInvalidCommandParameters );
+	shci_PostResponse( statusResponse, sizeof( statusResponse ) );
+}
+
+static void vSendCharacteristicValue( const uint8_t *pData, const uint16_t size )
+{
+	shci_postCommandComplete( eSendCharacteristicValue, ( size >= 4 ) ? eCommandSucceeded : eInvalidCommandParameters );
+}
+
+/**
+ * @brief	<HANDLE-H><HANDLE-L><VALUE ...>, stores value of a local characteristic
+ */
+static void vUpdateCharacteristicValue( const uint8_t *pData, const uint16_t size )
+{
+	uint16_t handle = ( size >= 2 ) ? ( ( pData[ 0 ] << 8 ) | pData[ 1 ] ) : 0xFFFF;
+
+	if( ( size < 3 ) || ( size > ( 2 + MAX_READ_CHAR_BUFF_SIZE ) ) )
+	{
+		shci_postCommandComplete( eUpdateCharacteristicValue, eInvalidCommandParameters );
+	}
+	else if( handle >= LOOPBACK_CHAR_HANDLES )
+	{
+		shci_postCommandComplete( eUpdateCharacteristicValue, eInvalidHandle );
+	}
+	else
+	{
+		memcpy( _charValues[ handle ], &pData[ 2 ], size - 2 );
+		_charLengths[ handle ] = size - 2;
+		shci_postCommandComplete( eUpdateCharacteristicValue, eCommandSucceeded );
+	}
+}
+
+/**
+ * @brief	<HANDLE-H><HANDLE-L>, subscribed deferred, runs on the SHCI worker task
+ */
+static void vReadLocalCharacteristicValue( const uint8_t *pData, const uint16_t size )
+{
+	uint8_t response[ 3 + MAX_READ_CHAR_BUFF_SIZE ] = { eCommandComplete, eReadLocalCharacteristicValue, eCommandSucceeded };
+	uint16_t handle = ( 2 == size ) ? ( ( pData[ 0 ] << 8 ) | pData[ 1 ] ) : 0xFFFF;
+
+	if( 2 != size )
+	{
+		shci_postCommandComplete( eReadLocalCharacteristicValue, eInvalidCommandParameters );
+	}
+	else if( ( handle >= LOOPBACK_CHAR_HANDLES ) || ( 0 == _charLengths[ handle ] ) )
+	{
+		shci_postCommandComplete( eReadLocalCharacteristicValue, eInvalidHandle );
+	}
+	else
+	{
+		memcpy( &response[ 3 ], _charValues[ handle ], _charLengths[ handle ] );
+		shci_PostResponse( response, 3 + _charLengths[ handle ] );
+	}
+}
+
+/**
+ * @brief	Second subscriber to eReadStatus, posts nothing
+ */
+static void vStatusSubscriber( const uint8_t *pData, const uint16_t size )
+{
+	_statusSubscriberCalls++;
+}
+
+/**
+ * @brief	<BLOCK ...>, stores a block of any size, received fragmented
+ */
+static void vEEBlockSave( const uint8_t *pData, const uint16_t size )
+{
+	memcpy( _eeBlock, pData, size );
+	_eeBlockLength = size;
+	shci_postCommandComplete( eEEBlockSave, eCommandSucceeded );
+}
+
+/**
+ * @brief	Second subscriber to eEEBlockSave, deferred, so it is given a heap copy of a large block
+ */
+static void vEEBlockAudit( const uint8_t *pData, const uint16_t size )
+{
+	uint32_t sum = 0;
+
+	for( uint16_t i = 0; i < size; ++i )
+	{
+		sum += pData[ i ];
+	}
+	_eeAuditSum = sum;
+	_eeAuditBytes = size;
+}
+
+/**
+ * @brief	Answers with the stored block, subscribed deferred as it posts a large response
+ */
+static void vEEBlockRestore( const uint8_t *pData, const uint16_t size )
+{
+	static uint8_t response[ SHCI_FRAGMENT_MAX_MESSAGE ];
+
+	response[ 0 ] = eEEBlockRestore;
+	memcpy( &response[ 1 ], _eeBlock, _eeBlockLength );
+	if( ESP_OK != shciFragment_post( response, 1 + _eeBlockLength, 1000 ) )
+	{
+		shci_postCommandComplete( eEEBlockRestore, eMemoryCapacityExceeded );
+	}
+}
+
+static void esp_init( void )
+{
+	shci_RegisterCommand( eReadDeviceName, &vReadDeviceName );
+	shci_RegisterCommand( eWriteDeviceName, &vWriteDeviceName );
+	shci_RegisterCommand( eReadLocalInformation, &vReadLocalInformation );
+	shci_RegisterCommand( eReadStatus, &vReadStatus );
+	shci_RegisterCommand( eReadAllPairedDeviceInformation, &vReadAllPairedDeviceInformation );
+	shci_RegisterCommand( eWriteScanResponseData, &vWriteScanResponseData );
+	shci_RegisterCommand( eConnectionParameterUpdateRequest, &vConnectionParameterUpdateRequest );
+	shci_RegisterCommand( eSetAdvertisingEnable, &vSetAdvertisingEnable );
+	shci_RegisterCommand( eSendCharacteristicValue, &vSendCharacteristicValue );
+	shci_RegisterCommand( eUpdateCharacteristicValue, &vUpdateCharacteristicValue );
+	HOST_CHECK( ESP_OK == shci_Subscribe( eReadLocalCharacteristicValue, &vReadLocalCharacteristicValue, eShciDeferred ) );
+	HOST_CHECK( ESP_OK == shci_Subscribe( eReadStatus, &vStatusSubscriber, eShciInline ) );
+	shci_RegisterCommand( eEEBlockSave, &vEEBlockSave );
+	HOST_CHECK( ESP_OK == shci_Subscribe( eEEBlockSave, &vEEBlockAudit, eShciDeferred ) );
+	HOST_CHECK( ESP_OK == shci_Subscribe( eEEBlockRestore, &vEEBlockRestore, eShciDeferred ) );
+}
+
+/* ************************************************************************* */
+/* Host                                                                      */
+/* ************************************************************************* */
+
+/**
+ * @brief	Deterministic pseudo-random number, so failures are reproducible
+ */
+static uint32_t loopback_rand( void )
+{
+	_seed = ( _seed * 1103515245 ) + 12345;
+	return ( _seed >> 16 ) & 0x7FFF;
+}
+
+static int64_t now_us( void )
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return ( ( int64_t ) now.tv_sec * 1000000 ) + ( now.tv_nsec / 1000 );
+}
+
+/**
+ * @brief	Frame a command, as Host does
+ *
+ * @return	frame length
+ */
+static size_t peer_frame( uint8_t *pFrame, uint8_t sync, const uint8_t *pPayload, uint16_t n )
+{
+	uint16_t crc;
+	uint8_t sum = 0;
+
+	pFrame[ 0 ] = sync;
+	pFrame[ 1 ] = ( uint8_t )( n >> 8 );
+	pFrame[ 2 ] = ( uint8_t )( n );
+	memcpy( &pFrame[ 3 ], pPayload, n );
+
+	if( SYNC_B_CHAR == sync )
+	{
+		crc = crc16_ccitt_compute( &pFrame[ 1 ], n + 2 );
+		pFrame[ n + 3 ] = ( uint8_t )( crc >> 8 );
+		pFrame[ n + 4 ] = ( uint8_t )( crc );
+		return n + 5;
+	}
+
+	for( uint16_t i = 1; i < ( n + 3 ); ++i )
+	{
+		sum += pFrame[ i ];
+	}
+	pFrame[ n + 3 ] = ( uint8_t )( 0 - sum );
+	return n + 4;
+}
+
+static void peer_write( const uint8_t *pData, size_t n )
+{
+	ssize_t written;
+
+	while( ( 0 < n ) && ( 0 < ( written = write( _fd, pData, n ) ) ) )
+	{
+		pData += written;
+		n -= written;
+	}
+}
+
+static void peer_send( uint8_t sync, const uint8_t *pPayload, uint16_t n )
+{
+	uint8_t frame[ SHCI_MAX_FRAME_SIZE ];
+
+	peer_write( frame, peer_frame( frame, sync, pPayload, n ) );
+}
+
+/**
+ * @brief	Take one valid frame from the accumulator, skipping bytes that do not start one
+ *
+ * @return	true if a frame was taken, false if more bytes are needed
+ */
+static bool peer_parse( peerFrame_t *pFrame )
+{
+	size_t skip = 0;
+	size_t total;
+	uint16_t length;
+	uint8_t sum;
+	bool valid;
+
+	while( ( _rxLength - skip ) >= 3 )
+	{
+		uint8_t *p = &_rx[ skip ];
+
+		if( ( SYNC_A_CHAR != p[ 0 ] ) && ( SYNC_B_CHAR != p[ 0 ] ) )
+		{
+			skip++;
+			continue;
+		}
+
+		length = ( p[ 1 ] << 8 ) | p[ 2 ];
+		total = 3 + length + ( ( SYNC_B_CHAR == p[ 0 ] ) ? 2 : 1 );
+		if( length > MAX_TX_RESPONSE )
+		{
+			_peerErrors++;
+			skip++;
+			continue;
+		}
+		if( ( _rxLength - skip ) < total )
+		{
+			break;
+		}
+
+		if( SYNC_B_CHAR == p[ 0 ] )
+		{
+			valid = ( 0 == crc16_ccitt_compute( &p[ 1 ], length + 4 ) );
+		}
+		else
+		{
+			sum = 0;
+			for( size_t i = 1; i < total; ++i )
+			{
+				sum += p[ i ];
+			}
+			valid = ( 0 == sum );
+		}
+
+		if( !valid )
+		{
+			_peerErrors++;
+			skip++;
+			continue;
+		}
+
+		pFrame->sync = p[ 0 ];
+		pFrame->length = length;
+		memcpy( pFrame->data, &p[ 3 ], length );
+		skip += total;
+		memmove( _rx, &_rx[ skip ], _rxLength - skip );
+		_rxLength -= skip;
+		return true;
+	}
+
+	memmove( _rx, &_rx[ skip ], _rxLength - skip );
+	_rxLength -= skip;
+	return false;
+}
+
+/**
+ * @brief	Receive one response frame
+ *
+ * @return	true if a frame was received within timeoutMs
+ */
+static bool peer_receive( peerFrame_t *pFrame, int timeoutMs )
+{
+	struct pollfd pfd = { .fd = _fd, .events = POLLIN };
+	int64_t deadline = now_us() + ( ( int64_t ) timeoutMs * 1000 );
+	int64_t remaining;
+	ssize_t n;
+
+	while( !peer_parse( pFrame ) )
+	{
+		remaining = deadline - now_us();
+		if( ( 0 >= remaining ) || ( 0 >= poll( &pfd, 1, ( int )( ( remaining + 999 ) / 1000 ) ) ) )
+		{
+			return false;
+		}
+		n = read( _fd, &_rx[ _rxLength ], sizeof( _rx ) - _rxLength );
+		if( 0 >= n )
+		{
+			return false;
+		}
+		_rxLength += n;
+	}
+	return true;
+}
+
+/**
+ * @brief	Discard everything received, once the link has been quiet for quietMs
+ */
+static void peer_drain( int quietMs )
+{
+	peerFrame_t frame;
+
+	while( peer_receive( &frame, quietMs ) )
+	{
+	}
+	_rxLength = 0;
+}
+
+/**
+ * @brief	Receive a response, and check it
+ */
+static bool peer_expect( const char *name, const uint8_t *pExpected, uint16_t n )
+{
+	peerFrame_t frame;
+	bool match;
+
+	if( !peer_receive( &frame, LOOPBACK_TIMEOUT_MS ) )
+	{
+		printf( "%s: no response\n", name );
+		hostTest_failures++;
+		return false;
+	}
+
+	match = ( frame.length == n ) && ( 0 == memcmp( frame.data, pExpected, n ) );
+	if( !match )
+	{
+		printf( "%s: unexpected response, %u bytes, %02X %02X %02X\n", name, frame.length, frame.data[ 0 ], frame.data[ 1 ], frame.data[ 2 ] );
+		hostTest_failures++;
+	}
+	return match;
+}
+
+static bool peer_expectComplete( const char *name, uint8_t opCode, uint8_t error )
+{
+	const uint8_t complete[] = { eCommandComplete, opCode, error };
+
+	return peer_expect( name, complete, sizeof( complete ) );
+}
+
+/**
+ * @brief	Wait for SHCI task to create its message buffer, and report communications initialized
+ */
+static void loopback_connect( void )
+{
+	const uint8_t initialized[] = { eCommunicationsInitialized };
+	peerFrame_t frame;
+	int tries;
+
+	for( tries = 0; tries < 100; ++tries )
+	{
+		shci_communicationsInitialized();
+		if( peer_receive( &frame, 10 ) )
+		{
+			break;
+		}
+	}
+	HOST_CHECK( ( 1 == frame.length ) && ( 0 == memcmp( frame.data, initialized, 1 ) ) );
+	HOST_CHECK( SYNC_A_CHAR == frame.sync );
+	peer_drain( 10 );
+}
+
+/* ************************************************************************* */
+/* Functional checks                                                         */
+/* ************************************************************************* */
+
+/**
+ * @brief	Every command of the set, with valid and invalid parameters
+ */
+static void test_commands( uint8_t sync )
+{
+	const uint8_t readName[] = { eReadDeviceName };
+	const uint8_t writeName[] = { eWriteDeviceName, 0x00, 'D', 'W' };
+	const uint8_t readInfo[] = { eReadLocalInformation };
+	const uint8_t readInfoBad[] = { eReadLocalInformation, 0x00 };
+	const uint8_t readStatus[] = { eReadStatus };
+	const uint8_t readBonds[] = { eReadAllPairedDeviceInformation };
+	const uint8_t scanResponse[] = { eWriteScanResponseData, 0x02, 0x01, 0x06 };
+	const uint8_t connParams[] = { eConnectionParameterUpdateRequest, 0x80, 0x00, 0x06, 0x00, 0x00, 0x00, 0x01, 0xF4 };
+	const uint8_t connParamsBad[] = { eConnectionParameterUpdateRequest, 0x80 };
+	const uint8_t advertise[] = { eSetAdvertisingEnable, 0x01 };
+	const uint8_t sendChar[] = { eSendCharacteristicValue, 0x80, 0x00, 0x80, 0x04, 0x55 };
+	const uint8_t updateChar[] = { eUpdateCharacteristicValue, 0x00, 0x02, 'd', 'r', 'i', 'n', 'k' };
+	const uint8_t readChar[] = { eReadLocalCharacteristicValue, 0x00, 0x02 };
+	const uint8_t readCharBad[] = { eReadLocalCharacteristicValue, 0x00, 0x03 };
+	const uint8_t charValue[] = { eCommandComplete, eReadLocalCharacteristicValue, eCommandSucceeded, 'd', 'r', 'i', 'n', 'k' };
+	uint32_t subscriberCalls = _statusSubscriberCalls;
+	peerFrame_t frame;
+
+	peer_send( sync, readName, sizeof( readName ) );
+	peer_expect( "eReadDeviceName", deviceNameResponse, sizeof( deviceNameResponse ) );
+
+	peer_send( sync, writeName, sizeof( writeName ) );
+	peer_expectComplete( "eWriteDeviceName", eWriteDeviceName, eCommandSucceeded );
+
+	peer_send( sync, readInfo, sizeof( readInfo ) );
+	peer_expect( "eReadLocalInformation", deviceInfoResponse, sizeof( deviceInfoResponse ) );
+
+	peer_send( sync, readInfoBad, sizeof( readInfoBad ) );
+	peer_expectComplete( "eReadLocalInformation, parameters", eReadLocalInformation, eInvalidCommandParameters );
+
+	peer_send( sync, readStatus, sizeof( readStatus ) );
+	peer_expect( "eReadStatus", statusResponse, sizeof( statusResponse ) );
+	HOST_CHECK( ( subscriberCalls + 1 ) == _statusSubscriberCalls );
+
+	peer_send( sync, readBonds, sizeof( readBonds ) );
+	peer_expect( "eReadAllPairedDeviceInformation", bondTableResponse, sizeof( bondTableResponse ) );
+
+	peer_send( sync, scanResponse, sizeof( scanResponse ) );
+	peer_expectComplete( "eWriteScanResponseData", eWriteScanResponseData, eCommandSucceeded );
+
+	peer_send( sync, connParams, sizeof( connParams ) );
+	peer_expectComplete( "eConnectionParameterUpdateRequest", eConnectionParameterUpdateRequest, eCommandSucceeded );
+
+	peer_send( sync, connParamsBad, sizeof( connParamsBad ) );
+	peer_expectComplete( "eConnectionParameterUpdateRequest, parameters", eConnectionParameterUpdateRequest, eInvalidCommandParameters );
+
+	peer_send( sync, advertise, sizeof( advertise ) );
+	peer_expectComplete( "eSetAdvertisingEnable", eSetAdvertisingEnable, eCommandSucceeded );
+	peer_expect( "eSetAdvertisingEnable, status", statusResponse, sizeof( statusResponse ) );
+
+	peer_send( sync, sendChar, sizeof( sendChar ) );
+	peer_expectComplete( "eSendCharacteristicValue", eSendCharacteristicValue, eCommandSucceeded );
+
+	peer_send( sync, updateChar, sizeof( updateChar ) );
+	peer_expectComplete( "eUpdateCharacteristicValue", eUpdateCharacteristicValue, eCommandSucceeded );
+
+	/* Deferred handler, answered from the worker task */
+	peer_send( sync, readChar, sizeof( readChar ) );
+	peer_expect( "eReadLocalCharacteristicValue", charValue, sizeof( charValue ) );
+
+	peer_send( sync, readCharBad, sizeof( readCharBad ) );
+	peer_expectComplete( "eReadLocalCharacteristicValue, handle", eReadLocalCharacteristicValue, eInvalidHandle );
+
+	/* Responses are CRC framed once a CRC frame has been received */
+	peer_send( sync, readInfo, sizeof( readInfo ) );
+	HOST_CHECK( peer_receive( &frame, LOOPBACK_TIMEOUT_MS ) );
+	HOST_CHECK( frame.sync == sync );
+}
+
+/**
+ * @brief	Unknown opcode, answered with Command Complete, eUnknownCommand
+ */
+static void test_unknown( void )
+{
+	const uint8_t unknown[] = { eUserConfirmResponse, 0x00, 0x80, 0x00 };
+	shci_Stats_t before, after;
+
+	shci_GetStats( &before );
+	peer_send( SYNC_B_CHAR, unknown, sizeof( unknown ) );
+	peer_expectComplete( "unknown opcode", eUserConfirmResponse, eUnknownCommand );
+	shci_GetStats( &after );
+	HOST_CHECK( ( before.unknownOpcodes + 1 ) == after.unknownOpcodes );
+}
+
+/**
+ * @brief	Frames with an invalid length, and a partial frame, are discarded; the frame
+ *			that follows each is answered.  A frame that completes while the SHCI task is
+ *			held up by a handler is not discarded
+ */
+static void test_resync( void )
+{
+	const uint8_t readInfo[] = { eReadLocalInformation };
+	const uint8_t writeName[] = { eWriteDeviceName, 0x00, 'D', 'W' };
+	uint8_t frame[ 2 * SHCI_MAX_FRAME_SIZE ] = { 0 };
+	uint8_t oversize[ SHCI_MAX_LENGTH + 1 ] = { eWriteDeviceName };
+	shci_Stats_t before, after;
+	size_t length;
+
+	shci_GetStats( &before );
+
+	/* Length zero, no opCode */
+	length = peer_frame( frame, SYNC_B_CHAR, readInfo, 0 );
+	length += peer_frame( &frame[ length ], SYNC_B_CHAR, readInfo, sizeof( readInfo ) );
+	peer_write( frame, length );
+	peer_expect( "length 0, then eReadLocalInformation", deviceInfoResponse, sizeof( deviceInfoResponse ) );
+
+	/* Length beyond the largest command, checksum framing allows one byte more than CRC */
+	length = peer_frame( frame, SYNC_A_CHAR, oversize, sizeof( oversize ) );
+	length += peer_frame( &frame[ length ], SYNC_B_CHAR, readInfo, sizeof( readInfo ) );
+	peer_write( frame, length );
+	peer_expect( "length too long, then eReadLocalInformation", deviceInfoResponse, sizeof( deviceInfoResponse ) );
+
+	/* Partial frame: header and opCode of a 10 byte command, then silence */
+	length = peer_frame( frame, SYNC_B_CHAR, oversize, 10 );
+	peer_write( frame, 4 );
+	usleep( LOOPBACK_LOST_MS * 1000 );
+	peer_send( SYNC_B_CHAR, readInfo, sizeof( readInfo ) );
+	peer_expect( "partial frame, then eReadLocalInformation", deviceInfoResponse, sizeof( deviceInfoResponse ) );
+
+	/* Frame completed while a slow handler runs: its bytes are in the driver, it is not abandoned */
+	_handlerStallMs = 5 * SHCI_RX_BYTE_TIMEOUT_MS;
+	length = peer_frame( frame, SYNC_B_CHAR, writeName, sizeof( writeName ) );
+	length += peer_frame( &frame[ length ], SYNC_B_CHAR, readInfo, sizeof( readInfo ) );
+	peer_write( frame, length - 2 );
+	usleep( 2 * SHCI_RX_BYTE_TIMEOUT_MS * 1000 );
+	peer_write( &frame[ length - 2 ], 2 );
+	peer_expectComplete( "slow handler", eWriteDeviceName, eCommandSucceeded );
+	peer_expect( "slow handler, then eReadLocalInformation", deviceInfoResponse, sizeof( deviceInfoResponse ) );
+	_handlerStallMs = 0;
+
+	shci_GetStats( &after );
+	HOST_CHECK( ( before.frameErrors + 3 ) == after.frameErrors );
+}
+
+/**
+ * @brief	Link statistics through eStatsGet match shci_GetStats()
+ */
+static void test_stats( void )
+{
+	const uint8_t statsGet[] = { eStatsGet, SHCI_STATS_LINK };
+	peerFrame_t frame;
+	shci_Stats_t stats;
+	uint32_t framesReceived;
+
+	peer_send( SYNC_B_CHAR, statsGet, sizeof( statsGet ) );
+	HOST_CHECK( peer_receive( &frame, LOOPBACK_TIMEOUT_MS ) );
+	shci_GetStats( &stats );
+
+	HOST_CHECK( ( eStatsGet == frame.data[ 0 ] ) && ( SHCI_STATS_LINK == frame.data[ 1 ] ) );
+	HOST_CHECK( ( 2 + ( 9 * 4 ) + 1 ) == frame.length );
+	framesReceived = ( frame.data[ 2 ] << 24 ) | ( frame.data[ 3 ] << 16 ) | ( frame.data[ 4 ] << 8 ) | frame.data[ 5 ];
+	HOST_CHECK( framesReceived == stats.framesReceived );
+	HOST_CHECK( 0 == stats.uartOverflows );
+	HOST_CHECK( 0 == stats.postDrops );
+}
+
+/* ************************************************************************* */
+/* Benchmarks                                                                */
+/* ************************************************************************* */
+
+static int compare_us( const void *a, const void *b )
+{
+	int64_t d = *( const int64_t * ) a - *( const int64_t * ) b;
+
+	return ( d > 0 ) - ( d < 0 );
+}
+
+/**
+ * @brief	Stop-and-wait round trip, eReadLocalInformation
+ */
+static void bench_latency( uint8_t sync )
+{
+	static int64_t rtt[ LOOPBACK_RTT_FRAMES ];
+	const uint8_t readInfo[] = { eReadLocalInformation };
+	peerFrame_t frame;
+	uint32_t answered = 0;
+	int64_t start;
+
+	for( uint32_t i = 0; i < LOOPBACK_RTT_FRAMES; ++i )
+	{
+		start = now_us();
+		peer_send( sync, readInfo, sizeof( readInfo ) );
+		if( peer_receive( &frame, LOOPBACK_TIMEOUT_MS ) && ( sizeof( deviceInfoResponse ) == frame.length ) )
+		{
+			rtt[ answered++ ] = now_us() - start;
+		}
+	}
+	HOST_CHECK( LOOPBACK_RTT_FRAMES == answered );
+	if( 0 == answered )
+	{
+		return;
+	}
+
+	qsort( rtt, answered, sizeof( rtt[ 0 ] ), compare_us );
+	printf( "round trip, SYNC-%c:   p50 %5lld us, p90 %5lld us, p99 %5lld us, max %6lld us\n", ( SYNC_B_CHAR == sync ) ? 'B' : 'A',
+			( long long ) rtt[ answered / 2 ], ( long long ) rtt[ ( answered * 9 ) / 10 ],
+			( long long ) rtt[ ( answered * 99 ) / 100 ], ( long long ) rtt[ answered - 1 ] );
+}
+
+/**
+ * @brief	Pipelined commands, up to LOOPBACK_PIPE_DEPTH, or LOOPBACK_PIPE_BYTES, outstanding
+ *
+ * Without flow control, Host must not send more than the UART driver can buffer.
+ *
+ * @return	frames answered
+ */
+static uint32_t bench_pipeline( uint8_t sync, const uint8_t *pCommand, uint16_t n, uint32_t frames, double *pSeconds )
+{
+	uint8_t frame[ SHCI_MAX_FRAME_SIZE ];
+	size_t length = peer_frame( frame, sync, pCommand, n );
+	peerFrame_t response;
+	uint32_t sent = 0;
+	uint32_t answered = 0;
+	uint32_t depth = LOOPBACK_PIPE_BYTES / length;
+	int64_t start = now_us();
+
+	if( depth > LOOPBACK_PIPE_DEPTH )
+	{
+		depth = LOOPBACK_PIPE_DEPTH;
+	}
+
+	while( answered < frames )
+	{
+		while( ( sent < frames ) && ( ( sent - answered ) < depth ) )
+		{
+			peer_write( frame, length );
+			sent++;
+		}
+		if( !peer_receive( &response, LOOPBACK_TIMEOUT_MS ) )
+		{
+			break;
+		}
+		answered++;
+	}
+
+	*pSeconds = ( now_us() - start ) / 1000000.0;
+	return answered;
+}
+
+static void bench_throughput( void )
+{
+	const uint8_t readInfo[] = { eReadLocalInformation };
+	uint8_t bulk[ 1 + LOOPBACK_BULK_PAYLOAD ] = { eWriteDeviceName };
+	double seconds;
+	uint32_t answered;
+
+	answered = bench_pipeline( SYNC_A_CHAR, readInfo, sizeof( readInfo ), LOOPBACK_PIPE_FRAMES, &seconds );
+	HOST_CHECK( LOOPBACK_PIPE_FRAMES == answered );
+	printf( "pipelined, SYNC-A:    %8.0f frames/s\n", answered / seconds );
+
+	answered = bench_pipeline( SYNC_B_CHAR, readInfo, sizeof( readInfo ), LOOPBACK_PIPE_FRAMES, &seconds );
+	HOST_CHECK( LOOPBACK_PIPE_FRAMES == answered );
+	printf( "pipelined, SYNC-B:    %8.0f frames/s\n", answered / seconds );
+
+	memset( &bulk[ 1 ], 0xA5, LOOPBACK_BULK_PAYLOAD );
+	answered = bench_pipeline( SYNC_B_CHAR, bulk, sizeof( bulk ), LOOPBACK_BULK_FRAMES, &seconds );
+	HOST_CHECK( LOOPBACK_BULK_FRAMES == answered );
+	printf( "bulk %u byte commands: %8.0f frames/s, %6.2f MB/s\n", LOOPBACK_BULK_PAYLOAD, answered / seconds,
+			( answered * ( sizeof( bulk ) + 5.0 ) ) / ( seconds * 1000000.0 ) );
+}
+
+/**
+ * @brief	Apply a corruption to a frame
+ *
+ * @return	corrupted frame length
+ */
+static size_t corrupt_frame( uint8_t *pFrame, size_t length, corruption_t kind )
+{
+	size_t at;
+
+	switch( kind )
+	{
+		case eCorruptPayload:
+			pFrame[ 3 + ( loopback_rand() % ( length - 5 ) ) ] ^= ( uint8_t )( 1 + ( loopback_rand() % 255 ) );
+			break;
+
+		case eCorruptCrc:
+			pFrame[ length - 1 - ( loopback_rand() % 2 ) ] ^= ( uint8_t )( 1 + ( loopback_rand() % 255 ) );
+			break;
+
+		case eCorruptSync:
+			pFrame[ 0 ] = ( uint8_t )( loopback_rand() );
+			if( ( SYNC_A_CHAR == pFrame[ 0 ] ) || ( SYNC_B_CHAR == pFrame[ 0 ] ) )
+			{
+				pFrame[ 0 ] = 0x00;
+			}
+			break;
+
+		case eCorruptLengthHigh:
+			pFrame[ 1 ] ^= ( uint8_t )( 1 << ( loopback_rand() % 8 ) );
+			break;
+
+		case eCorruptLengthLow:
+			pFrame[ 2 ] ^= ( uint8_t )( 1 << ( loopback_rand() % 8 ) );
+			break;
+
+		case eCorruptDrop:
+			at = loopback_rand() % length;
+			memmove( &pFrame[ at ], &pFrame[ at + 1 ], length - at - 1 );
+			length--;
+			break;
+
+		case eCorruptInsert:
+			at = 1 + ( loopback_rand() % ( length - 1 ) );
+			memmove( &pFrame[ at + 1 ], &pFrame[ at ], length - at );
+			pFrame[ at ] = ( uint8_t )( loopback_rand() );
+			length++;
+			break;
+
+		default:
+			break;
+	}
+	return length;
+}
+
+/**
+ * @brief	Frames lost to each kind of corruption
+ *
+ * Each trial sends a corrupted eReadLocalInformation frame, LOOPBACK_FOLLOWERS valid ones,
+ * and an eReadDeviceName marker, in one write.  Followers answered before the marker are
+ * counted.  If the marker is not answered, the parser is stalled waiting on a corrupted
+ * length: Host sends a frame's worth of zero bytes to recover, as it would after a timeout.
+ *
+ * @return	followers lost, over all trials
+ */
+static uint32_t bench_corruption( corruption_t kind, uint32_t *pStalls )
+{
+	const uint8_t readInfo[] = { eReadLocalInformation, 0x5A, 0xC3, 0x0F };
+	const uint8_t readName[] = { eReadDeviceName };
+	uint8_t burst[ ( LOOPBACK_FOLLOWERS + 2 ) * SHCI_MAX_FRAME_SIZE ];
+	uint8_t padding[ SHCI_MAX_FRAME_SIZE ] = { 0 };
+	peerFrame_t frame;
+	uint32_t lost = 0;
+	uint32_t answered;
+	size_t length;
+	bool marker;
+
+	*pStalls = 0;
+	for( uint32_t trial = 0; trial < LOOPBACK_TRIALS; ++trial )
+	{
+		length = corrupt_frame( burst, peer_frame( burst, SYNC_B_CHAR, readInfo, sizeof( readInfo ) ), kind );
+		for( uint32_t i = 0; i < LOOPBACK_FOLLOWERS; ++i )
+		{
+			length += peer_frame( &burst[ length ], SYNC_B_CHAR, readInfo, 1 );
+		}
+		length += peer_frame( &burst[ length ], SYNC_B_CHAR, readName, sizeof( readName ) );
+		peer_write( burst, length );
+
+		answered = 0;
+		marker = false;
+		while( !marker && peer_receive( &frame, LOOPBACK_LOST_MS ) )
+		{
+			if( ( sizeof( deviceInfoResponse ) == frame.length ) && ( 0 == memcmp( frame.data, deviceInfoResponse, frame.length ) ) )
+			{
+				answered++;
+			}
+			marker = ( sizeof( deviceNameResponse ) == frame.length ) && ( 0 == memcmp( frame.data, deviceNameResponse, frame.length ) );
+		}
+
+		lost += ( answered < LOOPBACK_FOLLOWERS ) ? ( LOOPBACK_FOLLOWERS - answered ) : 0;
+		if( !marker )
+		{
+			( *pStalls )++;
+			peer_write( padding, sizeof( padding ) );
+			peer_drain( LOOPBACK_LOST_MS );
+		}
+	}
+	return lost;
+}
+
+static void bench_corruptions( void )
+{
+	shci_Stats_t before, after;
+	uint32_t lost;
+	uint32_t stalls;
+
+	shci_GetStats( &before );
+	for( corruption_t kind = 0; kind < eCorruptEnd; ++kind )
+	{
+		lost = bench_corruption( kind, &stalls );
+		printf( "corrupted %-13s: %3u of %u following frames lost, %2u of %u trials stalled\n", _corruptionNames[ kind ],
+				lost, LOOPBACK_TRIALS * LOOPBACK_FOLLOWERS, stalls, LOOPBACK_TRIALS );
+
+		/* Parser rescans after an error, and abandons a partial frame: only the corrupted frame is lost */
+		HOST_CHECK( 0 == lost );
+		HOST_CHECK( 0 == stalls );
+	}
+	shci_GetStats( &after );
+	HOST_CHECK( ( after.frameErrors - before.frameErrors ) >= ( 2 * LOOPBACK_TRIALS ) );
+	printf( "frame errors %u, Host response errors %u\n", after.frameErrors - before.frameErrors, _peerErrors );
+}
+
+/* ************************************************************************* */
+/* Baud rate negotiation                                                     */
+/* ************************************************************************* */
+
+static uint32_t esp_baud( void )
+{
+	uint32_t baud = 0;
+
+	uart_get_baudrate( LOOPBACK_UART, &baud );
+	return baud;
+}
+
+static void peer_propose( uint32_t baud )
+{
+	const uint8_t propose[] = { eBaudRateSet, SHCI_BAUD_PROPOSE, ( uint8_t )( baud >> 24 ), ( uint8_t )( baud >> 16 ), ( uint8_t )( baud >> 8 ), ( uint8_t ) baud };
+
+	peer_send( SYNC_B_CHAR, propose, sizeof( propose ) );
+	peer_expectComplete( "eBaudRateSet, propose", eBaudRateSet, eCommandSucceeded );
+}
+
+static void test_baud( void )
+{
+	const uint8_t verify[] = { eBaudRateSet, SHCI_BAUD_VERIFY, 0x55, 0xAA, 0x0F };
+	const uint8_t confirm[] = { eBaudRateSet, SHCI_BAUD_CONFIRM };
+	const uint8_t propose[] = { eBaudRateSet, SHCI_BAUD_PROPOSE, 0x00, 0x00, 0x96, 0x00 };
+	const uint8_t readInfo[] = { eReadLocalInformation };
+	int tries;
+
+	/* Unsupported rate, and checksum framing, are refused */
+	peer_send( SYNC_B_CHAR, propose, sizeof( propose ) );
+	peer_expectComplete( "eBaudRateSet, 38400", eBaudRateSet, eUnsupportedFeatureOrParameterValue );
+	peer_send( SYNC_A_CHAR, verify, sizeof( verify ) );
+	peer_expectComplete( "eBaudRateSet, SYNC-A", eBaudRateSet, eCommandDisallowed );
+
+	/* Confirm without a negotiation is refused */
+	peer_send( SYNC_B_CHAR, confirm, sizeof( confirm ) );
+	peer_expectComplete( "eBaudRateSet, confirm", eBaudRateSet, eCommandDisallowed );
+
+	/* Switch to 921600, Host follows, verifies and confirms */
+	peer_propose( 921600 );
+	usleep( LOOPBACK_GUARD_MS * 1000 );
+	hostUart_setPeerBaud( LOOPBACK_UART, 921600 );
+	HOST_CHECK( 921600 == esp_baud() );
+	peer_send( SYNC_B_CHAR, verify, sizeof( verify ) );
+	peer_expect( "eBaudRateSet, verify", verify, sizeof( verify ) );
+	peer_send( SYNC_B_CHAR, confirm, sizeof( confirm ) );
+	peer_expectComplete( "eBaudRateSet, confirm", eBaudRateSet, eCommandSucceeded );
+	peer_send( SYNC_B_CHAR, readInfo, sizeof( readInfo ) );
+	peer_expect( "eReadLocalInformation, 921600", deviceInfoResponse, sizeof( deviceInfoResponse ) );
+	HOST_CHECK( 921600 == esp_baud() );
+
+	/* Switch to 460800, Host does not receive the echo of Verify and does not confirm:
+	 * ESP falls back on timeout, rather than staying at a rate Host has abandoned */
+	peer_propose( 460800 );
+	usleep( LOOPBACK_GUARD_MS * 1000 );
+	hostUart_setPeerBaud( LOOPBACK_UART, 460800 );
+	peer_send( SYNC_B_CHAR, verify, sizeof( verify ) );
+	peer_drain( LOOPBACK_GUARD_MS );
+	hostUart_setPeerBaud( LOOPBACK_UART, SHCI_BAUD_DEFAULT );
+	HOST_CHECK( 460800 == esp_baud() );
+	for( tries = 0; ( tries < 100 ) && ( SHCI_BAUD_DEFAULT != esp_baud() ); ++tries )
+	{
+		usleep( 10 * 1000 );
+	}
+	HOST_CHECK( SHCI_BAUD_DEFAULT == esp_baud() );
+	peer_send( SYNC_B_CHAR, readInfo, sizeof( readInfo ) );
+	peer_expect( "eReadLocalInformation, echo lost", deviceInfoResponse, sizeof( deviceInfoResponse ) );
+
+	/* Switch to 460800, Host does not follow: ESP falls back to the default rate on timeout */
+	peer_propose( 460800 );
+	hostUart_setPeerBaud( LOOPBACK_UART, SHCI_BAUD_DEFAULT );
+	usleep( LOOPBACK_GUARD_MS * 1000 );
+	for( tries = 0; ( tries < 100 ) && ( SHCI_BAUD_DEFAULT != esp_baud() ); ++tries )
+	{
+		usleep( 10 * 1000 );
+	}
+	HOST_CHECK( SHCI_BAUD_DEFAULT == esp_baud() );
+	peer_send( SYNC_B_CHAR, readInfo, sizeof( readInfo ) );
+	peer_expect( "eReadLocalInformation, fallback", deviceInfoResponse, sizeof( deviceInfoResponse ) );
+
+	/* Switch to 460800, Host sends at the old rate: framing error, immediate fallback */
+	peer_propose( 460800 );
+	usleep( LOOPBACK_GUARD_MS * 1000 );
+	peer_send( SYNC_B_CHAR, verify, sizeof( verify ) );
+	usleep( LOOPBACK_GUARD_MS * 1000 );
+	HOST_CHECK( SHCI_BAUD_DEFAULT == esp_baud() );
+	peer_drain( LOOPBACK_LOST_MS );
+	peer_send( SYNC_B_CHAR, readInfo, sizeof( readInfo ) );
+	peer_expect( "eReadLocalInformation, framing error", deviceInfoResponse, sizeof( deviceInfoResponse ) );
+}
+
+/* ************************************************************************* */
+/* Windowed transfer                                                         */
+/* ************************************************************************* */
+
+static shciWindow_handle_t _window;
+static int32_t _windowResult;
+
+static void * window_sender( void *arg )
+{
+	uint8_t payload[ 4 ];
+
+	_windowResult = ESP_OK;
+	for( uint8_t i = 0; ( i < LOOPBACK_WINDOW_FRAMES ) && ( ESP_OK == _windowResult ); ++i )
+	{
+		memset( payload, i, sizeof( payload ) );
+		_windowResult = shciWindow_send( _window, payload, sizeof( payload ), 2000 );
+	}
+	if( ESP_OK == _windowResult )
+	{
+		_windowResult = shciWindow_flush( _window, 2000 );
+	}
+	return NULL;
+}
+
+static void peer_ack( uint8_t seq, uint8_t status )
+{
+	const uint8_t ack[] = { eWindowAck, 0, seq, status };
+
+	peer_send( SYNC_B_CHAR, ack, sizeof( ack ) );
+}
+
+/**
+ * @brief	Eight frames through a window of four: frame 1 negatively acknowledged, the
+ *			acknowledgment of frame 5 lost, all frames must arrive and the flush succeed
+ */
+static void test_window( void )
+{
+	pthread_t sender;
+	peerFrame_t frame;
+	uint32_t received[ LOOPBACK_WINDOW_FRAMES ] = { 0 };
+	bool nakSent = false;
+	bool ackLost = false;
+	uint8_t seq;
+
+	_window = shciWindow_create( 0, 4, 16, 20, 5 );
+	HOST_CHECK( NULL != _window );
+	if( NULL == _window )
+	{
+		return;
+	}
+
+	pthread_create( &sender, NULL, window_sender, NULL );
+
+	while( peer_receive( &frame, 200 ) )
+	{
+		if( ( eWindowData != frame.data[ 0 ] ) || ( 0 != frame.data[ 1 ] ) || ( frame.data[ 2 ] >= LOOPBACK_WINDOW_FRAMES ) )
+		{
+			continue;
+		}
+		seq = frame.data[ 2 ];
+		HOST_CHECK( ( 7 == frame.length ) && ( seq == frame.data[ 3 ] ) );
+		received[ seq ]++;
+
+		if( ( 1 == seq ) && !nakSent )
+		{
+			nakSent = true;
+			peer_ack( seq, SHCI_WINDOW_NAK );
+		}
+		else if( ( 5 == seq ) && !ackLost )
+		{
+			ackLost = true;
+		}
+		else
+		{
+			peer_ack( seq, SHCI_WINDOW_ACK );
+		}
+	}
+
+	pthread_join( sender, NULL );
+	HOST_CHECK( ESP_OK == _windowResult );
+	HOST_CHECK( 0 == shciWindow_outstanding( _window ) );
+	for( seq = 0; seq < LOOPBACK_WINDOW_FRAMES; ++seq )
+	{
+		/* Any frame may also time out, if the host is slow to schedule this thread */
+		HOST_CHECK( received[ seq ] >= ( ( ( 1 == seq ) || ( 5 == seq ) ) ? 2 : 1 ) );
+	}
+	shciWindow_delete( _window );
+}
+
+static volatile bool _windowCycling;
+
+static void * window_cycler( void *arg )
+{
+	shciWindow_handle_t window;
+	uint32_t *pCreated = arg;
+
+	while( _windowCycling )
+	{
+		window = shciWindow_create( 1, 4, 16, 20, 5 );
+		if( NULL != window )
+		{
+			( *pCreated )++;
+			sched_yield();
+			shciWindow_delete( window );
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief	Windows created and deleted while Host acknowledges on their channel: each
+ *			acknowledgment finds a window or none, never one being deleted
+ */
+static void test_windowDelete( void )
+{
+	const uint8_t ack[] = { eWindowAck, 1, 0, SHCI_WINDOW_ACK };
+	pthread_t cycler;
+	uint32_t created = 0;
+	uint32_t i;
+
+	_windowCycling = true;
+	pthread_create( &cycler, NULL, window_cycler, &created );
+	for( i = 0; i < LOOPBACK_WINDOW_ACKS; ++i )
+	{
+		peer_send( SYNC_B_CHAR, ack, sizeof( ack ) );
+		peer_drain( 1 );
+	}
+	_windowCycling = false;
+	pthread_join( cycler, NULL );
+	peer_drain( LOOPBACK_GUARD_MS );
+
+	HOST_CHECK( 0 != created );
+	printf( "window create/delete %u, acknowledgments %u\n", created, LOOPBACK_WINDOW_ACKS );
+}
+
+/* ************************************************************************* */
+/* Fragmented messages                                                       */
+/* ************************************************************************* */
+
+/**
+ * @brief	Send one fragment of a command message
+ */
+static void peer_sendFragment( uint8_t id, uint8_t flags, uint16_t offset, const uint8_t *pData, uint16_t n )
+{
+	uint8_t fragment[ SHCI_MAX_LENGTH ] = { eFragmentCommand, id, flags, ( uint8_t )( offset >> 8 ), ( uint8_t ) offset };
+
+	memcpy( &fragment[ SHCI_FRAGMENT_HEADER ], pData, n );
+	peer_send( SYNC_B_CHAR, fragment, SHCI_FRAGMENT_HEADER + n );
+}
+
+/**
+ * @brief	Send a command message as fragments
+ *
+ * Without flow control, Host must not send more than the UART driver can buffer: as a
+ * UART running at line rate would, no more than LOOPBACK_PIPE_BYTES are left unread by SHCI.
+ */
+static void peer_sendMessage( uint8_t id, const uint8_t *pMessage, size_t n )
+{
+	shci_Stats_t stats;
+	uint32_t base;
+	uint32_t written = 0;
+	size_t offset;
+	size_t chunk;
+	int64_t deadline = now_us() + ( LOOPBACK_TIMEOUT_MS * 1000 );
+
+	shci_GetStats( &stats );
+	base = stats.bytesIn;
+
+	for( offset = 0; offset < n; offset += chunk )
+	{
+		chunk = ( ( n - offset ) > LOOPBACK_FRAGMENT_PAYLOAD ) ? LOOPBACK_FRAGMENT_PAYLOAD : ( n - offset );
+		while( ( ( written + SHCI_MAX_FRAME_SIZE ) - ( stats.bytesIn - base ) ) > LOOPBACK_PIPE_BYTES )
+		{
+			if( now_us() > deadline )
+			{
+				break;
+			}
+			usleep( 20 );
+			shci_GetStats( &stats );
+		}
+		peer_sendFragment( id, ( ( offset + chunk ) == n ) ? SHCI_FRAGMENT_FINAL : 0, offset, &pMessage[ offset ], chunk );
+		written += chunk + SHCI_FRAGMENT_HEADER + SHCI_FRAME_OVERHEAD;
+	}
+}
+
+/**
+ * @brief	Receive one response message, reassembling fragments
+ *
+ * @return	message length, 0 if not received or fragments are inconsistent
+ */
+static size_t peer_receiveMessage( uint8_t *pMessage, size_t size )
+{
+	peerFrame_t frame;
+	size_t length = 0;
+	size_t n;
+	uint16_t offset;
+	int id = -1;
+
+	while( peer_receive( &frame, LOOPBACK_TIMEOUT_MS ) )
+	{
+		if( eFragmentEvent != frame.data[ 0 ] )
+		{
+			memcpy( pMessage, frame.data, frame.length );
+			return frame.length;
+		}
+
+		offset = ( frame.data[ 3 ] << 8 ) | frame.data[ 4 ];
+		n = frame.length - SHCI_FRAGMENT_HEADER;
+		if( ( frame.length < SHCI_FRAGMENT_HEADER ) || ( offset != length ) || ( ( length + n ) > size ) ||
+			( ( -1 != id ) && ( id != frame.data[ 1 ] ) ) )
+		{
+			printf( "fragment %d, offset %u: out of sequence\n", frame.data[ 1 ], offset );
+			return 0;
+		}
+
+		id = frame.data[ 1 ];
+		memcpy( &pMessage[ length ], &frame.data[ SHCI_FRAGMENT_HEADER ], n );
+		length += n;
+		if( 0 != ( frame.data[ 2 ] & SHCI_FRAGMENT_FINAL ) )
+		{
+			return length;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief	Save a block, and restore it
+ *
+ * @return	true if the block restored matches
+ */
+static bool fragment_roundTrip( uint8_t id, const uint8_t *pBlock, size_t n )
+{
+	static uint8_t message[ SHCI_FRAGMENT_MAX_MESSAGE ];
+	const uint8_t restore[] = { eEEBlockRestore };
+	size_t length;
+
+	message[ 0 ] = eEEBlockSave;
+	memcpy( &message[ 1 ], pBlock, n );
+	peer_sendMessage( id, message, 1 + n );
+	if( !peer_expectComplete( "eEEBlockSave, fragmented", eEEBlockSave, eCommandSucceeded ) )
+	{
+		return false;
+	}
+
+	peer_send( SYNC_B_CHAR, restore, sizeof( restore ) );
+	length = peer_receiveMessage( message, sizeof( message ) );
+	return ( ( 1 + n ) == length ) && ( eEEBlockRestore == message[ 0 ] ) && ( 0 == memcmp( &message[ 1 ], pBlock, n ) );
+}
+
+/**
+ * @brief	Blocks of several kilobytes, saved and restored as fragmented messages, and
+ *			fragments out of sequence, too large, or of an unknown opcode
+ */
+static void test_fragment( void )
+{
+	static uint8_t block[ SHCI_FRAGMENT_MAX_MESSAGE + 1 ];
+	const uint8_t unknown[] = { eUserConfirmResponse, 0x00 };
+	uint32_t sum = 0;
+	size_t i;
+
+	for( i = 0; i < sizeof( block ); ++i )
+	{
+		block[ i ] = ( uint8_t ) loopback_rand();
+	}
+	for( i = 0; i < LOOPBACK_EE_BLOCK; ++i )
+	{
+		sum += block[ i ];
+	}
+
+	HOST_CHECK( fragment_roundTrip( 1, block, LOOPBACK_EE_BLOCK ) );
+	for( i = 0; ( i < 100 ) && ( LOOPBACK_EE_BLOCK != _eeAuditBytes ); ++i )
+	{
+		usleep( 1000 );
+	}
+	HOST_CHECK( ( LOOPBACK_EE_BLOCK == _eeAuditBytes ) && ( sum == _eeAuditSum ) );
+
+	/* Largest message, and a block that fits one frame each way */
+	HOST_CHECK( fragment_roundTrip( 2, block, SHCI_FRAGMENT_MAX_MESSAGE - 1 ) );
+	HOST_CHECK( fragment_roundTrip( 3, block, 100 ) );
+
+	/* Fragment skipped: message discarded, the following message is received */
+	peer_sendFragment( 4, 0, 0, unknown, 1 );
+	peer_sendFragment( 4, SHCI_FRAGMENT_FINAL, 2, &unknown[ 1 ], 1 );
+	peer_expectComplete( "fragment out of sequence", eFragmentCommand, eInvalidCommandParameters );
+	peer_sendFragment( 5, SHCI_FRAGMENT_FINAL, 10, unknown, 1 );
+	peer_expectComplete( "fragment of no message", eFragmentCommand, eInvalidCommandParameters );
+	HOST_CHECK( fragment_roundTrip( 4, block, 1000 ) );
+
+	/* Two messages interleaved */
+	peer_sendFragment( 6, 0, 0, unknown, 1 );
+	peer_sendFragment( 7, 0, 0, unknown, 1 );
+	peer_sendFragment( 6, SHCI_FRAGMENT_FINAL, 1, &unknown[ 1 ], 1 );
+	peer_expectComplete( "fragmented unknown opcode", eUserConfirmResponse, eUnknownCommand );
+	peer_sendFragment( 7, SHCI_FRAGMENT_FINAL, 1, &unknown[ 1 ], 1 );
+	peer_expectComplete( "fragmented unknown opcode, interleaved", eUserConfirmResponse, eUnknownCommand );
+
+	/* One byte beyond the largest message */
+	block[ 0 ] = eEEBlockSave;
+	peer_sendMessage( 8, block, SHCI_FRAGMENT_MAX_MESSAGE + 1 );
+	peer_expectComplete( "fragmented message too large", eFragmentCommand, eMemoryCapacityExceeded );
+	peer_drain( LOOPBACK_LOST_MS );
+}
+
+/**
+ * @brief	EE block save and restore throughput, fragmented in both directions
+ */
+static void bench_fragment( void )
+{
+	static uint8_t block[ LOOPBACK_EE_BLOCK ];
+	uint32_t transfers;
+	int64_t start = now_us();
+	double seconds;
+
+	memset( block, 0x5A, sizeof( block ) );
+	for( transfers = 0; ( transfers < LOOPBACK_EE_TRANSFERS ) && fragment_roundTrip( ( uint8_t ) transfers, block, sizeof( block ) ); ++transfers )
+	{
+	}
+	seconds = ( now_us() - start ) / 1000000.0;
+
+	HOST_CHECK( LOOPBACK_EE_TRANSFERS == transfers );
+	printf( "EE block %u bytes, saved and restored: %6.0f round trips/s, %6.2f MB/s each way\n", LOOPBACK_EE_BLOCK,
+			transfers / seconds, ( transfers * ( double ) LOOPBACK_EE_BLOCK ) / ( seconds * 1000000.0 ) );
+}
+
+int main( void )
+{
+	setenv( "HOST_LOG_LEVEL", "0", 0 );					/* Corruption trials log an error per frame */
+	_fd = hostUart_open( LOOPBACK_UART );
+	HOST_CHECK( 0 <= _fd );
+
+	esp_init();
+	HOST_CHECK( 0 == shci_init( LOOPBACK_UART ) );
+	loopback_connect();
+
+	test_commands( SYNC_A_CHAR );
+	test_commands( SYNC_B_CHAR );
+	test_unknown();
+	test_resync();
+	test_stats();
+
+	bench_latency( SYNC_B_CHAR );
+	bench_throughput();
+	bench_corruptions();
+	peer_drain( LOOPBACK_LOST_MS );
+
+	test_baud();
+	test_window();
+	test_windowDelete();
+	test_fragment();
+	bench_fragment();
+	test_stats();
+
+	shci_LogStats();
+
+	return HOST_TEST_RESULT( "shci_loopback" );
+}
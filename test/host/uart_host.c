@@ -0,0 +1,281 @@
+/**
+ * @file	uart_host.c
+ *
+ * Host build: ESP-IDF UART driver over a socket pair.
+ *
+ * The test program holds the Host end of the pair, returned by hostUart_open().  A reader
+ * thread per port moves bytes from the driver end into the receive buffer, and posts a
+ * UART_DATA event for each block, as the driver's interrupt handler does on target.
+ * Writes go straight to the socket; the socket buffer stands in for the transmit ring.
+ */
+
+#include	<string.h>
+#include	<pthread.h>
+#include	<unistd.h>
+#include	<sys/socket.h>
+#include	"driver/uart.h"
+
+#define	UART_READ_BLOCK			( 120 )						/**< Bytes per UART_DATA event, the target's RX FIFO full threshold */
+#define	UART_CORRUPT_MASK		( 0x5A )					/**< Applied to each byte while baud rates differ */
+
+/**
+ * @brief	Port state
+ */
+typedef struct
+{
+	int					fd;									/**< Driver end of socket pair */
+	int					peerFd;								/**< Host end, -1 if port not open */
+	volatile uint32_t	baud;
+	volatile uint32_t	peerBaud;
+	QueueHandle_t		eventQueue;
+	pthread_t			reader;
+	pthread_mutex_t		lock;								/**< Protects receive buffer */
+	uint8_t				*pRx;
+	size_t				rxSize;
+	size_t				rxHead;								/**< Free running, bytes written by reader thread */
+	size_t				rxTail;								/**< Free running, bytes read by uart_read_bytes() */
+} hostUart_t;
+
+static hostUart_t _uarts[ UART_NUM_MAX ] =
+{
+	{ .fd = -1, .peerFd = -1 }, { .fd = -1, .peerFd = -1 }, { .fd = -1, .peerFd = -1 }
+};
+
+static hostUart_t * uart_get( uart_port_t uart_num )
+{
+	return ( ( 0 <= uart_num ) && ( UART_NUM_MAX > uart_num ) && ( 0 <= _uarts[ uart_num ].fd ) ) ? &_uarts[ uart_num ] : NULL;
+}
+
+static bool uart_mismatched( const hostUart_t *pUart )
+{
+	return pUart->baud != pUart->peerBaud;
+}
+
+static void uart_corrupt( uint8_t *pData, size_t n )
+{
+	for( size_t i = 0; i < n; ++i )
+	{
+		pData[ i ] ^= UART_CORRUPT_MASK;
+	}
+}
+
+/**
+ * @brief	Reader thread, receives from Host end until it is closed
+ */
+static void * uart_reader( void *arg )
+{
+	hostUart_t *pUart = arg;
+	uint8_t block[ UART_READ_BLOCK ];
+	uart_event_t event;
+	ssize_t n;
+	size_t space;
+
+	while( 0 < ( n = read( pUart->fd, block, sizeof( block ) ) ) )
+	{
+		memset( &event, 0, sizeof( event ) );
+		event.type = UART_DATA;
+		event.size = n;
+
+		if( uart_mismatched( pUart ) )
+		{
+			uart_corrupt( block, n );
+			event.type = UART_FRAME_ERR;
+		}
+
+		pthread_mutex_lock( &pUart->lock );
+		space = pUart->rxSize - ( pUart->rxHead - pUart->rxTail );
+		if( ( size_t ) n > space )
+		{
+			event.type = UART_BUFFER_FULL;						/* Excess is lost */
+			n = space;
+		}
+		for( ssize_t i = 0; i < n; ++i )
+		{
+			pUart->pRx[ pUart->rxHead++ % pUart->rxSize ] = block[ i ];
+		}
+		pthread_mutex_unlock( &pUart->lock );
+
+		xQueueSend( pUart->eventQueue, &event, 0 );				/* Dropped if queue full, as on target */
+	}
+
+	return NULL;
+}
+
+int hostUart_open( uart_port_t uart_num )
+{
+	hostUart_t *pUart;
+	int fds[ 2 ];
+
+	if( ( 0 > uart_num ) || ( UART_NUM_MAX <= uart_num ) || ( 0 <= _uarts[ uart_num ].fd ) ||
+		( 0 != socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) ) )
+	{
+		return -1;
+	}
+
+	pUart = &_uarts[ uart_num ];
+	pUart->fd = fds[ 0 ];
+	pUart->peerFd = fds[ 1 ];
+	pUart->baud = 115200;
+	pUart->peerBaud = 115200;
+	pthread_mutex_init( &pUart->lock, NULL );
+
+	return pUart->peerFd;
+}
+
+void hostUart_setPeerBaud( uart_port_t uart_num, uint32_t baudrate )
+{
+	hostUart_t *pUart = uart_get( uart_num );
+
+	if( NULL != pUart )
+	{
+		pUart->peerBaud = baudrate;
+	}
+}
+
+esp_err_t uart_param_config( uart_port_t uart_num, const uart_config_t *uart_config )
+{
+	return uart_set_baudrate( uart_num, uart_config->baud_rate );
+}
+
+esp_err_t uart_set_pin( uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num )
+{
+	return ( NULL == uart_get( uart_num ) ) ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+esp_err_t uart_driver_install( uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *uart_queue, int intr_alloc_flags )
+{
+	hostUart_t *pUart = uart_get( uart_num );
+
+	if( ( NULL == pUart ) || ( NULL != pUart->pRx ) || ( 0 >= rx_buffer_size ) )
+	{
+		return ESP_FAIL;
+	}
+
+	pUart->pRx = malloc( rx_buffer_size );
+	pUart->rxSize = rx_buffer_size;
+	pUart->eventQueue = xQueueCreate( queue_size, sizeof( uart_event_t ) );
+	if( ( NULL == pUart->pRx ) || ( NULL == pUart->eventQueue ) ||
+		( 0 != pthread_create( &pUart->reader, NULL, uart_reader, pUart ) ) )
+	{
+		return ESP_ERR_NO_MEM;
+	}
+
+	if( NULL != uart_queue )
+	{
+		*uart_queue = pUart->eventQueue;
+	}
+	return ESP_OK;
+}
+
+int uart_read_bytes( uart_port_t uart_num, void *buf, uint32_t length, TickType_t ticks_to_wait )
+{
+	hostUart_t *pUart = uart_get( uart_num );
+	uint8_t *pDst = buf;
+	uint32_t n = 0;
+
+	if( NULL == pUart )
+	{
+		return -1;
+	}
+
+	pthread_mutex_lock( &pUart->lock );
+	while( ( n < length ) && ( pUart->rxTail != pUart->rxHead ) )
+	{
+		pDst[ n++ ] = pUart->pRx[ pUart->rxTail++ % pUart->rxSize ];
+	}
+	pthread_mutex_unlock( &pUart->lock );
+
+	return n;
+}
+
+int uart_write_bytes( uart_port_t uart_num, const void *src, size_t size )
+{
+	hostUart_t *pUart = uart_get( uart_num );
+	const uint8_t *pSrc = src;
+	uint8_t *pCorrupt = NULL;
+	size_t sent = 0;
+	ssize_t n;
+
+	if( NULL == pUart )
+	{
+		return -1;
+	}
+
+	if( uart_mismatched( pUart ) && ( NULL != ( pCorrupt = malloc( size ) ) ) )
+	{
+		memcpy( pCorrupt, src, size );
+		uart_corrupt( pCorrupt, size );
+		pSrc = pCorrupt;
+	}
+
+	while( ( sent < size ) && ( 0 < ( n = write( pUart->fd, &pSrc[ sent ], size - sent ) ) ) )
+	{
+		sent += n;
+	}
+
+	free( pCorrupt );
+	return sent;
+}
+
+esp_err_t uart_get_buffered_data_len( uart_port_t uart_num, size_t *size )
+{
+	hostUart_t *pUart = uart_get( uart_num );
+
+	if( NULL == pUart )
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	pthread_mutex_lock( &pUart->lock );
+	*size = pUart->rxHead - pUart->rxTail;
+	pthread_mutex_unlock( &pUart->lock );
+
+	return ESP_OK;
+}
+
+esp_err_t uart_flush_input( uart_port_t uart_num )
+{
+	hostUart_t *pUart = uart_get( uart_num );
+
+	if( NULL == pUart )
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	pthread_mutex_lock( &pUart->lock );
+	pUart->rxTail = pUart->rxHead;
+	pthread_mutex_unlock( &pUart->lock );
+
+	return ESP_OK;
+}
+
+esp_err_t uart_set_baudrate( uart_port_t uart_num, uint32_t baudrate )
+{
+	hostUart_t *pUart = uart_get( uart_num );
+
+	if( NULL == pUart )
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	pUart->baud = baudrate;
+	return ESP_OK;
+}
+
+esp_err_t uart_get_baudrate( uart_port_t uart_num, uint32_t *baudrate )
+{
+	hostUart_t *pUart = uart_get( uart_num );
+
+	if( NULL == pUart )
+	{
+		return ESP_ERR_INVALID_ARG;
+	}
+
+	*baudrate = pUart->baud;
+	return ESP_OK;
+}
+
+esp_err_t uart_wait_tx_done( uart_port_t uart_num, TickType_t ticks_to_wait )
+{
+	return ( NULL == uart_get( uart_num ) ) ? ESP_ERR_INVALID_ARG : ESP_OK;
+}